@@ -0,0 +1,591 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Writes a program for each workload, runs the interpreter on it a number of
+// times and prints the median and 95th percentile time, throughput and peak RSS
+// of each workload as JSON. Given a baseline printed by an earlier run, fails
+// when a workload's median time grew by more than the threshold.
+//
+//     make bench
+//     bin/bench [--interp=PATH] [--runs=N] [--baseline=FILE] [--threshold=PERCENT]
+//               [--save=FILE] [--counters] [workload...] [-- interpreter options...]
+//
+// The programs are the same on every run, so times can be compared across
+// builds of the interpreter. --counters also runs them with --perf-counters and
+// adds the median of each hardware counter in the lex, parse and evaluate
+// phases.
+
+#define DEFAULT_RUNS        5
+#define DEFAULT_THRESHOLD   10.0
+#define MAX_RUNS            1000
+// the environment's bucket count, see createEnvironment
+#define ENVIRONMENT_BUCKETS 1087
+#define COUNTED_PHASES      3
+#define COUNTER_COUNT       5
+
+// PROGRAMS
+
+static uint64_t randomState = 0x9e3779b97f4a7c15ULL;
+
+// xorshift64, seeded the same on every run
+static uint64_t nextRandom(void) {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 7;
+    randomState ^= randomState << 17;
+    return randomState;
+}
+
+static unsigned randomBelow(unsigned limit) {
+    return (unsigned) (nextRandom() % limit);
+}
+
+// each writes its program to out and gives the units of work it does
+
+// one statement evaluating an expression nested 256 deep, many times over
+static double deepExpressions(FILE* out) {
+    const size_t depth = 256;
+    const size_t iterations = 16000;
+    static const char* const operators[] = { "+", "-", "*" };
+
+    fprintf(out, "number x = 0;\nnumber i = 0;\nloop %zu {\n    x = ", iterations);
+    for (size_t d = 0; d < depth; d++) {
+        size_t op = d % 3;
+        fprintf(out, "(%s %s ", op == 2 ? "1" : d % 2 ? "i" : "x", operators[op]);
+    }
+    fputs("1", out);
+    for (size_t d = 0; d < depth; d++) {
+        fputc(')', out);
+    }
+    fputs(";\n    i = i + 1;\n}\nx;\n", out);
+    return (double) (depth * iterations);
+}
+
+static double arithmeticLoop(FILE* out) {
+    const size_t iterations = 800000;
+    fprintf(out,
+        "number total = 0;\n"
+        "number i = 0;\n"
+        "loop %zu {\n"
+        "    total = total + i * 3 - i / 2;\n"
+        "    if (total > 1000000) {\n"
+        "        total = total - 1000000;\n"
+        "    }\n"
+        "    i = i + 1;\n"
+        "}\n"
+        "total;\n", iterations);
+    return (double) iterations;
+}
+
+// calls at the top level and into a fn declared inside another
+static double callHeavy(FILE* out) {
+    const size_t iterations = 40000;
+    fprintf(out,
+        "fn add(number a, number b) {\n"
+        "    number c = a + b;\n"
+        "}\n"
+        "fn step(number a) {\n"
+        "    fn scale(number b) {\n"
+        "        number c = b * 2;\n"
+        "    }\n"
+        "    scale(a);\n"
+        "    scale(a + 1);\n"
+        "}\n"
+        "number i = 0;\n"
+        "loop %zu {\n"
+        "    add(i, 1);\n"
+        "    step(i);\n"
+        "    i = i + 1;\n"
+        "}\n"
+        "i;\n", iterations);
+    return (double) (iterations * 4);
+}
+
+static unsigned long bucketOf(const char* name) {
+    unsigned long h = 5381;
+    for (; *name; name++) {
+        h = ((h << 5) + h) + (unsigned char) *name;
+    }
+    return h % ENVIRONMENT_BUCKETS;
+}
+
+// thousands of globals, the ones the loop uses all in the same bucket
+static double manyVariables(FILE* out) {
+    const size_t fillers = 4000;
+    const size_t colliding = 48;
+    const size_t iterations = 12000;
+
+    for (size_t i = 0; i < fillers; i++) {
+        fprintf(out, "number f%zu = %zu;\n", i, i);
+    }
+    char names[48][32];
+    size_t found = 0;
+    for (size_t candidate = 0; found < colliding; candidate++) {
+        snprintf(names[found], sizeof(names[found]), "c%zu", candidate);
+        if (bucketOf(names[found]) == 0) found++;
+    }
+    for (size_t i = 0; i < colliding; i++) {
+        fprintf(out, "number %s = %zu;\n", names[i], i);
+    }
+    fprintf(out, "loop %zu {\n", iterations);
+    for (size_t i = 0; i < colliding; i++) {
+        fprintf(out, "    %s = %s + f%u;\n", names[i], names[(i + 1) % colliding], randomBelow((unsigned) fillers));
+    }
+    fprintf(out, "}\n%s;\n", names[0]);
+    return (double) (iterations * colliding * 3);
+}
+
+// a large source where almost nothing runs: a fn that is never called
+static double hugeSource(FILE* out) {
+    const size_t statements = 60000;
+    static const char* const words[] = { "alpha", "beta", "gamma", "delta", "epsilon", "zeta" };
+
+    fputs("fn neverCalled() {\n", out);
+    for (size_t i = 0; i < statements; i++) {
+        const char* word = words[randomBelow(6)];
+        switch (i % 5) {
+            case 0:
+                fprintf(out, "    number %s%zu = %u.%u * (%zu + %u) / 7;\n", word, i,
+                    randomBelow(1000), randomBelow(100), i, randomBelow(50));
+                break;
+            case 1:
+                fprintf(out, "    text %s%zu = \"%s number %zu of the source\";\n", word, i, word, i);
+                break;
+            case 2:
+                fprintf(out, "    /* %s: a comment between the statements */\n", word);
+                break;
+            case 3:
+                fprintf(out, "    if (%s%zu >= %u && true) {\n        %s%zu = %s%zu - 1;\n    }\n",
+                    word, i, randomBelow(100), word, i, word, i);
+                break;
+            default:
+                fprintf(out, "    boolean %s%zu = %u != %u;\n", word, i, randomBelow(9), randomBelow(9));
+                break;
+        }
+    }
+    fputs("}\nnumber done = 1;\ndone;\n", out);
+    return (double) ftell(out);
+}
+
+// text values assigned, copied from one variable to another, copied into fn
+// arguments and used as map keys
+static double textChurn(FILE* out) {
+    const size_t texts = 16;
+    const size_t iterations = 5000;
+
+    fputs("fn keep(text value) {\n    text label = value;\n}\nmap seen = {};\ntext current = \"\";\ntext previous = \"\";\n",
+        out);
+    fprintf(out, "number i = 0;\nloop %zu {\n", iterations);
+    for (size_t t = 0; t < texts; t++) {
+        fputs("    current = \"", out);
+        size_t length = 16 + randomBelow(200);
+        for (size_t c = 0; c < length; c++) {
+            fputc('a' + (int) randomBelow(26), out);
+        }
+        fputs("\";\n    previous = current;\n    keep(current);\n    seen[previous] = i;\n", out);
+    }
+    fputs("    i = i + 1;\n}\ntext last = current;\ncount(seen);\n", out);
+    return (double) (iterations * texts * 5);
+}
+
+struct Workload {
+    const char* name;
+    const char* unit;       // what throughput counts, per second
+    double      (*write)(FILE* out);
+};
+
+static const struct Workload workloads[] = {
+    { "deepExpressions", "operators", deepExpressions },
+    { "arithmeticLoop", "iterations", arithmeticLoop },
+    { "callHeavy", "calls", callHeavy },
+    { "manyVariables", "accesses", manyVariables },
+    { "hugeSource", "bytes", hugeSource },
+    { "textChurn", "texts", textChurn },
+};
+
+#define WORKLOAD_COUNT (sizeof(workloads) / sizeof(workloads[0]))
+
+// as named in the interpreter's --stats report
+static const char* const countedPhases[COUNTED_PHASES] = { "tokenise", "parse", "evaluate" };
+static const char* const counterNames[COUNTER_COUNT] = {
+    "cycles", "instructions", "l1Misses", "llcMisses", "branchMisses",
+};
+// a counter the interpreter could not open
+#define NO_COUNT UINT64_MAX
+
+// RUNNING
+
+struct Options {
+    const char*     interpreter;
+    size_t          runs;
+    const char*     baseline;
+    const char*     save;
+    double          threshold;      // percent
+    bool            counters;
+    char**          interpreterArgs;
+    size_t          interpreterArgCount;
+    bool            selected[WORKLOAD_COUNT];
+    bool            anySelected;
+};
+
+struct Result {
+    double  median;
+    double  p95;
+    double  throughput;
+    long    peakRss;        // bytes
+    uint64_t counters[COUNTED_PHASES][COUNTER_COUNT];
+};
+
+// why the interpreter had no hardware counters, empty while it had them
+static char countersMissing[256];
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double) t.tv_sec + (double) t.tv_nsec / 1e9;
+}
+
+// false when the interpreter could not run the program or it failed
+static bool runOnce(const struct Options* options, const char* path, const char* statsOption,
+        double* seconds, long* peakRss) {
+    char* argv[options->interpreterArgCount + 5];
+    size_t argc = 0;
+    argv[argc++] = (char*) options->interpreter;
+    for (size_t i = 0; i < options->interpreterArgCount; i++) {
+        argv[argc++] = options->interpreterArgs[i];
+    }
+    if (statsOption) {
+        argv[argc++] = (char*) statsOption;
+        argv[argc++] = "--perf-counters";
+    }
+    argv[argc++] = (char*) path;
+    argv[argc] = NULL;
+
+    double start = now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0) dup2(null, STDOUT_FILENO);
+        execv(argv[0], argv);
+        fprintf(stderr, "Cannot run %s: %s\n", argv[0], strerror(errno));
+        _exit(127);
+    }
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0) {
+        perror("wait4");
+        return false;
+    }
+    *seconds = now() - start;
+    *peakRss = usage.ru_maxrss * 1024;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static char* readFile(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return NULL;
+    char* text = NULL;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        long size = ftell(file);
+        rewind(file);
+        text = size >= 0 ? malloc((size_t) size + 1) : NULL;
+        if (text) text[fread(text, 1, (size_t) size, file)] = '\0';
+    }
+    fclose(file);
+    return text;
+}
+
+// the counters of one run from its --stats report, false when it wrote none
+static bool readCounters(const char* statsPath, uint64_t counts[COUNTED_PHASES][COUNTER_COUNT]) {
+    char* report = readFile(statsPath);
+    if (!report) return false;
+    const char* reason = strstr(report, "\"reason\": \"");
+    if (reason) {
+        reason += strlen("\"reason\": \"");
+        snprintf(countersMissing, sizeof(countersMissing), "%.*s", (int) strcspn(reason, "\""), reason);
+    }
+    for (size_t p = 0; p < COUNTED_PHASES; p++) {
+        char key[32];
+        snprintf(key, sizeof(key), "\"%s\": {", countedPhases[p]);
+        const char* phase = strstr(report, key);
+        const char* end = phase ? strchr(phase, '}') : NULL;
+        for (size_t c = 0; c < COUNTER_COUNT; c++) {
+            counts[p][c] = NO_COUNT;
+            if (!end) continue;
+            size_t length = (size_t) snprintf(key, sizeof(key), "\"%s\": ", counterNames[c]);
+            const char* value = strstr(phase, key);
+            if (value && value < end && value[length] >= '0' && value[length] <= '9') {
+                counts[p][c] = strtoull(value + length, NULL, 10);
+            }
+        }
+    }
+    free(report);
+    return true;
+}
+
+static int compareCounts(const void* a, const void* b) {
+    uint64_t left = *(const uint64_t*) a;
+    uint64_t right = *(const uint64_t*) b;
+    return left < right ? -1 : left > right;
+}
+
+static int compareSeconds(const void* a, const void* b) {
+    double left = *(const double*) a;
+    double right = *(const double*) b;
+    return left < right ? -1 : left > right;
+}
+
+static bool runWorkload(const struct Options* options, const struct Workload* workload, struct Result* result) {
+    char path[] = "/tmp/benchXXXXXX";
+    int fd = mkstemp(path);
+    FILE* out = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!out) {
+        fprintf(stderr, "Cannot write a program for %s: %s\n", workload->name, strerror(errno));
+        return false;
+    }
+    double units = workload->write(out);
+    if (fclose(out) != 0) {
+        fprintf(stderr, "Cannot write a program for %s: %s\n", workload->name, strerror(errno));
+        unlink(path);
+        return false;
+    }
+
+    char statsPath[] = "/tmp/benchStatsXXXXXX";
+    char statsOption[sizeof(statsPath) + 8] = "";
+    if (options->counters) {
+        int statsFd = mkstemp(statsPath);
+        if (statsFd < 0) {
+            fprintf(stderr, "Cannot make a --stats file for %s: %s\n", workload->name, strerror(errno));
+            unlink(path);
+            return false;
+        }
+        close(statsFd);
+        snprintf(statsOption, sizeof(statsOption), "--stats=%s", statsPath);
+    }
+
+    double seconds[MAX_RUNS];
+    static uint64_t counts[MAX_RUNS][COUNTED_PHASES][COUNTER_COUNT];
+    result->peakRss = 0;
+    bool ok = true;
+    for (size_t run = 0; run < options->runs && ok; run++) {
+        long peakRss;
+        ok = runOnce(options, path, options->counters ? statsOption : NULL, &seconds[run], &peakRss);
+        if (peakRss > result->peakRss) result->peakRss = peakRss;
+        if (ok && options->counters && !readCounters(statsPath, counts[run])) {
+            fprintf(stderr, "%s wrote no --stats report\n", workload->name);
+            ok = false;
+        }
+    }
+    if (options->counters) unlink(statsPath);
+    if (!ok) {
+        fprintf(stderr, "%s failed, its program is kept in %s\n", workload->name, path);
+        return false;
+    }
+    unlink(path);
+
+    size_t runs = options->runs;
+    for (size_t p = 0; p < COUNTED_PHASES && options->counters; p++) {
+        for (size_t c = 0; c < COUNTER_COUNT; c++) {
+            uint64_t values[MAX_RUNS];
+            bool counted = true;
+            for (size_t run = 0; run < runs; run++) {
+                values[run] = counts[run][p][c];
+                counted = counted && values[run] != NO_COUNT;
+            }
+            qsort(values, runs, sizeof(*values), compareCounts);
+            result->counters[p][c] = !counted ? NO_COUNT
+                : runs % 2 ? values[runs / 2] : values[runs / 2 - 1] / 2 + values[runs / 2] / 2;
+        }
+    }
+    qsort(seconds, runs, sizeof(*seconds), compareSeconds);
+    result->median = runs % 2 ? seconds[runs / 2] : (seconds[runs / 2 - 1] + seconds[runs / 2]) / 2;
+    // nearest rank
+    size_t rank = (runs * 95 + 99) / 100;
+    result->p95 = seconds[rank - 1];
+    result->throughput = units / result->median;
+    return true;
+}
+
+// BASELINE
+
+// the median a baseline printed by this program holds for a workload, or 0
+static double baselineMedian(const char* baseline, const char* name) {
+    char key[64];
+    snprintf(key, sizeof(key), "\"%s\": {", name);
+    const char* entry = strstr(baseline, key);
+    if (!entry) return 0;
+    const char* median = strstr(entry, "\"medianSeconds\": ");
+    const char* end = strchr(entry, '}');
+    if (!median || (end && median > end)) return 0;
+    return strtod(median + strlen("\"medianSeconds\": "), NULL);
+}
+
+// the medians per phase, inside the workload's object
+static void printCounters(FILE* out, const struct Result* result) {
+    fprintf(out, ",\n      \"counters\": {");
+    for (size_t p = 0; p < COUNTED_PHASES; p++) {
+        fprintf(out, "%s \"%s\": {", p ? "," : "", countedPhases[p]);
+        for (size_t c = 0; c < COUNTER_COUNT; c++) {
+            if (result->counters[p][c] == NO_COUNT) {
+                fprintf(out, "%s \"%s\": null", c ? "," : "", counterNames[c]);
+            } else {
+                fprintf(out, "%s \"%s\": %llu", c ? "," : "", counterNames[c],
+                    (unsigned long long) result->counters[p][c]);
+            }
+        }
+        fputs(" }", out);
+    }
+    fputs(" }", out);
+}
+
+static void printResults(FILE* out, const struct Options* options, const struct Result* results) {
+    fprintf(out, "{\n  \"interpreter\": \"%s\",\n  \"runs\": %zu,\n  \"workloads\": {", options->interpreter, options->runs);
+    bool first = true;
+    for (size_t i = 0; i < WORKLOAD_COUNT; i++) {
+        if (!options->selected[i]) continue;
+        const struct Result* result = &results[i];
+        fprintf(out, "%s\n    \"%s\": { \"medianSeconds\": %.6f, \"p95Seconds\": %.6f, "
+            "\"throughput\": %.0f, \"unit\": \"%s/s\", \"peakRssBytes\": %ld",
+            first ? "" : ",", workloads[i].name, result->median, result->p95,
+            result->throughput, workloads[i].unit, result->peakRss);
+        if (options->counters && !countersMissing[0]) printCounters(out, result);
+        fputs(" }", out);
+        first = false;
+    }
+    fprintf(out, "\n  }");
+    if (options->counters && countersMissing[0]) {
+        fprintf(out, ",\n  \"perfCounters\": { \"available\": false, \"reason\": \"%s\" }", countersMissing);
+    }
+    fprintf(out, "\n}\n");
+}
+
+static void usage(void) {
+    fprintf(stderr, "Usage: bench [--interp=PATH] [--runs=N] [--baseline=FILE] [--threshold=PERCENT] "
+        "[--save=FILE] [--counters] [workload...] [-- interpreter options...]\nWorkloads:");
+    for (size_t i = 0; i < WORKLOAD_COUNT; i++) {
+        fprintf(stderr, " %s", workloads[i].name);
+    }
+    fputc('\n', stderr);
+}
+
+static bool parseOptions(int argc, char** argv, struct Options* options) {
+    *options = (struct Options) { "bin/main", DEFAULT_RUNS, NULL, NULL, DEFAULT_THRESHOLD, false, NULL, 0, { false }, false };
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        char* end;
+        if (strcmp(arg, "--") == 0) {
+            options->interpreterArgs = argv + i + 1;
+            options->interpreterArgCount = (size_t) (argc - i - 1);
+            break;
+        } else if (strncmp(arg, "--interp=", 9) == 0) {
+            options->interpreter = arg + 9;
+        } else if (strncmp(arg, "--runs=", 7) == 0) {
+            long runs = strtol(arg + 7, &end, 10);
+            if (*end || runs < 1 || runs > MAX_RUNS) {
+                fprintf(stderr, "--runs must be between 1 and %d\n", MAX_RUNS);
+                return false;
+            }
+            options->runs = (size_t) runs;
+        } else if (strncmp(arg, "--baseline=", 11) == 0) {
+            options->baseline = arg + 11;
+        } else if (strncmp(arg, "--save=", 7) == 0) {
+            options->save = arg + 7;
+        } else if (strcmp(arg, "--counters") == 0) {
+            options->counters = true;
+        } else if (strncmp(arg, "--threshold=", 12) == 0) {
+            options->threshold = strtod(arg + 12, &end);
+            if (*end || options->threshold < 0) {
+                fprintf(stderr, "--threshold must be a percentage\n");
+                return false;
+            }
+        } else if (arg[0] == '-') {
+            return false;
+        } else {
+            size_t w = 0;
+            while (w < WORKLOAD_COUNT && strcmp(workloads[w].name, arg) != 0) w++;
+            if (w == WORKLOAD_COUNT) {
+                fprintf(stderr, "No workload %s\n", arg);
+                return false;
+            }
+            options->selected[w] = true;
+            options->anySelected = true;
+        }
+    }
+    if (!options->anySelected) {
+        for (size_t w = 0; w < WORKLOAD_COUNT; w++) options->selected[w] = true;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    struct Options options;
+    if (!parseOptions(argc, argv, &options)) {
+        usage();
+        return 2;
+    }
+
+    struct Result results[WORKLOAD_COUNT];
+    for (size_t i = 0; i < WORKLOAD_COUNT; i++) {
+        if (!options.selected[i]) continue;
+        fprintf(stderr, "%s...\n", workloads[i].name);
+        randomState = 0x9e3779b97f4a7c15ULL;
+        if (!runWorkload(&options, &workloads[i], &results[i])) return 1;
+    }
+    printResults(stdout, &options, results);
+
+    if (options.save) {
+        FILE* file = fopen(options.save, "w");
+        if (!file) {
+            fprintf(stderr, "Cannot write %s: %s\n", options.save, strerror(errno));
+            return 1;
+        }
+        printResults(file, &options, results);
+        if (fclose(file) != 0) {
+            fprintf(stderr, "Cannot write %s: %s\n", options.save, strerror(errno));
+            return 1;
+        }
+    }
+
+    if (!options.baseline) return 0;
+    char* baseline = readFile(options.baseline);
+    if (!baseline) {
+        fprintf(stderr, "No baseline in %s yet, `make bench-baseline` saves one\n", options.baseline);
+        return 0;
+    }
+    int status = 0;
+    double speedups = 1;
+    size_t compared = 0;
+    for (size_t i = 0; i < WORKLOAD_COUNT; i++) {
+        if (!options.selected[i]) continue;
+        double before = baselineMedian(baseline, workloads[i].name);
+        if (before <= 0) {
+            fprintf(stderr, "%s: not in the baseline\n", workloads[i].name);
+            continue;
+        }
+        double change = (results[i].median / before - 1) * 100;
+        bool regressed = change > options.threshold;
+        double speedup = results[i].median > 0 ? before / results[i].median : 1;
+        fprintf(stderr, "%s: %.3fs against %.3fs, %+.1f%%, %.2fx the speed%s\n", workloads[i].name, results[i].median,
+            before, change, speedup, regressed ? ", over the threshold" : "");
+        if (regressed) status = 1;
+        speedups *= speedup;
+        compared++;
+    }
+    free(baseline);
+    if (compared > 1) fprintf(stderr, "Geometric mean: %.2fx the speed\n", pow(speedups, 1.0 / (double) compared));
+    if (status) fprintf(stderr, "Slower than the baseline by more than %.1f%%\n", options.threshold);
+    return status;
+}
@@ -0,0 +1,163 @@
+#include "../include/map.h"
+#include "../include/evaluator.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Inserts, finds and removes the same text keys in a Map and in an
+// Environment, the chained table the evaluator keeps variables in.
+//
+//     make mapbench && bin/mapBench [entries...]
+
+#define KEY_SIZE 24
+#define ROUNDS 3
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double) t.tv_sec + (double) t.tv_nsec / 1e9;
+}
+
+static char* makeKeys(size_t count) {
+    char* keys = malloc(count * KEY_SIZE);
+    if (!keys) {
+        fprintf(stderr, "out of memory for %zu keys\n", count);
+        exit(1);
+    }
+    for (size_t i = 0; i < count; i++) {
+        snprintf(keys + i * KEY_SIZE, KEY_SIZE, "key%zu", i * 2654435761u % 1000000007u);
+    }
+    return keys;
+}
+
+// nanoseconds per operation of each phase, best of ROUNDS
+struct Timings {
+    double insert;
+    double hit;
+    double miss;
+    double remove;
+    double bytes;       // bytes per entry the table adds to the key and value, once full
+};
+
+static void keepBest(struct Timings* best, const struct Timings* round) {
+    if (round->insert < best->insert) best->insert = round->insert;
+    if (round->hit < best->hit) best->hit = round->hit;
+    if (round->miss < best->miss) best->miss = round->miss;
+    if (round->remove < best->remove) best->remove = round->remove;
+    best->bytes = round->bytes;
+}
+
+static struct Value keyValue(char* key) {
+    return createTextValue(key);
+}
+
+static size_t found;
+
+static struct Timings runMap(char* keys, char* missing, size_t count) {
+    struct Timings t;
+    struct Map* map = createMap();
+    double perOperation = 1e9 / (double) count;
+
+    double start = now();
+    for (size_t i = 0; i < count; i++) {
+        setMapEntry(map, keyValue(keys + i * KEY_SIZE), createNumberValue((double) i));
+    }
+    t.insert = (now() - start) * perOperation;
+    // a control byte and an entry index per slot, the entries array is not counted
+    t.bytes = (double) (map->capacity * (1 + sizeof(uint32_t))) / (double) count;
+
+    start = now();
+    for (size_t i = 0; i < count; i++) {
+        found += findMapEntry(map, keyValue(keys + i * KEY_SIZE)) != NULL;
+    }
+    t.hit = (now() - start) * perOperation;
+
+    start = now();
+    for (size_t i = 0; i < count; i++) {
+        found += findMapEntry(map, keyValue(missing + i * KEY_SIZE)) != NULL;
+    }
+    t.miss = (now() - start) * perOperation;
+
+    start = now();
+    for (size_t i = 0; i < count; i++) {
+        found += removeMapEntry(map, keyValue(keys + i * KEY_SIZE));
+    }
+    t.remove = (now() - start) * perOperation;
+
+    freeMap(map);
+    return t;
+}
+
+static struct Timings runEnvironment(char* keys, char* missing, size_t count) {
+    struct Timings t;
+    struct Environment env;
+    createEnvironment(&env);
+    double perOperation = 1e9 / (double) count;
+
+    double start = now();
+    for (size_t i = 0; i < count; i++) {
+        setValue(&env, keys + i * KEY_SIZE, createNumberValue((double) i));
+    }
+    t.insert = (now() - start) * perOperation;
+    // the next pointer of every Entry and the bucket array, malloc's own header per Entry is not counted
+    t.bytes = (double) (count * sizeof(struct Entry*) + env.bucket_count * sizeof(struct Entry*)) / (double) count;
+
+    start = now();
+    for (size_t i = 0; i < count; i++) {
+        found += getValue(&env, keys + i * KEY_SIZE) != NULL;
+    }
+    t.hit = (now() - start) * perOperation;
+
+    start = now();
+    for (size_t i = 0; i < count; i++) {
+        found += getValue(&env, missing + i * KEY_SIZE) != NULL;
+    }
+    t.miss = (now() - start) * perOperation;
+
+    start = now();
+    for (size_t i = 0; i < count; i++) {
+        removeValue(&env, keys + i * KEY_SIZE);
+    }
+    t.remove = (now() - start) * perOperation;
+
+    freeEnvironment(&env);
+    return t;
+}
+
+static void printTimings(const char* name, size_t count, const struct Timings* t) {
+    printf("%-12s %9zu %10.1f %10.1f %10.1f %10.1f %10.1f\n", name, count, t->insert, t->hit, t->miss, t->remove, t->bytes);
+}
+
+int main(int argc, char** argv) {
+    size_t defaults[] = { 1000, 10000, 100000 };
+    size_t sizeCount = argc > 1 ? (size_t) argc - 1 : sizeof(defaults) / sizeof(defaults[0]);
+
+    printf("%-12s %9s %10s %10s %10s %10s %10s\n", "table", "entries", "insert ns", "hit ns", "miss ns", "remove ns", "overhead B");
+    for (size_t s = 0; s < sizeCount; s++) {
+        size_t count = argc > 1 ? strtoull(argv[s + 1], NULL, 10) : defaults[s];
+        if (count == 0) continue;
+        char* keys = makeKeys(count);
+        char* missing = makeKeys(count);
+        // same digits, never equal to a stored key
+        for (size_t i = 0; i < count; i++) {
+            missing[i * KEY_SIZE] = 'x';
+        }
+
+        struct Timings mapBest = { 1e30, 1e30, 1e30, 1e30, 0 };
+        struct Timings environmentBest = mapBest;
+        for (int round = 0; round < ROUNDS; round++) {
+            struct Timings t = runMap(keys, missing, count);
+            keepBest(&mapBest, &t);
+            t = runEnvironment(keys, missing, count);
+            keepBest(&environmentBest, &t);
+        }
+        printTimings("map", count, &mapBest);
+        printTimings("environment", count, &environmentBest);
+
+        free(keys);
+        free(missing);
+    }
+    // keeps the lookups from being optimised away
+    return found == 0;
+}
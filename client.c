@@ -0,0 +1,197 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "protocol.h"
+
+// Runs a program on a server started with `main --serve`, a drop in for
+// `./main file`: prints what the program printed and exits with its status.
+
+extern char **environ;
+
+static void printUsage(const char *program) {
+    fprintf(stderr, "Usage: %s [options] <source-file-path | ->\n", program);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --socket=PATH   server socket (default %s)\n", SERVER_DEFAULT_SOCKET);
+    fprintf(stderr, "  --bench=N       time N runs of the file with a cold main and N warm server round trips\n");
+    fprintf(stderr, "  --main=PATH     main binary the benchmark starts (default: main next to this binary)\n");
+    fprintf(stderr, "  -               send source read from stdin instead of a path\n");
+}
+
+static char *readStdin(size_t *length) {
+    size_t capacity = 4096;
+    char *text = malloc(capacity);
+    *length = 0;
+    while (text) {
+        size_t got = fread(text + *length, 1, capacity - *length, stdin);
+        *length += got;
+        if (got == 0) break;
+        if (*length == capacity) {
+            capacity *= 2;
+            text = realloc(text, capacity);
+        }
+    }
+    return text;
+}
+
+// one request on a fresh connection, output goes to out when it is not NULL,
+// returns the program's exit status or -1 when the server could not be reached
+static int request(const char *socketPath, enum FrameType type, const char *payload, size_t length, FILE *out) {
+    int fd = connectSocket(socketPath);
+    if (fd < 0) {
+        fprintf(stderr, "client: cannot connect to %s: %s\n", socketPath, strerror(errno));
+        return -1;
+    }
+    int status = -1;
+    if (sendFrame(fd, type, payload, length)) {
+        struct FrameHeader header;
+        char *data;
+        while (receiveFrame(fd, &header, &data)) {
+            if (header.type == FRAME_OUTPUT && out) {
+                fwrite(data, 1, header.length, out);
+            } else if (header.type == FRAME_EXIT && header.length == sizeof(int32_t)) {
+                int32_t exitStatus;
+                memcpy(&exitStatus, data, sizeof(exitStatus));
+                status = exitStatus;
+                free(data);
+                break;
+            }
+            free(data);
+        }
+    }
+    close(fd);
+    if (status < 0) fprintf(stderr, "client: connection to %s lost\n", socketPath);
+    return status;
+}
+
+static double secondsSince(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int compareDoubles(const void *a, const void *b) {
+    double left = *(const double *) a, right = *(const double *) b;
+    return left < right ? -1 : left > right;
+}
+
+static void printTimes(const char *name, double *times, size_t count) {
+    double total = 0;
+    for (size_t i = 0; i < count; i++) total += times[i];
+    qsort(times, count, sizeof(double), compareDoubles);
+    printf("%-12s mean %8.3f ms  p50 %8.3f ms  p99 %8.3f ms\n", name,
+        total / count * 1e3, times[count / 2] * 1e3, times[(count * 99) / 100] * 1e3);
+}
+
+// cold: start main on the file, warm: a round trip to the server, output discarded
+static int benchmark(const char *socketPath, const char *mainPath, const char *path, size_t runs) {
+    double *cold = malloc(sizeof(double) * runs);
+    double *warm = malloc(sizeof(double) * runs);
+    FILE *devNull = fopen("/dev/null", "w");
+    if (!cold || !warm || !devNull) {
+        fprintf(stderr, "client: cannot set up benchmark\n");
+        return EXIT_FAILURE;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    char *arguments[] = { (char *) mainPath, (char *) path, NULL };
+    for (size_t i = 0; i < runs; i++) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        pid_t pid;
+        int error = posix_spawn(&pid, mainPath, &actions, NULL, arguments, environ);
+        if (error != 0) {
+            fprintf(stderr, "client: cannot start %s: %s\n", mainPath, strerror(error));
+            return EXIT_FAILURE;
+        }
+        waitpid(pid, NULL, 0);
+        cold[i] = secondsSince(&start);
+    }
+    posix_spawn_file_actions_destroy(&actions);
+
+    // the first request parses and caches the program
+    if (request(socketPath, FRAME_PATH, path, strlen(path), devNull) < 0) return EXIT_FAILURE;
+    for (size_t i = 0; i < runs; i++) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (request(socketPath, FRAME_PATH, path, strlen(path), devNull) < 0) return EXIT_FAILURE;
+        warm[i] = secondsSince(&start);
+    }
+
+    printf("%zu runs of %s\n", runs, path);
+    printTimes("cold main", cold, runs);
+    printTimes("warm server", warm, runs);
+    fclose(devNull);
+    free(cold);
+    free(warm);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    const char *socketPath = SERVER_DEFAULT_SOCKET;
+    const char *mainPath = NULL;
+    const char *path = NULL;
+    size_t benchRuns = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (strncmp(arg, "--socket=", 9) == 0) {
+            socketPath = arg + 9;
+        } else if (strncmp(arg, "--bench=", 8) == 0) {
+            benchRuns = strtoul(arg + 8, NULL, 10);
+            if (benchRuns == 0) {
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(arg, "--main=", 7) == 0) {
+            mainPath = arg + 7;
+        } else if ((arg[0] == '-' && arg[1] != '\0') || path) {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        } else {
+            path = arg;
+        }
+    }
+    if (!path) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (strcmp(path, "-") == 0) {
+        if (benchRuns > 0) {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        size_t length;
+        char *source = readStdin(&length);
+        if (!source) { fprintf(stderr, "client: malloc failed\n"); return EXIT_FAILURE; }
+        int status = request(socketPath, FRAME_SOURCE, source, length, stdout);
+        free(source);
+        return status < 0 ? EXIT_FAILURE : status;
+    }
+
+    // the server has its own working directory
+    char absolute[PATH_MAX];
+    if (!realpath(path, absolute)) { perror(path); return EXIT_FAILURE; }
+
+    if (benchRuns > 0) {
+        char defaultMain[PATH_MAX];
+        if (!mainPath) {
+            const char *slash = strrchr(argv[0], '/');
+            int length = slash ? (int) (slash - argv[0]) : 1;
+            snprintf(defaultMain, sizeof(defaultMain), "%.*s/main", length, slash ? argv[0] : ".");
+            mainPath = defaultMain;
+        }
+        return benchmark(socketPath, mainPath, absolute, benchRuns);
+    }
+    int status = request(socketPath, FRAME_PATH, absolute, strlen(absolute), stdout);
+    return status < 0 ? EXIT_FAILURE : status;
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Where the interpreter's memory comes from.
+//
+// Tokens, the AST, environments, values, maps, arrays, tasks and compiled
+// closures are all allocated and freed by the macros below, which pass their
+// file and line along, through the allocator of the interpreter running on the
+// thread, or the one set for the process outside of any. Blocks move between
+// threads and parsed programs are shared by interpreters, so an interpreter's
+// allocator takes its blocks from the process's and any block can be freed
+// through either. The process's can only be changed before the first
+// allocation. Buffers of the thread pool, --batch, the server and the profiler
+// come from malloc.
+//
+// Blocks are aligned like malloc's. Every implementation must be safe to call
+// from any thread.
+
+struct Allocator {
+    const char* name;
+    // NULL when there is no memory, size is never 0
+    void*       (*allocate)(struct Allocator* self, size_t size, const char* site);
+    // block is never NULL and size never 0
+    void*       (*resize)(struct Allocator* self, void* block, size_t size, const char* site);
+    // block is never NULL
+    void        (*release)(struct Allocator* self, void* block, const char* site);
+    // bytes the block holds, at least its size and the same until it is freed
+    size_t      (*measure)(struct Allocator* self, void* block);
+};
+
+extern struct Allocator* allocator;
+
+// false once anything has been allocated through the current allocator
+bool setAllocator(struct Allocator* replacement);
+
+// the allocator of the interpreter entered on this thread, NULL for the
+// process's, returns the previous one, see enterInterpreter
+struct Allocator* setThreadAllocator(struct Allocator* replacement);
+
+// "src/parser.c:123", the subsystem is the file
+#define ALLOCATION_LINE(line) #line
+#define ALLOCATION_SITE_AT(line) __FILE__ ":" ALLOCATION_LINE(line)
+#define ALLOCATION_SITE ALLOCATION_SITE_AT(__LINE__)
+
+// the malloc family, through the allocator
+#define allocMemory(size) allocateAt((size), ALLOCATION_SITE)
+#define allocZeroed(count, size) allocateZeroedAt((count), (size), ALLOCATION_SITE)
+#define resizeMemory(block, size) resizeAt((block), (size), ALLOCATION_SITE)
+#define freeMemory(block) releaseAt((block), ALLOCATION_SITE)
+#define copyText(text) copyTextAt((text), ALLOCATION_SITE)
+#define copyTextN(text, length) copyTextNAt((text), (length), ALLOCATION_SITE)
+// alignment is a power of two up to 256, blocks are freed with freeAligned
+#define allocAligned(alignment, size) allocateAlignedAt((alignment), (size), ALLOCATION_SITE)
+#define freeAligned(block) releaseAlignedAt((block), ALLOCATION_SITE)
+
+void* allocateAt(size_t size, const char* site);
+void* allocateZeroedAt(size_t count, size_t size, const char* site);
+void* resizeAt(void* block, size_t size, const char* site);
+void releaseAt(void* block, const char* site);
+char* copyTextAt(const char* text, const char* site);
+char* copyTextNAt(const char* text, size_t length, const char* site);
+void* allocateAlignedAt(size_t alignment, size_t size, const char* site);
+void releaseAlignedAt(void* block, const char* site);
+
+// malloc, realloc and free
+extern struct Allocator systemAllocator;
+
+// Counts calls and bytes per call site on top of another allocator, with the
+// current and peak bytes in use. With a limit above 0, an allocation that would
+// take the bytes in use past it stops the program through raiseError. Each
+// block carries 16 bytes saying its size and where it came from.
+struct Allocator* createCountingAllocator(struct Allocator* inner, size_t limit);
+// calls and bytes per subsystem, then the busiest call sites
+void reportAllocations(struct Allocator* counting, FILE* out);
+
+// Counts the bytes in use by blocks allocated and freed through it, taking them
+// from the process's allocator, for an interpreter's own limit. With a limit
+// above 0, an allocation that would take the bytes in use past it stops the run
+// through raiseError. Blocks carry no header, so they can still be freed
+// through any allocator, and are counted by the allocator freeing them.
+struct Allocator* createLimitingAllocator(size_t limit);
+// counts from nothing again, up to the new limit
+void resetLimitingAllocator(struct Allocator* limiting, size_t limit);
+void destroyLimitingAllocator(struct Allocator* limiting);
+
+// Blocks of up to POOL_LARGEST_BLOCK bytes, which covers the AST's nodes and the
+// environments' entries, come from per-thread free lists of 16 byte size
+// classes cut from 64 KiB slabs. Freed blocks go back on the list of the thread
+// freeing them and slabs are only returned to malloc by destroyPoolAllocator.
+// Larger blocks come from malloc. Each block carries 16 bytes saying its size.
+#define POOL_LARGEST_BLOCK 256
+
+struct Allocator* createPoolAllocator(void);
+void destroyPoolAllocator(struct Allocator* pool);
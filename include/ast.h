@@ -11,6 +11,11 @@ enum ASTNodeType {
 
     NODE_BINARY_OPERATION,
 
+    // LOGICAL OPERATIONS, the right side of && and || only runs when it decides the result
+    NODE_LOGICAL_AND,       // data.binary
+    NODE_LOGICAL_OR,        // data.binary
+    NODE_LOGICAL_NOT,       // data.unary
+
     // VARIABLE OPERATIONS
     NODE_VARIABLE_DECLARATION,
     NODE_VARIABLE_ASSIGN,
@@ -19,16 +24,65 @@ enum ASTNodeType {
     // FUNCTION OPERATIONS
     NODE_FUNCTION_DECLARATION,
     NODE_FUNCTION_CALL,
+    NODE_SPAWN,             // data.funcCall, starts the call as a task and yields its handle
+    NODE_AWAIT,             // data.unary, joins a task
+    NODE_BUILTIN_CALL,      // data.builtinCall, calls a C function resolved by the parser
+
+    // NUMBERS ARRAYS
+    NODE_NUMBERS,           // data.numbers, builds an array from its elements
+    NODE_INDEX,             // data.binary, element rightSide of the array or map leftSide
+
+    // MAPS
+    NODE_MAP,               // data.map, builds a map from its entries
+    NODE_INDEX_ASSIGN,      // data.indexAssignment, stores an entry in a map variable
+
+    // MODULES
+    NODE_IMPORT,            // data.import, binds the fns of a module, see modules.h
 
     // IF
     NODE_IF_STATEMENT,
 
     // LOOPS
     NODE_LOOP_STATEMENT,
+    NODE_PARALLEL_LOOP,
+
+    // PRODUCED BY OPTIMISATION PASSES
+    NODE_INLINED_BLOCK,
+    NODE_TEMPORARY_SET,     // data.varAssignment, stores a compiler temporary and yields its value
+
+    // binary operations proven to have number operands, use data.binary
+    NODE_NUMBER_ADD,
+    NODE_NUMBER_SUBTRACT,
+    NODE_NUMBER_MULTIPLY,
+    NODE_NUMBER_DIVIDE,
+    NODE_NUMBER_EQUAL,
+    NODE_NUMBER_NOT_EQUAL,
+    NODE_NUMBER_LESS,
+    NODE_NUMBER_GREATER,
+    NODE_NUMBER_LESSER_EQUAL,
+    NODE_NUMBER_GREATER_EQUAL,
+
+    // rewritten by the adaptive evaluator from runtime feedback, guarded
+    NODE_GUARDED_NUMBER_BINARY,         // data.binary, operands have always been numbers
+    NODE_CACHED_VARIABLE_REFERENCE,     // data.textValue, reads a cached environment entry
+    NODE_CACHED_FUNCTION_CALL,          // data.funcCall, calls through a cached environment entry
 };
 
+#define NODE_TYPE_COUNT (NODE_CACHED_FUNCTION_CALL + 1)
+
+// "NODE_NUMBER_LITERAL", ... for reports
+const char* nodeTypeName(enum ASTNodeType type);
+
+// case labels for every arithmetic or comparison node kind besides NODE_BINARY_OPERATION,
+// the logical nodes also use data.binary but do not always evaluate both sides
+#define CASE_NUMBER_BINARY_NODES \
+    case NODE_NUMBER_ADD: case NODE_NUMBER_SUBTRACT: case NODE_NUMBER_MULTIPLY: \
+    case NODE_NUMBER_DIVIDE: case NODE_NUMBER_EQUAL: case NODE_NUMBER_NOT_EQUAL: case NODE_NUMBER_LESS: \
+    case NODE_NUMBER_GREATER: case NODE_NUMBER_LESSER_EQUAL: case NODE_NUMBER_GREATER_EQUAL: \
+    case NODE_GUARDED_NUMBER_BINARY
+
 enum BinaryOperatorTypes {
-    BIN_OP_PLUS, BIN_OP_MINUS, BIN_OP_STAR, BIN_OP_SLASH, BIN_OP_EQUALITY,
+    BIN_OP_PLUS, BIN_OP_MINUS, BIN_OP_STAR, BIN_OP_SLASH, BIN_OP_EQUALITY, BIN_OP_NOT_EQUAL,
     BIN_OP_LESS, BIN_OP_GREATER, BIN_OP_LESSER_EQUAL, BIN_OP_GREATER_EQUAL
 };
 
@@ -45,15 +99,24 @@ struct ASTBinaryOperation {
     struct ASTNode*             rightSide;
 };
 
+struct ASTUnaryOperation {
+    struct ASTNode*             operand;
+};
+
+// typeChecked is set by the type checker once the value's type is proven,
+// the evaluator then skips its runtime type check
+
 struct ASTVariableDeclaration {
     char*           name;
     enum TokenType  dataType;
     struct ASTNode* node;
+    bool            typeChecked;
 };
 
 struct ASTVariableAssignment {
     char*           name;
     struct ASTNode* node;
+    bool            typeChecked;
 };
 
 struct ASTFunctionDeclaration {
@@ -61,12 +124,53 @@ struct ASTFunctionDeclaration {
     struct Parameter* parameters;
     size_t parameterCount;
     struct ASTNodeList* codeBlock;
+    bool                shared;     // declared by a module, its body must not be rewritten
 };
 
 struct ASTFunctionCall {
     char*               name;
     struct ASTNode**    arguments;
     size_t              argumentCount;
+    bool                typeChecked;
+};
+
+struct Builtin;
+
+// arguments are checked against the builtin's signature by the parser for
+// their count, and by the type checker or at run time for their types
+struct ASTBuiltinCall {
+    const struct Builtin*   builtin;
+    struct ASTNode**        arguments;
+    size_t                  argumentCount;
+    bool                    typeChecked;
+};
+
+// [a, b, c]
+struct ASTNumbers {
+    struct ASTNode**        elements;
+    size_t                  elementCount;
+};
+
+// {key: value, ...}
+struct ASTMap {
+    struct ASTNode**        keys;
+    struct ASTNode**        values;
+    size_t                  entryCount;
+};
+
+// name[key] = value;
+struct ASTIndexAssignment {
+    char*                   name;
+    struct ASTNode*         key;
+    struct ASTNode*         value;
+};
+
+struct Module;
+
+// import "path";
+struct ASTImport {
+    char*                   path;       // as written
+    struct Module*          module;     // set by loadImports
 };
 
 struct ASTIfStatement {
@@ -79,21 +183,77 @@ struct ASTLoopStatement {
     struct ASTNodeList* loopCodeBlock;
 };
 
+// combined into the outer variable once every iteration has run
+struct Reduction {
+    enum BinaryOperatorTypes    op;     // BIN_OP_PLUS or BIN_OP_STAR
+    char*                       name;
+};
+
+// iterations run in chunks on the thread pool, see parallelLoop.h
+struct ASTParallelLoop {
+    struct ASTNode*     loopCount;
+    struct ASTNodeList* loopCodeBlock;
+    char*               indexName;      // NULL without 'as'
+    struct Reduction*   reductions;
+    size_t              reductionCount;
+
+    // filled in by resolveParallelLoop
+    char**              sharedNames;    // outer variables the body reads, copied for every chunk
+    size_t              sharedCount;
+    char**              locals;         // declared by the body, fresh for every iteration
+    size_t              localCount;
+};
+
+// body of a function call substituted at its call site, parameters and locals
+// are renamed into fresh names so they cannot clash with the caller's scope
+struct ASTInlinedBlock {
+    char*               functionName;
+    struct Parameter*   parameters;
+    struct ASTNode**    arguments;
+    size_t              argumentCount;
+    struct ASTNodeList* codeBlock;
+    bool                typeChecked;
+
+    // fresh names removed from the environment once the block has run
+    char**              locals;
+    size_t              localCount;
+};
+
+struct Entry;
+
+// what the adaptive evaluator has seen a node do, zeroed when the node is created
+struct NodeFeedback {
+    unsigned int    hits;           // executions matching the shape being specialised for
+    unsigned int    misses;         // guard failures, specialisation stops once saturated
+    size_t          environmentId;  // environment the cached entry belongs to
+    struct Entry*   entry;
+};
+
 struct ASTNode {
     enum ASTNodeType nodeType;
     size_t line;
     size_t column;
+    char* sourceName;   // set on locals renamed by inlining, the name errors report
+    struct NodeFeedback feedback;
     union {
         double  numberValue;
         char*   textValue;
         bool    boolValue;
         struct  ASTBinaryOperation binary;
+        struct  ASTUnaryOperation unary;
         struct  ASTVariableDeclaration varDeclaration;
         struct  ASTVariableAssignment varAssignment;
         struct  ASTFunctionDeclaration funcDeclaration;
         struct  ASTFunctionCall funcCall;
+        struct  ASTBuiltinCall builtinCall;
+        struct  ASTNumbers numbers;
+        struct  ASTMap map;
+        struct  ASTIndexAssignment indexAssignment;
+        struct  ASTImport import;
         struct  ASTIfStatement ifStatement;
         struct  ASTLoopStatement loopStatement;
+        struct  ASTParallelLoop parallelLoop;
+        struct  ASTInlinedBlock inlinedBlock;
     } data;
 };
 
@@ -106,4 +266,17 @@ struct ASTNodeList {
 void initAST(struct ASTNodeList* ast);
 void appendAST(struct ASTNodeList* ast, struct ASTNode* node);
 void destroyAST(struct ASTNodeList* ast);
+void destroyNode(struct ASTNode* n);
+
+// deep copies, used by passes that duplicate code
+struct ASTNode* cloneNode(const struct ASTNode* n);
+struct ASTNodeList* cloneAST(const struct ASTNodeList* ast);
+
+// name to show users for a name the node holds
+const char* reportedName(const struct ASTNode* n, const char* name);
+
+size_t countNodes(const struct ASTNode* n);
+size_t countASTNodes(const struct ASTNodeList* ast);
+// also adds every node to the count of its type
+size_t countNodeTypes(const struct ASTNodeList* ast, size_t byType[NODE_TYPE_COUNT]);
 
@@ -0,0 +1,14 @@
+#pragma once
+#include "driver.h"
+
+// --batch PATH runs many scripts in one process. PATH is a directory, whose
+// files run in name order, or a manifest listing one script per line (relative
+// to the manifest, blank lines and lines starting with # skipped). Every script
+// runs in a fresh interpreter on the thread pool and keeps its own output and
+// exit status, printed in order as
+//
+//     ==> path (exit 0) <==
+//     ...what the script printed...
+//
+// Returns the process exit status, failure when any script failed.
+int runBatch(const char* path, const struct RunOptions* options);
@@ -0,0 +1,33 @@
+#pragma once
+#include "ast.h"
+#include "evaluator.h"
+#include "typeChecker.h"
+
+// Functions written in C, called by name like sqrt(x) or print(total).
+//
+// The parser looks the name up once and stores the Builtin in the call node,
+// so running a call never searches for it. Arguments are evaluated into an
+// array on the caller's stack and handed over without creating an
+// environment. A builtin's name cannot be used for a function.
+
+#define MAX_BUILTIN_PARAMETERS 3
+
+// arguments match the signature, node is the NODE_BUILTIN_CALL for errors
+typedef struct Value (*BuiltinFunction)(const struct ASTNode* node, const struct Value* arguments);
+
+struct Builtin {
+    const char*         name;
+    BuiltinFunction     run;
+    enum StaticType     parameters[MAX_BUILTIN_PARAMETERS];    // STATIC_UNKNOWN takes any value
+    size_t              requiredCount;      // the parameters after these may be left out
+    size_t              parameterCount;
+    enum StaticType     result;
+    bool                pure;               // prints nothing and gives the same result for the same arguments
+};
+
+// NULL when no builtin has that name
+const struct Builtin* findBuiltin(const char* name, size_t length);
+
+// Checks the arguments unless the type checker proved them, runs the builtin
+// and frees the arguments nothing else holds.
+struct Value callBuiltin(const struct ASTNode* node, struct Value* arguments);
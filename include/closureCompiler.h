@@ -0,0 +1,22 @@
+#pragma once
+#include "ast.h"
+#include "evaluator.h"
+
+// Closure engine: every ASTNode is compiled once into a Closure, a function
+// pointer bound to a context holding its already compiled children. Running
+// the program is a chain of indirect calls with the same semantics, output and
+// error messages as evaluateAST.
+
+struct Closure;
+typedef struct Value (*ClosureFunction)(const struct Closure* closure, struct Environment* env);
+
+struct Closure {
+    ClosureFunction         run;
+    const struct ASTNode*   node;   // source position for error messages
+};
+
+struct CompiledProgram;
+
+struct CompiledProgram* compileProgram(const struct ASTNodeList* program);
+void runCompiledProgram(const struct CompiledProgram* compiled, struct Environment* env);
+void destroyCompiledProgram(struct CompiledProgram* compiled);
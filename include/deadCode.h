@@ -0,0 +1,15 @@
+#pragma once
+#include "ast.h"
+
+struct DeadCodeStats {
+    size_t unreachableBlocks;   // if (false) { ... } and loop 0 { ... }
+    size_t flattenedBlocks;     // if (true) { ... } spliced into the enclosing block
+    size_t unusedFunctions;
+    size_t unusedDeclarations;
+    size_t nodesRemoved;
+    size_t iterations;
+};
+
+// removes code that can never run or whose result is never observed
+void eliminateDeadCode(struct ASTNodeList* program, struct DeadCodeStats* stats);
+void printDeadCodeStats(const struct DeadCodeStats* stats);
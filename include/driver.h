@@ -0,0 +1,31 @@
+#pragma once
+#include "ast.h"
+#include "evaluator.h"
+#include "inliner.h"
+#include <stdbool.h>
+
+// What the command line asked for, shared by a single run and --batch.
+
+struct RunOptions {
+    bool                typeCheck;
+    bool                closureEngine;
+    bool                inlineEnabled;
+    struct InlineOptions inlineOptions;
+    bool                deadCode;
+    bool                deadCodeStats;
+    bool                optimiser;
+    bool                optimiserStats;
+    size_t              memoryLimit;    // of each --batch or --serve run, a single run limits the process
+};
+
+// whole file null terminated, NULL with errno set when it cannot be read
+char* readSourceFile(const char* path);
+
+// runs the enabled passes over program, false when the type checker rejected it
+bool prepareProgram(struct ASTNodeList* program, const struct RunOptions* options);
+// runs a prepared program in env and awaits its tasks, program is not modified
+// unless --adaptive is on
+void executeProgram(const struct ASTNodeList* program, const struct RunOptions* options, struct Environment* env);
+
+// both of the above, false when the program was not run
+bool runProgram(struct ASTNodeList* program, const struct RunOptions* options, struct Environment* env);
@@ -1,6 +1,7 @@
 #pragma once
 #include "ast.h"
 #include <stdbool.h>
+#include <stdint.h>
 
 enum ValueType {
     VALUE_NUMBER,
@@ -8,8 +9,20 @@ enum ValueType {
     VALUE_FUNCTION,
     VALUE_FUNCTION_RETURN,
     VALUE_BOOL,
+    VALUE_TASK,
+    VALUE_NUMBERS,
+    VALUE_MAP,
 };
 
+// refers to a spawned task, the generation tells a reused slot apart once the task is awaited
+struct TaskHandle {
+    uint32_t    slot;
+    uint32_t    generation;
+};
+
+struct NumberArray;
+struct Map;
+
 struct Value {
     enum ValueType type;
     const struct ASTNode* originNode;
@@ -18,6 +31,9 @@ struct Value {
         char*   text;
         bool    boolVal;
         struct ASTNodeList* nodeList; 
+        struct TaskHandle   task;
+        struct NumberArray* numbers;    // see numbers.h
+        struct Map*         map;        // see map.h
     } data;
 };
 
@@ -34,18 +50,51 @@ struct Entry {
 struct Environment {
     struct Entry*   *bucket;
     size_t          bucket_count;
+    size_t          id;     // changes when entries are removed, see NodeFeedback
 };
 
 // Environment
 void createEnvironment(struct Environment* env);
 void freeEnvironment(struct Environment* env);
+// removes every entry but keeps the buckets, for reusing an environment
+void clearEnvironment(struct Environment* env);
 
+unsigned long hash(const char* val);
 struct Value* getValue(struct Environment* env, const char* key);
 void setValue(struct Environment* env, const char* key, struct Value val);
 
+// same as above with hash(key) computed ahead of time
+struct Value* getValueHashed(struct Environment* env, const char* key, unsigned long keyHash);
+void setValueHashed(struct Environment* env, const char* key, unsigned long keyHash, struct Value val);
+void removeValue(struct Environment* env, const char* key);
+
 // Evaluation
+void setAdaptiveEvaluation(bool enabled);
 struct Value createNumberValue(double num);
 struct Value createTextValue(char* str);
 struct Value createBoolValue(bool state);
+struct Value createFunctionValue(struct ASTNodeList* nodeList);
+
+// shared by every execution engine so they report the same errors and output
+struct Value applyNumberOperator(const struct ASTNode* node, double leftNum, double rightNum);
+struct Value applyBinaryOperator(const struct ASTNode* node, struct Value left, struct Value right);
+bool isComparisonOperator(enum BinaryOperatorTypes op);
+bool compareNumbers(enum BinaryOperatorTypes op, double leftNum, double rightNum);
+// owner is the if statement or logical operator the value is a condition of
+bool requireBoolValue(struct Value val, const struct ASTNode* owner);
+void writeValue(struct Value val);
+void printValue(struct Value val);
+
+// Arrays and maps are shared by the variables, arguments and tasks holding
+// them and counted. A value just produced by an expression has no holder,
+// whoever consumes it frees it.
+void retainValue(struct Value val);
+// text is freed, arrays and maps are freed once their last holder lets go
+void releaseValue(struct Value val);
+// frees an array or map nothing holds, for values an expression is done with
+void discardTemporary(struct Value val);
+// same, and frees text unless it was read from the variable node refers to
+void releaseTemporary(const struct ASTNode* node, struct Value val);
+
 struct Value evaluateASTNode(const struct ASTNode* node, struct Environment* env);
 void evaluateAST(const struct ASTNodeList* astList, struct Environment* env);
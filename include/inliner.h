@@ -0,0 +1,15 @@
+#pragma once
+#include "ast.h"
+#include <stdbool.h>
+
+// growth limits, counted in AST nodes
+#define INLINE_DEFAULT_BUDGET   256
+#define INLINE_MAX_CALLEE_NODES 24
+
+struct InlineOptions {
+    size_t  budget;     // total number of nodes the pass may add to the program
+    bool    report;     // print what was and was not inlined to stderr
+};
+
+// replaces calls to small leaf functions with their body, see NODE_INLINED_BLOCK
+void inlineFunctions(struct ASTNodeList* program, const struct InlineOptions* options);
@@ -0,0 +1,56 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+
+// Embedding API, built into bin/libinterp.a and bin/libinterp.so by `make lib`.
+//
+// A program is parsed once and never changed afterwards, so any number of
+// threads can run it at the same time, each with its own interpreter. An
+// interpreter holds the global variables, the tasks spawned by its runs, where
+// printed values go and the allocator counting its memory against a limit.
+// Errors end the run and are returned, nothing exits.
+//
+//     char error[256];
+//     struct InterpProgram* program = interpParse(source, error, sizeof(error));
+//     struct Interpreter* interp = interpCreate();
+//     if (interpRun(interp, program) != INTERP_OK) puts(interpError(interp));
+//     interpDestroy(interp);
+//     interpFreeProgram(program);
+
+struct InterpProgram;
+struct Interpreter;
+
+enum InterpStatus {
+    INTERP_OK,
+    INTERP_ERROR,
+};
+
+// receives everything a run prints, text is not null terminated
+typedef void (*OutputFunction)(void* data, const char* text, size_t length);
+
+// NULL on a syntax error or an import that failed, with the message copied into
+// error. Imports are resolved from the working directory and their modules kept
+// for the life of the process.
+struct InterpProgram* interpParse(const char* source, char* error, size_t errorSize);
+void interpFreeProgram(struct InterpProgram* program);
+
+struct Interpreter* interpCreate(void);
+void interpDestroy(struct Interpreter* interp);
+
+// NULL write sends output to stdout, the default
+void interpSetOutput(struct Interpreter* interp, OutputFunction write, void* data);
+
+// stops a run that has more than bytes allocated and not freed, with the error
+// "Memory limit of ... reached", 0 for no limit. Each run is counted on its own,
+// the globals left by earlier runs are not.
+void interpSetMemoryLimit(struct Interpreter* interp, size_t bytes);
+
+// runs the program in the interpreter's globals, which stay until interpReset,
+// so running two programs in a row works like running them as one
+enum InterpStatus interpRun(struct Interpreter* interp, const struct InterpProgram* program);
+
+// message of the last failed run, empty after a run that succeeded
+const char* interpError(const struct Interpreter* interp);
+
+// drops every global variable and function
+void interpReset(struct Interpreter* interp);
@@ -0,0 +1,64 @@
+#pragma once
+#include "ast.h"
+#include "evaluator.h"
+#include <stdatomic.h>
+#include <stdint.h>
+
+// map m = {"a": 1, "b": 2};   m["c"] = 3;   m["a"];
+//
+// Keys are text or numbers, values anything but maps, tasks and functions.
+// Entries sit in one array in insertion order, removing one moves the last
+// entry into its place. The table over them is open addressing in the
+// SwissTable style: every slot has a control byte holding 7 bits of the key's
+// hash, and a lookup compares a whole group of 16 control bytes at once with
+// SSE2, only looking at entries whose byte matches. A slot costs its control
+// byte and a 4 byte entry index, and at most 7 in 8 slots are used before the
+// table doubles.
+//
+// A map is changed in place and shared by every variable and argument holding
+// it, like an array it is counted by retainValue. Spawned tasks get their own
+// copy, so two threads never write the same map.
+
+#define MAP_GROUP_WIDTH 16
+
+struct MapEntry {
+    struct Value    key;
+    struct Value    value;
+};
+
+struct Map {
+    atomic_size_t       refcount;
+    size_t              count;
+    struct MapEntry*    entries;        // count used, in insertion order
+    size_t              entryCapacity;
+
+    size_t              capacity;       // slots, a power of two and a multiple of the group width
+    size_t              growthLeft;     // empty slots that can be filled before resizing
+    int8_t*             control;        // one byte per slot, aligned to the group width
+    uint32_t*           slots;          // entry index of every full slot, in control's block after the bytes
+};
+
+struct Map* createMap(void);
+struct Value createMapValue(struct Map* map);
+void freeMap(struct Map* map);
+// the map itself when nothing holds it, otherwise a copy nothing holds
+struct Value detachMap(struct Value val);
+
+// Any value can be looked up or removed, only text and numbers are ever
+// found. Stored keys and values are copies, the caller keeps what it passed in.
+struct MapEntry* findMapEntry(const struct Map* map, struct Value key);
+// key must be text or a number other than NaN
+void setMapEntry(struct Map* map, struct Value key, struct Value value);
+bool removeMapEntry(struct Map* map, struct Value key);
+
+// Checked operations of the language. They consume their operands like
+// expressions do: text that is not a variable's and a map nothing holds are
+// freed, also when they raise an error.
+
+// map[key] = value, or an entry of a map literal
+void storeMapElement(const struct ASTNode* node, struct Value map, const struct ASTNode* keyNode, struct Value key,
+    const struct ASTNode* valueNode, struct Value value);
+// node is the NODE_INDEX, the element is returned as an expression result
+struct Value indexMap(const struct ASTNode* node, struct Value map, struct Value key);
+
+void writeMap(const struct Map* map);
@@ -0,0 +1,48 @@
+#pragma once
+#include "ast.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// import "path"; makes the fns of another file callable.
+//
+// A module is a file holding only fn declarations and imports. Paths are
+// relative to the directory of the importing file. Modules are kept for the
+// whole process in one cache, keyed by their resolved path, so each is read,
+// tokenised and parsed once however many programs, scripts of --batch or
+// requests of the server import it, and edits to it are not seen until the
+// process restarts. Its AST is never changed after it is parsed: importing
+// binds its fns with the module's own declarations, the passes leave its
+// bodies alone and the adaptive evaluator does not rewrite them.
+//
+// The imports of a program are parsed together on the thread pool, each
+// module's own imports are queued as soon as it is parsed. Once they are all
+// parsed the import graph is walked, which reports a module that failed and
+// import cycles.
+
+enum ModuleState {
+    MODULE_QUEUED,      // waiting for a parse task
+    MODULE_PARSING,
+    MODULE_READY,
+    MODULE_FAILED,
+};
+
+struct Module {
+    char*               path;       // resolved, the key of the cache
+    struct ASTNodeList  program;    // once ready
+    enum ModuleState    state;      // changed holding the cache's lock
+    char*               error;      // once failed
+    atomic_bool         linked;     // its imports have been walked without a cycle
+    struct Module*      next;
+};
+
+// Parses every module the program imports, directly or through other modules,
+// and links its NODE_IMPORT nodes to them. path is the program's file, NULL
+// resolves imports from the working directory. Raises when a module cannot be
+// read or parsed, or imports form a cycle.
+void loadImports(struct ASTNodeList* program, const char* path);
+
+// the modules read so far, linked by next
+const struct Module* loadedModules(void);
+
+// frees every module, once no program using them is left
+void unloadModules(void);
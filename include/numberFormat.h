@@ -0,0 +1,28 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Numbers as text without going through printf.
+//
+// shortestDecimal is Ryu (Ulf Adams, PLDI 2018): the fewest decimal digits that
+// read back as the same double, found with two 64 x 128 bit multiplications
+// by a precomputed power of five. formatGeneral rounds them to six and lays
+// them out exactly as "%g" does, leaving snprintf the few numbers whose
+// shortest digits cannot tell which way to round. formatShortest lays out
+// every digit Ryu found, so the text reads back as the same number.
+
+// room for either format and its null
+#define NUMBER_TEXT_SIZE 32
+
+// digits * 10^exponent
+struct Decimal {
+    uint64_t    digits;
+    int32_t     exponent;
+};
+
+// value must be finite and above zero, digits has no trailing zeros
+struct Decimal shortestDecimal(double value);
+
+// both return the length written to text, without the null
+size_t formatGeneral(double value, char* text);
+size_t formatShortest(double value, char* text);
@@ -0,0 +1,47 @@
+#pragma once
+#include "ast.h"
+#include "evaluator.h"
+#include <stdatomic.h>
+
+// numbers xs = [1, 2, 3];   numbers ys = range(0, 10, 2);
+//
+// A numbers array is a contiguous block of doubles, aligned for the widest
+// vector loads, and never changes once built. One array is shared by every
+// variable, argument and parallel chunk holding it: refcount counts those
+// holders, see retainValue in evaluator.h.
+//
+// Element-wise operators and reductions run through kernels picked once from
+// the CPU's features (AVX2, SSE2 or plain C). Setting INTERP_KERNELS to scalar,
+// sse2 or avx2 forces one, for comparing them. Every variant adds in the same
+// order, so results do not depend on the CPU.
+
+#define NUMBERS_ALIGNMENT 64
+
+struct NumberArray {
+    atomic_size_t   refcount;
+    size_t          length;
+    double*         data;
+};
+
+struct NumberArray* createNumberArray(size_t length);
+struct Value createNumbersValue(struct NumberArray* array);
+
+void freeNumberArray(struct NumberArray* array);
+
+// element i of an array literal, frees the array when element is not a number
+void storeNumbersElement(const struct ASTNode* node, struct NumberArray* array, size_t i, struct Value element);
+// start, start + step, ... up to end, which is left out
+struct Value buildRange(const struct ASTNode* node, double start, double end, double step);
+// reductions with the kernels in use, min and max need at least one element
+// and dot two arrays of the same length
+double sumNumbers(const struct NumberArray* array);
+double minNumbers(const struct NumberArray* array);
+double maxNumbers(const struct NumberArray* array);
+double dotNumbers(const struct NumberArray* left, const struct NumberArray* right);
+struct Value indexNumbers(const struct ASTNode* node, struct Value array, struct Value index);
+// binary operator with a numbers operand and a number or numbers on the other side
+struct Value applyNumbersOperator(const struct ASTNode* node, struct Value left, struct Value right);
+
+void writeNumbers(const struct NumberArray* array);
+// name of the kernels in use, "avx2", "sse2" or "scalar"
+const char* numbersKernelName(void);
@@ -0,0 +1,28 @@
+#pragma once
+#include "ast.h"
+
+// Optimiser behind -O. Each scope (the program, every fn body) is lowered
+// into an SSA form where every variable write creates a new version and every
+// expression becomes a value. Copy propagation, common subexpression
+// elimination and loop-invariant code motion run on those values, then the
+// results are written back into the AST with NODE_TEMPORARY_SET temporaries.
+
+enum OptimiserPass {
+    PASS_BUILD_SSA,
+    PASS_COPY_PROPAGATION,
+    PASS_CSE,
+    PASS_LICM,
+    PASS_LOWER_AST,
+    OPTIMISER_PASS_COUNT,
+};
+
+struct OptimiserStats {
+    size_t  changes[OPTIMISER_PASS_COUNT];
+    double  milliseconds[OPTIMISER_PASS_COUNT];
+    size_t  values;
+    size_t  versions;
+    size_t  regions;
+};
+
+void optimiseProgram(struct ASTNodeList* program, struct OptimiserStats* stats);
+void printOptimiserStats(const struct OptimiserStats* stats);
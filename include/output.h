@@ -0,0 +1,46 @@
+#pragma once
+#include "evaluator.h"
+#include "numberFormat.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// How printed values are written, and where the command line sends them.
+//
+// The command line keeps everything printed outside a sink in one large
+// buffer and hands it to write(2) a block at a time, instead of going through
+// stdio for every value. The buffer is flushed when full, at exit and before
+// an error that ends the program is printed. On a terminal it is also flushed
+// at every line break, so output still shows up line by line.
+//
+// --output picks the form of printed values:
+//   text    numbers as "%g" writes them, the default
+//   exact   numbers with every digit needed to read back as the same double
+//   binary  a record per printed value, a tag byte then the value in host
+//           byte order: 'n' a double, 'b' a byte 0 or 1, 't' a uint64 length
+//           and the text, 'a' a uint64 length and the doubles, 'm' a uint64
+//           count then the key and value records of every entry
+
+#define OUTPUT_BUFFER_SIZE (256 * 1024)
+
+enum OutputFormat {
+    OUTPUT_TEXT,
+    OUTPUT_EXACT,
+    OUTPUT_BINARY,
+};
+
+void setOutputFormat(enum OutputFormat format);
+enum OutputFormat getOutputFormat(void);
+
+// value as text in the format in use, at most NUMBER_TEXT_SIZE bytes with the
+// null, returns the length
+size_t formatNumber(double value, char* text);
+
+// from now on output that has no sink goes to fd through the buffer, false
+// when fd is not open for writing
+bool useBufferedOutput(int fd);
+// false when useBufferedOutput was never called, the caller writes to stdout
+bool bufferOutput(const char* text, size_t length);
+void flushOutput(void);
+
+// the binary record of a value, nothing for functions and tasks
+void writeBinaryValue(struct Value val);
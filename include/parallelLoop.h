@@ -0,0 +1,25 @@
+#pragma once
+#include "ast.h"
+#include "evaluator.h"
+
+// parallel loop N as i reduce(+: total) { ... }
+//
+// The iterations are split into chunks that run on the thread pool. Every chunk
+// gets its own Environment holding copies of the outer variables the body reads,
+// the index and its own accumulator for each reduction, so the body never
+// touches shared state. Once all chunks are done the accumulators are combined
+// into the outer variables in chunk order.
+
+// chunk boundaries only depend on the loop count, so reductions combine in the
+// same order (and round the same way) whatever the number of threads
+#define PARALLEL_MAX_CHUNKS 256
+
+// runs the body once in env, each engine passes its own
+typedef void (*ParallelBodyFunction)(const void* body, struct Environment* env);
+
+// called by the parser, rejects bodies that write shared variables, print or call
+// functions and fills in sharedNames and locals
+void resolveParallelLoop(struct ASTNode* node);
+
+void runParallelLoop(const struct ASTNode* node, struct Value loopCount, const void* body,
+    ParallelBodyFunction runBody, struct Environment* env);
@@ -7,16 +7,23 @@ struct ASTNode* parsePrimary(struct TokenList* tokens, size_t* index);
 struct ASTNode* parseFactor(struct TokenList* tokens, size_t* index);
 struct ASTNode* parseTerm(struct TokenList* tokens, size_t* index);
 struct ASTNode* parseExpression(struct TokenList* tokens, size_t* index);
+struct ASTNode* parseLogicalOr(struct TokenList* tokens, size_t* index);
+struct ASTNode* parseLogicalAnd(struct TokenList* tokens, size_t* index);
 struct ASTNode* parseEquality(struct TokenList* tokens, size_t* index);
 struct ASTNode* parseComparsion(struct TokenList* tokens, size_t* index);
 struct ASTNode* parseTopLevel(struct TokenList* tokens, size_t* index);
 struct ASTNode* parseIfStatement(struct TokenList* tokens, size_t* index);
 struct ASTNode* parseLoopStatement(struct TokenList* tokens, size_t* index);
+struct ASTNode* parseParallelLoop(struct TokenList* tokens, size_t* index);
 struct ASTNode* parseStatement(struct TokenList* tokens, size_t* index);
 struct ASTNode* parseDeclaration(struct TokenList* tokens, size_t* index);
 struct ASTNode* parseAssignment(struct TokenList* tokens, size_t* index);
 struct ASTNodeList* parseCodeBlock(struct TokenList* tokens, size_t* index);
 struct ASTNode* parseFunctionDeclaration(struct TokenList* tokens, size_t* index);
 struct ASTNode* parseFunctionCall(struct TokenList* tokens, size_t* index);
-struct ASTNodeList parseProgram(const char* sourceCode);
+// tokenises and parses, then loads the modules the program imports, which are
+// resolved from the directory of path, see modules.h
+struct ASTNodeList parseProgram(const char* sourceCode, const char* path);
+// tokenises and parses without loading imports or taking stats, for modules
+struct ASTNodeList parseSource(const char* sourceCode);
 
@@ -0,0 +1,31 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Hardware counters of the calling thread, read through perf_event_open.
+//
+// Each counter is opened on its own, so one the CPU or the kernel does not
+// offer leaves the others working. Counting is done by the PMU and costs
+// nothing until read, reading them all is one read(2) each. Kernel and
+// hypervisor time are left out, which also lets perf_event_paranoid up to 2
+// allow them. Threads the calling thread starts later are not counted.
+
+enum PerfCounter {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1_MISSES,         // level 1 data cache read misses
+    PERF_LLC_MISSES,        // last level cache read misses
+    PERF_BRANCH_MISSES,
+    PERF_COUNTER_COUNT,
+};
+
+extern const char* const perfCounterNames[PERF_COUNTER_COUNT];
+
+// opens every counter it can, false with why in reason when it could open none
+bool openPerfCounters(char* reason, size_t reasonSize);
+bool perfCounterOpen(enum PerfCounter counter);
+// counts so far, scaled up for the time a counter shared the PMU with others,
+// 0 for the ones that are not open
+void readPerfCounters(uint64_t values[PERF_COUNTER_COUNT]);
+void closePerfCounters(void);
@@ -0,0 +1,67 @@
+#pragma once
+#include "ast.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// --profile: a sampling profiler of the interpreted program.
+//
+// Every thread running interpreted code keeps a stack of frames, one per fn
+// call it is in, each holding the position of the statement it is at. While
+// the profiler runs, ITIMER_PROF raises SIGPROF every PROFILE_INTERVAL_US of
+// CPU time the process uses. The handler copies the stack of the thread it
+// interrupted into a table of distinct stacks and counts one more sample, with
+// no allocation and no lock, so it is cheap enough to leave on.
+//
+// Keeping the frames costs a store per statement and two per call while the
+// profiler runs, a load and a branch otherwise. Calls nested deeper than
+// PROFILE_MAX_DEPTH are counted in the deepest frame kept.
+
+#define PROFILE_MAX_DEPTH   64
+#define PROFILE_INTERVAL_US 1000
+
+struct ProfileFrame {
+    const char* name;       // the fn, NULL in the frame a thread starts in
+    uint32_t    line;       // of the statement running in it, 0 before the first
+    uint32_t    column;
+};
+
+struct ProfileStack {
+    size_t              depth;      // frames above the first one, may pass the ones kept
+    struct ProfileFrame frames[PROFILE_MAX_DEPTH];
+};
+
+extern bool profilerRunning;
+extern _Thread_local struct ProfileStack profileStack;
+
+static inline void profileStatement(const struct ASTNode* node) {
+    if (profilerRunning && profileStack.depth < PROFILE_MAX_DEPTH) {
+        struct ProfileFrame* frame = &profileStack.frames[profileStack.depth];
+        frame->line = (uint32_t) node->line;
+        frame->column = (uint32_t) node->column;
+    }
+}
+
+static inline void profileEnter(const char* name) {
+    if (!profilerRunning) return;
+    size_t depth = profileStack.depth + 1;
+    if (depth < PROFILE_MAX_DEPTH) {
+        profileStack.frames[depth] = (struct ProfileFrame) { name, 0, 0 };
+    }
+    // the frame is written before a sample on this thread can see it
+    atomic_signal_fence(memory_order_release);
+    profileStack.depth = depth;
+}
+
+static inline void profileLeave(void) {
+    if (profilerRunning) profileStack.depth--;
+}
+
+// starts sampling, false with errno set when the timer cannot be set up
+bool startProfiler(const char* foldedPath);
+// stops sampling, prints the hottest lines and functions to stderr and writes
+// every sampled stack to the folded path in the format flame graph tools read,
+// "main:12;fib:3;fib:4 57". Runs at exit unless called before, after it the fn
+// names in the stacks may be freed.
+void finishProfiler(void);
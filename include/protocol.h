@@ -0,0 +1,37 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Messages between bin/client and `main --serve` over a Unix domain socket.
+// Both ends run on the same machine, so headers use its byte order.
+//
+//     client: FRAME_PATH or FRAME_SOURCE
+//     server: FRAME_OUTPUT (all the program printed), then FRAME_EXIT
+//
+// A connection may send any number of requests, one after the other.
+
+#define SERVER_DEFAULT_SOCKET "/tmp/interp.sock"
+
+// larger requests are refused, the connection is closed
+#define FRAME_MAX_LENGTH (64u << 20)
+
+enum FrameType {
+    FRAME_PATH,     // absolute path of a source file the server reads
+    FRAME_SOURCE,   // the source text itself
+    FRAME_OUTPUT,
+    FRAME_EXIT,     // 4 byte exit status of the run
+};
+
+struct FrameHeader {
+    uint32_t    type;
+    uint32_t    length;     // bytes following the header
+};
+
+// false when the peer closed the connection or on any error
+bool sendFrame(int socket, enum FrameType type, const void* data, size_t length);
+// payload is malloc'd and null terminated, the caller frees it
+bool receiveFrame(int socket, struct FrameHeader* header, char** payload);
+
+// path too long for a sockaddr_un is an error
+int connectSocket(const char* path);
@@ -0,0 +1,86 @@
+#pragma once
+#include "allocator.h"
+#include "evaluator.h"
+#include "interp.h"
+#include "tasks.h"
+#include <setjmp.h>
+
+// State of one interpreter instance. The command line uses a default one,
+// embedders create their own through interp.h. Every thread running code of
+// an instance (the caller, pool workers running its tasks) points at it.
+
+#define ERROR_MESSAGE_SIZE 512
+
+struct OutputSink {
+    OutputFunction  write;      // NULL writes to stdout
+    void*           data;
+};
+
+struct Interpreter {
+    struct Environment  globals;
+    struct OutputSink   output;
+    struct TaskRegistry tasks;
+    struct Allocator*   allocator;      // what its runs allocate through, NULL for the process's
+    size_t              memoryLimit;    // of each interpRun, see interpSetMemoryLimit
+    char                error[ERROR_MESSAGE_SIZE];
+};
+
+// the instance code on this thread belongs to, set and restored around every
+// run, along with the thread's allocator
+struct Interpreter* currentInterpreter(void);
+struct Interpreter* enterInterpreter(struct Interpreter* interpreter);
+
+// Instances kept between runs by --batch and the server, so their globals
+// buckets and task slots are allocated once per thread rather than once per
+// run. Returned instances have their globals cleared. A taken one counts what
+// it allocates from nothing, up to memoryLimit when above 0.
+struct Interpreter* takeSpareInterpreter(size_t memoryLimit);
+void returnSpareInterpreter(struct Interpreter* interpreter);
+void destroySpareInterpreters(void);
+
+// Counts what the instance allocates from now on, with limit 0 only counting,
+// see createLimitingAllocator. Set while it is not entered, false when there
+// is no memory for it.
+bool limitInterpreterMemory(struct Interpreter* interpreter, size_t limit);
+
+// where printed values go on this thread, returns the previous sink
+const struct OutputSink* setOutputSink(const struct OutputSink* sink);
+void writeOutput(const char* text, size_t length);
+void printOutput(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+// The environment of a fn call from its creation until it is freed, chained
+// to the calls in progress on the same thread. An error unwinding the call
+// frees it, along with every other scope entered after the handler was pushed.
+struct CallScope {
+    struct Environment  env;
+    struct CallScope*   caller;
+};
+
+// after createEnvironment(&scope->env)
+void enterCallScope(struct CallScope* scope);
+// before the environment is freed or handed to a task
+void leaveCallScope(struct CallScope* scope);
+
+// Errors stop the run they happen in. raiseError unwinds to the innermost
+// handler pushed on this thread, or prints the message and exits when there is
+// none, which is what the command line relies on.
+//
+//     struct ErrorHandler handler;
+//     if (setjmp(handler.jump) == 0) {
+//         pushErrorHandler(&handler);
+//         ...
+//         popErrorHandler(&handler);
+//     } else {
+//         // handler.message holds the error, the handler is already popped
+//     }
+struct ErrorHandler {
+    jmp_buf                 jump;
+    struct ErrorHandler*    previous;
+    size_t                  profileDepth;   // fn frames the profiler had, see profiler.h
+    struct CallScope*       scope;          // innermost call in progress when pushed
+    char                    message[ERROR_MESSAGE_SIZE];
+};
+
+void pushErrorHandler(struct ErrorHandler* handler);
+void popErrorHandler(struct ErrorHandler* handler);
+_Noreturn void raiseError(const char* format, ...) __attribute__((format(printf, 1, 2)));
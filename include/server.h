@@ -0,0 +1,10 @@
+#pragma once
+#include "driver.h"
+
+// --serve[=SOCKET] keeps the interpreter resident and runs programs sent by
+// bin/client, see protocol.h. Parsed programs, with the enabled passes already
+// applied, are cached by a hash of their source and the path they were read
+// from, which their imports are resolved from, so a warm request only pays for
+// running. Every request runs in a fresh interpreter on its own connection
+// thread. Only returns when the socket cannot be set up.
+int runServer(const char* socketPath, const struct RunOptions* options);
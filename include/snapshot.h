@@ -0,0 +1,61 @@
+#pragma once
+#include "ast.h"
+#include "driver.h"
+#include "evaluator.h"
+#include <limits.h>
+#include <stdint.h>
+
+// --snapshot=FILE: start a program from its globals as an earlier run left
+// them, rather than running its declarations again.
+//
+// A run without a usable snapshot runs the program up to its snapshot point,
+// the first top-level snapshot(); call or else the end of its leading
+// declarations and imports, then saves an image of the globals: numbers,
+// bools, texts, arrays and maps by value, fns by their declarations, with the
+// output printed so far and the statements after the point. Later runs of the
+// same source with the same passes map the image, print that output again,
+// set the globals and run only what follows the point, without tokenising,
+// parsing or running the passes.
+//
+// The image is the AST nodes and values themselves, laid out for the address
+// SNAPSHOT_BASE, with a table of where every pointer in it is. It is read
+// once for its checksum, an image that does not match is ignored like a stale
+// one. Mapped at SNAPSHOT_BASE, which is tried first, nothing but the pointers
+// to builtins is changed, mapped anywhere else the pointers are moved by the
+// difference. The mapping is private, so --adaptive rewriting nodes never
+// changes the file.
+
+#define SNAPSHOT_BASE ((uintptr_t) 0x200000000000)
+
+// what an image is only valid for, taken from the source before it is freed
+struct SnapshotKey {
+    uint64_t    sourceHash;
+    uint64_t    sourceLength;
+    uint64_t    passes;             // the options changing the prepared program, a bit each
+    uint64_t    inlineBudget;
+    uint64_t    outputFormat;       // of the output kept in the image
+    char        path[PATH_MAX];     // the program's, resolved, its imports are found from it
+};
+
+struct Snapshot;
+
+void makeSnapshotKey(struct SnapshotKey* key, const char* source, const char* path, const struct RunOptions* options);
+
+// the image in file when it was saved for key by this build and the modules
+// it imported are unchanged, otherwise NULL
+struct Snapshot* openSnapshot(const char* file, const struct SnapshotKey* key);
+// the declarations of the fns among the globals, then the statements after
+// the snapshot point, owned by the image
+const struct ASTNodeList* snapshotProgram(const struct Snapshot* snapshot);
+// prints what the run up to the snapshot point printed, and sets its globals in env
+void restoreSnapshot(const struct Snapshot* snapshot, struct Environment* env);
+// once nothing uses the program
+void closeSnapshot(struct Snapshot* snapshot);
+
+// Runs program like executeProgram, saving an image for key to file at the
+// snapshot point, and runs what comes after it like a run from the image
+// would. Tasks spawned before the point are awaited there. An image that
+// cannot be saved, because a global holds a task or an import comes after
+// the point, is reported to stderr and the program runs on.
+void executeAndSnapshot(const struct ASTNodeList* program, const struct RunOptions* options, struct Environment* env,
+    const char* file, const struct SnapshotKey* key);
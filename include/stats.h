@@ -0,0 +1,79 @@
+#pragma once
+#include "ast.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// --stats: where a run's time and memory go, written as JSON when it ends.
+//
+// Phases are timed on the thread running the program, in wall time and in the
+// CPU time of the whole process, pool threads included. Counters are kept per
+// thread and added up once the program has run, so counting is an increment,
+// or a load and a branch while stats are off. The counting hooks are macros so
+// that holds in builds that do not inline.
+
+enum StatsPhase {
+    STATS_READ,
+    STATS_TOKENISE,
+    STATS_PARSE,
+    STATS_PASSES,       // --typecheck, --inline, --dce and -O
+    STATS_EVALUATE,
+    STATS_TEARDOWN,
+    STATS_PHASE_COUNT,
+};
+
+struct StatsCounters {
+    uint64_t                dispatches;     // evaluateASTNode calls
+    uint64_t                environments;   // created
+    uint64_t                lookups;
+    uint64_t                lookupProbes;   // entries of a bucket's chain compared
+    uint64_t                stores;
+    uint64_t                storeProbes;
+    bool                    registered;
+    struct StatsCounters*   next;           // of the thread that counted before this one
+};
+
+extern bool statsEnabled;
+extern _Thread_local struct StatsCounters statsCounters;
+
+void registerStatsCounters(void);
+
+static inline struct StatsCounters* threadCounters(void) {
+    if (!statsCounters.registered) registerStatsCounters();
+    return &statsCounters;
+}
+
+#define countDispatch() do { \
+        if (statsEnabled) threadCounters()->dispatches++; \
+    } while (0)
+
+#define countEnvironment() do { \
+        if (statsEnabled) threadCounters()->environments++; \
+    } while (0)
+
+#define countLookup(probes) do { \
+        if (statsEnabled) { \
+            threadCounters()->lookups++; \
+            statsCounters.lookupProbes += (probes); \
+        } \
+    } while (0)
+
+#define countStore(probes) do { \
+        if (statsEnabled) { \
+            threadCounters()->stores++; \
+            statsCounters.storeProbes += (probes); \
+        } \
+    } while (0)
+
+// the report goes to path, or stderr when it is NULL
+void enableStats(const char* path);
+// adds the hardware counters of the thread running the program to each phase,
+// or why there are none, see perfCounters.h
+void enablePerfCounters(void);
+void beginPhase(enum StatsPhase phase);
+void endPhase(enum StatsPhase phase);
+void countTokens(size_t count);
+void countProgramNodes(const struct ASTNodeList* program);
+// adds up every thread's counters, before the pool's threads exit
+void collectStatsCounters(void);
+void writeStats(void);
@@ -0,0 +1,39 @@
+#pragma once
+#include "evaluator.h"
+#include <pthread.h>
+
+// spawn f(args) starts a function call as a task on the thread pool and yields
+// a handle, await joins it. Tasks are stackless: one is only the call's
+// environment and body, it runs on whichever thread takes it from the pool, and
+// a thread waiting in await runs queued tasks meanwhile instead of blocking.
+// What a task prints is kept and written out when it is awaited, so output
+// appears in the order the program awaits its tasks.
+
+// runs the body once in env, each engine passes its own
+typedef void (*TaskBodyFunction)(const void* body, struct Environment* env);
+
+// tasks of one interpreter instance
+struct TaskRegistry {
+    pthread_mutex_t         lock;
+    struct TaskSlot*        slots;
+    size_t                  slotCount;
+    size_t*                 freeSlots;
+    size_t                  freeSlotCount;
+    size_t                  nextSequence;
+};
+
+void initTaskRegistry(struct TaskRegistry* registry);
+void destroyTaskRegistry(struct TaskRegistry* registry);
+
+// takes over env, which already holds the arguments
+struct Value spawnTask(const void* body, TaskBodyFunction runBody, struct Environment* env);
+// the value of the call, which is 0 like every call until functions return values.
+// An error in the task is raised again here, after what it printed
+struct Value awaitTask(const struct ASTNode* node, struct Value handle);
+// called once the program ends, awaits what was never awaited in the order it was spawned
+void awaitRemainingTasks(void);
+// after an error, waits for what is left and drops its output and errors
+void discardRemainingTasks(void);
+
+// nodes must not rewrite themselves while tasks may be running them
+bool tasksInFlight(void);
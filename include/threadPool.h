@@ -0,0 +1,26 @@
+#pragma once
+#include <stdatomic.h>
+#include <stddef.h>
+
+// Work-stealing pool shared by everything that runs in parallel. Every worker
+// owns a queue it pushes to and pops from at the back, idle workers steal from
+// the front of the others. Threads outside the pool (the main thread) share one
+// extra queue. Waiting on a group runs queued tasks instead of blocking.
+
+typedef void (*TaskFunction)(void* argument);
+
+// tasks submitted together, waited on together
+struct TaskGroup {
+    atomic_size_t pending;
+};
+
+// total threads running tasks, the calling thread included, set before the first task
+void setThreadCount(size_t threads);
+size_t getThreadCount(void);
+
+void initTaskGroup(struct TaskGroup* group);
+void submitTask(struct TaskGroup* group, TaskFunction run, void* argument);
+void waitTaskGroup(struct TaskGroup* group);
+
+// joins the workers, called once at exit
+void shutdownThreadPool(void);
@@ -5,7 +5,7 @@
 enum TokenType {
 
     // datatypes
-    TEXT_TYPE, NUMBER_TYPE, BOOLEAN_TYPE,
+    TEXT_TYPE, NUMBER_TYPE, BOOLEAN_TYPE, TASK_TYPE, NUMBERS_TYPE, MAP_TYPE,
 
     // identifier + literals
     IDENTIFIER, TEXT, NUMBER, TRUE, FALSE,
@@ -13,12 +13,14 @@ enum TokenType {
     // operators
     EQUAL, STAR, SLASH, PLUS, MINUS, LESS_THAN, MORE_THAN,
     EQUALITY_OPERATOR, LESSER_EQUAL, GREATER_EQUAL, NOT_EQUAL,
+    NOT_OPERATOR, AND_OPERATOR, OR_OPERATOR,
 
     // punctuation
-    SEMICOLON, LEFT_PAREN, RIGHT_PAREN, COMMA, LEFT_CURLY, RIGHT_CURLY,
+    SEMICOLON, COLON, LEFT_PAREN, RIGHT_PAREN, COMMA, LEFT_CURLY, RIGHT_CURLY,
+    LEFT_SQUARE, RIGHT_SQUARE,
 
     // keywords
-    COMMENT, FUNCTION_DECLARATION, IF_DECLARATION, LOOP_DECLARATION, END_OF_FILE, 
+    COMMENT, FUNCTION_DECLARATION, IF_DECLARATION, LOOP_DECLARATION, PARALLEL_DECLARATION, SPAWN_DECLARATION, AWAIT_DECLARATION, IMPORT_DECLARATION, END_OF_FILE, 
 };
 
 union uLiteral {
@@ -0,0 +1,54 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// --trace: a timeline of the run in Chrome's trace-event JSON, which
+// chrome://tracing and Perfetto open.
+//
+// The phases, the parse of every imported module, every fn called by
+// NODE_FUNCTION_CALL and every loop statement are recorded as spans. Each thread writes its spans to a ring of its own, so
+// recording takes no lock: a clock read when the span starts, and another and
+// a 40 byte store when it ends. A thread that ends more than TRACE_RING_EVENTS
+// spans keeps the latest. The clock is the time stamp counter where there is
+// one, converted to time with the monotonic clock when the trace is written.
+// While tracing is off the hooks are a load and a branch, and macros so that
+// holds in builds that do not inline.
+
+#define TRACE_RING_EVENTS (1 << 20)
+
+enum TraceKind {
+    TRACE_PHASE,
+    TRACE_CALL,         // count is the arguments
+    TRACE_LOOP,         // count is the iterations
+};
+
+extern bool traceEnabled;
+
+static inline uint64_t traceClock(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    // rdtsc, without pulling in x86intrin.h
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000u + (uint64_t) t.tv_nsec;
+#endif
+}
+
+// ends a span on the calling thread's ring
+void recordTraceSpan(enum TraceKind kind, const char* name, uint64_t count, size_t line, uint64_t start);
+
+// the start of a span, passed to traceSpan when it ends
+#define traceStart() (traceEnabled ? traceClock() : 0)
+
+#define traceSpan(kind, name, count, line, start) do { \
+        if (traceEnabled) recordTraceSpan((kind), (name), (count), (line), (start)); \
+    } while (0)
+
+// starts recording, the trace is written to path by finishTrace
+void enableTrace(const char* path);
+// stops recording and writes the trace. Runs at exit unless called before,
+// after it the fn names in the spans may be freed.
+void finishTrace(void);
@@ -0,0 +1,21 @@
+#pragma once
+#include "ast.h"
+
+enum StaticType {
+    STATIC_UNKNOWN,     // not provable, the evaluator keeps its runtime checks
+    STATIC_NUMBER,
+    STATIC_TEXT,
+    STATIC_BOOL,
+    STATIC_FUNCTION,
+    STATIC_TASK,
+    STATIC_NUMBERS,
+    STATIC_MAP,
+};
+
+// "number", "text", ... for messages
+const char* staticTypeName(enum StaticType type);
+
+// Checks the whole program before it runs. Every type error is printed, the
+// return value is the number of errors found. Operations whose types are
+// proven are marked or rewritten so the evaluator can skip the dynamic checks.
+size_t typeCheckProgram(struct ASTNodeList* program);
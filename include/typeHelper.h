@@ -3,7 +3,7 @@
 #include "../include/evaluator.h"
 #include <stdbool.h>
 
-bool doesDataTypeMatchesData(enum ValueType valType, enum TokenType nodeType) {
+static inline bool doesDataTypeMatchesData(enum ValueType valType, enum TokenType nodeType) {
     switch (nodeType) {
     case TEXT_TYPE:
         return valType == VALUE_TEXT;
@@ -11,6 +11,12 @@ bool doesDataTypeMatchesData(enum ValueType valType, enum TokenType nodeType) {
         return valType == VALUE_NUMBER;
     case BOOLEAN_TYPE:
         return valType == VALUE_BOOL;
+    case TASK_TYPE:
+        return valType == VALUE_TASK;
+    case NUMBERS_TYPE:
+        return valType == VALUE_NUMBERS;
+    case MAP_TYPE:
+        return valType == VALUE_MAP;
     default:
         return false;
     }
@@ -1,46 +1,309 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <stdint.h>
+#include <unistd.h>
 #include "parser.h"
 #include "evaluator.h"
+#include "driver.h"
+#include "batch.h"
+#include "server.h"
+#include "protocol.h"
+#include "threadPool.h"
+#include "output.h"
+#include "profiler.h"
+#include "trace.h"
+#include "stats.h"
+#include "allocator.h"
+#include "modules.h"
+#include "snapshot.h"
+
+static void printUsage(const char *program) {
+    fprintf(stderr, "Usage: %s [options] <source-file-path>\n", program);
+    fprintf(stderr, "       %s --batch [options] <manifest-or-directory>\n", program);
+    fprintf(stderr, "       %s --serve[=SOCKET] [options]\n", program);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --typecheck         report all type errors before running, skip proven runtime checks\n");
+    fprintf(stderr, "  --engine=NAME       execution engine, 'tree' (default) or 'closure'\n");
+    fprintf(stderr, "  --adaptive          let AST nodes specialise themselves from runtime type feedback\n");
+    fprintf(stderr, "  --inline            inline small non-recursive functions\n");
+    fprintf(stderr, "  --inline-budget=N   maximum number of AST nodes inlining may add (default %d)\n", INLINE_DEFAULT_BUDGET);
+    fprintf(stderr, "  --inline-report     print inlining decisions to stderr\n");
+    fprintf(stderr, "  --dce               remove unreachable blocks and unused declarations\n");
+    fprintf(stderr, "  --dce-stats         print what dead code elimination removed to stderr\n");
+    fprintf(stderr, "  -O                  optimise with copy propagation, CSE and loop-invariant code motion\n");
+    fprintf(stderr, "  --opt-stats         print per-pass optimiser timings and change counts to stderr\n");
+    fprintf(stderr, "  --batch             run every script of a manifest or directory, each in a fresh interpreter\n");
+    fprintf(stderr, "  --serve[=SOCKET]    run programs sent by bin/client over a Unix socket (default %s)\n", SERVER_DEFAULT_SOCKET);
+    fprintf(stderr, "  --threads=N         threads running parallel loops and tasks, the main thread included (default: all cores)\n");
+    fprintf(stderr, "  --output=FORMAT     printed values as 'text' (default), 'exact' (every digit a number needs) or 'binary' records\n");
+    fprintf(stderr, "  --output-fd=N       write printed values to file descriptor N rather than stdout\n");
+    fprintf(stderr, "  --profile[=FILE]    sample the running line and fn calls, report the hottest to stderr and\n");
+    fprintf(stderr, "                      write flame graph stacks to FILE (default profile.folded)\n");
+    fprintf(stderr, "  --trace[=FILE]      record phases, fn calls and loops as a Chrome trace-event timeline in FILE\n");
+    fprintf(stderr, "                      (default trace.json), for chrome://tracing or Perfetto\n");
+    fprintf(stderr, "  --stats[=FILE]      write phase timings, counters and peak memory as JSON to FILE (default stderr)\n");
+    fprintf(stderr, "  --perf-counters     add cycles, instructions, cache misses and branch misses to each --stats phase\n");
+    fprintf(stderr, "  --snapshot=FILE     start from the globals FILE saved at snapshot() or the end of the leading\n");
+    fprintf(stderr, "                      declarations when the program is unchanged, otherwise save them there\n");
+    fprintf(stderr, "  --allocator=NAME    memory from 'system' (default), 'pool' size classes, or 'counting', which\n");
+    fprintf(stderr, "                      reports calls and bytes per file and line to stderr at exit\n");
+    fprintf(stderr, "  --memory-limit=N    stop the program when it has more than N bytes (K, M or G suffix) in use,\n");
+    fprintf(stderr, "                      with --batch or --serve each run on its own\n");
+}
+
+static struct Allocator *reportedAllocator = NULL;
+
+static void reportAllocationsAtExit(void) {
+    reportAllocations(reportedAllocator, stderr);
+}
+
+// N, NK, NM or NG bytes, 0 when it is none of them
+static size_t parseByteCount(const char *text) {
+    char *end;
+    unsigned long long count = strtoull(text, &end, 10);
+    if (end == text) return 0;
+    unsigned shift = 0;
+    if (*end == 'K' || *end == 'k') shift = 10;
+    if (*end == 'M' || *end == 'm') shift = 20;
+    if (*end == 'G' || *end == 'g') shift = 30;
+    if (shift) end++;
+    if (*end != '\0' || count > (SIZE_MAX >> shift)) return 0;
+    return (size_t) count << shift;
+}
+
+// before anything is allocated, a limit counts on top of any allocator
+static bool chooseAllocator(const char *name, size_t memoryLimit) {
+    struct Allocator *chosen;
+    bool report = false;
+    if (strcmp(name, "system") == 0) {
+        chosen = &systemAllocator;
+    } else if (strcmp(name, "pool") == 0) {
+        chosen = createPoolAllocator();
+    } else if (strcmp(name, "counting") == 0) {
+        chosen = createCountingAllocator(&systemAllocator, memoryLimit);
+        report = true;
+    } else {
+        return false;
+    }
+    if (chosen && memoryLimit && !report) {
+        chosen = createCountingAllocator(chosen, memoryLimit);
+    }
+    if (!chosen || !setAllocator(chosen)) return false;
+    if (report) {
+        reportedAllocator = chosen;
+        atexit(reportAllocationsAtExit);
+    }
+    return true;
+}
 
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <source-file-path>\n", argv[0]);
+    const char *path = NULL;
+    bool batchMode = false;
+    bool adaptive = false;
+    const char *socketPath = NULL;
+    int outputFd = -1;
+    const char *profilePath = NULL;
+    const char *tracePath = NULL;
+    bool stats = false;
+    const char *statsPath = NULL;
+    bool perfCounters = false;
+    const char *snapshotPath = NULL;
+    const char *allocatorName = "system";
+    size_t memoryLimit = 0;
+    struct RunOptions options = { .inlineOptions = { INLINE_DEFAULT_BUDGET, false } };
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (strcmp(arg, "--typecheck") == 0) {
+            options.typeCheck = true;
+        } else if (strcmp(arg, "--engine=tree") == 0) {
+            options.closureEngine = false;
+        } else if (strcmp(arg, "--engine=closure") == 0) {
+            options.closureEngine = true;
+        } else if (strcmp(arg, "--adaptive") == 0) {
+            setAdaptiveEvaluation(true);
+            adaptive = true;
+        } else if (strcmp(arg, "--inline") == 0) {
+            options.inlineEnabled = true;
+        } else if (strncmp(arg, "--inline-budget=", 16) == 0) {
+            options.inlineEnabled = true;
+            options.inlineOptions.budget = strtoul(arg + 16, NULL, 10);
+        } else if (strcmp(arg, "--inline-report") == 0) {
+            options.inlineEnabled = true;
+            options.inlineOptions.report = true;
+        } else if (strcmp(arg, "--dce") == 0) {
+            options.deadCode = true;
+        } else if (strcmp(arg, "--dce-stats") == 0) {
+            options.deadCode = true;
+            options.deadCodeStats = true;
+        } else if (strcmp(arg, "-O") == 0) {
+            options.optimiser = true;
+        } else if (strcmp(arg, "--opt-stats") == 0) {
+            options.optimiser = true;
+            options.optimiserStats = true;
+        } else if (strncmp(arg, "--threads=", 10) == 0) {
+            size_t threads = strtoul(arg + 10, NULL, 10);
+            if (threads == 0) {
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            setThreadCount(threads);
+        } else if (strcmp(arg, "--output=text") == 0) {
+            setOutputFormat(OUTPUT_TEXT);
+        } else if (strcmp(arg, "--output=exact") == 0) {
+            setOutputFormat(OUTPUT_EXACT);
+        } else if (strcmp(arg, "--output=binary") == 0) {
+            setOutputFormat(OUTPUT_BINARY);
+        } else if (strncmp(arg, "--output-fd=", 12) == 0) {
+            char *end;
+            long fd = strtol(arg + 12, &end, 10);
+            if (end == arg + 12 || *end != '\0' || fd < 0 || fd > INT_MAX) {
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            outputFd = (int) fd;
+        } else if (strcmp(arg, "--profile") == 0) {
+            profilePath = "profile.folded";
+        } else if (strncmp(arg, "--profile=", 10) == 0 && arg[10] != '\0') {
+            profilePath = arg + 10;
+        } else if (strcmp(arg, "--trace") == 0) {
+            tracePath = "trace.json";
+        } else if (strncmp(arg, "--trace=", 8) == 0 && arg[8] != '\0') {
+            tracePath = arg + 8;
+        } else if (strcmp(arg, "--stats") == 0) {
+            stats = true;
+        } else if (strncmp(arg, "--stats=", 8) == 0 && arg[8] != '\0') {
+            stats = true;
+            statsPath = arg + 8;
+        } else if (strcmp(arg, "--perf-counters") == 0) {
+            stats = true;
+            perfCounters = true;
+        } else if (strncmp(arg, "--snapshot=", 11) == 0 && arg[11] != '\0') {
+            snapshotPath = arg + 11;
+        } else if (strncmp(arg, "--allocator=", 12) == 0) {
+            allocatorName = arg + 12;
+        } else if (strncmp(arg, "--memory-limit=", 15) == 0) {
+            memoryLimit = parseByteCount(arg + 15);
+            if (memoryLimit == 0) {
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(arg, "--batch") == 0) {
+            batchMode = true;
+        } else if (strcmp(arg, "--serve") == 0) {
+            socketPath = SERVER_DEFAULT_SOCKET;
+        } else if (strncmp(arg, "--serve=", 8) == 0) {
+            socketPath = arg + 8;
+        } else if (arg[0] == '-' || path) {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        } else {
+            path = arg;
+        }
+    }
+    // batch and server output is gathered per run and written by them, and
+    // their runs share the threads a profile or trace could not tell apart
+    // a snapshot is of one program
+    if ((outputFd >= 0 || profilePath || tracePath || stats || snapshotPath) && (socketPath || batchMode)) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    // their runs are limited one by one rather than the whole process
+    if (socketPath || batchMode) {
+        options.memoryLimit = memoryLimit;
+        memoryLimit = 0;
+    }
+    if (!chooseAllocator(allocatorName, memoryLimit)) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (socketPath) {
+        // cached programs are shared between requests, nodes must not rewrite themselves
+        if (path || batchMode || adaptive) {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        return runServer(socketPath, &options);
+    }
+    if (!path) {
+        printUsage(argv[0]);
         return EXIT_FAILURE;
     }
 
-    // 1) Read whole file into `source`
-    const char *path = argv[1];
-    FILE *file = fopen(path, "rb");
-    if (!file) { perror("fopen"); return EXIT_FAILURE; }
-    if (fseek(file, 0, SEEK_END) != 0) { perror("fseek"); fclose(file); return EXIT_FAILURE; }
-    long fileSize = ftell(file);
-    if (fileSize < 0) { perror("ftell"); fclose(file); return EXIT_FAILURE; }
-    rewind(file);
-
-    char *source = malloc(fileSize + 1);
-    if (!source) { fprintf(stderr, "malloc failed\n"); fclose(file); return EXIT_FAILURE; }
-    if (fread(source, 1, fileSize, file) != (size_t)fileSize) {
-        fprintf(stderr, "fread failed\n");
-        free(source);
-        fclose(file);
+    if (batchMode) {
+        int status = runBatch(path, &options);
+        shutdownThreadPool();
+        unloadModules();
+        return status;
+    }
+
+    if (stats) enableStats(statsPath);
+    if (perfCounters) enablePerfCounters();
+    if (tracePath) enableTrace(tracePath);
+    if (outputFd < 0) outputFd = STDOUT_FILENO;
+    if (!useBufferedOutput(outputFd)) {
+        fprintf(stderr, "Cannot write to file descriptor %d\n", outputFd);
         return EXIT_FAILURE;
     }
-    source[fileSize] = '\0';
-    fclose(file);
 
-    // 2) Parse entire program into an ASTNodeList
-    struct ASTNodeList program = parseProgram(source);
+    // 1) Read whole file into `source`
+    beginPhase(STATS_READ);
+    char *source = readSourceFile(path);
+    if (!source) { perror(path); return EXIT_FAILURE; }
+    struct SnapshotKey snapshotKey;
+    struct Snapshot *snapshot = NULL;
+    if (snapshotPath) {
+        makeSnapshotKey(&snapshotKey, source, path, &options);
+        snapshot = openSnapshot(snapshotPath, &snapshotKey);
+    }
+    endPhase(STATS_READ);
+
+    // 2) Parse entire program into an ASTNodeList, or take what is left of it from the snapshot
+    struct ASTNodeList program = snapshot ? *snapshotProgram(snapshot) : parseProgram(source, path);
     free(source);
+    countProgramNodes(&program);
 
     struct Environment env;
     createEnvironment(&env);
-    evaluateAST(&program, &env);
-    freeEnvironment(&env);
+    beginPhase(STATS_PASSES);
+    // the program in a snapshot is already prepared
+    bool ran = snapshot || prepareProgram(&program, &options);
+    endPhase(STATS_PASSES);
+    if (ran) {
+        if (profilePath && !startProfiler(profilePath)) {
+            perror("--profile");
+            return EXIT_FAILURE;
+        }
+        beginPhase(STATS_EVALUATE);
+        if (snapshot) {
+            restoreSnapshot(snapshot, &env);
+            executeProgram(&program, &options, &env);
+        } else if (snapshotPath) {
+            executeAndSnapshot(&program, &options, &env, snapshotPath, &snapshotKey);
+        } else {
+            executeProgram(&program, &options, &env);
+        }
+        endPhase(STATS_EVALUATE);
+    }
+    // before the fn names they report are freed with the program
+    if (profilePath) finishProfiler();
+    if (tracePath) finishTrace();
+    collectStatsCounters();
 
     // 3) Clean up
-    destroyAST(&program);
-    return EXIT_SUCCESS;
+    beginPhase(STATS_TEARDOWN);
+    freeEnvironment(&env);
+    shutdownThreadPool();
+    if (snapshot) {
+        closeSnapshot(snapshot);
+    } else {
+        destroyAST(&program);
+    }
+    unloadModules();
+    endPhase(STATS_TEARDOWN);
+    writeStats();
+    return ran ? EXIT_SUCCESS : EXIT_FAILURE;
 }
-
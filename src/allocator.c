@@ -0,0 +1,113 @@
+#include "../include/allocator.h"
+#include <malloc.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// SYSTEM
+
+static void* systemAllocate(struct Allocator* self, size_t size, const char* site) {
+    (void) self;
+    (void) site;
+    return malloc(size);
+}
+
+static void* systemResize(struct Allocator* self, void* block, size_t size, const char* site) {
+    (void) self;
+    (void) site;
+    return realloc(block, size);
+}
+
+static void systemRelease(struct Allocator* self, void* block, const char* site) {
+    (void) self;
+    (void) site;
+    free(block);
+}
+
+static size_t systemMeasure(struct Allocator* self, void* block) {
+    (void) self;
+    return malloc_usable_size(block);
+}
+
+struct Allocator systemAllocator = { "system", systemAllocate, systemResize, systemRelease, systemMeasure };
+
+struct Allocator* allocator = &systemAllocator;
+static atomic_bool allocatorUsed;
+static _Thread_local struct Allocator* allocatorOnThread = NULL;
+
+bool setAllocator(struct Allocator* replacement) {
+    if (atomic_load(&allocatorUsed)) return false;
+    allocator = replacement;
+    return true;
+}
+
+struct Allocator* setThreadAllocator(struct Allocator* replacement) {
+    struct Allocator* previous = allocatorOnThread;
+    allocatorOnThread = replacement;
+    return previous;
+}
+
+static inline struct Allocator* currentAllocator(void) {
+    return allocatorOnThread ? allocatorOnThread : allocator;
+}
+
+// THROUGH THE ALLOCATOR
+
+void* allocateAt(size_t size, const char* site) {
+    if (!atomic_load_explicit(&allocatorUsed, memory_order_relaxed)) atomic_store(&allocatorUsed, true);
+    struct Allocator* through = currentAllocator();
+    return through->allocate(through, size ? size : 1, site);
+}
+
+void* allocateZeroedAt(size_t count, size_t size, const char* site) {
+    if (size && count > SIZE_MAX / size) return NULL;
+    void* block = allocateAt(count * size, site);
+    if (block) memset(block, 0, count * size);
+    return block;
+}
+
+void* resizeAt(void* block, size_t size, const char* site) {
+    if (!block) return allocateAt(size, site);
+    struct Allocator* through = currentAllocator();
+    return through->resize(through, block, size ? size : 1, site);
+}
+
+void releaseAt(void* block, const char* site) {
+    if (!block) return;
+    struct Allocator* through = currentAllocator();
+    through->release(through, block, site);
+}
+
+char* copyTextAt(const char* text, const char* site) {
+    size_t length = strlen(text);
+    char* copy = allocateAt(length + 1, site);
+    if (copy) memcpy(copy, text, length + 1);
+    return copy;
+}
+
+char* copyTextNAt(const char* text, size_t length, const char* site) {
+    length = strnlen(text, length);
+    char* copy = allocateAt(length + 1, site);
+    if (copy) {
+        memcpy(copy, text, length);
+        copy[length] = '\0';
+    }
+    return copy;
+}
+
+// the distance back to the block the allocator gave is kept just before the
+// aligned one, which is always at least 16 bytes in
+void* allocateAlignedAt(size_t alignment, size_t size, const char* site) {
+    if (alignment < 16) alignment = 16;
+    if (size > SIZE_MAX - alignment) return NULL;
+    char* block = allocateAt(size + alignment, site);
+    if (!block) return NULL;
+    char* aligned = (char*) (((uintptr_t) block + alignment) & ~(uintptr_t) (alignment - 1));
+    ((uint16_t*) aligned)[-1] = (uint16_t) (aligned - block);
+    return aligned;
+}
+
+void releaseAlignedAt(void* block, const char* site) {
+    if (block) releaseAt((char*) block - ((uint16_t*) block)[-1], site);
+}
@@ -1,9 +1,56 @@
 #include "../include/ast.h"
+#include "../include/allocator.h"
+#include <string.h>
 
 #define AST_INITIAL_CAPACITY 10
 
+static const char* const nodeTypeNames[NODE_TYPE_COUNT] = {
+    [NODE_NUMBER_LITERAL] = "NODE_NUMBER_LITERAL",
+    [NODE_TEXT_LITERAL] = "NODE_TEXT_LITERAL",
+    [NODE_BOOL_LITERAL] = "NODE_BOOL_LITERAL",
+    [NODE_BINARY_OPERATION] = "NODE_BINARY_OPERATION",
+    [NODE_LOGICAL_AND] = "NODE_LOGICAL_AND",
+    [NODE_LOGICAL_OR] = "NODE_LOGICAL_OR",
+    [NODE_LOGICAL_NOT] = "NODE_LOGICAL_NOT",
+    [NODE_VARIABLE_DECLARATION] = "NODE_VARIABLE_DECLARATION",
+    [NODE_VARIABLE_ASSIGN] = "NODE_VARIABLE_ASSIGN",
+    [NODE_VARIABLE_REFERENCE] = "NODE_VARIABLE_REFERENCE",
+    [NODE_FUNCTION_DECLARATION] = "NODE_FUNCTION_DECLARATION",
+    [NODE_FUNCTION_CALL] = "NODE_FUNCTION_CALL",
+    [NODE_SPAWN] = "NODE_SPAWN",
+    [NODE_AWAIT] = "NODE_AWAIT",
+    [NODE_BUILTIN_CALL] = "NODE_BUILTIN_CALL",
+    [NODE_NUMBERS] = "NODE_NUMBERS",
+    [NODE_INDEX] = "NODE_INDEX",
+    [NODE_MAP] = "NODE_MAP",
+    [NODE_INDEX_ASSIGN] = "NODE_INDEX_ASSIGN",
+    [NODE_IMPORT] = "NODE_IMPORT",
+    [NODE_IF_STATEMENT] = "NODE_IF_STATEMENT",
+    [NODE_LOOP_STATEMENT] = "NODE_LOOP_STATEMENT",
+    [NODE_PARALLEL_LOOP] = "NODE_PARALLEL_LOOP",
+    [NODE_INLINED_BLOCK] = "NODE_INLINED_BLOCK",
+    [NODE_TEMPORARY_SET] = "NODE_TEMPORARY_SET",
+    [NODE_NUMBER_ADD] = "NODE_NUMBER_ADD",
+    [NODE_NUMBER_SUBTRACT] = "NODE_NUMBER_SUBTRACT",
+    [NODE_NUMBER_MULTIPLY] = "NODE_NUMBER_MULTIPLY",
+    [NODE_NUMBER_DIVIDE] = "NODE_NUMBER_DIVIDE",
+    [NODE_NUMBER_EQUAL] = "NODE_NUMBER_EQUAL",
+    [NODE_NUMBER_NOT_EQUAL] = "NODE_NUMBER_NOT_EQUAL",
+    [NODE_NUMBER_LESS] = "NODE_NUMBER_LESS",
+    [NODE_NUMBER_GREATER] = "NODE_NUMBER_GREATER",
+    [NODE_NUMBER_LESSER_EQUAL] = "NODE_NUMBER_LESSER_EQUAL",
+    [NODE_NUMBER_GREATER_EQUAL] = "NODE_NUMBER_GREATER_EQUAL",
+    [NODE_GUARDED_NUMBER_BINARY] = "NODE_GUARDED_NUMBER_BINARY",
+    [NODE_CACHED_VARIABLE_REFERENCE] = "NODE_CACHED_VARIABLE_REFERENCE",
+    [NODE_CACHED_FUNCTION_CALL] = "NODE_CACHED_FUNCTION_CALL",
+};
+
+const char* nodeTypeName(enum ASTNodeType type) {
+    return (size_t) type < NODE_TYPE_COUNT ? nodeTypeNames[type] : "NODE_UNKNOWN";
+}
+
 void initAST(struct ASTNodeList* ast) {
-    ast->nodes = malloc(sizeof(struct ASTNode*) * AST_INITIAL_CAPACITY);
+    ast->nodes = allocMemory(sizeof(struct ASTNode*) * AST_INITIAL_CAPACITY);
     ast->count = 0;
     ast->capacity = AST_INITIAL_CAPACITY;
 }
@@ -11,7 +58,7 @@ void initAST(struct ASTNodeList* ast) {
 void appendAST(struct ASTNodeList* ast, struct ASTNode* node) {
     if (ast->count >= ast->capacity) {
         size_t newCapacity = ast->capacity * 2;
-        ast->nodes = realloc(ast->nodes, sizeof(struct ASTNode*) * newCapacity);
+        ast->nodes = resizeMemory(ast->nodes, sizeof(struct ASTNode*) * newCapacity);
         ast->capacity = newCapacity;
     }
     ast->nodes[ast->count] = node;
@@ -27,7 +74,7 @@ void destroyNode(struct ASTNode *n) {
 
       case NODE_TEXT_LITERAL:
         // textValue was strdup'ed in parsePrimary
-        free(n->data.textValue);
+        freeMemory(n->data.textValue);
         break;
       
       case NODE_BOOL_LITERAL:
@@ -35,69 +82,158 @@ void destroyNode(struct ASTNode *n) {
         break;
 
       case NODE_VARIABLE_REFERENCE:
+      case NODE_CACHED_VARIABLE_REFERENCE:
         // same: strdup'ed name
-        free(n->data.textValue);
+        freeMemory(n->data.textValue);
         break;
 
       case NODE_BINARY_OPERATION:
+      case NODE_INDEX:
+      case NODE_LOGICAL_AND:
+      case NODE_LOGICAL_OR:
+      CASE_NUMBER_BINARY_NODES:
         // destroy both subtrees
         destroyNode(n->data.binary.leftSide);
         destroyNode(n->data.binary.rightSide);
         break;
 
+      case NODE_LOGICAL_NOT:
+      case NODE_AWAIT:
+        destroyNode(n->data.unary.operand);
+        break;
+
       case NODE_VARIABLE_DECLARATION:
         // free the variable name, then the initialiser subtree
-        free(n->data.varDeclaration.name);
+        freeMemory(n->data.varDeclaration.name);
         destroyNode(n->data.varDeclaration.node);
         break;
 
       case NODE_VARIABLE_ASSIGN:
+      case NODE_TEMPORARY_SET:
         // free the variable name, then the RHS subtree
-        free(n->data.varAssignment.name);
+        freeMemory(n->data.varAssignment.name);
         destroyNode(n->data.varAssignment.node);
         break;
 
       case NODE_FUNCTION_DECLARATION:
-        free(n->data.funcDeclaration.name);
+        freeMemory(n->data.funcDeclaration.name);
 
         if (n->data.funcDeclaration.parameters && n->data.funcDeclaration.parameterCount > 0) {
           for (size_t i = 0; i < n->data.funcDeclaration.parameterCount; i++) {
-            free(n->data.funcDeclaration.parameters[i].name);
+            freeMemory(n->data.funcDeclaration.parameters[i].name);
           }
-          free(n->data.funcDeclaration.parameters);
+          freeMemory(n->data.funcDeclaration.parameters);
         }
 
         destroyAST(n->data.funcDeclaration.codeBlock);
-        free(n->data.funcDeclaration.codeBlock);
+        freeMemory(n->data.funcDeclaration.codeBlock);
         break;
 
       case NODE_FUNCTION_CALL:
-        free(n->data.funcCall.name);
+      case NODE_CACHED_FUNCTION_CALL:
+      case NODE_SPAWN:
+        freeMemory(n->data.funcCall.name);
 
         for (size_t i = 0; i < n->data.funcCall.argumentCount; i++) {
           destroyNode(n->data.funcCall.arguments[i]);
         }
         
-        free(n->data.funcCall.arguments);
+        freeMemory(n->data.funcCall.arguments);
+        break;
+
+      case NODE_BUILTIN_CALL:
+        for (size_t i = 0; i < n->data.builtinCall.argumentCount; i++) {
+          destroyNode(n->data.builtinCall.arguments[i]);
+        }
+        freeMemory(n->data.builtinCall.arguments);
+        break;
+
+      case NODE_NUMBERS:
+        for (size_t i = 0; i < n->data.numbers.elementCount; i++) {
+          destroyNode(n->data.numbers.elements[i]);
+        }
+        freeMemory(n->data.numbers.elements);
+        break;
+
+      case NODE_MAP:
+        for (size_t i = 0; i < n->data.map.entryCount; i++) {
+          destroyNode(n->data.map.keys[i]);
+          destroyNode(n->data.map.values[i]);
+        }
+        freeMemory(n->data.map.keys);
+        freeMemory(n->data.map.values);
+        break;
+
+      case NODE_INDEX_ASSIGN:
+        freeMemory(n->data.indexAssignment.name);
+        destroyNode(n->data.indexAssignment.key);
+        destroyNode(n->data.indexAssignment.value);
+        break;
+
+      case NODE_IMPORT:
+        // the module belongs to the cache, see modules.h
+        freeMemory(n->data.import.path);
         break;
       
       case NODE_IF_STATEMENT:
         destroyNode(n->data.ifStatement.condition);
         destroyAST(n->data.ifStatement.conditionTrueBlock);
-        free(n->data.ifStatement.conditionTrueBlock);
+        freeMemory(n->data.ifStatement.conditionTrueBlock);
         break;
 
       case NODE_LOOP_STATEMENT:
         destroyNode(n->data.loopStatement.loopCount);
         destroyAST(n->data.loopStatement.loopCodeBlock);
-        free(n->data.loopStatement.loopCodeBlock);
+        freeMemory(n->data.loopStatement.loopCodeBlock);
+        break;
+
+      case NODE_PARALLEL_LOOP:
+        destroyNode(n->data.parallelLoop.loopCount);
+        destroyAST(n->data.parallelLoop.loopCodeBlock);
+        freeMemory(n->data.parallelLoop.loopCodeBlock);
+        freeMemory(n->data.parallelLoop.indexName);
+
+        for (size_t i = 0; i < n->data.parallelLoop.reductionCount; i++) {
+          freeMemory(n->data.parallelLoop.reductions[i].name);
+        }
+        freeMemory(n->data.parallelLoop.reductions);
+
+        for (size_t i = 0; i < n->data.parallelLoop.sharedCount; i++) {
+          freeMemory(n->data.parallelLoop.sharedNames[i]);
+        }
+        freeMemory(n->data.parallelLoop.sharedNames);
+
+        for (size_t i = 0; i < n->data.parallelLoop.localCount; i++) {
+          freeMemory(n->data.parallelLoop.locals[i]);
+        }
+        freeMemory(n->data.parallelLoop.locals);
+        break;
+
+      case NODE_INLINED_BLOCK:
+        freeMemory(n->data.inlinedBlock.functionName);
+
+        for (size_t i = 0; i < n->data.inlinedBlock.argumentCount; i++) {
+          freeMemory(n->data.inlinedBlock.parameters[i].name);
+          destroyNode(n->data.inlinedBlock.arguments[i]);
+        }
+        freeMemory(n->data.inlinedBlock.parameters);
+        freeMemory(n->data.inlinedBlock.arguments);
+
+        for (size_t i = 0; i < n->data.inlinedBlock.localCount; i++) {
+          freeMemory(n->data.inlinedBlock.locals[i]);
+        }
+        freeMemory(n->data.inlinedBlock.locals);
+
+        destroyAST(n->data.inlinedBlock.codeBlock);
+        freeMemory(n->data.inlinedBlock.codeBlock);
         break;
 
       default:
         // others
         break;
     }
-    free(n);
+    freeMemory(n->sourceName);
+    freeMemory(n);
 }
 
 void destroyAST(struct ASTNodeList* ast) {
@@ -107,10 +243,306 @@ void destroyAST(struct ASTNodeList* ast) {
     }
 
     // 2) free the array of pointers
-    free(ast->nodes);
+    freeMemory(ast->nodes);
 
     // 3) reset the list
     ast->nodes    = NULL;
     ast->count    = 0;
     ast->capacity = 0;
 }
+
+const char* reportedName(const struct ASTNode* n, const char* name) {
+    return n->sourceName ? n->sourceName : name;
+}
+
+static char** cloneNames(char** names, size_t count) {
+    if (count == 0) return NULL;
+    char** copy = allocMemory(sizeof(char*) * count);
+    for (size_t i = 0; i < count; i++) {
+        copy[i] = copyText(names[i]);
+    }
+    return copy;
+}
+
+struct ASTNode* cloneNode(const struct ASTNode* n) {
+    if (!n) return NULL;
+
+    struct ASTNode* copy = allocMemory(sizeof(struct ASTNode));
+    // copies type, position and every plain field, owned pointers are replaced below
+    *copy = *n;
+    memset(&copy->feedback, 0, sizeof(copy->feedback));
+    if (n->sourceName) copy->sourceName = copyText(n->sourceName);
+
+    switch (n->nodeType) {
+        case NODE_NUMBER_LITERAL:
+        case NODE_BOOL_LITERAL:
+            break;
+
+        case NODE_TEXT_LITERAL:
+        case NODE_VARIABLE_REFERENCE:
+        case NODE_CACHED_VARIABLE_REFERENCE:
+            copy->data.textValue = copyText(n->data.textValue);
+            break;
+
+        case NODE_BINARY_OPERATION:
+        case NODE_INDEX:
+        case NODE_LOGICAL_AND:
+        case NODE_LOGICAL_OR:
+        CASE_NUMBER_BINARY_NODES:
+            copy->data.binary.leftSide = cloneNode(n->data.binary.leftSide);
+            copy->data.binary.rightSide = cloneNode(n->data.binary.rightSide);
+            break;
+
+        case NODE_LOGICAL_NOT:
+        case NODE_AWAIT:
+            copy->data.unary.operand = cloneNode(n->data.unary.operand);
+            break;
+
+        case NODE_VARIABLE_DECLARATION:
+            copy->data.varDeclaration.name = copyText(n->data.varDeclaration.name);
+            copy->data.varDeclaration.node = cloneNode(n->data.varDeclaration.node);
+            break;
+
+        case NODE_VARIABLE_ASSIGN:
+        case NODE_TEMPORARY_SET:
+            copy->data.varAssignment.name = copyText(n->data.varAssignment.name);
+            copy->data.varAssignment.node = cloneNode(n->data.varAssignment.node);
+            break;
+
+        case NODE_FUNCTION_DECLARATION:
+            {
+                const struct ASTFunctionDeclaration* decl = &n->data.funcDeclaration;
+                copy->data.funcDeclaration.name = copyText(decl->name);
+                copy->data.funcDeclaration.parameters = NULL;
+                if (decl->parameterCount > 0) {
+                    copy->data.funcDeclaration.parameters = allocMemory(sizeof(struct Parameter) * decl->parameterCount);
+                    for (size_t i = 0; i < decl->parameterCount; i++) {
+                        copy->data.funcDeclaration.parameters[i].dataType = decl->parameters[i].dataType;
+                        copy->data.funcDeclaration.parameters[i].name = copyText(decl->parameters[i].name);
+                    }
+                }
+                copy->data.funcDeclaration.codeBlock = cloneAST(decl->codeBlock);
+                break;
+            }
+
+        case NODE_FUNCTION_CALL:
+        case NODE_CACHED_FUNCTION_CALL:
+        case NODE_SPAWN:
+            copy->data.funcCall.name = copyText(n->data.funcCall.name);
+            copy->data.funcCall.arguments = NULL;
+            if (n->data.funcCall.argumentCount > 0) {
+                copy->data.funcCall.arguments = allocMemory(sizeof(struct ASTNode*) * n->data.funcCall.argumentCount);
+                for (size_t i = 0; i < n->data.funcCall.argumentCount; i++) {
+                    copy->data.funcCall.arguments[i] = cloneNode(n->data.funcCall.arguments[i]);
+                }
+            }
+            break;
+
+        case NODE_BUILTIN_CALL:
+            copy->data.builtinCall.arguments = NULL;
+            if (n->data.builtinCall.argumentCount > 0) {
+                copy->data.builtinCall.arguments = allocMemory(sizeof(struct ASTNode*) * n->data.builtinCall.argumentCount);
+                for (size_t i = 0; i < n->data.builtinCall.argumentCount; i++) {
+                    copy->data.builtinCall.arguments[i] = cloneNode(n->data.builtinCall.arguments[i]);
+                }
+            }
+            break;
+
+        case NODE_NUMBERS:
+            copy->data.numbers.elements = NULL;
+            if (n->data.numbers.elementCount > 0) {
+                copy->data.numbers.elements = allocMemory(sizeof(struct ASTNode*) * n->data.numbers.elementCount);
+                for (size_t i = 0; i < n->data.numbers.elementCount; i++) {
+                    copy->data.numbers.elements[i] = cloneNode(n->data.numbers.elements[i]);
+                }
+            }
+            break;
+
+        case NODE_MAP:
+            copy->data.map.keys = NULL;
+            copy->data.map.values = NULL;
+            if (n->data.map.entryCount > 0) {
+                copy->data.map.keys = allocMemory(sizeof(struct ASTNode*) * n->data.map.entryCount);
+                copy->data.map.values = allocMemory(sizeof(struct ASTNode*) * n->data.map.entryCount);
+                for (size_t i = 0; i < n->data.map.entryCount; i++) {
+                    copy->data.map.keys[i] = cloneNode(n->data.map.keys[i]);
+                    copy->data.map.values[i] = cloneNode(n->data.map.values[i]);
+                }
+            }
+            break;
+
+        case NODE_INDEX_ASSIGN:
+            copy->data.indexAssignment.name = copyText(n->data.indexAssignment.name);
+            copy->data.indexAssignment.key = cloneNode(n->data.indexAssignment.key);
+            copy->data.indexAssignment.value = cloneNode(n->data.indexAssignment.value);
+            break;
+
+        case NODE_IMPORT:
+            copy->data.import.path = copyText(n->data.import.path);
+            break;
+
+        case NODE_IF_STATEMENT:
+            copy->data.ifStatement.condition = cloneNode(n->data.ifStatement.condition);
+            copy->data.ifStatement.conditionTrueBlock = cloneAST(n->data.ifStatement.conditionTrueBlock);
+            break;
+
+        case NODE_LOOP_STATEMENT:
+            copy->data.loopStatement.loopCount = cloneNode(n->data.loopStatement.loopCount);
+            copy->data.loopStatement.loopCodeBlock = cloneAST(n->data.loopStatement.loopCodeBlock);
+            break;
+
+        case NODE_PARALLEL_LOOP:
+            {
+                const struct ASTParallelLoop* loop = &n->data.parallelLoop;
+                copy->data.parallelLoop.loopCount = cloneNode(loop->loopCount);
+                copy->data.parallelLoop.loopCodeBlock = cloneAST(loop->loopCodeBlock);
+                copy->data.parallelLoop.indexName = loop->indexName ? copyText(loop->indexName) : NULL;
+                copy->data.parallelLoop.reductions = NULL;
+                if (loop->reductionCount > 0) {
+                    copy->data.parallelLoop.reductions = allocMemory(sizeof(struct Reduction) * loop->reductionCount);
+                    for (size_t i = 0; i < loop->reductionCount; i++) {
+                        copy->data.parallelLoop.reductions[i].op = loop->reductions[i].op;
+                        copy->data.parallelLoop.reductions[i].name = copyText(loop->reductions[i].name);
+                    }
+                }
+                copy->data.parallelLoop.sharedNames = cloneNames(loop->sharedNames, loop->sharedCount);
+                copy->data.parallelLoop.locals = cloneNames(loop->locals, loop->localCount);
+                break;
+            }
+
+        case NODE_INLINED_BLOCK:
+            {
+                const struct ASTInlinedBlock* block = &n->data.inlinedBlock;
+                copy->data.inlinedBlock.functionName = copyText(block->functionName);
+                copy->data.inlinedBlock.parameters = NULL;
+                copy->data.inlinedBlock.arguments = NULL;
+                if (block->argumentCount > 0) {
+                    copy->data.inlinedBlock.parameters = allocMemory(sizeof(struct Parameter) * block->argumentCount);
+                    copy->data.inlinedBlock.arguments = allocMemory(sizeof(struct ASTNode*) * block->argumentCount);
+                    for (size_t i = 0; i < block->argumentCount; i++) {
+                        copy->data.inlinedBlock.parameters[i].dataType = block->parameters[i].dataType;
+                        copy->data.inlinedBlock.parameters[i].name = copyText(block->parameters[i].name);
+                        copy->data.inlinedBlock.arguments[i] = cloneNode(block->arguments[i]);
+                    }
+                }
+                copy->data.inlinedBlock.locals = cloneNames(block->locals, block->localCount);
+                copy->data.inlinedBlock.codeBlock = cloneAST(block->codeBlock);
+                break;
+            }
+
+        default:
+            break;
+    }
+    return copy;
+}
+
+struct ASTNodeList* cloneAST(const struct ASTNodeList* ast) {
+    struct ASTNodeList* copy = allocMemory(sizeof(struct ASTNodeList));
+    initAST(copy);
+    for (size_t i = 0; i < ast->count; i++) {
+        appendAST(copy, cloneNode(ast->nodes[i]));
+    }
+    return copy;
+}
+
+static size_t tallyList(const struct ASTNodeList* ast, size_t* byType);
+
+// nodes under n and n itself, counted by type too when byType is given
+static size_t tallyNodes(const struct ASTNode* n, size_t* byType) {
+    if (!n) return 0;
+    if (byType) byType[n->nodeType]++;
+
+    size_t total = 1;
+    switch (n->nodeType) {
+        case NODE_BINARY_OPERATION:
+        case NODE_INDEX:
+        case NODE_LOGICAL_AND:
+        case NODE_LOGICAL_OR:
+        CASE_NUMBER_BINARY_NODES:
+            total += tallyNodes(n->data.binary.leftSide, byType);
+            total += tallyNodes(n->data.binary.rightSide, byType);
+            break;
+        case NODE_LOGICAL_NOT:
+        case NODE_AWAIT:
+            total += tallyNodes(n->data.unary.operand, byType);
+            break;
+        case NODE_VARIABLE_DECLARATION:
+            total += tallyNodes(n->data.varDeclaration.node, byType);
+            break;
+        case NODE_VARIABLE_ASSIGN:
+        case NODE_TEMPORARY_SET:
+            total += tallyNodes(n->data.varAssignment.node, byType);
+            break;
+        case NODE_FUNCTION_DECLARATION:
+            total += tallyList(n->data.funcDeclaration.codeBlock, byType);
+            break;
+        case NODE_FUNCTION_CALL:
+        case NODE_CACHED_FUNCTION_CALL:
+        case NODE_SPAWN:
+            for (size_t i = 0; i < n->data.funcCall.argumentCount; i++) {
+                total += tallyNodes(n->data.funcCall.arguments[i], byType);
+            }
+            break;
+        case NODE_BUILTIN_CALL:
+            for (size_t i = 0; i < n->data.builtinCall.argumentCount; i++) {
+                total += tallyNodes(n->data.builtinCall.arguments[i], byType);
+            }
+            break;
+        case NODE_NUMBERS:
+            for (size_t i = 0; i < n->data.numbers.elementCount; i++) {
+                total += tallyNodes(n->data.numbers.elements[i], byType);
+            }
+            break;
+        case NODE_MAP:
+            for (size_t i = 0; i < n->data.map.entryCount; i++) {
+                total += tallyNodes(n->data.map.keys[i], byType);
+                total += tallyNodes(n->data.map.values[i], byType);
+            }
+            break;
+        case NODE_INDEX_ASSIGN:
+            total += tallyNodes(n->data.indexAssignment.key, byType);
+            total += tallyNodes(n->data.indexAssignment.value, byType);
+            break;
+        case NODE_IF_STATEMENT:
+            total += tallyNodes(n->data.ifStatement.condition, byType);
+            total += tallyList(n->data.ifStatement.conditionTrueBlock, byType);
+            break;
+        case NODE_LOOP_STATEMENT:
+            total += tallyNodes(n->data.loopStatement.loopCount, byType);
+            total += tallyList(n->data.loopStatement.loopCodeBlock, byType);
+            break;
+        case NODE_PARALLEL_LOOP:
+            total += tallyNodes(n->data.parallelLoop.loopCount, byType);
+            total += tallyList(n->data.parallelLoop.loopCodeBlock, byType);
+            break;
+        case NODE_INLINED_BLOCK:
+            for (size_t i = 0; i < n->data.inlinedBlock.argumentCount; i++) {
+                total += tallyNodes(n->data.inlinedBlock.arguments[i], byType);
+            }
+            total += tallyList(n->data.inlinedBlock.codeBlock, byType);
+            break;
+        default:
+            break;
+    }
+    return total;
+}
+
+static size_t tallyList(const struct ASTNodeList* ast, size_t* byType) {
+    size_t total = 0;
+    for (size_t i = 0; i < ast->count; i++) {
+        total += tallyNodes(ast->nodes[i], byType);
+    }
+    return total;
+}
+
+size_t countNodes(const struct ASTNode* n) {
+    return tallyNodes(n, NULL);
+}
+
+size_t countASTNodes(const struct ASTNodeList* ast) {
+    return tallyList(ast, NULL);
+}
+
+size_t countNodeTypes(const struct ASTNodeList* ast, size_t byType[NODE_TYPE_COUNT]) {
+    return tallyList(ast, byType);
+}
@@ -0,0 +1,187 @@
+#include "../include/batch.h"
+#include "../include/parser.h"
+#include "../include/runtime.h"
+#include "../include/threadPool.h"
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// scripts run together before their output is written, bounds buffered output
+#define BATCH_WINDOW 64
+
+struct BatchScript {
+    char*                       path;
+    const struct RunOptions*    options;
+    struct ASTNodeList          program;
+    bool                        parsed;
+    char*                       output;
+    size_t                      outputSize;
+    int                         status;
+};
+
+static void writeScriptOutput(void* data, const char* text, size_t length) {
+    fwrite(text, 1, length, data);
+}
+
+static void runScript(void* argument) {
+    struct BatchScript* script = argument;
+    FILE* output = open_memstream(&script->output, &script->outputSize);
+    if (!output) {
+        printf("Error open_memstream while running %s.\n", script->path);
+        exit(1);
+    }
+
+    struct Interpreter* interp = takeSpareInterpreter(script->options->memoryLimit);
+    struct Interpreter* previousInterpreter = enterInterpreter(interp);
+    struct OutputSink sink = { writeScriptOutput, output };
+    const struct OutputSink* previousSink = setOutputSink(&sink);
+
+    script->status = EXIT_FAILURE;
+    char* source = readSourceFile(script->path);
+    if (!source) {
+        printOutput("Cannot read %s: %s\n", script->path, strerror(errno));
+    } else {
+        // errors print their message into the script's output like a single run would
+        struct ErrorHandler handler;
+        if (setjmp(handler.jump) == 0) {
+            pushErrorHandler(&handler);
+            script->program = parseProgram(source, script->path);
+            script->parsed = true;
+            if (runProgram(&script->program, script->options, &interp->globals)) {
+                script->status = EXIT_SUCCESS;
+            }
+            popErrorHandler(&handler);
+        } else {
+            discardRemainingTasks();
+            printOutput("%s", handler.message);
+        }
+        free(source);
+    }
+    if (script->parsed) destroyAST(&script->program);
+
+    setOutputSink(previousSink);
+    enterInterpreter(previousInterpreter);
+    returnSpareInterpreter(interp);
+    fclose(output);
+}
+
+static int compareNames(const void* a, const void* b) {
+    return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+static void addPath(char*** paths, size_t* count, size_t* capacity, char* path) {
+    if (*count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        *paths = realloc(*paths, sizeof(char*) * *capacity);
+        if (!*paths) {
+            printf("Error realloc while listing batch scripts.\n");
+            exit(1);
+        }
+    }
+    (*paths)[(*count)++] = path;
+}
+
+static char* joinPath(const char* directory, size_t directoryLength, const char* name) {
+    size_t nameLength = strlen(name);
+    char* path = malloc(directoryLength + nameLength + 2);
+    if (!path) {
+        printf("Error malloc while listing batch scripts.\n");
+        exit(1);
+    }
+    memcpy(path, directory, directoryLength);
+    path[directoryLength] = '/';
+    memcpy(path + directoryLength + 1, name, nameLength + 1);
+    return path;
+}
+
+// regular files of the directory, hidden ones skipped, in name order
+static bool listDirectory(const char* directory, char*** paths, size_t* count) {
+    DIR* dir = opendir(directory);
+    if (!dir) return false;
+    size_t capacity = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir))) {
+        if (entry->d_name[0] == '.') continue;
+        char* path = joinPath(directory, strlen(directory), entry->d_name);
+        struct stat info;
+        if (stat(path, &info) != 0 || !S_ISREG(info.st_mode)) {
+            free(path);
+            continue;
+        }
+        addPath(paths, count, &capacity, path);
+    }
+    closedir(dir);
+    qsort(*paths, *count, sizeof(char*), compareNames);
+    return true;
+}
+
+static bool readManifest(const char* manifest, char*** paths, size_t* count) {
+    char* text = readSourceFile(manifest);
+    if (!text) return false;
+    const char* slash = strrchr(manifest, '/');
+    size_t directoryLength = slash ? (size_t) (slash - manifest) : 0;
+
+    size_t capacity = 0;
+    for (char* line = strtok(text, "\n"); line; line = strtok(NULL, "\n")) {
+        size_t length = strlen(line);
+        while (length > 0 && (line[length - 1] == '\r' || line[length - 1] == ' ' || line[length - 1] == '\t')) {
+            line[--length] = '\0';
+        }
+        if (length == 0 || line[0] == '#') continue;
+        char* path = line[0] == '/' || !slash ? strdup(line) : joinPath(manifest, directoryLength, line);
+        addPath(paths, count, &capacity, path);
+    }
+    free(text);
+    return true;
+}
+
+int runBatch(const char* path, const struct RunOptions* options) {
+    char** paths = NULL;
+    size_t count = 0;
+    struct stat info;
+    bool listed = stat(path, &info) == 0 && S_ISDIR(info.st_mode)
+        ? listDirectory(path, &paths, &count)
+        : readManifest(path, &paths, &count);
+    if (!listed) {
+        fprintf(stderr, "batch: cannot read %s: %s\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    struct BatchScript* scripts = calloc(BATCH_WINDOW, sizeof(struct BatchScript));
+    if (!scripts) {
+        printf("Error calloc while running batch.\n");
+        exit(1);
+    }
+    size_t failed = 0;
+    for (size_t first = 0; first < count; first += BATCH_WINDOW) {
+        size_t windowSize = count - first < BATCH_WINDOW ? count - first : BATCH_WINDOW;
+        struct TaskGroup group;
+        initTaskGroup(&group);
+        for (size_t i = 0; i < windowSize; i++) {
+            memset(&scripts[i], 0, sizeof(struct BatchScript));
+            scripts[i].path = paths[first + i];
+            scripts[i].options = options;
+            submitTask(&group, runScript, &scripts[i]);
+        }
+        waitTaskGroup(&group);
+
+        for (size_t i = 0; i < windowSize; i++) {
+            printf("==> %s (exit %d) <==\n", scripts[i].path, scripts[i].status);
+            fwrite(scripts[i].output, 1, scripts[i].outputSize, stdout);
+            free(scripts[i].output);
+            if (scripts[i].status != EXIT_SUCCESS) failed++;
+        }
+    }
+    fflush(stdout);
+    fprintf(stderr, "batch: %zu script(s), %zu failed\n", count, failed);
+
+    for (size_t i = 0; i < count; i++) free(paths[i]);
+    free(paths);
+    free(scripts);
+    destroySpareInterpreters();
+    
+    return failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
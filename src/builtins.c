@@ -0,0 +1,222 @@
+#include "../include/builtins.h"
+#include "../include/allocator.h"
+#include "../include/runtime.h"
+#include "../include/numbers.h"
+#include "../include/map.h"
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static void releaseArguments(const struct ASTNode* node, const struct Value* arguments) {
+    const struct ASTBuiltinCall* call = &node->data.builtinCall;
+    for (size_t i = 0; i < call->argumentCount; i++) {
+        releaseTemporary(call->arguments[i], arguments[i]);
+    }
+}
+
+static _Noreturn void failBuiltin(const struct ASTNode* node, const struct Value* arguments, const char* format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+static _Noreturn void failBuiltin(const struct ASTNode* node, const struct Value* arguments, const char* format, ...) {
+    char message[ERROR_MESSAGE_SIZE];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    releaseArguments(node, arguments);
+    raiseError("%s", message);
+}
+
+// OUTPUT AND TIME
+
+static struct Value runPrint(const struct ASTNode* node, const struct Value* arguments) {
+    (void) node;
+    printValue(arguments[0]);
+    return createNumberValue(0);
+}
+
+// seconds from an arbitrary start, for timing parts of a program
+static struct Value runClock(const struct ASTNode* node, const struct Value* arguments) {
+    (void) node;
+    (void) arguments;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return createNumberValue((double) now.tv_sec + (double) now.tv_nsec / 1e9);
+}
+
+// where --snapshot saves the globals, see snapshot.h, nothing otherwise
+static struct Value runSnapshot(const struct ASTNode* node, const struct Value* arguments) {
+    (void) node;
+    (void) arguments;
+    return createNumberValue(0);
+}
+
+// MATH
+
+static struct Value runSqrt(const struct ASTNode* node, const struct Value* arguments) {
+    (void) node;
+    return createNumberValue(sqrt(arguments[0].data.number));
+}
+
+static struct Value runFloor(const struct ASTNode* node, const struct Value* arguments) {
+    (void) node;
+    return createNumberValue(floor(arguments[0].data.number));
+}
+
+static struct Value runPow(const struct ASTNode* node, const struct Value* arguments) {
+    (void) node;
+    return createNumberValue(pow(arguments[0].data.number, arguments[1].data.number));
+}
+
+// NUMBERS
+
+static struct Value runRange(const struct ASTNode* node, const struct Value* arguments) {
+    double step = node->data.builtinCall.argumentCount == 3 ? arguments[2].data.number : 1.0;
+    return buildRange(node, arguments[0].data.number, arguments[1].data.number, step);
+}
+
+static struct Value runSum(const struct ASTNode* node, const struct Value* arguments) {
+    (void) node;
+    return createNumberValue(sumNumbers(arguments[0].data.numbers));
+}
+
+static struct Value runMin(const struct ASTNode* node, const struct Value* arguments) {
+    if (arguments[0].data.numbers->length == 0) {
+        failBuiltin(node, arguments, "min of empty numbers, line %zu\n", node->line);
+    }
+    return createNumberValue(minNumbers(arguments[0].data.numbers));
+}
+
+static struct Value runMax(const struct ASTNode* node, const struct Value* arguments) {
+    if (arguments[0].data.numbers->length == 0) {
+        failBuiltin(node, arguments, "max of empty numbers, line %zu\n", node->line);
+    }
+    return createNumberValue(maxNumbers(arguments[0].data.numbers));
+}
+
+static struct Value runDot(const struct ASTNode* node, const struct Value* arguments) {
+    const struct NumberArray* left = arguments[0].data.numbers;
+    const struct NumberArray* right = arguments[1].data.numbers;
+    if (left->length != right->length) {
+        failBuiltin(node, arguments, "dot of numbers with different lengths (%zu and %zu), line %zu\n",
+            left->length, right->length, node->line);
+    }
+    return createNumberValue(dotNumbers(left, right));
+}
+
+// MAPS
+
+static struct Value runHas(const struct ASTNode* node, const struct Value* arguments) {
+    (void) node;
+    return createBoolValue(findMapEntry(arguments[0].data.map, arguments[1]) != NULL);
+}
+
+static struct Value runRemove(const struct ASTNode* node, const struct Value* arguments) {
+    (void) node;
+    return createBoolValue(removeMapEntry(arguments[0].data.map, arguments[1]));
+}
+
+// entries of a map or elements of numbers
+static struct Value runCount(const struct ASTNode* node, const struct Value* arguments) {
+    if (arguments[0].type == VALUE_MAP) {
+        return createNumberValue((double) arguments[0].data.map->count);
+    }
+    if (arguments[0].type == VALUE_NUMBERS) {
+        return createNumberValue((double) arguments[0].data.numbers->length);
+    }
+    failBuiltin(node, arguments, "count needs a map or numbers, line %zu\n", node->line);
+}
+
+// entry i in insertion order, for iterating with loop count(m)
+static const struct MapEntry* entryAt(const struct ASTNode* node, const struct Value* arguments) {
+    const struct Map* map = arguments[0].data.map;
+    double position = arguments[1].data.number;
+    if (!(position >= 0) || position >= (double) map->count || position != (double) (size_t) position) {
+        failBuiltin(node, arguments, "Position %g is not an entry of a map with %zu entries, line %zu\n",
+            position, map->count, node->line);
+    }
+    return &map->entries[(size_t) position];
+}
+
+// a copy of a key or value, the entry stays the map's
+static struct Value copyOut(const struct Map* map, struct Value val) {
+    if (val.type == VALUE_TEXT) {
+        val.data.text = copyText(val.data.text);
+    } else if (val.type == VALUE_NUMBERS && atomic_load(&map->refcount) == 0) {
+        // the map is freed with the arguments, the array has to outlive it
+        struct NumberArray* array = createNumberArray(val.data.numbers->length);
+        memcpy(array->data, val.data.numbers->data, sizeof(double) * array->length);
+        val = createNumbersValue(array);
+    }
+    return val;
+}
+
+static struct Value runKeyAt(const struct ASTNode* node, const struct Value* arguments) {
+    return copyOut(arguments[0].data.map, entryAt(node, arguments)->key);
+}
+
+static struct Value runValueAt(const struct ASTNode* node, const struct Value* arguments) {
+    return copyOut(arguments[0].data.map, entryAt(node, arguments)->value);
+}
+
+// REGISTRY
+
+static const struct Builtin builtins[] = {
+    // name     function    parameters                                          required, count, result, pure
+    { "print",  runPrint,   { STATIC_UNKNOWN },                                 1, 1, STATIC_NUMBER,  false },
+    { "clock",  runClock,   { 0 },                                              0, 0, STATIC_NUMBER,  false },
+    { "snapshot", runSnapshot, { 0 },                                           0, 0, STATIC_NUMBER,  false },
+    { "sqrt",   runSqrt,    { STATIC_NUMBER },                                  1, 1, STATIC_NUMBER,  true },
+    { "floor",  runFloor,   { STATIC_NUMBER },                                  1, 1, STATIC_NUMBER,  true },
+    { "pow",    runPow,     { STATIC_NUMBER, STATIC_NUMBER },                   2, 2, STATIC_NUMBER,  true },
+    { "range",  runRange,   { STATIC_NUMBER, STATIC_NUMBER, STATIC_NUMBER },    2, 3, STATIC_NUMBERS, true },
+    { "sum",    runSum,     { STATIC_NUMBERS },                                 1, 1, STATIC_NUMBER,  true },
+    { "min",    runMin,     { STATIC_NUMBERS },                                 1, 1, STATIC_NUMBER,  true },
+    { "max",    runMax,     { STATIC_NUMBERS },                                 1, 1, STATIC_NUMBER,  true },
+    { "dot",    runDot,     { STATIC_NUMBERS, STATIC_NUMBERS },                 2, 2, STATIC_NUMBER,  true },
+    { "has",    runHas,     { STATIC_MAP, STATIC_UNKNOWN },                     2, 2, STATIC_BOOL,    true },
+    { "remove", runRemove,  { STATIC_MAP, STATIC_UNKNOWN },                     2, 2, STATIC_BOOL,    false },
+    { "count",  runCount,   { STATIC_UNKNOWN },                                 1, 1, STATIC_NUMBER,  true },
+    { "keyAt",  runKeyAt,   { STATIC_MAP, STATIC_NUMBER },                      2, 2, STATIC_UNKNOWN, true },
+    { "valueAt", runValueAt, { STATIC_MAP, STATIC_NUMBER },                     2, 2, STATIC_UNKNOWN, true },
+};
+
+const struct Builtin* findBuiltin(const char* name, size_t length) {
+    for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++) {
+        if (strlen(builtins[i].name) == length && strncmp(builtins[i].name, name, length) == 0) {
+            return &builtins[i];
+        }
+    }
+    return NULL;
+}
+
+static bool hasStaticType(struct Value val, enum StaticType type) {
+    switch (type) {
+        case STATIC_UNKNOWN:    return true;
+        case STATIC_NUMBER:     return val.type == VALUE_NUMBER;
+        case STATIC_TEXT:       return val.type == VALUE_TEXT;
+        case STATIC_BOOL:       return val.type == VALUE_BOOL;
+        case STATIC_TASK:       return val.type == VALUE_TASK;
+        case STATIC_NUMBERS:    return val.type == VALUE_NUMBERS;
+        case STATIC_MAP:        return val.type == VALUE_MAP;
+        default:                return false;
+    }
+}
+
+struct Value callBuiltin(const struct ASTNode* node, struct Value* arguments) {
+    const struct ASTBuiltinCall* call = &node->data.builtinCall;
+    const struct Builtin* builtin = call->builtin;
+    if (!call->typeChecked) {
+        for (size_t i = 0; i < call->argumentCount; i++) {
+            if (!hasStaticType(arguments[i], builtin->parameters[i])) {
+                failBuiltin(node, arguments, "Argument %zu of %s should be %s, line %zu\n",
+                    i + 1, builtin->name, staticTypeName(builtin->parameters[i]), node->line);
+            }
+        }
+    }
+    struct Value result = builtin->run(node, arguments);
+    releaseArguments(node, arguments);
+    return result;
+}
@@ -0,0 +1,992 @@
+#include "../include/closureCompiler.h"
+#include "../include/allocator.h"
+#include "../include/runtime.h"
+#include "../include/typeHelper.h"
+#include "../include/parallelLoop.h"
+#include "../include/tasks.h"
+#include "../include/numbers.h"
+#include "../include/builtins.h"
+#include "../include/map.h"
+#include "../include/modules.h"
+#include "../include/profiler.h"
+#include "../include/trace.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+// compiled ASTNodeList
+struct ClosureBlock {
+    const struct Closure**  statements;
+    bool*                   prints;     // bare variable references print their value
+    size_t                  count;
+};
+
+struct CompiledFunction {
+    const struct ASTNode*   declaration;
+    struct ClosureBlock     body;
+};
+
+struct CompiledProgram {
+    struct ClosureBlock         main;
+
+    // sorted by declaration address, calls find the body of the function value they get
+    struct CompiledFunction*    functions;
+    size_t                      functionCount;
+
+    // everything allocated while compiling, freed together
+    void**                      allocations;
+    size_t                      allocationCount;
+    size_t                      allocationCapacity;
+};
+
+struct LiteralClosure {
+    struct Closure  base;
+    struct Value    value;
+};
+
+struct NameClosure {
+    struct Closure  base;
+    const char*     name;
+    unsigned long   nameHash;
+};
+
+struct BinaryClosure {
+    struct Closure          base;
+    const struct Closure*   left;
+    const struct Closure*   right;
+};
+
+struct DeclarationClosure {
+    struct Closure          base;
+    const char*             name;
+    unsigned long           nameHash;
+    enum TokenType          dataType;
+    bool                    typeChecked;
+    const struct Closure*   value;
+};
+
+struct CallClosure {
+    struct Closure                  base;
+    const char*                     name;
+    unsigned long                   nameHash;
+    const struct Closure**          arguments;
+    size_t                          argumentCount;
+    bool                            typeChecked;
+    const struct CompiledProgram*   program;
+};
+
+struct NumbersClosure {
+    struct Closure          base;
+    const struct Closure**  elements;
+    size_t                  elementCount;
+};
+
+struct MapClosure {
+    struct Closure          base;
+    const struct Closure**  keys;
+    const struct Closure**  values;
+    size_t                  entryCount;
+};
+
+struct IndexAssignClosure {
+    struct Closure          base;
+    const char*             name;
+    unsigned long           nameHash;
+    const struct Closure*   key;
+    const struct Closure*   value;
+};
+
+struct BuiltinClosure {
+    struct Closure          base;
+    const struct Closure**  arguments;
+    size_t                  argumentCount;
+};
+
+struct UnaryClosure {
+    struct Closure          base;
+    const struct Closure*   operand;
+};
+
+struct BlockClosure {
+    struct Closure          base;
+    const struct Closure*   expression;     // loop count
+    struct ClosureBlock     block;
+};
+
+// conditions of if statements and logical operators are compiled into Conditions,
+// which branch on a C bool instead of creating a boolean Value
+struct Condition;
+typedef bool (*ConditionFunction)(const struct Condition* condition, struct Environment* env);
+
+struct Condition {
+    ConditionFunction       test;
+    const struct ASTNode*   node;
+};
+
+struct CompareCondition {
+    struct Condition        base;
+    const struct Closure*   left;
+    const struct Closure*   right;
+    const struct ASTNode*   owner;      // for the error when numbers are compared
+};
+
+struct LogicalCondition {
+    struct Condition        base;
+    const struct Condition* left;       // operand of '!'
+    const struct Condition* right;
+};
+
+struct ValueCondition {
+    struct Condition        base;
+    const struct Closure*   value;
+    const struct ASTNode*   owner;      // if statement or logical operator, for the error message
+};
+
+struct ConditionClosure {
+    struct Closure          base;
+    const struct Condition* condition;
+};
+
+struct IfClosure {
+    struct Closure          base;
+    const struct Condition* condition;
+    struct ClosureBlock     block;
+};
+
+struct InlinedClosure {
+    struct Closure          base;
+    const struct Closure**  arguments;
+    const struct Parameter* parameters;
+    unsigned long*          parameterHashes;
+    size_t                  argumentCount;
+    bool                    typeChecked;
+    struct ClosureBlock     block;
+    char**                  locals;
+    size_t                  localCount;
+};
+
+static void* compilerAlloc(struct CompiledProgram* compiled, size_t size) {
+    if (compiled->allocationCount >= compiled->allocationCapacity) {
+        compiled->allocationCapacity = compiled->allocationCapacity ? compiled->allocationCapacity * 2 : 64;
+        compiled->allocations = resizeMemory(compiled->allocations, sizeof(void*) * compiled->allocationCapacity);
+    }
+    void* memory = allocZeroed(1, size ? size : 1);
+    if (!memory) {
+        raiseError("Error calloc while compiling closures.\n");
+    }
+    compiled->allocations[compiled->allocationCount++] = memory;
+    return memory;
+}
+
+static void runBlock(const struct ClosureBlock* block, struct Environment* env) {
+    for (size_t i = 0; i < block->count; i++) {
+        const struct Closure* statement = block->statements[i];
+        profileStatement(statement->node);
+        struct Value val = statement->run(statement, env);
+        if (block->prints[i]) {
+            printValue(val);
+        }
+        discardTemporary(val);
+    }
+}
+
+static const struct CompiledFunction* findFunction(const struct CompiledProgram* program, const struct ASTNode* declaration) {
+    size_t low = 0;
+    size_t high = program->functionCount;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        const struct ASTNode* candidate = program->functions[mid].declaration;
+        if (candidate == declaration) return &program->functions[mid];
+        if ((uintptr_t) candidate < (uintptr_t) declaration) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return NULL;
+}
+
+// LITERALS
+
+static struct Value runLiteral(const struct Closure* closure, struct Environment* env) {
+    (void) env;
+    return ((const struct LiteralClosure*) closure)->value;
+}
+
+static struct Value runTextLiteral(const struct Closure* closure, struct Environment* env) {
+    (void) env;
+    return createTextValue(copyText(((const struct LiteralClosure*) closure)->value.data.text));
+}
+
+// VARIABLES
+
+static bool readsVariable(const struct Closure* closure) {
+    return closure->node->nodeType == NODE_VARIABLE_REFERENCE || closure->node->nodeType == NODE_CACHED_VARIABLE_REFERENCE;
+}
+
+static struct Value runVariableReference(const struct Closure* closure, struct Environment* env) {
+    const struct NameClosure* reference = (const struct NameClosure*) closure;
+    struct Value* val = getValueHashed(env, reference->name, reference->nameHash);
+    if (!val) {
+        raiseError("Variable reference %s does not exist, line %zu\n", reportedName(closure->node, reference->name),
+            closure->node->line);
+    }
+    return *val;
+}
+
+static struct Value runVariableDeclaration(const struct Closure* closure, struct Environment* env) {
+    const struct DeclarationClosure* decl = (const struct DeclarationClosure*) closure;
+    if (getValueHashed(env, decl->name, decl->nameHash)) {
+        raiseError("Variable with name '%s' already exists, therefore cannot declare with same name. Line %zu\n",
+            reportedName(closure->node, decl->name), closure->node->line);
+    }
+    struct Value val = decl->value->run(decl->value, env);
+    if (!decl->typeChecked && !doesDataTypeMatchesData(val.type, decl->dataType)) {
+        raiseError("Cannot assign variable at line %zu, data and type does not match.\n", closure->node->line);
+    }
+    // text read from another variable stays that variable's, each frees its own
+    if (val.type == VALUE_TEXT && readsVariable(decl->value)) {
+        val.data.text = copyText(val.data.text);
+    }
+    setValueHashed(env, decl->name, decl->nameHash, val);
+    return val;
+}
+
+static struct Value runVariableAssignment(const struct Closure* closure, struct Environment* env) {
+    const struct DeclarationClosure* assign = (const struct DeclarationClosure*) closure;
+    struct Value* previousData = getValueHashed(env, assign->name, assign->nameHash);
+    if (!previousData) {
+        raiseError("Variable reference on line %zu does not exist, therefore cannot assign value.\n", closure->node->line);
+    }
+    struct Value val = assign->value->run(assign->value, env);
+    if (!assign->typeChecked && previousData->type != val.type) {
+        raiseError("Assigning variable datatype does not match on line %zu.\n", closure->node->line);
+    }
+    if (val.type == VALUE_TEXT && readsVariable(assign->value)) {
+        val.data.text = copyText(val.data.text);
+    }
+    setValueHashed(env, assign->name, assign->nameHash, val);
+    return val;
+}
+
+static struct Value runTemporarySet(const struct Closure* closure, struct Environment* env) {
+    const struct DeclarationClosure* temporary = (const struct DeclarationClosure*) closure;
+    struct Value val = temporary->value->run(temporary->value, env);
+    setValueHashed(env, temporary->name, temporary->nameHash, val);
+    return val;
+}
+
+// BINARY OPERATIONS
+
+// operands checked at runtime, anything but two numbers goes to applyBinaryOperator for its error
+#define CHECKED_OPERATOR_CLOSURE(functionName, expression) \
+    static struct Value functionName(const struct Closure* closure, struct Environment* env) { \
+        const struct BinaryClosure* binary = (const struct BinaryClosure*) closure; \
+        struct Value l = binary->left->run(binary->left, env); \
+        struct Value r = binary->right->run(binary->right, env); \
+        if (l.type != VALUE_NUMBER || r.type != VALUE_NUMBER) { \
+            return applyBinaryOperator(closure->node, l, r); \
+        } \
+        double left = l.data.number; \
+        double right = r.data.number; \
+        return expression; \
+    }
+
+// operands proven to be numbers by the type checker
+#define NUMBER_OPERATOR_CLOSURE(functionName, expression) \
+    static struct Value functionName(const struct Closure* closure, struct Environment* env) { \
+        const struct BinaryClosure* binary = (const struct BinaryClosure*) closure; \
+        double left = binary->left->run(binary->left, env).data.number; \
+        double right = binary->right->run(binary->right, env).data.number; \
+        return expression; \
+    }
+
+CHECKED_OPERATOR_CLOSURE(runCheckedAdd, createNumberValue(left + right))
+CHECKED_OPERATOR_CLOSURE(runCheckedSubtract, createNumberValue(left - right))
+CHECKED_OPERATOR_CLOSURE(runCheckedMultiply, createNumberValue(left * right))
+CHECKED_OPERATOR_CLOSURE(runCheckedDivide, applyNumberOperator(closure->node, left, right))
+CHECKED_OPERATOR_CLOSURE(runCheckedEqual, createBoolValue(left == right))
+CHECKED_OPERATOR_CLOSURE(runCheckedNotEqual, createBoolValue(left != right))
+CHECKED_OPERATOR_CLOSURE(runCheckedLess, createBoolValue(left < right))
+CHECKED_OPERATOR_CLOSURE(runCheckedGreater, createBoolValue(left > right))
+CHECKED_OPERATOR_CLOSURE(runCheckedLesserEqual, createBoolValue(left <= right))
+CHECKED_OPERATOR_CLOSURE(runCheckedGreaterEqual, createBoolValue(left >= right))
+
+NUMBER_OPERATOR_CLOSURE(runNumberAdd, createNumberValue(left + right))
+NUMBER_OPERATOR_CLOSURE(runNumberSubtract, createNumberValue(left - right))
+NUMBER_OPERATOR_CLOSURE(runNumberMultiply, createNumberValue(left * right))
+NUMBER_OPERATOR_CLOSURE(runNumberDivide, applyNumberOperator(closure->node, left, right))
+NUMBER_OPERATOR_CLOSURE(runNumberEqual, createBoolValue(left == right))
+NUMBER_OPERATOR_CLOSURE(runNumberNotEqual, createBoolValue(left != right))
+NUMBER_OPERATOR_CLOSURE(runNumberLess, createBoolValue(left < right))
+NUMBER_OPERATOR_CLOSURE(runNumberGreater, createBoolValue(left > right))
+NUMBER_OPERATOR_CLOSURE(runNumberLesserEqual, createBoolValue(left <= right))
+NUMBER_OPERATOR_CLOSURE(runNumberGreaterEqual, createBoolValue(left >= right))
+
+static ClosureFunction checkedOperator(enum BinaryOperatorTypes op) {
+    switch (op) {
+        case BIN_OP_PLUS:           return runCheckedAdd;
+        case BIN_OP_MINUS:          return runCheckedSubtract;
+        case BIN_OP_STAR:           return runCheckedMultiply;
+        case BIN_OP_SLASH:          return runCheckedDivide;
+        case BIN_OP_EQUALITY:       return runCheckedEqual;
+        case BIN_OP_NOT_EQUAL:      return runCheckedNotEqual;
+        case BIN_OP_LESS:           return runCheckedLess;
+        case BIN_OP_GREATER:        return runCheckedGreater;
+        case BIN_OP_LESSER_EQUAL:   return runCheckedLesserEqual;
+        case BIN_OP_GREATER_EQUAL:  return runCheckedGreaterEqual;
+        default:                    return NULL;
+    }
+}
+
+static ClosureFunction numberOperator(enum ASTNodeType type) {
+    switch (type) {
+        case NODE_NUMBER_ADD:           return runNumberAdd;
+        case NODE_NUMBER_SUBTRACT:      return runNumberSubtract;
+        case NODE_NUMBER_MULTIPLY:      return runNumberMultiply;
+        case NODE_NUMBER_DIVIDE:        return runNumberDivide;
+        case NODE_NUMBER_EQUAL:         return runNumberEqual;
+        case NODE_NUMBER_NOT_EQUAL:     return runNumberNotEqual;
+        case NODE_NUMBER_LESS:          return runNumberLess;
+        case NODE_NUMBER_GREATER:       return runNumberGreater;
+        case NODE_NUMBER_LESSER_EQUAL:  return runNumberLesserEqual;
+        case NODE_NUMBER_GREATER_EQUAL: return runNumberGreaterEqual;
+        default:                        return NULL;
+    }
+}
+
+// CONDITIONS
+
+#define CHECKED_COMPARE_CONDITION(functionName, operator) \
+    static bool functionName(const struct Condition* condition, struct Environment* env) { \
+        const struct CompareCondition* compare = (const struct CompareCondition*) condition; \
+        struct Value l = compare->left->run(compare->left, env); \
+        struct Value r = compare->right->run(compare->right, env); \
+        if (l.type != VALUE_NUMBER || r.type != VALUE_NUMBER) { \
+            struct Value val = applyBinaryOperator(condition->node, l, r); \
+            discardTemporary(val); \
+            return requireBoolValue(val, compare->owner); \
+        } \
+        return l.data.number operator r.data.number; \
+    }
+
+#define NUMBER_COMPARE_CONDITION(functionName, operator) \
+    static bool functionName(const struct Condition* condition, struct Environment* env) { \
+        const struct CompareCondition* compare = (const struct CompareCondition*) condition; \
+        double left = compare->left->run(compare->left, env).data.number; \
+        return left operator compare->right->run(compare->right, env).data.number; \
+    }
+
+CHECKED_COMPARE_CONDITION(testCheckedEqual, ==)
+CHECKED_COMPARE_CONDITION(testCheckedNotEqual, !=)
+CHECKED_COMPARE_CONDITION(testCheckedLess, <)
+CHECKED_COMPARE_CONDITION(testCheckedGreater, >)
+CHECKED_COMPARE_CONDITION(testCheckedLesserEqual, <=)
+CHECKED_COMPARE_CONDITION(testCheckedGreaterEqual, >=)
+
+NUMBER_COMPARE_CONDITION(testNumberEqual, ==)
+NUMBER_COMPARE_CONDITION(testNumberNotEqual, !=)
+NUMBER_COMPARE_CONDITION(testNumberLess, <)
+NUMBER_COMPARE_CONDITION(testNumberGreater, >)
+NUMBER_COMPARE_CONDITION(testNumberLesserEqual, <=)
+NUMBER_COMPARE_CONDITION(testNumberGreaterEqual, >=)
+
+static ConditionFunction checkedComparison(enum BinaryOperatorTypes op) {
+    switch (op) {
+        case BIN_OP_EQUALITY:       return testCheckedEqual;
+        case BIN_OP_NOT_EQUAL:      return testCheckedNotEqual;
+        case BIN_OP_LESS:           return testCheckedLess;
+        case BIN_OP_GREATER:        return testCheckedGreater;
+        case BIN_OP_LESSER_EQUAL:   return testCheckedLesserEqual;
+        case BIN_OP_GREATER_EQUAL:  return testCheckedGreaterEqual;
+        default:                    return NULL;
+    }
+}
+
+static ConditionFunction numberComparison(enum ASTNodeType type) {
+    switch (type) {
+        case NODE_NUMBER_EQUAL:         return testNumberEqual;
+        case NODE_NUMBER_NOT_EQUAL:     return testNumberNotEqual;
+        case NODE_NUMBER_LESS:          return testNumberLess;
+        case NODE_NUMBER_GREATER:       return testNumberGreater;
+        case NODE_NUMBER_LESSER_EQUAL:  return testNumberLesserEqual;
+        case NODE_NUMBER_GREATER_EQUAL: return testNumberGreaterEqual;
+        default:                        return NULL;
+    }
+}
+
+static bool testAnd(const struct Condition* condition, struct Environment* env) {
+    const struct LogicalCondition* logical = (const struct LogicalCondition*) condition;
+    return logical->left->test(logical->left, env) && logical->right->test(logical->right, env);
+}
+
+static bool testOr(const struct Condition* condition, struct Environment* env) {
+    const struct LogicalCondition* logical = (const struct LogicalCondition*) condition;
+    return logical->left->test(logical->left, env) || logical->right->test(logical->right, env);
+}
+
+static bool testNot(const struct Condition* condition, struct Environment* env) {
+    const struct LogicalCondition* logical = (const struct LogicalCondition*) condition;
+    return !logical->left->test(logical->left, env);
+}
+
+static bool testValue(const struct Condition* condition, struct Environment* env) {
+    const struct ValueCondition* value = (const struct ValueCondition*) condition;
+    return requireBoolValue(value->value->run(value->value, env), value->owner);
+}
+
+static struct Value runCondition(const struct Closure* closure, struct Environment* env) {
+    const struct Condition* condition = ((const struct ConditionClosure*) closure)->condition;
+    return createBoolValue(condition->test(condition, env));
+}
+
+// FUNCTIONS
+
+static struct Value runFunctionDeclaration(const struct Closure* closure, struct Environment* env) {
+    const struct NameClosure* decl = (const struct NameClosure*) closure;
+    struct Value val = createFunctionValue(closure->node->data.funcDeclaration.codeBlock);
+    val.originNode = closure->node;
+    setValueHashed(env, decl->name, decl->nameHash, val);
+    return val;
+}
+
+// checks the call and binds its arguments in a fresh scope, entered, returns the function to run there
+static const struct CompiledFunction* prepareCompiledCall(const struct CallClosure* call, struct Environment* env,
+        struct CallScope* scope) {
+    const struct ASTNode* node = call->base.node;
+
+    struct Value* function = getValueHashed(env, call->name, call->nameHash);
+    if (!function || function->type != VALUE_FUNCTION) {
+        raiseError("Function %s does not exist, line %zu\n", call->name, node->line);
+    }
+    const struct ASTFunctionDeclaration* funcDeclaration = &function->originNode->data.funcDeclaration;
+    const struct CompiledFunction* compiled = findFunction(call->program, function->originNode);
+
+    if (!call->typeChecked && funcDeclaration->parameterCount != call->argumentCount) {
+        raiseError("Argument count does not match. Expected %zu, got %zu. Line %zu\n",
+            funcDeclaration->parameterCount, call->argumentCount, node->line);
+    }
+
+    createEnvironment(&scope->env);
+    enterCallScope(scope);
+
+    for (size_t i = 0; i < call->argumentCount; i++) {
+        struct Value argVal = call->arguments[i]->run(call->arguments[i], env);
+        if (!call->typeChecked && !doesDataTypeMatchesData(argVal.type, funcDeclaration->parameters[i].dataType)) {
+            raiseError("Datatype of argument does not match relative parameter datatype, line %zu\n", node->line);
+        }
+        // text read from a variable still belongs to the caller, the scope frees what it holds
+        if (argVal.type == VALUE_TEXT && readsVariable(call->arguments[i])) {
+            argVal.data.text = copyText(argVal.data.text);
+        }
+        // a task gets its own copy of a map, it runs on another thread
+        if (argVal.type == VALUE_MAP && node->nodeType == NODE_SPAWN) {
+            argVal = detachMap(argVal);
+        }
+        setValue(&scope->env, funcDeclaration->parameters[i].name, argVal);
+    }
+    return compiled;
+}
+
+static void runFunctionBody(const struct CompiledFunction* function, struct Environment* env) {
+    profileEnter(function->declaration->data.funcDeclaration.name);
+    runBlock(&function->body, env);
+    profileLeave();
+}
+
+static struct Value runFunctionCall(const struct Closure* closure, struct Environment* env) {
+    const struct CallClosure* call = (const struct CallClosure*) closure;
+    struct CallScope scope;
+    const struct CompiledFunction* function = prepareCompiledCall(call, env, &scope);
+    uint64_t start = traceStart();
+    runFunctionBody(function, &scope.env);
+    traceSpan(TRACE_CALL, function->declaration->data.funcDeclaration.name, call->argumentCount, closure->node->line, start);
+    leaveCallScope(&scope);
+    freeEnvironment(&scope.env);
+    return createNumberValue(0);
+}
+
+static struct Value runImport(const struct Closure* closure, struct Environment* env) {
+    runBlock(&((const struct BlockClosure*) closure)->block, env);
+    return createNumberValue(0);
+}
+
+static void runTaskBlock(const void* body, struct Environment* env) {
+    runFunctionBody(body, env);
+}
+
+static struct Value runSpawn(const struct Closure* closure, struct Environment* env) {
+    struct CallScope scope;
+    const struct CompiledFunction* function = prepareCompiledCall((const struct CallClosure*) closure, env, &scope);
+    // the task frees the scope
+    leaveCallScope(&scope);
+    return spawnTask(function, runTaskBlock, &scope.env);
+}
+
+static struct Value runAwait(const struct Closure* closure, struct Environment* env) {
+    const struct UnaryClosure* await = (const struct UnaryClosure*) closure;
+    return awaitTask(closure->node, await->operand->run(await->operand, env));
+}
+
+static struct Value runInlinedBlock(const struct Closure* closure, struct Environment* env) {
+    const struct InlinedClosure* inlined = (const struct InlinedClosure*) closure;
+    for (size_t i = 0; i < inlined->argumentCount; i++) {
+        struct Value argVal = inlined->arguments[i]->run(inlined->arguments[i], env);
+        if (!inlined->typeChecked && !doesDataTypeMatchesData(argVal.type, inlined->parameters[i].dataType)) {
+            raiseError("Datatype of argument does not match relative parameter datatype, line %zu\n", closure->node->line);
+        }
+        // like a call, the renamed parameter is removed with the locals and frees its text
+        if (argVal.type == VALUE_TEXT && readsVariable(inlined->arguments[i])) {
+            argVal.data.text = copyText(argVal.data.text);
+        }
+        setValueHashed(env, inlined->parameters[i].name, inlined->parameterHashes[i], argVal);
+    }
+
+    runBlock(&inlined->block, env);
+
+    for (size_t i = 0; i < inlined->localCount; i++) {
+        removeValue(env, inlined->locals[i]);
+    }
+    return createNumberValue(0);
+}
+
+static struct Value runBuiltinCall(const struct Closure* closure, struct Environment* env) {
+    const struct BuiltinClosure* call = (const struct BuiltinClosure*) closure;
+    struct Value arguments[MAX_BUILTIN_PARAMETERS];
+    for (size_t i = 0; i < call->argumentCount; i++) {
+        arguments[i] = call->arguments[i]->run(call->arguments[i], env);
+    }
+    return callBuiltin(closure->node, arguments);
+}
+
+// NUMBERS
+
+static struct Value runNumbersLiteral(const struct Closure* closure, struct Environment* env) {
+    const struct NumbersClosure* numbers = (const struct NumbersClosure*) closure;
+    struct NumberArray* array = createNumberArray(numbers->elementCount);
+    for (size_t i = 0; i < numbers->elementCount; i++) {
+        const struct Closure* element = numbers->elements[i];
+        storeNumbersElement(closure->node, array, i, element->run(element, env));
+    }
+    return createNumbersValue(array);
+}
+
+static struct Value runIndex(const struct Closure* closure, struct Environment* env) {
+    const struct BinaryClosure* index = (const struct BinaryClosure*) closure;
+    struct Value container = index->left->run(index->left, env);
+    struct Value key = index->right->run(index->right, env);
+    if (container.type == VALUE_MAP) {
+        return indexMap(closure->node, container, key);
+    }
+    return indexNumbers(closure->node, container, key);
+}
+
+// MAPS
+
+static struct Value runMapLiteral(const struct Closure* closure, struct Environment* env) {
+    const struct MapClosure* literal = (const struct MapClosure*) closure;
+    struct Value map = createMapValue(createMap());
+    for (size_t i = 0; i < literal->entryCount; i++) {
+        const struct Closure* key = literal->keys[i];
+        const struct Closure* value = literal->values[i];
+        struct Value keyVal = key->run(key, env);
+        struct Value valueVal = value->run(value, env);
+        storeMapElement(closure->node, map, key->node, keyVal, value->node, valueVal);
+    }
+    return map;
+}
+
+static struct Value runIndexAssignment(const struct Closure* closure, struct Environment* env) {
+    const struct IndexAssignClosure* assign = (const struct IndexAssignClosure*) closure;
+    struct Value* target = getValueHashed(env, assign->name, assign->nameHash);
+    if (!target) {
+        raiseError("Variable reference on line %zu does not exist, therefore cannot assign value.\n", closure->node->line);
+    }
+    if (target->type != VALUE_MAP) {
+        raiseError("Only map elements can be assigned to, line %zu\n", closure->node->line);
+    }
+    struct Value map = *target;
+    struct Value key = assign->key->run(assign->key, env);
+    struct Value value = assign->value->run(assign->value, env);
+    storeMapElement(closure->node, map, assign->key->node, key, assign->value->node, value);
+    return createNumberValue(0);
+}
+
+// CONTROL FLOW
+
+static struct Value runIfStatement(const struct Closure* closure, struct Environment* env) {
+    const struct IfClosure* ifStatement = (const struct IfClosure*) closure;
+    if (ifStatement->condition->test(ifStatement->condition, env)) {
+        runBlock(&ifStatement->block, env);
+    }
+    return createNumberValue(0);
+}
+
+static struct Value runLoopStatement(const struct Closure* closure, struct Environment* env) {
+    const struct BlockClosure* loop = (const struct BlockClosure*) closure;
+    struct Value loopCount = loop->expression->run(loop->expression, env);
+    if (loopCount.type != VALUE_NUMBER) {
+        raiseError("Loop count must be a number value, line %zu\n", closure->node->line);
+    }
+    if (loopCount.data.number < 0.0) {
+        raiseError("Negative loop count is not possible, line %zu\n", closure->node->line);
+    }
+    size_t loopAmount = (size_t) loopCount.data.number;
+    uint64_t start = traceStart();
+    for (size_t i = 0; i < loopAmount; i++) {
+        runBlock(&loop->block, env);
+    }
+    traceSpan(TRACE_LOOP, "loop", loopAmount, closure->node->line, start);
+    return createNumberValue(0);
+}
+
+static void runParallelBlock(const void* body, struct Environment* env) {
+    runBlock(body, env);
+}
+
+static struct Value runParallelLoopStatement(const struct Closure* closure, struct Environment* env) {
+    const struct BlockClosure* loop = (const struct BlockClosure*) closure;
+    struct Value loopCount = loop->expression->run(loop->expression, env);
+    runParallelLoop(closure->node, loopCount, &loop->block, runParallelBlock, env);
+    return createNumberValue(0);
+}
+
+// COMPILATION
+
+static const struct Closure* compileNode(struct CompiledProgram* compiled, const struct ASTNode* node);
+
+// while compiling, the functions are not sorted yet
+static bool isCompiled(const struct CompiledProgram* compiled, const struct ASTNode* declaration) {
+    for (size_t i = 0; i < compiled->functionCount; i++) {
+        if (compiled->functions[i].declaration == declaration) return true;
+    }
+    return false;
+}
+
+static void compileBlock(struct CompiledProgram* compiled, struct ClosureBlock* block, const struct ASTNodeList* list) {
+    block->count = list->count;
+    block->statements = compilerAlloc(compiled, sizeof(struct Closure*) * list->count);
+    block->prints = compilerAlloc(compiled, sizeof(bool) * list->count);
+    for (size_t i = 0; i < list->count; i++) {
+        const struct ASTNode* statement = list->nodes[i];
+        block->statements[i] = compileNode(compiled, statement);
+        block->prints[i] = statement->nodeType == NODE_VARIABLE_REFERENCE ||
+            statement->nodeType == NODE_CACHED_VARIABLE_REFERENCE;
+    }
+}
+
+static const struct Closure** compileArguments(struct CompiledProgram* compiled, struct ASTNode** arguments, size_t count) {
+    const struct Closure** compiledArguments = compilerAlloc(compiled, sizeof(struct Closure*) * count);
+    for (size_t i = 0; i < count; i++) {
+        compiledArguments[i] = compileNode(compiled, arguments[i]);
+    }
+    return compiledArguments;
+}
+
+#define NEW_CLOSURE(type, function) \
+    type* closure = compilerAlloc(compiled, sizeof(type)); \
+    closure->base.run = function; \
+    closure->base.node = node
+
+#define NEW_CONDITION(type, function) \
+    type* condition = compilerAlloc(compiled, sizeof(type)); \
+    condition->base.test = function; \
+    condition->base.node = node
+
+// owner is the if statement or logical operator the condition belongs to
+static const struct Condition* compileCondition(struct CompiledProgram* compiled, const struct ASTNode* node, const struct ASTNode* owner) {
+    switch (node->nodeType) {
+        case NODE_LOGICAL_AND:
+        case NODE_LOGICAL_OR:
+            {
+                NEW_CONDITION(struct LogicalCondition, node->nodeType == NODE_LOGICAL_AND ? testAnd : testOr);
+                condition->left = compileCondition(compiled, node->data.binary.leftSide, node);
+                condition->right = compileCondition(compiled, node->data.binary.rightSide, node);
+                return &condition->base;
+            }
+        case NODE_LOGICAL_NOT:
+            {
+                NEW_CONDITION(struct LogicalCondition, testNot);
+                condition->left = compileCondition(compiled, node->data.unary.operand, node);
+                return &condition->base;
+            }
+        case NODE_BINARY_OPERATION:
+        case NODE_GUARDED_NUMBER_BINARY:
+            if (!isComparisonOperator(node->data.binary.operationChar)) break;
+            {
+                NEW_CONDITION(struct CompareCondition, checkedComparison(node->data.binary.operationChar));
+                condition->left = compileNode(compiled, node->data.binary.leftSide);
+                condition->right = compileNode(compiled, node->data.binary.rightSide);
+                condition->owner = owner;
+                return &condition->base;
+            }
+        case NODE_NUMBER_EQUAL:
+        case NODE_NUMBER_NOT_EQUAL:
+        case NODE_NUMBER_LESS:
+        case NODE_NUMBER_GREATER:
+        case NODE_NUMBER_LESSER_EQUAL:
+        case NODE_NUMBER_GREATER_EQUAL:
+            {
+                NEW_CONDITION(struct CompareCondition, numberComparison(node->nodeType));
+                condition->left = compileNode(compiled, node->data.binary.leftSide);
+                condition->right = compileNode(compiled, node->data.binary.rightSide);
+                return &condition->base;
+            }
+        default:
+            break;
+    }
+    NEW_CONDITION(struct ValueCondition, testValue);
+    condition->value = compileNode(compiled, node);
+    condition->owner = owner;
+    return &condition->base;
+}
+
+static const struct Closure* compileNode(struct CompiledProgram* compiled, const struct ASTNode* node) {
+    switch (node->nodeType) {
+        case NODE_NUMBER_LITERAL:
+            {
+                NEW_CLOSURE(struct LiteralClosure, runLiteral);
+                closure->value = createNumberValue(node->data.numberValue);
+                return &closure->base;
+            }
+        case NODE_BOOL_LITERAL:
+            {
+                NEW_CLOSURE(struct LiteralClosure, runLiteral);
+                closure->value = createBoolValue(node->data.boolValue);
+                return &closure->base;
+            }
+        case NODE_TEXT_LITERAL:
+            {
+                NEW_CLOSURE(struct LiteralClosure, runTextLiteral);
+                closure->value = createTextValue(node->data.textValue);
+                return &closure->base;
+            }
+        case NODE_VARIABLE_REFERENCE:
+        case NODE_CACHED_VARIABLE_REFERENCE:
+            {
+                NEW_CLOSURE(struct NameClosure, runVariableReference);
+                closure->name = node->data.textValue;
+                closure->nameHash = hash(closure->name);
+                return &closure->base;
+            }
+        case NODE_BINARY_OPERATION:
+        case NODE_GUARDED_NUMBER_BINARY:
+            {
+                NEW_CLOSURE(struct BinaryClosure, checkedOperator(node->data.binary.operationChar));
+                closure->left = compileNode(compiled, node->data.binary.leftSide);
+                closure->right = compileNode(compiled, node->data.binary.rightSide);
+                return &closure->base;
+            }
+        case NODE_NUMBER_ADD:
+        case NODE_NUMBER_SUBTRACT:
+        case NODE_NUMBER_MULTIPLY:
+        case NODE_NUMBER_DIVIDE:
+        case NODE_NUMBER_EQUAL:
+        case NODE_NUMBER_NOT_EQUAL:
+        case NODE_NUMBER_LESS:
+        case NODE_NUMBER_GREATER:
+        case NODE_NUMBER_LESSER_EQUAL:
+        case NODE_NUMBER_GREATER_EQUAL:
+            {
+                NEW_CLOSURE(struct BinaryClosure, numberOperator(node->nodeType));
+                closure->left = compileNode(compiled, node->data.binary.leftSide);
+                closure->right = compileNode(compiled, node->data.binary.rightSide);
+                return &closure->base;
+            }
+        case NODE_LOGICAL_AND:
+        case NODE_LOGICAL_OR:
+        case NODE_LOGICAL_NOT:
+            {
+                NEW_CLOSURE(struct ConditionClosure, runCondition);
+                closure->condition = compileCondition(compiled, node, node);
+                return &closure->base;
+            }
+        case NODE_VARIABLE_DECLARATION:
+            {
+                NEW_CLOSURE(struct DeclarationClosure, runVariableDeclaration);
+                closure->name = node->data.varDeclaration.name;
+                closure->nameHash = hash(closure->name);
+                closure->dataType = node->data.varDeclaration.dataType;
+                closure->typeChecked = node->data.varDeclaration.typeChecked;
+                closure->value = compileNode(compiled, node->data.varDeclaration.node);
+                return &closure->base;
+            }
+        case NODE_VARIABLE_ASSIGN:
+            {
+                NEW_CLOSURE(struct DeclarationClosure, runVariableAssignment);
+                closure->name = node->data.varAssignment.name;
+                closure->nameHash = hash(closure->name);
+                closure->typeChecked = node->data.varAssignment.typeChecked;
+                closure->value = compileNode(compiled, node->data.varAssignment.node);
+                return &closure->base;
+            }
+        case NODE_TEMPORARY_SET:
+            {
+                NEW_CLOSURE(struct DeclarationClosure, runTemporarySet);
+                closure->name = node->data.varAssignment.name;
+                closure->nameHash = hash(closure->name);
+                closure->value = compileNode(compiled, node->data.varAssignment.node);
+                return &closure->base;
+            }
+        case NODE_FUNCTION_DECLARATION:
+            {
+                NEW_CLOSURE(struct NameClosure, runFunctionDeclaration);
+                closure->name = node->data.funcDeclaration.name;
+                closure->nameHash = hash(closure->name);
+
+                // a module imported along more than one path already has its body
+                if (node->data.funcDeclaration.shared && isCompiled(compiled, node)) return &closure->base;
+
+                compiled->functions = resizeMemory(compiled->functions, sizeof(struct CompiledFunction) * (compiled->functionCount + 1));
+                size_t index = compiled->functionCount++;
+                compiled->functions[index].declaration = node;
+                // compiling the body may append more functions, fill the slot through its index
+                struct ClosureBlock body;
+                compileBlock(compiled, &body, node->data.funcDeclaration.codeBlock);
+                compiled->functions[index].body = body;
+                return &closure->base;
+            }
+        case NODE_FUNCTION_CALL:
+        case NODE_CACHED_FUNCTION_CALL:
+            {
+                NEW_CLOSURE(struct CallClosure, runFunctionCall);
+                closure->name = node->data.funcCall.name;
+                closure->nameHash = hash(closure->name);
+                closure->argumentCount = node->data.funcCall.argumentCount;
+                closure->arguments = compileArguments(compiled, node->data.funcCall.arguments, closure->argumentCount);
+                closure->typeChecked = node->data.funcCall.typeChecked;
+                closure->program = compiled;
+                return &closure->base;
+            }
+        case NODE_SPAWN:
+            {
+                NEW_CLOSURE(struct CallClosure, runSpawn);
+                closure->name = node->data.funcCall.name;
+                closure->nameHash = hash(closure->name);
+                closure->argumentCount = node->data.funcCall.argumentCount;
+                closure->arguments = compileArguments(compiled, node->data.funcCall.arguments, closure->argumentCount);
+                closure->typeChecked = node->data.funcCall.typeChecked;
+                closure->program = compiled;
+                return &closure->base;
+            }
+        case NODE_IMPORT:
+            {
+                // the module's fns are compiled into this program, calls find them by declaration
+                NEW_CLOSURE(struct BlockClosure, runImport);
+                compileBlock(compiled, &closure->block, &node->data.import.module->program);
+                return &closure->base;
+            }
+        case NODE_BUILTIN_CALL:
+            {
+                NEW_CLOSURE(struct BuiltinClosure, runBuiltinCall);
+                closure->argumentCount = node->data.builtinCall.argumentCount;
+                closure->arguments = compileArguments(compiled, node->data.builtinCall.arguments, closure->argumentCount);
+                return &closure->base;
+            }
+        case NODE_NUMBERS:
+            {
+                NEW_CLOSURE(struct NumbersClosure, runNumbersLiteral);
+                closure->elementCount = node->data.numbers.elementCount;
+                closure->elements = compileArguments(compiled, node->data.numbers.elements, closure->elementCount);
+                return &closure->base;
+            }
+        case NODE_INDEX:
+            {
+                NEW_CLOSURE(struct BinaryClosure, runIndex);
+                closure->left = compileNode(compiled, node->data.binary.leftSide);
+                closure->right = compileNode(compiled, node->data.binary.rightSide);
+                return &closure->base;
+            }
+        case NODE_MAP:
+            {
+                NEW_CLOSURE(struct MapClosure, runMapLiteral);
+                closure->entryCount = node->data.map.entryCount;
+                closure->keys = compileArguments(compiled, node->data.map.keys, closure->entryCount);
+                closure->values = compileArguments(compiled, node->data.map.values, closure->entryCount);
+                return &closure->base;
+            }
+        case NODE_INDEX_ASSIGN:
+            {
+                NEW_CLOSURE(struct IndexAssignClosure, runIndexAssignment);
+                closure->name = node->data.indexAssignment.name;
+                closure->nameHash = hash(closure->name);
+                closure->key = compileNode(compiled, node->data.indexAssignment.key);
+                closure->value = compileNode(compiled, node->data.indexAssignment.value);
+                return &closure->base;
+            }
+        case NODE_AWAIT:
+            {
+                NEW_CLOSURE(struct UnaryClosure, runAwait);
+                closure->operand = compileNode(compiled, node->data.unary.operand);
+                return &closure->base;
+            }
+        case NODE_IF_STATEMENT:
+            {
+                NEW_CLOSURE(struct IfClosure, runIfStatement);
+                closure->condition = compileCondition(compiled, node->data.ifStatement.condition, node);
+                compileBlock(compiled, &closure->block, node->data.ifStatement.conditionTrueBlock);
+                return &closure->base;
+            }
+        case NODE_LOOP_STATEMENT:
+            {
+                NEW_CLOSURE(struct BlockClosure, runLoopStatement);
+                closure->expression = compileNode(compiled, node->data.loopStatement.loopCount);
+                compileBlock(compiled, &closure->block, node->data.loopStatement.loopCodeBlock);
+                return &closure->base;
+            }
+        case NODE_PARALLEL_LOOP:
+            {
+                NEW_CLOSURE(struct BlockClosure, runParallelLoopStatement);
+                closure->expression = compileNode(compiled, node->data.parallelLoop.loopCount);
+                compileBlock(compiled, &closure->block, node->data.parallelLoop.loopCodeBlock);
+                return &closure->base;
+            }
+        case NODE_INLINED_BLOCK:
+            {
+                const struct ASTInlinedBlock* block = &node->data.inlinedBlock;
+                NEW_CLOSURE(struct InlinedClosure, runInlinedBlock);
+                closure->argumentCount = block->argumentCount;
+                closure->arguments = compileArguments(compiled, block->arguments, block->argumentCount);
+                closure->parameters = block->parameters;
+                closure->parameterHashes = compilerAlloc(compiled, sizeof(unsigned long) * block->argumentCount);
+                for (size_t i = 0; i < block->argumentCount; i++) {
+                    closure->parameterHashes[i] = hash(block->parameters[i].name);
+                }
+                closure->typeChecked = block->typeChecked;
+                compileBlock(compiled, &closure->block, block->codeBlock);
+                closure->locals = block->locals;
+                closure->localCount = block->localCount;
+                return &closure->base;
+            }
+        default:
+            raiseError("Unhandled node.\n");
+    }
+}
+
+static int compareFunctions(const void* a, const void* b) {
+    uintptr_t left = (uintptr_t) ((const struct CompiledFunction*) a)->declaration;
+    uintptr_t right = (uintptr_t) ((const struct CompiledFunction*) b)->declaration;
+    return (left > right) - (left < right);
+}
+
+struct CompiledProgram* compileProgram(const struct ASTNodeList* program) {
+    struct CompiledProgram* compiled = allocZeroed(1, sizeof(struct CompiledProgram));
+    compileBlock(compiled, &compiled->main, program);
+    if (compiled->functionCount > 0) {
+        qsort(compiled->functions, compiled->functionCount, sizeof(struct CompiledFunction), compareFunctions);
+    }
+    return compiled;
+}
+
+void runCompiledProgram(const struct CompiledProgram* compiled, struct Environment* env) {
+    runBlock(&compiled->main, env);
+}
+
+void destroyCompiledProgram(struct CompiledProgram* compiled) {
+    for (size_t i = 0; i < compiled->allocationCount; i++) {
+        freeMemory(compiled->allocations[i]);
+    }
+    freeMemory(compiled->allocations);
+    freeMemory(compiled->functions);
+    freeMemory(compiled);
+}
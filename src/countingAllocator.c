@@ -0,0 +1,224 @@
+#include "../include/allocator.h"
+#include "../include/runtime.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define REPORT_ROWS 15
+
+// in front of every block
+struct CountedBlock {
+    size_t      size;
+    const char* site;
+};
+
+_Static_assert(sizeof(struct CountedBlock) == 16, "blocks must stay aligned like malloc's");
+
+struct SiteCount {
+    const char* site;       // NULL while the slot is free
+    uint64_t    calls;      // allocations and resizes made there
+    uint64_t    bytes;
+    uint64_t    frees;
+};
+
+struct CountingAllocator {
+    struct Allocator    base;
+    struct Allocator*   inner;
+    size_t              limit;
+    pthread_mutex_t     lock;
+    size_t              inUse;
+    size_t              peak;
+    uint64_t            calls;
+    uint64_t            bytes;
+    uint64_t            frees;
+    struct SiteCount*   sites;      // open addressing on the site's address
+    size_t              siteCapacity;
+    size_t              siteCount;
+};
+
+static struct SiteCount* findSite(struct CountingAllocator* counting, const char* site) {
+    if (counting->siteCount + 1 > counting->siteCapacity / 4 * 3) {
+        size_t capacity = counting->siteCapacity ? counting->siteCapacity * 2 : 256;
+        struct SiteCount* sites = calloc(capacity, sizeof(struct SiteCount));
+        if (!sites) return NULL;
+        for (size_t i = 0; i < counting->siteCapacity; i++) {
+            const struct SiteCount* old = &counting->sites[i];
+            if (!old->site) continue;
+            size_t slot = ((uintptr_t) old->site >> 3) & (capacity - 1);
+            while (sites[slot].site) slot = (slot + 1) & (capacity - 1);
+            sites[slot] = *old;
+        }
+        free(counting->sites);
+        counting->sites = sites;
+        counting->siteCapacity = capacity;
+    }
+    size_t slot = ((uintptr_t) site >> 3) & (counting->siteCapacity - 1);
+    while (counting->sites[slot].site && counting->sites[slot].site != site) {
+        slot = (slot + 1) & (counting->siteCapacity - 1);
+    }
+    struct SiteCount* count = &counting->sites[slot];
+    if (!count->site) {
+        count->site = site;
+        counting->siteCount++;
+    }
+    return count;
+}
+
+// holding the lock, false when growing by bytes would pass the limit
+static bool countAllocation(struct CountingAllocator* counting, const char* site, size_t bytes, size_t freed) {
+    if (counting->limit && counting->inUse - freed + bytes > counting->limit) return false;
+    counting->inUse = counting->inUse - freed + bytes;
+    if (counting->inUse > counting->peak) counting->peak = counting->inUse;
+    counting->calls++;
+    counting->bytes += bytes;
+    struct SiteCount* count = findSite(counting, site);
+    if (count) {
+        count->calls++;
+        count->bytes += bytes;
+    }
+    return true;
+}
+
+static _Noreturn void raiseLimit(struct CountingAllocator* counting, size_t size, const char* site) {
+    size_t inUse = counting->inUse;
+    pthread_mutex_unlock(&counting->lock);
+    raiseError("Memory limit of %zu bytes reached, %zu in use and %zu more asked for at %s\n",
+        counting->limit, inUse, size, site);
+}
+
+static void* countingAllocate(struct Allocator* self, size_t size, const char* site) {
+    struct CountingAllocator* counting = (struct CountingAllocator*) self;
+    if (size > SIZE_MAX - sizeof(struct CountedBlock)) return NULL;
+    pthread_mutex_lock(&counting->lock);
+    if (!countAllocation(counting, site, size, 0)) raiseLimit(counting, size, site);
+    pthread_mutex_unlock(&counting->lock);
+
+    struct CountedBlock* block = counting->inner->allocate(counting->inner, sizeof(struct CountedBlock) + size, site);
+    if (!block) {
+        pthread_mutex_lock(&counting->lock);
+        counting->inUse -= size;
+        pthread_mutex_unlock(&counting->lock);
+        return NULL;
+    }
+    *block = (struct CountedBlock) { size, site };
+    return block + 1;
+}
+
+static void* countingResize(struct Allocator* self, void* memory, size_t size, const char* site) {
+    struct CountingAllocator* counting = (struct CountingAllocator*) self;
+    struct CountedBlock* block = (struct CountedBlock*) memory - 1;
+    size_t oldSize = block->size;
+    if (size > SIZE_MAX - sizeof(struct CountedBlock)) return NULL;
+    pthread_mutex_lock(&counting->lock);
+    if (!countAllocation(counting, site, size, oldSize)) raiseLimit(counting, size, site);
+    pthread_mutex_unlock(&counting->lock);
+
+    struct CountedBlock* resized = counting->inner->resize(counting->inner, block, sizeof(struct CountedBlock) + size, site);
+    if (!resized) {
+        pthread_mutex_lock(&counting->lock);
+        counting->inUse = counting->inUse - size + oldSize;
+        pthread_mutex_unlock(&counting->lock);
+        return NULL;
+    }
+    *resized = (struct CountedBlock) { size, site };
+    return resized + 1;
+}
+
+static void countingRelease(struct Allocator* self, void* memory, const char* site) {
+    struct CountingAllocator* counting = (struct CountingAllocator*) self;
+    struct CountedBlock* block = (struct CountedBlock*) memory - 1;
+    pthread_mutex_lock(&counting->lock);
+    counting->inUse -= block->size;
+    counting->frees++;
+    // credited to where the block came from, where it is freed says little
+    struct SiteCount* count = findSite(counting, block->site);
+    if (count) count->frees++;
+    pthread_mutex_unlock(&counting->lock);
+    counting->inner->release(counting->inner, block, site);
+}
+
+static size_t countingMeasure(struct Allocator* self, void* memory) {
+    (void) self;
+    return ((struct CountedBlock*) memory - 1)->size;
+}
+
+struct Allocator* createCountingAllocator(struct Allocator* inner, size_t limit) {
+    struct CountingAllocator* counting = calloc(1, sizeof(struct CountingAllocator));
+    if (!counting) return NULL;
+    counting->base = (struct Allocator) { "counting", countingAllocate, countingResize, countingRelease, countingMeasure };
+    counting->inner = inner;
+    counting->limit = limit;
+    pthread_mutex_init(&counting->lock, NULL);
+    return &counting->base;
+}
+
+// REPORT
+
+struct ReportRow {
+    const char* name;
+    size_t      nameLength;
+    uint64_t    calls;
+    uint64_t    bytes;
+    uint64_t    frees;
+};
+
+static int compareCalls(const void* a, const void* b) {
+    const struct ReportRow* left = a;
+    const struct ReportRow* right = b;
+    if (left->calls != right->calls) return left->calls < right->calls ? 1 : -1;
+    return left->bytes < right->bytes ? 1 : left->bytes > right->bytes ? -1 : 0;
+}
+
+static void printRows(FILE* out, const char* heading, struct ReportRow* rows, size_t count) {
+    qsort(rows, count, sizeof(*rows), compareCalls);
+    fprintf(out, "\n     calls         bytes     frees  %s\n", heading);
+    for (size_t i = 0; i < count && i < REPORT_ROWS; i++) {
+        fprintf(out, "%10llu  %12llu  %8llu  %.*s\n", (unsigned long long) rows[i].calls,
+            (unsigned long long) rows[i].bytes, (unsigned long long) rows[i].frees,
+            (int) rows[i].nameLength, rows[i].name);
+    }
+}
+
+void reportAllocations(struct Allocator* self, FILE* out) {
+    struct CountingAllocator* counting = (struct CountingAllocator*) self;
+    pthread_mutex_lock(&counting->lock);
+    fprintf(out, "Allocations: %llu calls, %llu bytes, %llu frees, %zu bytes at the peak, %zu still in use, from %s\n",
+        (unsigned long long) counting->calls, (unsigned long long) counting->bytes,
+        (unsigned long long) counting->frees, counting->peak, counting->inUse, counting->inner->name);
+
+    struct ReportRow* sites = malloc(sizeof(struct ReportRow) * (counting->siteCount ? counting->siteCount : 1));
+    struct ReportRow* subsystems = malloc(sizeof(struct ReportRow) * (counting->siteCount ? counting->siteCount : 1));
+    size_t siteCount = 0;
+    size_t subsystemCount = 0;
+    for (size_t i = 0; sites && subsystems && i < counting->siteCapacity; i++) {
+        const struct SiteCount* count = &counting->sites[i];
+        if (!count->site) continue;
+        struct ReportRow row = { count->site, strlen(count->site), count->calls, count->bytes, count->frees };
+        sites[siteCount++] = row;
+
+        // the file the site is in
+        const char* colon = strrchr(count->site, ':');
+        row.nameLength = colon ? (size_t) (colon - count->site) : row.nameLength;
+        size_t s = 0;
+        while (s < subsystemCount && (subsystems[s].nameLength != row.nameLength ||
+                memcmp(subsystems[s].name, row.name, row.nameLength) != 0)) {
+            s++;
+        }
+        if (s == subsystemCount) {
+            subsystems[subsystemCount++] = row;
+        } else {
+            subsystems[s].calls += row.calls;
+            subsystems[s].bytes += row.bytes;
+            subsystems[s].frees += row.frees;
+        }
+    }
+    pthread_mutex_unlock(&counting->lock);
+
+    if (sites && subsystems) {
+        printRows(out, "subsystem", subsystems, subsystemCount);
+        printRows(out, "call site", sites, siteCount);
+    }
+    free(sites);
+    free(subsystems);
+}
@@ -0,0 +1,373 @@
+#include "../include/deadCode.h"
+#include "../include/allocator.h"
+#include "../include/modules.h"
+#include "../include/evaluator.h"
+#include "../include/typeHelper.h"
+#include <stdio.h>
+#include <string.h>
+#define NAME_USE_BUCKET_COUNT 1024
+
+// How every name in the program is used, counted by name only. Scopes are not
+// resolved, so a name used anywhere keeps every declaration with that name alive.
+struct NameUse {
+    char*           name;
+    size_t          bindings;       // variable and function declarations
+    size_t          references;
+    size_t          assignments;
+    size_t          calls;
+    struct NameUse* next;
+};
+
+struct NameUseTable {
+    struct NameUse* bucket[NAME_USE_BUCKET_COUNT];
+};
+
+struct DeadCodeContext {
+    struct NameUseTable     uses;
+    struct DeadCodeStats*   stats;
+    bool                    changed;
+};
+
+static unsigned long hashName(const char* name) {
+    unsigned long h = 5381;
+    while (*name) {
+        h = ((h << 5) + h) + (unsigned char)*name;
+        name++;
+    }
+    return h;
+}
+
+static struct NameUse* lookupUse(struct NameUseTable* table, const char* name, bool create) {
+    unsigned long h = hashName(name) % NAME_USE_BUCKET_COUNT;
+    for (struct NameUse* use = table->bucket[h]; use; use = use->next) {
+        if (strcmp(use->name, name) == 0) return use;
+    }
+    if (!create) return NULL;
+
+    struct NameUse* use = allocZeroed(1, sizeof(struct NameUse));
+    // pruning frees nodes while the table is in use, so keep a copy of the name
+    use->name = copyText(name);
+    use->next = table->bucket[h];
+    table->bucket[h] = use;
+    return use;
+}
+
+static void clearUses(struct NameUseTable* table) {
+    for (size_t i = 0; i < NAME_USE_BUCKET_COUNT; i++) {
+        struct NameUse* use = table->bucket[i];
+        while (use) {
+            struct NameUse* next = use->next;
+            freeMemory(use->name);
+            freeMemory(use);
+            use = next;
+        }
+        table->bucket[i] = NULL;
+    }
+}
+
+static void collectUsesList(struct NameUseTable* table, const struct ASTNodeList* list);
+
+static void collectUses(struct NameUseTable* table, const struct ASTNode* n) {
+    if (!n) return;
+    switch (n->nodeType) {
+        case NODE_VARIABLE_REFERENCE:
+            lookupUse(table, n->data.textValue, true)->references++;
+            break;
+        case NODE_BINARY_OPERATION:
+        case NODE_INDEX:
+        case NODE_LOGICAL_AND:
+        case NODE_LOGICAL_OR:
+        CASE_NUMBER_BINARY_NODES:
+            collectUses(table, n->data.binary.leftSide);
+            collectUses(table, n->data.binary.rightSide);
+            break;
+        case NODE_NUMBERS:
+            for (size_t i = 0; i < n->data.numbers.elementCount; i++) {
+                collectUses(table, n->data.numbers.elements[i]);
+            }
+            break;
+        case NODE_MAP:
+            for (size_t i = 0; i < n->data.map.entryCount; i++) {
+                collectUses(table, n->data.map.keys[i]);
+                collectUses(table, n->data.map.values[i]);
+            }
+            break;
+        case NODE_INDEX_ASSIGN:
+            // changes the map the variable refers to, so it reads the variable
+            lookupUse(table, n->data.indexAssignment.name, true)->references++;
+            collectUses(table, n->data.indexAssignment.key);
+            collectUses(table, n->data.indexAssignment.value);
+            break;
+        case NODE_BUILTIN_CALL:
+            for (size_t i = 0; i < n->data.builtinCall.argumentCount; i++) {
+                collectUses(table, n->data.builtinCall.arguments[i]);
+            }
+            break;
+        case NODE_LOGICAL_NOT:
+        case NODE_AWAIT:
+            collectUses(table, n->data.unary.operand);
+            break;
+        case NODE_VARIABLE_DECLARATION:
+            lookupUse(table, n->data.varDeclaration.name, true)->bindings++;
+            collectUses(table, n->data.varDeclaration.node);
+            break;
+        case NODE_VARIABLE_ASSIGN:
+            lookupUse(table, n->data.varAssignment.name, true)->assignments++;
+            collectUses(table, n->data.varAssignment.node);
+            break;
+        case NODE_FUNCTION_DECLARATION:
+            lookupUse(table, n->data.funcDeclaration.name, true)->bindings++;
+            // a local with a parameter's name fails when declared, keep it
+            for (size_t i = 0; i < n->data.funcDeclaration.parameterCount; i++) {
+                lookupUse(table, n->data.funcDeclaration.parameters[i].name, true)->bindings++;
+            }
+            collectUsesList(table, n->data.funcDeclaration.codeBlock);
+            break;
+        case NODE_IMPORT:
+            // the fns it binds, their bodies cannot see this program
+            for (size_t i = 0; i < n->data.import.module->program.count; i++) {
+                const struct ASTNode* imported = n->data.import.module->program.nodes[i];
+                if (imported->nodeType == NODE_FUNCTION_DECLARATION) {
+                    lookupUse(table, imported->data.funcDeclaration.name, true)->bindings++;
+                } else {
+                    collectUses(table, imported);
+                }
+            }
+            break;
+        case NODE_FUNCTION_CALL:
+        case NODE_SPAWN:
+            lookupUse(table, n->data.funcCall.name, true)->calls++;
+            for (size_t i = 0; i < n->data.funcCall.argumentCount; i++) {
+                collectUses(table, n->data.funcCall.arguments[i]);
+            }
+            break;
+        case NODE_IF_STATEMENT:
+            collectUses(table, n->data.ifStatement.condition);
+            collectUsesList(table, n->data.ifStatement.conditionTrueBlock);
+            break;
+        case NODE_LOOP_STATEMENT:
+            collectUses(table, n->data.loopStatement.loopCount);
+            collectUsesList(table, n->data.loopStatement.loopCodeBlock);
+            break;
+        case NODE_PARALLEL_LOOP:
+            if (n->data.parallelLoop.indexName) {
+                lookupUse(table, n->data.parallelLoop.indexName, true)->bindings++;
+            }
+            for (size_t i = 0; i < n->data.parallelLoop.reductionCount; i++) {
+                struct NameUse* use = lookupUse(table, n->data.parallelLoop.reductions[i].name, true);
+                use->references++;
+                use->assignments++;
+            }
+            collectUses(table, n->data.parallelLoop.loopCount);
+            collectUsesList(table, n->data.parallelLoop.loopCodeBlock);
+            break;
+        case NODE_INLINED_BLOCK:
+            for (size_t i = 0; i < n->data.inlinedBlock.argumentCount; i++) {
+                lookupUse(table, n->data.inlinedBlock.parameters[i].name, true)->bindings++;
+                collectUses(table, n->data.inlinedBlock.arguments[i]);
+            }
+            collectUsesList(table, n->data.inlinedBlock.codeBlock);
+            break;
+        default:
+            break;
+    }
+}
+
+static void collectUsesList(struct NameUseTable* table, const struct ASTNodeList* list) {
+    for (size_t i = 0; i < list->count; i++) {
+        collectUses(table, list->nodes[i]);
+    }
+}
+
+// Folds an expression made only of literals. Returns false if it is not constant
+// or if evaluating it would stop the program (type error, division by zero).
+static bool foldConstant(const struct ASTNode* n, struct Value* out) {
+    switch (n->nodeType) {
+        case NODE_NUMBER_LITERAL:
+            *out = createNumberValue(n->data.numberValue);
+            return true;
+        case NODE_TEXT_LITERAL:
+            // the text itself is never needed, only its type
+            *out = createTextValue(n->data.textValue);
+            return true;
+        case NODE_BOOL_LITERAL:
+            *out = createBoolValue(n->data.boolValue);
+            return true;
+        case NODE_BINARY_OPERATION:
+        CASE_NUMBER_BINARY_NODES:
+            {
+                struct Value left, right;
+                if (!foldConstant(n->data.binary.leftSide, &left) || !foldConstant(n->data.binary.rightSide, &right)) {
+                    return false;
+                }
+                if (left.type != VALUE_NUMBER || right.type != VALUE_NUMBER) return false;
+
+                double l = left.data.number;
+                double r = right.data.number;
+                switch (n->data.binary.operationChar) {
+                    case BIN_OP_PLUS:           *out = createNumberValue(l + r); return true;
+                    case BIN_OP_MINUS:          *out = createNumberValue(l - r); return true;
+                    case BIN_OP_STAR:           *out = createNumberValue(l * r); return true;
+                    case BIN_OP_SLASH:
+                        if (r == 0) return false;
+                        *out = createNumberValue(l / r);
+                        return true;
+                    case BIN_OP_EQUALITY:       *out = createBoolValue(l == r); return true;
+                    case BIN_OP_NOT_EQUAL:      *out = createBoolValue(l != r); return true;
+                    case BIN_OP_LESS:           *out = createBoolValue(l < r); return true;
+                    case BIN_OP_GREATER:        *out = createBoolValue(l > r); return true;
+                    case BIN_OP_LESSER_EQUAL:   *out = createBoolValue(l <= r); return true;
+                    case BIN_OP_GREATER_EQUAL:  *out = createBoolValue(l >= r); return true;
+                    default:                    return false;
+                }
+            }
+        case NODE_LOGICAL_AND:
+        case NODE_LOGICAL_OR:
+            {
+                // the right side is skipped once the left side decides the result
+                struct Value left, right;
+                bool decidedBy = n->nodeType == NODE_LOGICAL_OR;
+                if (!foldConstant(n->data.binary.leftSide, &left) || left.type != VALUE_BOOL) return false;
+                if (left.data.boolVal == decidedBy) {
+                    *out = createBoolValue(decidedBy);
+                    return true;
+                }
+                if (!foldConstant(n->data.binary.rightSide, &right) || right.type != VALUE_BOOL) return false;
+                *out = right;
+                return true;
+            }
+        case NODE_LOGICAL_NOT:
+            {
+                struct Value operand;
+                if (!foldConstant(n->data.unary.operand, &operand) || operand.type != VALUE_BOOL) return false;
+                *out = createBoolValue(!operand.data.boolVal);
+                return true;
+            }
+        default:
+            return false;
+    }
+}
+
+static void removeNode(struct DeadCodeContext* ctx, struct ASTNode* n) {
+    ctx->stats->nodesRemoved += countNodes(n);
+    ctx->changed = true;
+    destroyNode(n);
+}
+
+static void pruneList(struct DeadCodeContext* ctx, struct ASTNodeList* list, bool insideLoop) {
+    struct ASTNodeList kept;
+    initAST(&kept);
+
+    for (size_t i = 0; i < list->count; i++) {
+        struct ASTNode* n = list->nodes[i];
+        struct Value constant;
+
+        switch (n->nodeType) {
+            case NODE_IF_STATEMENT:
+                {
+                    struct ASTNodeList* block = n->data.ifStatement.conditionTrueBlock;
+                    if (foldConstant(n->data.ifStatement.condition, &constant) && constant.type == VALUE_BOOL) {
+                        if (!constant.data.boolVal) {
+                            ctx->stats->unreachableBlocks++;
+                            removeNode(ctx, n);
+                            continue;
+                        }
+
+                        // the block runs in the enclosing environment anyway
+                        pruneList(ctx, block, insideLoop);
+                        for (size_t j = 0; j < block->count; j++) {
+                            appendAST(&kept, block->nodes[j]);
+                        }
+                        block->count = 0;
+                        ctx->stats->flattenedBlocks++;
+                        removeNode(ctx, n);
+                        continue;
+                    }
+                    pruneList(ctx, block, insideLoop);
+                    break;
+                }
+            case NODE_LOOP_STATEMENT:
+                if (foldConstant(n->data.loopStatement.loopCount, &constant) && constant.type == VALUE_NUMBER &&
+                        constant.data.number >= 0.0 && constant.data.number < 1.0) {
+                    ctx->stats->unreachableBlocks++;
+                    removeNode(ctx, n);
+                    continue;
+                }
+                pruneList(ctx, n->data.loopStatement.loopCodeBlock, true);
+                break;
+            case NODE_PARALLEL_LOOP:
+                // reductions are checked even when nothing runs, keep those loops
+                if (n->data.parallelLoop.reductionCount == 0 &&
+                        foldConstant(n->data.parallelLoop.loopCount, &constant) && constant.type == VALUE_NUMBER &&
+                        constant.data.number >= 0.0 && constant.data.number < 1.0) {
+                    ctx->stats->unreachableBlocks++;
+                    removeNode(ctx, n);
+                    continue;
+                }
+                // locals are removed after every iteration, so declarations never repeat at this level
+                pruneList(ctx, n->data.parallelLoop.loopCodeBlock, false);
+                break;
+            case NODE_FUNCTION_DECLARATION:
+                {
+                    struct NameUse* use = lookupUse(&ctx->uses, n->data.funcDeclaration.name, false);
+                    if (use && use->bindings == 1 && use->calls == 0 && use->references == 0 && use->assignments == 0) {
+                        ctx->stats->unusedFunctions++;
+                        removeNode(ctx, n);
+                        continue;
+                    }
+                    // every call gets a fresh environment, so the body is never inside a loop
+                    pruneList(ctx, n->data.funcDeclaration.codeBlock, false);
+                    break;
+                }
+            case NODE_VARIABLE_DECLARATION:
+                {
+                    // a declaration repeated by a loop fails on the second iteration, keep that error
+                    if (insideLoop) break;
+
+                    struct NameUse* use = lookupUse(&ctx->uses, n->data.varDeclaration.name, false);
+                    if (use && use->bindings == 1 && use->calls == 0 && use->references == 0 && use->assignments == 0 &&
+                            foldConstant(n->data.varDeclaration.node, &constant) &&
+                            doesDataTypeMatchesData(constant.type, n->data.varDeclaration.dataType)) {
+                        ctx->stats->unusedDeclarations++;
+                        removeNode(ctx, n);
+                        continue;
+                    }
+                    break;
+                }
+            case NODE_INLINED_BLOCK:
+                pruneList(ctx, n->data.inlinedBlock.codeBlock, insideLoop);
+                break;
+            default:
+                break;
+        }
+        appendAST(&kept, n);
+    }
+
+    freeMemory(list->nodes);
+    *list = kept;
+}
+
+void eliminateDeadCode(struct ASTNodeList* program, struct DeadCodeStats* stats) {
+    memset(stats, 0, sizeof(struct DeadCodeStats));
+
+    struct DeadCodeContext ctx;
+    memset(&ctx.uses, 0, sizeof(ctx.uses));
+    ctx.stats = stats;
+
+    // removing code can make more names unused, repeat until nothing changes
+    do {
+        ctx.changed = false;
+        collectUsesList(&ctx.uses, program);
+        pruneList(&ctx, program, false);
+        clearUses(&ctx.uses);
+        stats->iterations++;
+    } while (ctx.changed);
+}
+
+void printDeadCodeStats(const struct DeadCodeStats* stats) {
+    fprintf(stderr, "dce: %zu unreachable block(s) removed\n", stats->unreachableBlocks);
+    fprintf(stderr, "dce: %zu always-true if block(s) flattened\n", stats->flattenedBlocks);
+    fprintf(stderr, "dce: %zu unused function(s) removed\n", stats->unusedFunctions);
+    fprintf(stderr, "dce: %zu unused declaration(s) removed\n", stats->unusedDeclarations);
+    fprintf(stderr, "dce: %zu AST node(s) removed in %zu iteration(s)\n", stats->nodesRemoved, stats->iterations);
+}
@@ -0,0 +1,89 @@
+#include "../include/driver.h"
+#include "../include/closureCompiler.h"
+#include "../include/deadCode.h"
+#include "../include/optimiser.h"
+#include "../include/runtime.h"
+#include "../include/tasks.h"
+#include "../include/typeChecker.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+char* readSourceFile(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return NULL;
+
+    char* source = NULL;
+    long fileSize = -1;
+    if (fseek(file, 0, SEEK_END) == 0) fileSize = ftell(file);
+    if (fileSize >= 0 && fseek(file, 0, SEEK_SET) == 0) {
+        source = malloc(fileSize + 1);
+        if (source && fread(source, 1, fileSize, file) != (size_t) fileSize) {
+            free(source);
+            source = NULL;
+            errno = EIO;
+        }
+    }
+    int error = errno;
+    fclose(file);
+    if (!source) {
+        errno = error ? error : ENOMEM;
+        return NULL;
+    }
+    source[fileSize] = '\0';
+    return source;
+}
+
+bool prepareProgram(struct ASTNodeList* program, const struct RunOptions* options) {
+    // checked first so errors in code the other passes remove are still reported
+    if (options->typeCheck) {
+        size_t errorCount = typeCheckProgram(program);
+        if (errorCount > 0) {
+            printOutput("%zu type error(s), program not run.\n", errorCount);
+            return false;
+        }
+    }
+    if (options->inlineEnabled) {
+        inlineFunctions(program, &options->inlineOptions);
+    }
+    // runs after inlining so functions that were inlined everywhere are dropped
+    if (options->deadCode) {
+        struct DeadCodeStats stats;
+        eliminateDeadCode(program, &stats);
+        if (options->deadCodeStats) printDeadCodeStats(&stats);
+    }
+    // last, so it also sees code the other passes exposed
+    if (options->optimiser) {
+        struct OptimiserStats stats;
+        optimiseProgram(program, &stats);
+        if (options->optimiserStats) printOptimiserStats(&stats);
+    }
+    return true;
+}
+
+void executeProgram(const struct ASTNodeList* program, const struct RunOptions* options, struct Environment* env) {
+    if (options->closureEngine) {
+        struct CompiledProgram* compiled = compileProgram(program);
+        // unawaited tasks still run compiled code, also when an error stops the run
+        struct ErrorHandler handler;
+        if (setjmp(handler.jump) != 0) {
+            discardRemainingTasks();
+            destroyCompiledProgram(compiled);
+            raiseError("%s", handler.message);
+        }
+        pushErrorHandler(&handler);
+        runCompiledProgram(compiled, env);
+        awaitRemainingTasks();
+        popErrorHandler(&handler);
+        destroyCompiledProgram(compiled);
+    } else {
+        evaluateAST(program, env);
+        awaitRemainingTasks();
+    }
+}
+
+bool runProgram(struct ASTNodeList* program, const struct RunOptions* options, struct Environment* env) {
+    if (!prepareProgram(program, options)) return false;
+    executeProgram(program, options, env);
+    return true;
+}
@@ -1,8 +1,21 @@
 #include "../include/evaluator.h"
+#include "../include/allocator.h"
+#include "../include/runtime.h"
 #include "../include/typeHelper.h"
+#include "../include/parallelLoop.h"
+#include "../include/tasks.h"
+#include "../include/numbers.h"
+#include "../include/builtins.h"
+#include "../include/map.h"
+#include "../include/modules.h"
+#include "../include/output.h"
+#include "../include/profiler.h"
+#include "../include/stats.h"
+#include "../include/trace.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 #define DEFAULT_BUCKET_COUNT 1087
 
 unsigned long hash(const char* val) {
@@ -14,75 +27,190 @@ unsigned long hash(const char* val) {
     return h;
 }
 
+// identifies an environment for cached entries, a fresh id is also handed out
+// whenever entries are removed so caches pointing at them stop matching.
+// Threads take ids in blocks so interpreters running side by side do not
+// contend on one counter for every call.
+#define ENVIRONMENT_ID_BLOCK 4096
+static atomic_size_t nextEnvironmentIdBlock = 1;
+static _Thread_local size_t nextEnvironmentId = 0;
+static _Thread_local size_t environmentIdBlockEnd = 0;
+
+static size_t newEnvironmentId(void) {
+    if (nextEnvironmentId == environmentIdBlockEnd) {
+        nextEnvironmentId = atomic_fetch_add(&nextEnvironmentIdBlock, ENVIRONMENT_ID_BLOCK);
+        environmentIdBlockEnd = nextEnvironmentId + ENVIRONMENT_ID_BLOCK;
+    }
+    return nextEnvironmentId++;
+}
+
+static bool adaptiveEvaluation = false;
+
+// parallel loop bodies and tasks run on several threads at once, nodes are only
+// rewritten (or their caches refreshed) while nothing else can be running them
+static _Thread_local bool adaptiveSuspended = false;
+#define ADAPTIVE_ENABLED (adaptiveEvaluation && !adaptiveSuspended && !tasksInFlight())
+
+void setAdaptiveEvaluation(bool enabled) {
+    adaptiveEvaluation = enabled;
+}
+
 void createEnvironment(struct Environment* env) {
+    countEnvironment();
+    env->id = newEnvironmentId();
     env->bucket_count = DEFAULT_BUCKET_COUNT;
-    env->bucket = calloc(env->bucket_count, sizeof(struct Entry*));
+    env->bucket = allocZeroed(env->bucket_count, sizeof(struct Entry*));
 
     if (!env->bucket) {
-        printf("Error calloc while creating environment.\n");
-        exit(1);
+        raiseError("Error calloc while creating environment.\n");
     }
 }
 
-void freeEnvironment(struct Environment* env) {
+static void freeEntries(struct Environment* env) {
     for(size_t i = 0; i < env->bucket_count; i++) {
         struct Entry* e = env->bucket[i];
 
         while (e) {
             struct Entry* next = e->next;
-            free(e->key);
-            // free char* if text
-            if (e->value.type == VALUE_TEXT) {
-                free(e->value.data.text);
-            }
+            freeMemory(e->key);
+            // free char* if text, release arrays
+            releaseValue(e->value);
 
-            free(e);
+            freeMemory(e);
             e = next;
         }
     }
-    free(env->bucket);
+}
+
+void clearEnvironment(struct Environment* env) {
+    freeEntries(env);
+    memset(env->bucket, 0, sizeof(struct Entry*) * env->bucket_count);
+    // entries cached by nodes are gone
+    env->id = newEnvironmentId();
+}
+
+void freeEnvironment(struct Environment* env) {
+    freeEntries(env);
+    freeMemory(env->bucket);
     env->bucket = NULL;
 }
 
-struct Value* getValue(struct Environment* env, const char* key) {
-    unsigned long h = hash(key) % env->bucket_count;
-    struct Entry* e = env->bucket[h];
+static struct Entry* findEntryHashed(struct Environment* env, const char* key, unsigned long keyHash) {
+    struct Entry* e = env->bucket[keyHash % env->bucket_count];
+    size_t probes = 0;
 
     while (e) {
+        probes++;
         if (strcmp(e->key, key) == 0) {
-            return &e->value;
+            break;
         }
         // if collision
         e = e->next;
     }
-    return NULL;
+    countLookup(probes);
+    return e;
+}
+
+static struct Entry* findEntry(struct Environment* env, const char* key) {
+    return findEntryHashed(env, key, hash(key));
+}
+
+struct Value* getValue(struct Environment* env, const char* key) {
+    struct Entry* e = findEntry(env, key);
+    return e ? &e->value : NULL;
+}
+
+struct Value* getValueHashed(struct Environment* env, const char* key, unsigned long keyHash) {
+    struct Entry* e = findEntryHashed(env, key, keyHash);
+    return e ? &e->value : NULL;
 }
 
 void setValue(struct Environment* env, const char* key, struct Value val) {
-    unsigned long h = hash(key) % env->bucket_count;
+    setValueHashed(env, key, hash(key), val);
+}
+
+void setValueHashed(struct Environment* env, const char* key, unsigned long keyHash, struct Value val) {
+    unsigned long h = keyHash % env->bucket_count;
     struct Entry* e = env->bucket[h];
+    size_t probes = 0;
 
     // if entry exists
     while (e) {
+        probes++;
         if (strcmp(e->key, key) == 0) {
-            // override data, free previous char*
-            if (e->value.type == VALUE_TEXT) {
-                free(e->value.data.text);
-            }
+            countStore(probes);
+            // override data, free previous char*. Retained first, the value may be the one it replaces
+            retainValue(val);
+            releaseValue(e->value);
             e->value = val;
             return;
         }
         e = e->next;
     }
+    countStore(probes);
 
-    struct Entry* newEntry = malloc(sizeof (struct Entry));
-    newEntry->key = strdup(key);
+    struct Entry* newEntry = allocMemory(sizeof (struct Entry));
+    newEntry->key = copyText(key);
+    retainValue(val);
     newEntry->value = val;
     newEntry->next = env->bucket[h];
 
     env->bucket[h] = newEntry;
 }
 
+void removeValue(struct Environment* env, const char* key) {
+    unsigned long h = hash(key) % env->bucket_count;
+    struct Entry** link = &env->bucket[h];
+
+    while (*link) {
+        struct Entry* e = *link;
+        if (strcmp(e->key, key) == 0) {
+            *link = e->next;
+            env->id = newEnvironmentId();
+            freeMemory(e->key);
+            releaseValue(e->value);
+            freeMemory(e);
+            return;
+        }
+        link = &e->next;
+    }
+}
+
+void retainValue(struct Value val) {
+    if (val.type == VALUE_NUMBERS) {
+        atomic_fetch_add(&val.data.numbers->refcount, 1);
+    } else if (val.type == VALUE_MAP) {
+        atomic_fetch_add(&val.data.map->refcount, 1);
+    }
+}
+
+void releaseValue(struct Value val) {
+    if (val.type == VALUE_TEXT) {
+        freeMemory(val.data.text);
+    } else if (val.type == VALUE_NUMBERS && atomic_fetch_sub(&val.data.numbers->refcount, 1) == 1) {
+        freeNumberArray(val.data.numbers);
+    } else if (val.type == VALUE_MAP && atomic_fetch_sub(&val.data.map->refcount, 1) == 1) {
+        freeMap(val.data.map);
+    }
+}
+
+void discardTemporary(struct Value val) {
+    if (val.type == VALUE_NUMBERS && atomic_load(&val.data.numbers->refcount) == 0) {
+        freeNumberArray(val.data.numbers);
+    } else if (val.type == VALUE_MAP && atomic_load(&val.data.map->refcount) == 0) {
+        freeMap(val.data.map);
+    }
+}
+
+void releaseTemporary(const struct ASTNode* node, struct Value val) {
+    if (val.type != VALUE_TEXT) {
+        discardTemporary(val);
+    } else if (node->nodeType != NODE_VARIABLE_REFERENCE && node->nodeType != NODE_CACHED_VARIABLE_REFERENCE
+            && node->nodeType != NODE_TEMPORARY_SET) {
+        freeMemory(val.data.text);
+    }
+}
+
 struct Value createNumberValue(double num) {
     struct Value val;
     val.type = VALUE_NUMBER;
@@ -111,88 +239,328 @@ struct Value createFunctionValue(struct ASTNodeList* nodeList) {
     return val;
 }
 
+bool compareNumbers(enum BinaryOperatorTypes op, double leftNum, double rightNum) {
+    switch (op) {
+        case BIN_OP_EQUALITY:       return leftNum == rightNum;
+        case BIN_OP_NOT_EQUAL:      return leftNum != rightNum;
+        case BIN_OP_LESS:           return leftNum < rightNum;
+        case BIN_OP_GREATER:        return leftNum > rightNum;
+        case BIN_OP_LESSER_EQUAL:   return leftNum <= rightNum;
+        case BIN_OP_GREATER_EQUAL:  return leftNum >= rightNum;
+        default:
+            raiseError("Unknown operator.\n");
+    }
+}
+
+bool isComparisonOperator(enum BinaryOperatorTypes op) {
+    return op == BIN_OP_EQUALITY || op == BIN_OP_NOT_EQUAL || op == BIN_OP_LESS || op == BIN_OP_GREATER ||
+        op == BIN_OP_LESSER_EQUAL || op == BIN_OP_GREATER_EQUAL;
+}
+
+struct Value applyNumberOperator(const struct ASTNode* node, double leftNum, double rightNum) {
+    double res;
+    switch (node->data.binary.operationChar) {
+        case BIN_OP_PLUS: 
+            res = leftNum + rightNum;
+            break;
+        case BIN_OP_MINUS:
+            res = leftNum - rightNum;
+            break;
+        case BIN_OP_STAR:
+            res = leftNum * rightNum;
+            break;
+        case BIN_OP_SLASH:
+            {
+                if (rightNum == 0) {
+                    raiseError("Cannot divide by zero. line %zu column %zu\n", node->line, node->column);
+                }
+                res = leftNum / rightNum;
+                break;
+            }
+        case BIN_OP_EQUALITY:
+        case BIN_OP_NOT_EQUAL:
+        case BIN_OP_LESS:
+        case BIN_OP_GREATER:
+        case BIN_OP_LESSER_EQUAL:
+        case BIN_OP_GREATER_EQUAL:
+            return createBoolValue(compareNumbers(node->data.binary.operationChar, leftNum, rightNum));
+        default:
+            raiseError("Unknown operator.\n");
+    }
+    return createNumberValue(res);
+}
+
+struct Value applyBinaryOperator(const struct ASTNode* node, struct Value left, struct Value right) {
+    if (left.type == VALUE_NUMBER && right.type == VALUE_NUMBER) {
+        return applyNumberOperator(node, left.data.number, right.data.number);
+    }
+    // element-wise, with a number on one side applied to every element
+    bool leftNumeric = left.type == VALUE_NUMBER || left.type == VALUE_NUMBERS;
+    bool rightNumeric = right.type == VALUE_NUMBER || right.type == VALUE_NUMBERS;
+    if (leftNumeric && rightNumeric) {
+        return applyNumbersOperator(node, left, right);
+    }
+    discardTemporary(left);
+    discardTemporary(right);
+    raiseError("Unable to '+'?\n");
+}
+
+// Adaptive evaluation: generic nodes count executions that match a specialisation and
+// rewrite themselves once ADAPTIVE_THRESHOLD is reached. Specialised nodes check their
+// assumption on every execution and rewrite themselves back when it breaks.
+#define ADAPTIVE_THRESHOLD  8
+#define ADAPTIVE_MAX_MISSES 64
+
+static bool recordHit(struct ASTNode* node) {
+    if (node->feedback.misses >= ADAPTIVE_MAX_MISSES) return false;
+    node->feedback.hits++;
+    return node->feedback.hits >= ADAPTIVE_THRESHOLD;
+}
+
+static void cacheEntry(struct ASTNode* node, struct Environment* env, struct Entry* entry) {
+    node->feedback.environmentId = env->id;
+    node->feedback.entry = entry;
+}
+
+static void deoptimise(struct ASTNode* node, enum ASTNodeType genericType) {
+    node->nodeType = genericType;
+    node->feedback.hits = 0;
+    node->feedback.misses++;
+    node->feedback.entry = NULL;
+}
+
+// entry cached by a node, looked up again (and the cache refreshed) when the guard fails
+static struct Entry* cachedEntry(struct ASTNode* node, struct Environment* env, const char* key, enum ASTNodeType genericType) {
+    if (node->feedback.environmentId == env->id) {
+        return node->feedback.entry;
+    }
+
+    // a different environment, for example the next call of the same function
+    struct Entry* entry = findEntry(env, key);
+    if (!ADAPTIVE_ENABLED) return entry;
+    node->feedback.misses++;
+    if (!entry || node->feedback.misses >= ADAPTIVE_MAX_MISSES) {
+        deoptimise(node, genericType);
+    } else {
+        cacheEntry(node, env, entry);
+    }
+    return entry;
+}
+
+static struct Value callFunction(const struct ASTNode* node, const struct Value* function, struct Environment* env);
+
+static bool isVariableReference(const struct ASTNode* node) {
+    return node->nodeType == NODE_VARIABLE_REFERENCE || node->nodeType == NODE_CACHED_VARIABLE_REFERENCE;
+}
+
+static void prepareCall(const struct ASTNode* node, const struct Value* function, struct Environment* env,
+    struct CallScope* scope);
+
+// body is the fn's declaration, so samples taken in the task name it
+static void runTaskBody(const void* body, struct Environment* env) {
+    const struct ASTFunctionDeclaration* declaration = &((const struct ASTNode*) body)->data.funcDeclaration;
+    profileEnter(declaration->name);
+    evaluateAST(declaration->codeBlock, env);
+    profileLeave();
+}
+
+static void runParallelBody(const void* body, struct Environment* env) {
+    adaptiveSuspended = true;
+    evaluateAST(body, env);
+    adaptiveSuspended = false;
+}
+
+bool requireBoolValue(struct Value val, const struct ASTNode* owner) {
+    if (val.type != VALUE_BOOL) {
+        if (owner->nodeType == NODE_IF_STATEMENT) {
+            raiseError("Condition in if statement should have a boolean value, line %zu\n", owner->line);
+        }
+        raiseError("Operands of '&&', '||' and '!' should be boolean values, line %zu\n", owner->line);
+    }
+    return val.data.boolVal;
+}
+
+// Conditions branch straight on a C bool: comparisons compare their operands without
+// creating a boolean Value, and && / || skip the right side once the result is known.
+// owner is the if statement or logical operator the condition belongs to, for errors.
+static bool testCondition(const struct ASTNode* node, struct Environment* env, const struct ASTNode* owner) {
+    switch (node->nodeType) {
+        case NODE_BOOL_LITERAL:
+            return node->data.boolValue;
+        case NODE_LOGICAL_AND:
+            return testCondition(node->data.binary.leftSide, env, node) && testCondition(node->data.binary.rightSide, env, node);
+        case NODE_LOGICAL_OR:
+            return testCondition(node->data.binary.leftSide, env, node) || testCondition(node->data.binary.rightSide, env, node);
+        case NODE_LOGICAL_NOT:
+            return !testCondition(node->data.unary.operand, env, node);
+        case NODE_BINARY_OPERATION:
+        case NODE_GUARDED_NUMBER_BINARY:
+            {
+                if (!isComparisonOperator(node->data.binary.operationChar)) break;
+                struct Value left = evaluateASTNode(node->data.binary.leftSide, env);
+                struct Value right = evaluateASTNode(node->data.binary.rightSide, env);
+                bool numbers = left.type == VALUE_NUMBER && right.type == VALUE_NUMBER;
+
+                if (node->nodeType == NODE_GUARDED_NUMBER_BINARY && !numbers && ADAPTIVE_ENABLED) {
+                    deoptimise((struct ASTNode*) node, NODE_BINARY_OPERATION);
+                } else if (node->nodeType == NODE_BINARY_OPERATION && ADAPTIVE_ENABLED && numbers &&
+                        recordHit((struct ASTNode*) node)) {
+                    ((struct ASTNode*) node)->nodeType = NODE_GUARDED_NUMBER_BINARY;
+                }
+                if (!numbers) {
+                    // reports the operand error, or that numbers compare into numbers
+                    struct Value val = applyBinaryOperator(node, left, right);
+                    discardTemporary(val);
+                    return requireBoolValue(val, owner);
+                }
+                return compareNumbers(node->data.binary.operationChar, left.data.number, right.data.number);
+            }
+        case NODE_NUMBER_EQUAL:
+        case NODE_NUMBER_NOT_EQUAL:
+        case NODE_NUMBER_LESS:
+        case NODE_NUMBER_GREATER:
+        case NODE_NUMBER_LESSER_EQUAL:
+        case NODE_NUMBER_GREATER_EQUAL:
+            {
+                double left = evaluateASTNode(node->data.binary.leftSide, env).data.number;
+                double right = evaluateASTNode(node->data.binary.rightSide, env).data.number;
+                return compareNumbers(node->data.binary.operationChar, left, right);
+            }
+        default:
+            break;
+    }
+    return requireBoolValue(evaluateASTNode(node, env), owner);
+}
+
 struct Value evaluateASTNode(const struct ASTNode* node, struct Environment* env) {
+    countDispatch();
     switch (node->nodeType) {
         case NODE_NUMBER_LITERAL:
             return createNumberValue(node->data.numberValue);
         case NODE_TEXT_LITERAL:
-            return createTextValue(strdup(node->data.textValue));
+            return createTextValue(copyText(node->data.textValue));
         case NODE_BOOL_LITERAL:
             return createBoolValue(node->data.boolValue);
         case NODE_VARIABLE_REFERENCE:
             {
-                struct Value* val = getValue(env, node->data.textValue);
-                if (!val) {
-                    printf("Variable reference %s does not exist, line %zu\n", node->data.textValue, node->line);
-                    exit(1);
+                struct Entry* entry = findEntry(env, node->data.textValue);
+                if (!entry) {
+                    raiseError("Variable reference %s does not exist, line %zu\n", reportedName(node, node->data.textValue), node->line);
                 }
-                return *val;
+                if (ADAPTIVE_ENABLED && recordHit((struct ASTNode*) node)) {
+                    cacheEntry((struct ASTNode*) node, env, entry);
+                    ((struct ASTNode*) node)->nodeType = NODE_CACHED_VARIABLE_REFERENCE;
+                }
+                return entry->value;
+            }
+        case NODE_CACHED_VARIABLE_REFERENCE:
+            {
+                struct Entry* entry = cachedEntry((struct ASTNode*) node, env, node->data.textValue, NODE_VARIABLE_REFERENCE);
+                if (!entry) {
+                    raiseError("Variable reference %s does not exist, line %zu\n", reportedName(node, node->data.textValue), node->line);
+                }
+                return entry->value;
             }
         case NODE_BINARY_OPERATION: 
             {
                 struct Value left = evaluateASTNode(node->data.binary.leftSide, env);
                 struct Value right = evaluateASTNode(node->data.binary.rightSide, env);
-                enum BinaryOperatorTypes op = node->data.binary.operationChar;
-
-                if (left.type == VALUE_NUMBER && right.type == VALUE_NUMBER) {
-                    double leftNum = left.data.number;
-                    double rightNum = right.data.number;
-
-                    double res;
-                    switch (op) {
-                        case BIN_OP_PLUS: 
-                            res = leftNum + rightNum;
-                            break;
-                        case BIN_OP_MINUS:
-                            res = leftNum - rightNum;
-                            break;
-                        case BIN_OP_STAR:
-                            res = leftNum * rightNum;
-                            break;
-                        case BIN_OP_SLASH:
-                            {
-                                if (rightNum == 0) {
-                                    printf("Cannot divide by zero. line %zu column %zu\n", node->line, node->column);
-                                    exit(1);
-                                }
-                                res = leftNum / rightNum;
-                                break;
-                            }
-                        case BIN_OP_EQUALITY:
-                            return createBoolValue(leftNum == rightNum);
-                        case BIN_OP_LESS:
-                            return createBoolValue(leftNum < rightNum);
-                        case BIN_OP_GREATER:
-                            return createBoolValue(leftNum > rightNum);
-                        case BIN_OP_LESSER_EQUAL:
-                            return createBoolValue(leftNum <= rightNum);
-                        case BIN_OP_GREATER_EQUAL:
-                            return createBoolValue(leftNum >= rightNum);
-                        default:
-                            printf("Unknown operator.\n");
-                            exit(1);
-                    }
-                    return createNumberValue(res);
+
+                if (ADAPTIVE_ENABLED && left.type == VALUE_NUMBER && right.type == VALUE_NUMBER &&
+                        recordHit((struct ASTNode*) node)) {
+                    ((struct ASTNode*) node)->nodeType = NODE_GUARDED_NUMBER_BINARY;
+                }
+                return applyBinaryOperator(node, left, right);
+            }
+        case NODE_GUARDED_NUMBER_BINARY:
+            {
+                struct Value left = evaluateASTNode(node->data.binary.leftSide, env);
+                struct Value right = evaluateASTNode(node->data.binary.rightSide, env);
+
+                if (left.type != VALUE_NUMBER || right.type != VALUE_NUMBER) {
+                    if (ADAPTIVE_ENABLED) deoptimise((struct ASTNode*) node, NODE_BINARY_OPERATION);
+                    return applyBinaryOperator(node, left, right);
                 }
-                printf("Unable to '+'?\n");
-                exit(1);
+                return applyNumberOperator(node, left.data.number, right.data.number);
+            }
+        // operands already proven to be numbers by the type checker
+        case NODE_NUMBER_ADD:
+            {
+                double left = evaluateASTNode(node->data.binary.leftSide, env).data.number;
+                return createNumberValue(left + evaluateASTNode(node->data.binary.rightSide, env).data.number);
+            }
+        case NODE_NUMBER_SUBTRACT:
+            {
+                double left = evaluateASTNode(node->data.binary.leftSide, env).data.number;
+                return createNumberValue(left - evaluateASTNode(node->data.binary.rightSide, env).data.number);
+            }
+        case NODE_NUMBER_MULTIPLY:
+            {
+                double left = evaluateASTNode(node->data.binary.leftSide, env).data.number;
+                return createNumberValue(left * evaluateASTNode(node->data.binary.rightSide, env).data.number);
+            }
+        case NODE_NUMBER_DIVIDE:
+            {
+                double left = evaluateASTNode(node->data.binary.leftSide, env).data.number;
+                double right = evaluateASTNode(node->data.binary.rightSide, env).data.number;
+                if (right == 0) {
+                    raiseError("Cannot divide by zero. line %zu column %zu\n", node->line, node->column);
+                }
+                return createNumberValue(left / right);
+            }
+        case NODE_NUMBER_EQUAL:
+            {
+                double left = evaluateASTNode(node->data.binary.leftSide, env).data.number;
+                return createBoolValue(left == evaluateASTNode(node->data.binary.rightSide, env).data.number);
+            }
+        case NODE_NUMBER_NOT_EQUAL:
+            {
+                double left = evaluateASTNode(node->data.binary.leftSide, env).data.number;
+                return createBoolValue(left != evaluateASTNode(node->data.binary.rightSide, env).data.number);
+            }
+        case NODE_LOGICAL_AND:
+        case NODE_LOGICAL_OR:
+        case NODE_LOGICAL_NOT:
+            return createBoolValue(testCondition(node, env, node));
+        case NODE_NUMBER_LESS:
+            {
+                double left = evaluateASTNode(node->data.binary.leftSide, env).data.number;
+                return createBoolValue(left < evaluateASTNode(node->data.binary.rightSide, env).data.number);
+            }
+        case NODE_NUMBER_GREATER:
+            {
+                double left = evaluateASTNode(node->data.binary.leftSide, env).data.number;
+                return createBoolValue(left > evaluateASTNode(node->data.binary.rightSide, env).data.number);
+            }
+        case NODE_NUMBER_LESSER_EQUAL:
+            {
+                double left = evaluateASTNode(node->data.binary.leftSide, env).data.number;
+                return createBoolValue(left <= evaluateASTNode(node->data.binary.rightSide, env).data.number);
+            }
+        case NODE_NUMBER_GREATER_EQUAL:
+            {
+                double left = evaluateASTNode(node->data.binary.leftSide, env).data.number;
+                return createBoolValue(left >= evaluateASTNode(node->data.binary.rightSide, env).data.number);
             }
         case NODE_VARIABLE_DECLARATION: 
             {
                 struct Value* previousData = getValue(env, node->data.varDeclaration.name);
                 // if get data does exists
                 if (previousData) {
-                    printf("Variable with name '%s' already exists, therefore cannot declare with same name. Line %zu\n", node->data.varDeclaration.name, node->line);
-                    exit(1);
+                    raiseError("Variable with name '%s' already exists, therefore cannot declare with same name. Line %zu\n",
+                        reportedName(node, node->data.varDeclaration.name), node->line);
                 }
                 struct Value val = evaluateASTNode(node->data.varDeclaration.node, env);
                 // val.type matches node->nodeType then set, else type error.
-                bool typeMatch = doesDataTypeMatchesData(val.type, node->data.varDeclaration.dataType);
+                bool typeMatch = node->data.varDeclaration.typeChecked ||
+                    doesDataTypeMatchesData(val.type, node->data.varDeclaration.dataType);
                 if (!typeMatch) {
-                    printf("Cannot assign variable at line %zu, data and type does not match.\n", node->line);
-                    exit(1);
+                    raiseError("Cannot assign variable at line %zu, data and type does not match.\n", node->line);
+                }
+                // text read from another variable stays that variable's, each frees its own
+                if (val.type == VALUE_TEXT && isVariableReference(node->data.varDeclaration.node)) {
+                    val.data.text = copyText(val.data.text);
                 }
-
                 setValue(env, node->data.varDeclaration.name, val);
                 return val;
             }
@@ -201,15 +569,23 @@ struct Value evaluateASTNode(const struct ASTNode* node, struct Environment* env
                 struct Value* previousData = getValue(env, node->data.varAssignment.name);
                 // if get data does not exist
                 if (!previousData) {
-                    printf("Variable reference on line %zu does not exist, therefore cannot assign value.\n", node->line);
-                    exit(1);
+                    raiseError("Variable reference on line %zu does not exist, therefore cannot assign value.\n", node->line);
                 }
                 struct Value val = evaluateASTNode(node->data.varAssignment.node, env);
                 // if datatype does not match
-                if (previousData->type != val.type) {
-                    printf("Assigning variable datatype does not match on line %zu.\n", node->line);
-                    exit(1);
+                if (!node->data.varAssignment.typeChecked && previousData->type != val.type) {
+                    raiseError("Assigning variable datatype does not match on line %zu.\n", node->line);
                 }
+                if (val.type == VALUE_TEXT && isVariableReference(node->data.varAssignment.node)) {
+                    val.data.text = copyText(val.data.text);
+                }
+                setValue(env, node->data.varAssignment.name, val);
+                return val;
+            }
+        case NODE_TEMPORARY_SET:
+            {
+                // compiler temporaries never hold text, arrays are retained like any other value
+                struct Value val = evaluateASTNode(node->data.varAssignment.node, env);
                 setValue(env, node->data.varAssignment.name, val);
                 return val;
             }
@@ -220,44 +596,93 @@ struct Value evaluateASTNode(const struct ASTNode* node, struct Environment* env
                 setValue(env, node->data.funcDeclaration.name, val);
                 return val;
             }
+        case NODE_IMPORT:
+            // binds the module's fns, and those of the modules it imports
+            evaluateAST(&node->data.import.module->program, env);
+            return createNumberValue(0);
         case NODE_FUNCTION_CALL:
             {
-                struct Value val = *getValue(env, node->data.funcCall.name);
-                struct ASTFunctionDeclaration funcDeclaration = val.originNode->data.funcDeclaration;
-
-                if (funcDeclaration.parameterCount != node->data.funcCall.argumentCount) {
-                    printf("Argument count does not match. Expected %zu, got %zu. Line %zu\n", 
-                        funcDeclaration.parameterCount, node->data.funcCall.argumentCount, node->line);
-                    exit(1);
+                struct Entry* entry = findEntry(env, node->data.funcCall.name);
+                if (entry && ADAPTIVE_ENABLED && entry->value.type == VALUE_FUNCTION && recordHit((struct ASTNode*) node)) {
+                    cacheEntry((struct ASTNode*) node, env, entry);
+                    ((struct ASTNode*) node)->nodeType = NODE_CACHED_FUNCTION_CALL;
                 }
-                
-                struct Environment scopeEnv;
-                createEnvironment(&scopeEnv);
-
-                for (size_t i = 0; i < node->data.funcCall.argumentCount; i++) {
-                    struct Value argVal = evaluateASTNode(node->data.funcCall.arguments[i], env);
-                    if (!doesDataTypeMatchesData(argVal.type, funcDeclaration.parameters[i].dataType)) {
-                        printf("Datatype of argument does not match relative parameter datatype, line %zu\n", node->line);
-                        exit(1);
-                    }
-                    setValue(&scopeEnv, funcDeclaration.parameters[i].name, argVal);
+                return callFunction(node, entry ? &entry->value : NULL, env);
+            }
+        case NODE_CACHED_FUNCTION_CALL:
+            {
+                struct Entry* entry = cachedEntry((struct ASTNode*) node, env, node->data.funcCall.name, NODE_FUNCTION_CALL);
+                return callFunction(node, entry ? &entry->value : NULL, env);
+            }
+        case NODE_SPAWN:
+            {
+                struct Value* function = getValue(env, node->data.funcCall.name);
+                struct CallScope scope;
+                prepareCall(node, function, env, &scope);
+                // the task frees the scope
+                leaveCallScope(&scope);
+                return spawnTask(function->originNode, runTaskBody, &scope.env);
+            }
+        case NODE_AWAIT:
+            return awaitTask(node, evaluateASTNode(node->data.unary.operand, env));
+        case NODE_BUILTIN_CALL:
+            {
+                const struct ASTBuiltinCall* call = &node->data.builtinCall;
+                struct Value arguments[MAX_BUILTIN_PARAMETERS];
+                for (size_t i = 0; i < call->argumentCount; i++) {
+                    arguments[i] = evaluateASTNode(call->arguments[i], env);
                 }
-
-                evaluateAST(val.data.nodeList, &scopeEnv);
-                freeEnvironment(&scopeEnv);
-                // could change later to get a return
+                return callBuiltin(node, arguments);
+            }
+        case NODE_NUMBERS:
+            {
+                const struct ASTNumbers* numbers = &node->data.numbers;
+                struct NumberArray* array = createNumberArray(numbers->elementCount);
+                for (size_t i = 0; i < numbers->elementCount; i++) {
+                    storeNumbersElement(node, array, i, evaluateASTNode(numbers->elements[i], env));
+                }
+                return createNumbersValue(array);
+            }
+        case NODE_INDEX:
+            {
+                struct Value container = evaluateASTNode(node->data.binary.leftSide, env);
+                struct Value key = evaluateASTNode(node->data.binary.rightSide, env);
+                if (container.type == VALUE_MAP) {
+                    return indexMap(node, container, key);
+                }
+                return indexNumbers(node, container, key);
+            }
+        case NODE_MAP:
+            {
+                const struct ASTMap* literal = &node->data.map;
+                struct Value map = createMapValue(createMap());
+                for (size_t i = 0; i < literal->entryCount; i++) {
+                    struct Value key = evaluateASTNode(literal->keys[i], env);
+                    struct Value value = evaluateASTNode(literal->values[i], env);
+                    storeMapElement(node, map, literal->keys[i], key, literal->values[i], value);
+                }
+                return map;
+            }
+        case NODE_INDEX_ASSIGN:
+            {
+                const struct ASTIndexAssignment* assignment = &node->data.indexAssignment;
+                struct Value* target = getValue(env, assignment->name);
+                if (!target) {
+                    raiseError("Variable reference on line %zu does not exist, therefore cannot assign value.\n", node->line);
+                }
+                if (target->type != VALUE_MAP) {
+                    raiseError("Only map elements can be assigned to, line %zu\n", node->line);
+                }
+                struct Value map = *target;
+                struct Value key = evaluateASTNode(assignment->key, env);
+                struct Value value = evaluateASTNode(assignment->value, env);
+                storeMapElement(node, map, assignment->key, key, assignment->value, value);
                 return createNumberValue(0);
-
             }
         case NODE_IF_STATEMENT:
             {
-                // get value of condition, should be boolean. If true then execute code block.
-                struct Value val = evaluateASTNode(node->data.ifStatement.condition, env);
-                if (val.type != VALUE_BOOL) {
-                    printf("Condition in if statement should have a boolean value, line %zu\n", node->line);
-                    exit(1);
-                }
-                if (val.data.boolVal) {
+                // condition should be boolean. If true then execute code block.
+                if (testCondition(node->data.ifStatement.condition, env, node)) {
                     evaluateAST(node->data.ifStatement.conditionTrueBlock, env);
                 }
                 return createNumberValue(0);
@@ -267,41 +692,155 @@ struct Value evaluateASTNode(const struct ASTNode* node, struct Environment* env
                 struct Value loopCount = evaluateASTNode(node->data.loopStatement.loopCount, env);
                 // not number
                 if (loopCount.type != VALUE_NUMBER) {
-                    printf("Loop count must be a number value, line %zu\n", node->line);
-                    exit(1);
+                    raiseError("Loop count must be a number value, line %zu\n", node->line);
                 }
                 // negative
                 if (loopCount.data.number < 0.0) {
-                    printf("Negative loop count is not possible, line %zu\n", node->line);
-                    exit(1);
+                    raiseError("Negative loop count is not possible, line %zu\n", node->line);
                 }
                 // convert double value to size_t,
                 size_t loopAmount = (size_t) loopCount.data.number;
+                uint64_t start = traceStart();
                 for (size_t i = 0; i < loopAmount; i++) {
                     evaluateAST(node->data.loopStatement.loopCodeBlock, env);
                 }
+                traceSpan(TRACE_LOOP, "loop", loopAmount, node->line, start);
+                return createNumberValue(0);
+            }
+        case NODE_PARALLEL_LOOP:
+            {
+                struct Value loopCount = evaluateASTNode(node->data.parallelLoop.loopCount, env);
+                runParallelLoop(node, loopCount, node->data.parallelLoop.loopCodeBlock, runParallelBody, env);
+                return createNumberValue(0);
+            }
+        case NODE_INLINED_BLOCK:
+            {
+                // same checks as NODE_FUNCTION_CALL, but the body runs in the caller's environment
+                const struct ASTInlinedBlock* block = &node->data.inlinedBlock;
+                for (size_t i = 0; i < block->argumentCount; i++) {
+                    struct Value argVal = evaluateASTNode(block->arguments[i], env);
+                    if (!block->typeChecked && !doesDataTypeMatchesData(argVal.type, block->parameters[i].dataType)) {
+                        raiseError("Datatype of argument does not match relative parameter datatype, line %zu\n", node->line);
+                    }
+                    // like a call, the renamed parameter is removed with the locals and frees its text
+                    if (argVal.type == VALUE_TEXT && isVariableReference(block->arguments[i])) {
+                        argVal.data.text = copyText(argVal.data.text);
+                    }
+                    setValue(env, block->parameters[i].name, argVal);
+                }
+
+                evaluateAST(block->codeBlock, env);
+
+                for (size_t i = 0; i < block->localCount; i++) {
+                    removeValue(env, block->locals[i]);
+                }
                 return createNumberValue(0);
             }
         default:
-            printf("Unhandled node.\n");
-            exit(1);
+            raiseError("Unhandled node.\n");
+    }
+}
+
+// checks the call and binds its arguments in a fresh scope, entered
+static void prepareCall(const struct ASTNode* node, const struct Value* function, struct Environment* env,
+        struct CallScope* scope) {
+    if (!function || function->type != VALUE_FUNCTION) {
+        raiseError("Function %s does not exist, line %zu\n", node->data.funcCall.name, node->line);
+    }
+    struct Value val = *function;
+    struct ASTFunctionDeclaration funcDeclaration = val.originNode->data.funcDeclaration;
+    bool typeChecked = node->data.funcCall.typeChecked;
+
+    if (!typeChecked && funcDeclaration.parameterCount != node->data.funcCall.argumentCount) {
+        raiseError("Argument count does not match. Expected %zu, got %zu. Line %zu\n", 
+            funcDeclaration.parameterCount, node->data.funcCall.argumentCount, node->line);
+    }
+    
+    createEnvironment(&scope->env);
+    enterCallScope(scope);
+
+    for (size_t i = 0; i < node->data.funcCall.argumentCount; i++) {
+        struct Value argVal = evaluateASTNode(node->data.funcCall.arguments[i], env);
+        if (!typeChecked && !doesDataTypeMatchesData(argVal.type, funcDeclaration.parameters[i].dataType)) {
+            raiseError("Datatype of argument does not match relative parameter datatype, line %zu\n", node->line);
+        }
+        // text read from a variable still belongs to the caller, the scope frees what it holds
+        if (argVal.type == VALUE_TEXT && isVariableReference(node->data.funcCall.arguments[i])) {
+            argVal.data.text = copyText(argVal.data.text);
+        }
+        // a task gets its own copy of a map, it runs on another thread
+        if (argVal.type == VALUE_MAP && node->nodeType == NODE_SPAWN) {
+            argVal = detachMap(argVal);
+        }
+        setValue(&scope->env, funcDeclaration.parameters[i].name, argVal);
+    }
+}
+
+static struct Value callFunction(const struct ASTNode* node, const struct Value* function, struct Environment* env) {
+    struct CallScope scope;
+    prepareCall(node, function, env, &scope);
+    const char* name = function->originNode->data.funcDeclaration.name;
+    // a module's fns are shared by every program importing it, their nodes are left as parsed
+    bool suspended = adaptiveSuspended;
+    adaptiveSuspended = suspended || function->originNode->data.funcDeclaration.shared;
+    uint64_t start = traceStart();
+    profileEnter(name);
+    evaluateAST(function->data.nodeList, &scope.env);
+    profileLeave();
+    adaptiveSuspended = suspended;
+    traceSpan(TRACE_CALL, name, node->data.funcCall.argumentCount, node->line, start);
+    leaveCallScope(&scope);
+    freeEnvironment(&scope.env);
+    // could change later to get a return
+    return createNumberValue(0);
+}
+
+// the value as printed, without the line break, maps print their elements through it
+void writeValue(struct Value val) {
+    if (val.type == VALUE_NUMBER) {
+        char buffer[NUMBER_TEXT_SIZE];
+        size_t length = formatNumber(val.data.number, buffer);
+        writeOutput(buffer, length);
+    } else if (val.type == VALUE_TEXT) {
+        writeOutput(val.data.text, strlen(val.data.text));
+    } else if (val.type == VALUE_BOOL) {
+        if (val.data.boolVal) {
+            writeOutput("true", 4);
+        } else {
+            writeOutput("false", 5);
+        }
+    } else if (val.type == VALUE_NUMBERS) {
+        writeNumbers(val.data.numbers);
+    } else if (val.type == VALUE_MAP) {
+        writeMap(val.data.map);
+    }
+}
+
+void printValue(struct Value val) {
+    if (getOutputFormat() == OUTPUT_BINARY) {
+        writeBinaryValue(val);
+    } else if (val.type == VALUE_NUMBER) {
+        char buffer[NUMBER_TEXT_SIZE + 1];
+        size_t length = formatNumber(val.data.number, buffer);
+        buffer[length++] = '\n';
+        writeOutput(buffer, length);
+    } else if (val.type == VALUE_TEXT || val.type == VALUE_BOOL || val.type == VALUE_NUMBERS || val.type == VALUE_MAP) {
+        writeValue(val);
+        writeOutput("\n", 1);
     }
 }
 
 void evaluateAST(const struct ASTNodeList* astList, struct Environment* env) {
     for (size_t i = 0; i < astList->count; i++) {
         struct ASTNode* node = astList->nodes[i];
+        profileStatement(node);
         struct Value val = evaluateASTNode(node, env);
 
         // TEMP: print method without language builtins.
-        if (node->nodeType == NODE_VARIABLE_REFERENCE) {
-            if (val.type == VALUE_NUMBER) {
-                printf("%g\n", val.data.number);
-            } else if (val.type == VALUE_TEXT) {
-                printf("%s\n", val.data.text);
-            } else if (val.type == VALUE_BOOL) {
-                printf("%s\n", val.data.boolVal ? "true" : "false");
-            }
+        if (node->nodeType == NODE_VARIABLE_REFERENCE || node->nodeType == NODE_CACHED_VARIABLE_REFERENCE) {
+            printValue(val);
         }
+        // an expression statement's array is not kept anywhere
+        discardTemporary(val);
     }
 }
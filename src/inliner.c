@@ -0,0 +1,442 @@
+#include "../include/inliner.h"
+#include "../include/allocator.h"
+#include "../include/modules.h"
+#include <stdio.h>
+#include <string.h>
+
+// A function body is only substituted when running it in the caller's environment
+// behaves exactly like running it in the fresh environment NODE_FUNCTION_CALL creates:
+//  - it is declared once, at the top level, before the call site
+//  - it is a leaf, no calls or nested fn declarations (so it can never be recursive)
+//  - every name it touches is a parameter or one of its own declarations
+// Those names are renamed with a '$' suffix, which the tokeniser never produces,
+// and removed from the environment when the inlined block finishes.
+
+struct InlineCandidate {
+    const struct ASTNode*   declaration;
+    bool                    visible;
+    const char*             rejectReason;
+    size_t                  bodySize;
+
+    // parameters first, then names declared in the body
+    char**                  locals;
+    size_t                  localCount;
+};
+
+struct InlineContext {
+    const struct InlineOptions* options;
+    struct InlineCandidate*     candidates;
+    size_t                      candidateCount;
+    size_t                      nodesAdded;
+    size_t                      inlinedCalls;
+    size_t                      nextSiteId;
+};
+
+static bool containsString(char** names, size_t count, const char* name) {
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(names[i], name) == 0) return true;
+    }
+    return false;
+}
+
+static void addLocal(struct InlineCandidate* candidate, const char* name) {
+    if (containsString(candidate->locals, candidate->localCount, name)) return;
+    candidate->locals = resizeMemory(candidate->locals, sizeof(char*) * (candidate->localCount + 1));
+    candidate->locals[candidate->localCount] = (char*) name;
+    candidate->localCount++;
+}
+
+// counts how often a name is bound anywhere in the program, functions and variables alike
+static size_t countBindings(const struct ASTNodeList* list, const char* name) {
+    size_t total = 0;
+    for (size_t i = 0; i < list->count; i++) {
+        const struct ASTNode* n = list->nodes[i];
+        switch (n->nodeType) {
+            case NODE_FUNCTION_DECLARATION:
+                if (strcmp(n->data.funcDeclaration.name, name) == 0) total++;
+                total += countBindings(n->data.funcDeclaration.codeBlock, name);
+                break;
+            case NODE_VARIABLE_DECLARATION:
+                if (strcmp(n->data.varDeclaration.name, name) == 0) total++;
+                break;
+            case NODE_VARIABLE_ASSIGN:
+                if (strcmp(n->data.varAssignment.name, name) == 0) total++;
+                break;
+            case NODE_IMPORT:
+                total += countBindings(&n->data.import.module->program, name);
+                break;
+            case NODE_IF_STATEMENT:
+                total += countBindings(n->data.ifStatement.conditionTrueBlock, name);
+                break;
+            case NODE_LOOP_STATEMENT:
+                total += countBindings(n->data.loopStatement.loopCodeBlock, name);
+                break;
+            case NODE_PARALLEL_LOOP:
+                if (n->data.parallelLoop.indexName && strcmp(n->data.parallelLoop.indexName, name) == 0) total++;
+                total += countBindings(n->data.parallelLoop.loopCodeBlock, name);
+                break;
+            default:
+                break;
+        }
+    }
+    return total;
+}
+
+static void collectDeclaredNames(struct InlineCandidate* candidate, const struct ASTNodeList* list) {
+    for (size_t i = 0; i < list->count; i++) {
+        const struct ASTNode* n = list->nodes[i];
+        switch (n->nodeType) {
+            case NODE_VARIABLE_DECLARATION:
+                addLocal(candidate, n->data.varDeclaration.name);
+                break;
+            case NODE_IF_STATEMENT:
+                collectDeclaredNames(candidate, n->data.ifStatement.conditionTrueBlock);
+                break;
+            case NODE_LOOP_STATEMENT:
+                collectDeclaredNames(candidate, n->data.loopStatement.loopCodeBlock);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+static const char* checkClosedNode(const struct InlineCandidate* candidate, const struct ASTNode* n);
+
+static const char* checkClosedList(const struct InlineCandidate* candidate, const struct ASTNodeList* list) {
+    for (size_t i = 0; i < list->count; i++) {
+        const char* reason = checkClosedNode(candidate, list->nodes[i]);
+        if (reason) return reason;
+    }
+    return NULL;
+}
+
+// returns why the body cannot be moved into the caller's environment, or NULL
+static const char* checkClosedNode(const struct InlineCandidate* candidate, const struct ASTNode* n) {
+    if (!n) return NULL;
+    switch (n->nodeType) {
+        case NODE_VARIABLE_REFERENCE:
+            if (!containsString(candidate->locals, candidate->localCount, n->data.textValue)) {
+                return "references a name outside its scope";
+            }
+            return NULL;
+        case NODE_BINARY_OPERATION:
+        case NODE_INDEX:
+        case NODE_LOGICAL_AND:
+        case NODE_LOGICAL_OR:
+        CASE_NUMBER_BINARY_NODES:
+            {
+                const char* reason = checkClosedNode(candidate, n->data.binary.leftSide);
+                return reason ? reason : checkClosedNode(candidate, n->data.binary.rightSide);
+            }
+        case NODE_NUMBERS:
+            for (size_t i = 0; i < n->data.numbers.elementCount; i++) {
+                const char* reason = checkClosedNode(candidate, n->data.numbers.elements[i]);
+                if (reason) return reason;
+            }
+            return NULL;
+        case NODE_MAP:
+            for (size_t i = 0; i < n->data.map.entryCount; i++) {
+                const char* reason = checkClosedNode(candidate, n->data.map.keys[i]);
+                if (!reason) reason = checkClosedNode(candidate, n->data.map.values[i]);
+                if (reason) return reason;
+            }
+            return NULL;
+        case NODE_INDEX_ASSIGN:
+            {
+                if (!containsString(candidate->locals, candidate->localCount, n->data.indexAssignment.name)) {
+                    return "assigns a name outside its scope";
+                }
+                const char* reason = checkClosedNode(candidate, n->data.indexAssignment.key);
+                return reason ? reason : checkClosedNode(candidate, n->data.indexAssignment.value);
+            }
+        case NODE_BUILTIN_CALL:
+            for (size_t i = 0; i < n->data.builtinCall.argumentCount; i++) {
+                const char* reason = checkClosedNode(candidate, n->data.builtinCall.arguments[i]);
+                if (reason) return reason;
+            }
+            return NULL;
+        case NODE_LOGICAL_NOT:
+        case NODE_AWAIT:
+            return checkClosedNode(candidate, n->data.unary.operand);
+        case NODE_VARIABLE_DECLARATION:
+            return checkClosedNode(candidate, n->data.varDeclaration.node);
+        case NODE_VARIABLE_ASSIGN:
+            if (!containsString(candidate->locals, candidate->localCount, n->data.varAssignment.name)) {
+                return "assigns a name outside its scope";
+            }
+            return checkClosedNode(candidate, n->data.varAssignment.node);
+        case NODE_FUNCTION_DECLARATION:
+            return "declares a nested function";
+        case NODE_FUNCTION_CALL:
+        case NODE_INLINED_BLOCK:
+        case NODE_SPAWN:
+            return "calls another function";
+        case NODE_IF_STATEMENT:
+            {
+                const char* reason = checkClosedNode(candidate, n->data.ifStatement.condition);
+                return reason ? reason : checkClosedList(candidate, n->data.ifStatement.conditionTrueBlock);
+            }
+        case NODE_LOOP_STATEMENT:
+            {
+                const char* reason = checkClosedNode(candidate, n->data.loopStatement.loopCount);
+                return reason ? reason : checkClosedList(candidate, n->data.loopStatement.loopCodeBlock);
+            }
+        case NODE_PARALLEL_LOOP:
+            return "contains a parallel loop";
+        default:
+            return NULL;
+    }
+}
+
+static void analyseCandidate(struct InlineCandidate* candidate, const struct ASTNodeList* program) {
+    const struct ASTFunctionDeclaration* decl = &candidate->declaration->data.funcDeclaration;
+
+    for (size_t i = 0; i < decl->parameterCount; i++) {
+        if (containsString(candidate->locals, candidate->localCount, decl->parameters[i].name)) {
+            candidate->rejectReason = "has duplicate parameter names";
+            return;
+        }
+        addLocal(candidate, decl->parameters[i].name);
+    }
+    collectDeclaredNames(candidate, decl->codeBlock);
+
+    if (countBindings(program, decl->name) != 1) {
+        candidate->rejectReason = "name is bound more than once";
+        return;
+    }
+
+    candidate->bodySize = countASTNodes(decl->codeBlock);
+    if (candidate->bodySize > INLINE_MAX_CALLEE_NODES) {
+        candidate->rejectReason = "body is too large";
+        return;
+    }
+
+    candidate->rejectReason = checkClosedList(candidate, decl->codeBlock);
+}
+
+static struct InlineCandidate* findCandidate(struct InlineContext* ctx, const char* name) {
+    for (size_t i = 0; i < ctx->candidateCount; i++) {
+        if (strcmp(ctx->candidates[i].declaration->data.funcDeclaration.name, name) == 0) {
+            return &ctx->candidates[i];
+        }
+    }
+    return NULL;
+}
+
+static void renameList(struct ASTNodeList* list, char** from, char** to, size_t count);
+
+// renames a name held by n, which keeps the source name for errors
+static void renameName(struct ASTNode* n, char** name, char** from, char** to, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(*name, from[i]) == 0) {
+            freeMemory(*name);
+            *name = copyText(to[i]);
+            if (!n->sourceName) n->sourceName = copyText(from[i]);
+            return;
+        }
+    }
+}
+
+static void renameNode(struct ASTNode* n, char** from, char** to, size_t count) {
+    if (!n) return;
+    switch (n->nodeType) {
+        case NODE_VARIABLE_REFERENCE:
+            renameName(n, &n->data.textValue, from, to, count);
+            break;
+        case NODE_BINARY_OPERATION:
+        case NODE_INDEX:
+        case NODE_LOGICAL_AND:
+        case NODE_LOGICAL_OR:
+        CASE_NUMBER_BINARY_NODES:
+            renameNode(n->data.binary.leftSide, from, to, count);
+            renameNode(n->data.binary.rightSide, from, to, count);
+            break;
+        case NODE_NUMBERS:
+            for (size_t i = 0; i < n->data.numbers.elementCount; i++) {
+                renameNode(n->data.numbers.elements[i], from, to, count);
+            }
+            break;
+        case NODE_MAP:
+            for (size_t i = 0; i < n->data.map.entryCount; i++) {
+                renameNode(n->data.map.keys[i], from, to, count);
+                renameNode(n->data.map.values[i], from, to, count);
+            }
+            break;
+        case NODE_INDEX_ASSIGN:
+            renameName(n, &n->data.indexAssignment.name, from, to, count);
+            renameNode(n->data.indexAssignment.key, from, to, count);
+            renameNode(n->data.indexAssignment.value, from, to, count);
+            break;
+        case NODE_BUILTIN_CALL:
+            for (size_t i = 0; i < n->data.builtinCall.argumentCount; i++) {
+                renameNode(n->data.builtinCall.arguments[i], from, to, count);
+            }
+            break;
+        case NODE_LOGICAL_NOT:
+        case NODE_AWAIT:
+            renameNode(n->data.unary.operand, from, to, count);
+            break;
+        case NODE_VARIABLE_DECLARATION:
+            renameName(n, &n->data.varDeclaration.name, from, to, count);
+            renameNode(n->data.varDeclaration.node, from, to, count);
+            break;
+        case NODE_VARIABLE_ASSIGN:
+            renameName(n, &n->data.varAssignment.name, from, to, count);
+            renameNode(n->data.varAssignment.node, from, to, count);
+            break;
+        case NODE_IF_STATEMENT:
+            renameNode(n->data.ifStatement.condition, from, to, count);
+            renameList(n->data.ifStatement.conditionTrueBlock, from, to, count);
+            break;
+        case NODE_LOOP_STATEMENT:
+            renameNode(n->data.loopStatement.loopCount, from, to, count);
+            renameList(n->data.loopStatement.loopCodeBlock, from, to, count);
+            break;
+        default:
+            break;
+    }
+}
+
+static void renameList(struct ASTNodeList* list, char** from, char** to, size_t count) {
+    for (size_t i = 0; i < list->count; i++) {
+        renameNode(list->nodes[i], from, to, count);
+    }
+}
+
+// builds the NODE_INLINED_BLOCK replacing `call`, the call node's arguments are moved into it
+static struct ASTNode* expandCall(struct InlineContext* ctx, const struct InlineCandidate* candidate, struct ASTNode* call) {
+    const struct ASTFunctionDeclaration* decl = &candidate->declaration->data.funcDeclaration;
+    size_t siteId = ctx->nextSiteId++;
+
+    char** freshNames = allocMemory(sizeof(char*) * (candidate->localCount ? candidate->localCount : 1));
+    for (size_t i = 0; i < candidate->localCount; i++) {
+        size_t length = strlen(candidate->locals[i]) + 24;
+        freshNames[i] = allocMemory(length);
+        snprintf(freshNames[i], length, "%s$%zu", candidate->locals[i], siteId);
+    }
+
+    struct ASTNode* node = allocZeroed(1, sizeof(struct ASTNode));
+    node->nodeType = NODE_INLINED_BLOCK;
+    node->line = call->line;
+    node->column = call->column;
+
+    struct ASTInlinedBlock* block = &node->data.inlinedBlock;
+    block->functionName = copyText(decl->name);
+    block->argumentCount = decl->parameterCount;
+    block->arguments = call->data.funcCall.arguments;
+    block->typeChecked = call->data.funcCall.typeChecked;
+    block->parameters = NULL;
+    if (decl->parameterCount > 0) {
+        block->parameters = allocMemory(sizeof(struct Parameter) * decl->parameterCount);
+        for (size_t i = 0; i < decl->parameterCount; i++) {
+            block->parameters[i].dataType = decl->parameters[i].dataType;
+            // parameters are the first locals
+            block->parameters[i].name = copyText(freshNames[i]);
+        }
+    }
+
+    block->codeBlock = cloneAST(decl->codeBlock);
+    renameList(block->codeBlock, candidate->locals, freshNames, candidate->localCount);
+
+    block->locals = freshNames;
+    block->localCount = candidate->localCount;
+
+    // arguments now belong to the inlined block
+    freeMemory(call->data.funcCall.name);
+    freeMemory(call);
+    return node;
+}
+
+static void inlineList(struct InlineContext* ctx, struct ASTNodeList* list, bool topLevel) {
+    for (size_t i = 0; i < list->count; i++) {
+        struct ASTNode* n = list->nodes[i];
+        switch (n->nodeType) {
+            case NODE_FUNCTION_DECLARATION:
+                {
+                    // function bodies run in their own environment, calls there cannot see the top level
+                    struct InlineCandidate* candidate = findCandidate(ctx, n->data.funcDeclaration.name);
+                    if (topLevel && candidate && candidate->declaration == n) {
+                        candidate->visible = true;
+                    }
+                    break;
+                }
+            case NODE_FUNCTION_CALL:
+                {
+                    struct InlineCandidate* candidate = findCandidate(ctx, n->data.funcCall.name);
+                    if (!candidate || !candidate->visible) break;
+
+                    const char* reason = candidate->rejectReason;
+                    if (!reason && n->data.funcCall.argumentCount != candidate->declaration->data.funcDeclaration.parameterCount) {
+                        reason = "argument count does not match";
+                    }
+                    if (!reason && ctx->nodesAdded + candidate->bodySize > ctx->options->budget) {
+                        reason = "size budget exhausted";
+                    }
+
+                    if (reason) {
+                        if (ctx->options->report) {
+                            fprintf(stderr, "inline: skipped '%s' at line %zu, %s\n", n->data.funcCall.name, n->line, reason);
+                        }
+                        break;
+                    }
+
+                    if (ctx->options->report) {
+                        fprintf(stderr, "inline: '%s' at line %zu, column %zu (%zu nodes)\n",
+                            n->data.funcCall.name, n->line, n->column, candidate->bodySize);
+                    }
+                    list->nodes[i] = expandCall(ctx, candidate, n);
+                    ctx->nodesAdded += candidate->bodySize;
+                    ctx->inlinedCalls++;
+                    break;
+                }
+            case NODE_IF_STATEMENT:
+                inlineList(ctx, n->data.ifStatement.conditionTrueBlock, false);
+                break;
+            case NODE_LOOP_STATEMENT:
+                inlineList(ctx, n->data.loopStatement.loopCodeBlock, false);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+void inlineFunctions(struct ASTNodeList* program, const struct InlineOptions* options) {
+    struct InlineContext ctx;
+    ctx.options = options;
+    ctx.candidates = NULL;
+    ctx.candidateCount = 0;
+    ctx.nodesAdded = 0;
+    ctx.inlinedCalls = 0;
+    ctx.nextSiteId = 1;
+
+    for (size_t i = 0; i < program->count; i++) {
+        const struct ASTNode* n = program->nodes[i];
+        if (n->nodeType != NODE_FUNCTION_DECLARATION) continue;
+
+        ctx.candidates = resizeMemory(ctx.candidates, sizeof(struct InlineCandidate) * (ctx.candidateCount + 1));
+        struct InlineCandidate* candidate = &ctx.candidates[ctx.candidateCount];
+        candidate->declaration = n;
+        candidate->visible = false;
+        candidate->rejectReason = NULL;
+        candidate->bodySize = 0;
+        candidate->locals = NULL;
+        candidate->localCount = 0;
+        analyseCandidate(candidate, program);
+        ctx.candidateCount++;
+    }
+
+    inlineList(&ctx, program, true);
+
+    if (options->report) {
+        fprintf(stderr, "inline: %zu call site(s) inlined, %zu of %zu node budget used\n",
+            ctx.inlinedCalls, ctx.nodesAdded, options->budget);
+    }
+
+    // locals only borrow names from the declarations
+    for (size_t i = 0; i < ctx.candidateCount; i++) {
+        freeMemory(ctx.candidates[i].locals);
+    }
+    freeMemory(ctx.candidates);
+}
@@ -0,0 +1,110 @@
+#include "../include/interp.h"
+#include "../include/allocator.h"
+#include "../include/parser.h"
+#include "../include/runtime.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct InterpProgram {
+    struct ASTNodeList ast;
+};
+
+static void copyMessage(char* destination, size_t size, const char* message) {
+    if (size == 0) return;
+    // messages end in a newline for the command line, callers get the text only
+    size_t length = strcspn(message, "\n");
+    if (length >= size) length = size - 1;
+    memcpy(destination, message, length);
+    destination[length] = '\0';
+}
+
+struct InterpProgram* interpParse(const char* source, char* error, size_t errorSize) {
+    struct InterpProgram* program = allocMemory(sizeof(struct InterpProgram));
+    if (!program) {
+        copyMessage(error, errorSize, "Error malloc while parsing.");
+        return NULL;
+    }
+
+    struct ErrorHandler handler;
+    if (setjmp(handler.jump) == 0) {
+        pushErrorHandler(&handler);
+        program->ast = parseProgram(source, NULL);
+        popErrorHandler(&handler);
+    } else {
+        copyMessage(error, errorSize, handler.message);
+        freeMemory(program);
+        return NULL;
+    }
+    if (errorSize > 0) error[0] = '\0';
+    return program;
+}
+
+void interpFreeProgram(struct InterpProgram* program) {
+    if (!program) return;
+    destroyAST(&program->ast);
+    freeMemory(program);
+}
+
+struct Interpreter* interpCreate(void) {
+    struct Interpreter* interp = allocZeroed(1, sizeof(struct Interpreter));
+    if (!interp) return NULL;
+    createEnvironment(&interp->globals);
+    initTaskRegistry(&interp->tasks);
+    return interp;
+}
+
+void interpDestroy(struct Interpreter* interp) {
+    if (!interp) return;
+    freeEnvironment(&interp->globals);
+    destroyTaskRegistry(&interp->tasks);
+    if (interp->allocator) destroyLimitingAllocator(interp->allocator);
+    freeMemory(interp);
+}
+
+void interpSetOutput(struct Interpreter* interp, OutputFunction write, void* data) {
+    interp->output.write = write;
+    interp->output.data = data;
+}
+
+void interpSetMemoryLimit(struct Interpreter* interp, size_t bytes) {
+    interp->memoryLimit = bytes;
+}
+
+enum InterpStatus interpRun(struct Interpreter* interp, const struct InterpProgram* program) {
+    // counted from nothing, memory an earlier run failed to free is not held against this one
+    if ((interp->memoryLimit || interp->allocator) && !limitInterpreterMemory(interp, interp->memoryLimit)) {
+        copyMessage(interp->error, sizeof(interp->error), "Error calloc while limiting memory.");
+        return INTERP_ERROR;
+    }
+    struct Interpreter* previousInterpreter = enterInterpreter(interp);
+    const struct OutputSink* previousSink = setOutputSink(&interp->output);
+    enum InterpStatus status = INTERP_OK;
+
+    struct ErrorHandler handler;
+    if (setjmp(handler.jump) == 0) {
+        pushErrorHandler(&handler);
+        evaluateAST(&program->ast, &interp->globals);
+        awaitRemainingTasks();
+        popErrorHandler(&handler);
+        interp->error[0] = '\0';
+    } else {
+        // tasks of the failed run must not outlive it
+        discardRemainingTasks();
+        copyMessage(interp->error, sizeof(interp->error), handler.message);
+        status = INTERP_ERROR;
+    }
+
+    setOutputSink(previousSink);
+    enterInterpreter(previousInterpreter);
+    return status;
+}
+
+const char* interpError(const struct Interpreter* interp) {
+    return interp->error;
+}
+
+void interpReset(struct Interpreter* interp) {
+    clearEnvironment(&interp->globals);
+    interp->error[0] = '\0';
+}
@@ -0,0 +1,83 @@
+#include "../include/allocator.h"
+#include "../include/runtime.h"
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+struct LimitingAllocator {
+    struct Allocator    base;
+    struct Allocator*   inner;
+    atomic_size_t       limit;
+    // below 0 after freeing blocks counted before a reset or by another allocator
+    atomic_int_fast64_t inUse;
+};
+
+// raises when size more bytes in place of freed would pass the limit, checked
+// before allocating, so tasks allocating at once can each pass it by a block
+static void checkLimit(struct LimitingAllocator* limiting, size_t size, size_t freed, const char* site) {
+    size_t limit = atomic_load_explicit(&limiting->limit, memory_order_relaxed);
+    if (!limit) return;
+    int_fast64_t inUse = atomic_load_explicit(&limiting->inUse, memory_order_relaxed);
+    size_t counted = inUse > 0 ? (size_t) inUse : 0;
+    size_t kept = counted > freed ? counted - freed : 0;
+    if (size > limit || kept > limit - size) {
+        raiseError("Memory limit of %zu bytes reached, %zu in use and %zu more asked for at %s\n",
+            limit, counted, size, site);
+    }
+}
+
+static void* limitingAllocate(struct Allocator* self, size_t size, const char* site) {
+    struct LimitingAllocator* limiting = (struct LimitingAllocator*) self;
+    checkLimit(limiting, size, 0, site);
+    void* block = limiting->inner->allocate(limiting->inner, size, site);
+    if (block) {
+        atomic_fetch_add_explicit(&limiting->inUse, (int_fast64_t) limiting->inner->measure(limiting->inner, block),
+            memory_order_relaxed);
+    }
+    return block;
+}
+
+static void* limitingResize(struct Allocator* self, void* block, size_t size, const char* site) {
+    struct LimitingAllocator* limiting = (struct LimitingAllocator*) self;
+    size_t oldSize = limiting->inner->measure(limiting->inner, block);
+    checkLimit(limiting, size, oldSize, site);
+    void* resized = limiting->inner->resize(limiting->inner, block, size, site);
+    if (resized) {
+        size_t newSize = limiting->inner->measure(limiting->inner, resized);
+        atomic_fetch_add_explicit(&limiting->inUse, (int_fast64_t) newSize - (int_fast64_t) oldSize,
+            memory_order_relaxed);
+    }
+    return resized;
+}
+
+static void limitingRelease(struct Allocator* self, void* block, const char* site) {
+    struct LimitingAllocator* limiting = (struct LimitingAllocator*) self;
+    atomic_fetch_sub_explicit(&limiting->inUse, (int_fast64_t) limiting->inner->measure(limiting->inner, block),
+        memory_order_relaxed);
+    limiting->inner->release(limiting->inner, block, site);
+}
+
+static size_t limitingMeasure(struct Allocator* self, void* block) {
+    struct LimitingAllocator* limiting = (struct LimitingAllocator*) self;
+    return limiting->inner->measure(limiting->inner, block);
+}
+
+struct Allocator* createLimitingAllocator(size_t limit) {
+    struct LimitingAllocator* limiting = calloc(1, sizeof(struct LimitingAllocator));
+    if (!limiting) return NULL;
+    limiting->base = (struct Allocator) { "limiting", limitingAllocate, limitingResize, limitingRelease, limitingMeasure };
+    limiting->inner = allocator;
+    atomic_init(&limiting->limit, limit);
+    atomic_init(&limiting->inUse, 0);
+    return &limiting->base;
+}
+
+void resetLimitingAllocator(struct Allocator* self, size_t limit) {
+    struct LimitingAllocator* limiting = (struct LimitingAllocator*) self;
+    atomic_store(&limiting->limit, limit);
+    atomic_store(&limiting->inUse, 0);
+}
+
+void destroyLimitingAllocator(struct Allocator* self) {
+    free(self);
+}
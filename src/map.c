@@ -0,0 +1,380 @@
+#include "../include/map.h"
+#include "../include/allocator.h"
+#include "../include/runtime.h"
+#include "../include/numbers.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
+// control bytes, a full slot holds the low 7 bits of its key's hash
+#define CONTROL_EMPTY   ((int8_t) -128)
+#define CONTROL_DELETED ((int8_t) -2)
+
+// entries are found through 32 bit indexes
+#define MAP_MAX_ENTRIES ((size_t) UINT32_MAX)
+#define NO_SLOT         ((size_t) -1)
+
+// HASHING
+
+// splitmix64 finaliser, spreads every input bit over the low bits the table uses
+static uint64_t mixBits(uint64_t h) {
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+static uint64_t hashKey(struct Value key) {
+    if (key.type == VALUE_NUMBER) {
+        uint64_t bits;
+        memcpy(&bits, &key.data.number, sizeof(bits));
+        return mixBits(bits);
+    }
+    // FNV-1a over the text
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (const unsigned char* c = (const unsigned char*) key.data.text; *c; c++) {
+        h ^= *c;
+        h *= 0x100000001b3ULL;
+    }
+    return mixBits(h);
+}
+
+static bool sameKey(struct Value a, struct Value b) {
+    if (a.type != b.type) return false;
+    if (a.type == VALUE_NUMBER) return a.data.number == b.data.number;
+    return strcmp(a.data.text, b.data.text) == 0;
+}
+
+// GROUPS
+//
+// Bit i of a match is set when byte i of the 16 byte group matches.
+
+#if defined(__x86_64__)
+
+static uint32_t matchByte(const int8_t* group, int8_t byte) {
+    __m128i control = _mm_load_si128((const __m128i*) group);
+    return (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(control, _mm_set1_epi8(byte)));
+}
+
+// empty and deleted are the only bytes with the top bit set
+static uint32_t matchEmptyOrDeleted(const int8_t* group) {
+    return (uint32_t) _mm_movemask_epi8(_mm_load_si128((const __m128i*) group));
+}
+
+#else
+
+static uint32_t matchByte(const int8_t* group, int8_t byte) {
+    uint32_t mask = 0;
+    for (int i = 0; i < MAP_GROUP_WIDTH; i++) {
+        if (group[i] == byte) mask |= (uint32_t) 1 << i;
+    }
+    return mask;
+}
+
+static uint32_t matchEmptyOrDeleted(const int8_t* group) {
+    uint32_t mask = 0;
+    for (int i = 0; i < MAP_GROUP_WIDTH; i++) {
+        if (group[i] < 0) mask |= (uint32_t) 1 << i;
+    }
+    return mask;
+}
+
+#endif
+
+static int8_t hashControl(uint64_t h) {
+    return (int8_t) (h & 0x7f);
+}
+
+// Groups are probed at offsets 0, 1, 3, 6, ... from the one the hash picks,
+// which visits every group when their count is a power of two. A lookup stops
+// at the first group with an empty slot, nothing was ever placed past it.
+#define FOR_EACH_PROBED_GROUP(map, h, group) \
+    for (size_t groupMask_ = (map)->capacity / MAP_GROUP_WIDTH - 1, step_ = 0, group = ((h) >> 7) & groupMask_; ; \
+            step_++, group = (group + step_) & groupMask_)
+
+static size_t findSlot(const struct Map* map, struct Value key, uint64_t h) {
+    if (map->count == 0) return NO_SLOT;
+    FOR_EACH_PROBED_GROUP(map, h, group) {
+        const int8_t* control = map->control + group * MAP_GROUP_WIDTH;
+        for (uint32_t match = matchByte(control, hashControl(h)); match; match &= match - 1) {
+            size_t slot = group * MAP_GROUP_WIDTH + (size_t) __builtin_ctz(match);
+            if (sameKey(map->entries[map->slots[slot]].key, key)) return slot;
+        }
+        if (matchByte(control, CONTROL_EMPTY)) return NO_SLOT;
+    }
+}
+
+// the slot pointing at entry index, which is known to be in the table
+static size_t findSlotOfEntry(const struct Map* map, uint64_t h, size_t index) {
+    FOR_EACH_PROBED_GROUP(map, h, group) {
+        const int8_t* control = map->control + group * MAP_GROUP_WIDTH;
+        for (uint32_t match = matchByte(control, hashControl(h)); match; match &= match - 1) {
+            size_t slot = group * MAP_GROUP_WIDTH + (size_t) __builtin_ctz(match);
+            if (map->slots[slot] == index) return slot;
+        }
+    }
+}
+
+// first empty or deleted slot on the key's probe sequence, there always is one
+static size_t findFreeSlot(const struct Map* map, uint64_t h) {
+    FOR_EACH_PROBED_GROUP(map, h, group) {
+        uint32_t match = matchEmptyOrDeleted(map->control + group * MAP_GROUP_WIDTH);
+        if (match) return group * MAP_GROUP_WIDTH + (size_t) __builtin_ctz(match);
+    }
+}
+
+// TABLE
+
+// at most 7 in 8 slots are used, so probes always reach an empty one
+static size_t maxLoad(size_t capacity) {
+    return capacity - capacity / 8;
+}
+
+// the control bytes with the slots after them, in one block so an allocation
+// stopped by a memory limit leaves nothing half made
+static int8_t* allocTable(size_t capacity) {
+    return allocAligned(MAP_GROUP_WIDTH, capacity + sizeof(uint32_t) * capacity);
+}
+
+static void rebuildTable(struct Map* map, size_t capacity) {
+    int8_t* control = allocTable(capacity);
+    if (!control) {
+        raiseError("Error allocating while resizing map.\n");
+    }
+    memset(control, CONTROL_EMPTY, capacity);
+    freeAligned(map->control);
+    map->control = control;
+    map->slots = (uint32_t*) (control + capacity);
+    map->capacity = capacity;
+    map->growthLeft = maxLoad(capacity) - map->count;
+
+    for (size_t i = 0; i < map->count; i++) {
+        uint64_t h = hashKey(map->entries[i].key);
+        size_t slot = findFreeSlot(map, h);
+        map->control[slot] = hashControl(h);
+        map->slots[slot] = (uint32_t) i;
+    }
+}
+
+// called when no empty slot is left, deleted ones are reclaimed when they are most of the table
+static void growTable(struct Map* map) {
+    size_t capacity = map->capacity ? map->capacity : MAP_GROUP_WIDTH;
+    if (map->count + 1 > maxLoad(capacity) / 2) {
+        capacity = map->capacity ? map->capacity * 2 : MAP_GROUP_WIDTH;
+    }
+    rebuildTable(map, capacity);
+}
+
+// what the map keeps of a key or value, text is copied and arrays counted
+static struct Value storedValue(struct Value val) {
+    val.originNode = NULL;
+    if (val.type == VALUE_TEXT) {
+        val.data.text = copyText(val.data.text);
+    } else if (val.type == VALUE_NUMBER && val.data.number == 0) {
+        // -0 and 0 are one key
+        val.data.number = 0;
+    }
+    retainValue(val);
+    return val;
+}
+
+struct Map* createMap(void) {
+    struct Map* map = allocZeroed(1, sizeof(struct Map));
+    if (!map) {
+        raiseError("Error calloc while creating map.\n");
+    }
+    atomic_init(&map->refcount, 0);
+    return map;
+}
+
+struct Value createMapValue(struct Map* map) {
+    struct Value val;
+    val.type = VALUE_MAP;
+    val.originNode = NULL;
+    val.data.map = map;
+    return val;
+}
+
+void freeMap(struct Map* map) {
+    for (size_t i = 0; i < map->count; i++) {
+        releaseValue(map->entries[i].key);
+        releaseValue(map->entries[i].value);
+    }
+    freeMemory(map->entries);
+    freeAligned(map->control);
+    freeMemory(map);
+}
+
+struct Value detachMap(struct Value val) {
+    const struct Map* map = val.data.map;
+    if (atomic_load(&map->refcount) == 0) return val;
+
+    struct Map* copy = createMap();
+    copy->count = map->count;
+    copy->entryCapacity = map->count;
+    copy->capacity = map->capacity;
+    copy->growthLeft = map->growthLeft;
+    if (map->count > 0) {
+        copy->entries = allocMemory(sizeof(struct MapEntry) * map->count);
+        copy->control = allocTable(map->capacity);
+        if (!copy->entries || !copy->control) {
+            raiseError("Error allocating while copying map.\n");
+        }
+        copy->slots = (uint32_t*) (copy->control + map->capacity);
+        memcpy(copy->control, map->control, map->capacity + sizeof(uint32_t) * map->capacity);
+        for (size_t i = 0; i < map->count; i++) {
+            copy->entries[i].key = storedValue(map->entries[i].key);
+            copy->entries[i].value = storedValue(map->entries[i].value);
+        }
+    } else {
+        // an emptied table is rebuilt on the first insert
+        copy->capacity = 0;
+        copy->growthLeft = 0;
+    }
+    return createMapValue(copy);
+}
+
+struct MapEntry* findMapEntry(const struct Map* map, struct Value key) {
+    if (key.type != VALUE_TEXT && key.type != VALUE_NUMBER) return NULL;
+    size_t slot = findSlot(map, key, hashKey(key));
+    return slot == NO_SLOT ? NULL : &map->entries[map->slots[slot]];
+}
+
+void setMapEntry(struct Map* map, struct Value key, struct Value value) {
+    uint64_t h = hashKey(key);
+    size_t slot = findSlot(map, key, h);
+    if (slot != NO_SLOT) {
+        struct MapEntry* entry = &map->entries[map->slots[slot]];
+        struct Value previous = entry->value;
+        entry->value = storedValue(value);
+        releaseValue(previous);
+        return;
+    }
+
+    if (map->count == MAP_MAX_ENTRIES) {
+        raiseError("Map of %zu entries is too large.\n", map->count);
+    }
+    if (map->count == map->entryCapacity) {
+        size_t entryCapacity = map->entryCapacity ? map->entryCapacity * 2 : 8;
+        struct MapEntry* entries = resizeMemory(map->entries, sizeof(struct MapEntry) * entryCapacity);
+        if (!entries) {
+            raiseError("Error realloc while growing map.\n");
+        }
+        map->entries = entries;
+        map->entryCapacity = entryCapacity;
+    }
+    if (map->growthLeft == 0) {
+        growTable(map);
+    }
+
+    slot = findFreeSlot(map, h);
+    if (map->control[slot] == CONTROL_EMPTY) map->growthLeft--;
+    map->control[slot] = hashControl(h);
+    map->slots[slot] = (uint32_t) map->count;
+    map->entries[map->count].key = storedValue(key);
+    map->entries[map->count].value = storedValue(value);
+    map->count++;
+}
+
+bool removeMapEntry(struct Map* map, struct Value key) {
+    if (key.type != VALUE_TEXT && key.type != VALUE_NUMBER) return false;
+    size_t slot = findSlot(map, key, hashKey(key));
+    if (slot == NO_SLOT) return false;
+
+    size_t index = map->slots[slot];
+    releaseValue(map->entries[index].key);
+    releaseValue(map->entries[index].value);
+
+    // no probe ever went past a group that still has an empty slot
+    if (matchByte(map->control + slot / MAP_GROUP_WIDTH * MAP_GROUP_WIDTH, CONTROL_EMPTY)) {
+        map->control[slot] = CONTROL_EMPTY;
+        map->growthLeft++;
+    } else {
+        map->control[slot] = CONTROL_DELETED;
+    }
+
+    // the last entry fills the gap, so entries stay packed
+    map->count--;
+    if (index != map->count) {
+        map->entries[index] = map->entries[map->count];
+        size_t moved = findSlotOfEntry(map, hashKey(map->entries[index].key), map->count);
+        map->slots[moved] = (uint32_t) index;
+    }
+    return true;
+}
+
+// LANGUAGE
+
+// NULL when key can be stored in a map
+static const char* keyProblem(struct Value key) {
+    if (key.type != VALUE_TEXT && key.type != VALUE_NUMBER) return "Map keys must be text or number values";
+    if (key.data.number != key.data.number) return "Map keys cannot be NaN";
+    return NULL;
+}
+
+void storeMapElement(const struct ASTNode* node, struct Value map, const struct ASTNode* keyNode, struct Value key,
+        const struct ASTNode* valueNode, struct Value value) {
+    const char* problem = keyProblem(key);
+    if (!problem && (value.type == VALUE_MAP || value.type == VALUE_TASK || value.type == VALUE_FUNCTION)) {
+        problem = "Map values cannot be maps, tasks or functions";
+    }
+    if (problem) {
+        releaseTemporary(keyNode, key);
+        releaseTemporary(valueNode, value);
+        discardTemporary(map);
+        raiseError("%s, line %zu\n", problem, node->line);
+    }
+    setMapEntry(map.data.map, key, value);
+    releaseTemporary(keyNode, key);
+    releaseTemporary(valueNode, value);
+}
+
+struct Value indexMap(const struct ASTNode* node, struct Value map, struct Value key) {
+    const struct ASTNode* keyNode = node->data.binary.rightSide;
+    const struct MapEntry* entry = findMapEntry(map.data.map, key);
+    if (!entry) {
+        char message[ERROR_MESSAGE_SIZE];
+        const char* problem = keyProblem(key);
+        if (problem) {
+            snprintf(message, sizeof(message), "%s, line %zu\n", problem, node->line);
+        } else if (key.type == VALUE_TEXT) {
+            snprintf(message, sizeof(message), "Key %s is not in the map, line %zu\n", key.data.text, node->line);
+        } else {
+            snprintf(message, sizeof(message), "Key %g is not in the map, line %zu\n", key.data.number, node->line);
+        }
+        releaseTemporary(keyNode, key);
+        discardTemporary(map);
+        raiseError("%s", message);
+    }
+
+    struct Value element = entry->value;
+    releaseTemporary(keyNode, key);
+    if (element.type == VALUE_TEXT) {
+        element.data.text = copyText(element.data.text);
+    } else if (element.type == VALUE_NUMBERS && atomic_load(&map.data.map->refcount) == 0) {
+        // the map goes with this expression, its array is left as an unheld temporary
+        retainValue(element);
+        freeMap(map.data.map);
+        atomic_fetch_sub(&element.data.numbers->refcount, 1);
+        return element;
+    }
+    discardTemporary(map);
+    return element;
+}
+
+void writeMap(const struct Map* map) {
+    writeOutput("{", 1);
+    for (size_t i = 0; i < map->count; i++) {
+        if (i > 0) writeOutput(", ", 2);
+        writeValue(map->entries[i].key);
+        writeOutput(": ", 2);
+        writeValue(map->entries[i].value);
+    }
+    writeOutput("}", 1);
+}
@@ -0,0 +1,287 @@
+#include "../include/modules.h"
+#include "../include/driver.h"
+#include "../include/parser.h"
+#include "../include/runtime.h"
+#include "../include/threadPool.h"
+#include "../include/trace.h"
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct ModuleCache {
+    pthread_mutex_t     lock;
+    pthread_cond_t      parsed;     // broadcast when a module stops parsing
+    struct Module*      modules;
+};
+
+static struct ModuleCache moduleCache = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .parsed = PTHREAD_COND_INITIALIZER,
+};
+
+// the argument of a parse task
+struct ModuleTask {
+    struct Module*      module;
+    struct TaskGroup*   group;
+};
+
+// the imports being walked, from the program to the module walked last
+struct ImportChain {
+    const char*                 path;   // resolved
+    const char*                 name;   // as written, for messages
+    const struct ImportChain*   importer;
+};
+
+static void parseModuleTask(void* argument);
+
+static bool hasImports(const struct ASTNodeList* program) {
+    for (size_t i = 0; i < program->count; i++) {
+        if (program->nodes[i]->nodeType == NODE_IMPORT) return true;
+    }
+    return false;
+}
+
+// "." for a path without a directory
+static char* directoryOf(const char* path) {
+    const char* slash = path ? strrchr(path, '/') : NULL;
+    if (!slash) return strdup(".");
+    if (slash == path) return strdup("/");
+    return strndup(path, (size_t) (slash - path));
+}
+
+static char* formatMessage(const char* format, const char* path, const char* detail) {
+    size_t size = strlen(format) + strlen(path) + strlen(detail) + 1;
+    char* message = malloc(size);
+    if (message) snprintf(message, size, format, path, detail);
+    return message;
+}
+
+// called with the lock held
+static struct Module* findModule(const char* path) {
+    for (struct Module* module = moduleCache.modules; module; module = module->next) {
+        if (strcmp(module->path, path) == 0) return module;
+    }
+    return NULL;
+}
+
+// The module at path, added to the cache when it is not there yet. A new
+// module is parsed by a task of group, or by whoever walks to it first when
+// group is NULL. A file that cannot be resolved is cached as failed.
+static struct Module* requestModule(const char* directory, const char* name, struct TaskGroup* group) {
+    size_t length = strlen(directory) + strlen(name) + 2;
+    char* joined = malloc(length);
+    if (!joined) raiseError("Error malloc while importing %s.\n", name);
+    if (name[0] == '/') {
+        snprintf(joined, length, "%s", name);
+    } else {
+        snprintf(joined, length, "%s/%s", directory, name);
+    }
+    char* resolved = realpath(joined, NULL);
+    int resolveError = errno;
+
+    pthread_mutex_lock(&moduleCache.lock);
+    struct Module* module = findModule(resolved ? resolved : joined);
+    if (module) {
+        pthread_mutex_unlock(&moduleCache.lock);
+        free(resolved);
+        free(joined);
+        return module;
+    }
+    module = calloc(1, sizeof(struct Module));
+    if (!module) {
+        pthread_mutex_unlock(&moduleCache.lock);
+        raiseError("Error malloc while importing %s.\n", name);
+    }
+    atomic_init(&module->linked, false);
+    if (resolved) {
+        module->path = resolved;
+        module->state = MODULE_QUEUED;
+        free(joined);
+    } else {
+        module->path = joined;
+        module->state = MODULE_FAILED;
+        module->error = formatMessage("Cannot read %s: %s\n", joined, strerror(resolveError));
+    }
+    module->next = moduleCache.modules;
+    moduleCache.modules = module;
+    pthread_mutex_unlock(&moduleCache.lock);
+
+    if (module->state == MODULE_QUEUED && group) {
+        struct ModuleTask* task = malloc(sizeof(struct ModuleTask));
+        if (!task) raiseError("Error malloc while importing %s.\n", name);
+        *task = (struct ModuleTask) { module, group };
+        submitTask(group, parseModuleTask, task);
+    }
+    return module;
+}
+
+static void requestImports(struct ASTNodeList* program, const char* path, struct TaskGroup* group) {
+    char* directory = directoryOf(path);
+    if (!directory) raiseError("Error malloc while importing.\n");
+    for (size_t i = 0; i < program->count; i++) {
+        struct ASTNode* n = program->nodes[i];
+        if (n->nodeType == NODE_IMPORT) {
+            n->data.import.module = requestModule(directory, n->data.import.path, group);
+        }
+    }
+    free(directory);
+}
+
+// PARSING
+
+// false when the module is already claimed by another thread
+static bool claimModule(struct Module* module) {
+    pthread_mutex_lock(&moduleCache.lock);
+    bool claimed = module->state == MODULE_QUEUED;
+    if (claimed) module->state = MODULE_PARSING;
+    pthread_mutex_unlock(&moduleCache.lock);
+    return claimed;
+}
+
+static void checkModule(struct ASTNodeList* program) {
+    for (size_t i = 0; i < program->count; i++) {
+        struct ASTNode* n = program->nodes[i];
+        if (n->nodeType == NODE_FUNCTION_DECLARATION) {
+            n->data.funcDeclaration.shared = true;
+        } else if (n->nodeType != NODE_IMPORT) {
+            raiseError("Modules can only declare fns and import other modules, line %zu\n", n->line);
+        }
+    }
+}
+
+static void readModule(struct Module* module, struct TaskGroup* group) {
+    char* source = readSourceFile(module->path);
+    if (!source) raiseError("Cannot read %s: %s\n", module->path, strerror(errno));
+    struct ErrorHandler handler;
+    if (setjmp(handler.jump) != 0) {
+        free(source);
+        raiseError("%s", handler.message);
+    }
+    pushErrorHandler(&handler);
+    module->program = parseSource(source);
+    popErrorHandler(&handler);
+    free(source);
+
+    if (setjmp(handler.jump) != 0) {
+        destroyAST(&module->program);
+        raiseError("%s", handler.message);
+    }
+    pushErrorHandler(&handler);
+    checkModule(&module->program);
+    requestImports(&module->program, module->path, group);
+    popErrorHandler(&handler);
+}
+
+// parses a claimed module, its imports go to group, errors are kept for the walk
+static void parseModule(struct Module* module, struct TaskGroup* group) {
+    uint64_t start = traceStart();
+    enum ModuleState state = MODULE_READY;
+    char* error = NULL;
+    struct ErrorHandler handler;
+    if (setjmp(handler.jump) == 0) {
+        pushErrorHandler(&handler);
+        readModule(module, group);
+        popErrorHandler(&handler);
+    } else {
+        state = MODULE_FAILED;
+        error = formatMessage("In %s: %s", module->path, handler.message);
+    }
+    traceSpan(TRACE_PHASE, module->path, 0, 0, start);
+
+    pthread_mutex_lock(&moduleCache.lock);
+    module->error = error;
+    module->state = state;
+    pthread_cond_broadcast(&moduleCache.parsed);
+    pthread_mutex_unlock(&moduleCache.lock);
+}
+
+static void parseModuleTask(void* argument) {
+    struct ModuleTask task = *(struct ModuleTask*) argument;
+    free(argument);
+    if (claimModule(task.module)) parseModule(task.module, task.group);
+}
+
+// LINKING
+
+// Ready or failed once it returns. A module still queued, by a loader that has
+// not got to it yet, is parsed here rather than waited for, so only modules a
+// thread is parsing, which never waits itself, are waited for.
+static void awaitModule(struct Module* module) {
+    if (claimModule(module)) parseModule(module, NULL);
+    pthread_mutex_lock(&moduleCache.lock);
+    while (module->state == MODULE_PARSING) {
+        pthread_cond_wait(&moduleCache.parsed, &moduleCache.lock);
+    }
+    pthread_mutex_unlock(&moduleCache.lock);
+}
+
+// appends "name imports " for the chain from first down to link
+static size_t writeChain(char* message, size_t size, const struct ImportChain* link, const struct ImportChain* first) {
+    size_t length = link == first ? 0 : writeChain(message, size, link->importer, first);
+    if (length < size) length += (size_t) snprintf(message + length, size - length, "%s imports ", link->name);
+    return length;
+}
+
+static void linkImports(const struct ASTNodeList* program, const struct ImportChain* chain) {
+    for (size_t i = 0; i < program->count; i++) {
+        const struct ASTNode* n = program->nodes[i];
+        if (n->nodeType != NODE_IMPORT) continue;
+        struct Module* module = n->data.import.module;
+        for (const struct ImportChain* link = chain; link; link = link->importer) {
+            if (link->path && strcmp(link->path, module->path) == 0) {
+                char message[ERROR_MESSAGE_SIZE];
+                message[0] = '\0';
+                writeChain(message, sizeof(message), chain, link);
+                raiseError("Import cycle: %s%s\n", message, n->data.import.path);
+            }
+        }
+        if (atomic_load(&module->linked)) continue;
+
+        awaitModule(module);
+        if (module->state == MODULE_FAILED) {
+            raiseError("Cannot import \"%s\" on line %zu of %s. %s", n->data.import.path, n->line, chain->name,
+                module->error ? module->error : "Error malloc while importing.\n");
+        }
+        struct ImportChain link = { module->path, n->data.import.path, chain };
+        linkImports(&module->program, &link);
+        atomic_store(&module->linked, true);
+    }
+}
+
+void loadImports(struct ASTNodeList* program, const char* path) {
+    if (!hasImports(program)) return;
+
+    struct TaskGroup group;
+    initTaskGroup(&group);
+    requestImports(program, path, &group);
+    waitTaskGroup(&group);
+
+    char resolved[PATH_MAX];
+    struct ImportChain root = { path ? realpath(path, resolved) : NULL, path ? path : "the program", NULL };
+    linkImports(program, &root);
+}
+
+const struct Module* loadedModules(void) {
+    pthread_mutex_lock(&moduleCache.lock);
+    const struct Module* modules = moduleCache.modules;
+    pthread_mutex_unlock(&moduleCache.lock);
+    return modules;
+}
+
+void unloadModules(void) {
+    pthread_mutex_lock(&moduleCache.lock);
+    struct Module* module = moduleCache.modules;
+    moduleCache.modules = NULL;
+    pthread_mutex_unlock(&moduleCache.lock);
+    while (module) {
+        struct Module* next = module->next;
+        if (module->state == MODULE_READY) destroyAST(&module->program);
+        free(module->path);
+        free(module->error);
+        free(module);
+        module = next;
+    }
+}
@@ -0,0 +1,611 @@
+#include "../include/numbers.h"
+#include "../include/allocator.h"
+#include "../include/output.h"
+#include "../include/runtime.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// arrays larger than this are an error rather than a failed allocation
+#define NUMBERS_MAX_LENGTH ((size_t) 1 << 32)
+
+// slots of the element-wise kernels, the operators in BinaryOperatorTypes order
+// then number - array and number / array, which only exist with a broadcast side
+enum {
+    KERNEL_REVERSE_SUBTRACT = BIN_OP_GREATER_EQUAL + 1,
+    KERNEL_REVERSE_DIVIDE,
+    KERNEL_OPERATION_COUNT,
+};
+
+typedef void (*ElementwiseKernel)(double* out, const double* a, const double* b, size_t n);
+typedef void (*BroadcastKernel)(double* out, const double* a, double b, size_t n);
+typedef double (*ReduceKernel)(const double* a, size_t n);
+typedef double (*DotKernel)(const double* a, const double* b, size_t n);
+
+struct NumbersKernels {
+    const char*         name;
+    ElementwiseKernel   elementwise[KERNEL_OPERATION_COUNT];   // reverse slots unused
+    BroadcastKernel     broadcast[KERNEL_OPERATION_COUNT];
+    ReduceKernel        sum;
+    ReduceKernel        min;
+    ReduceKernel        max;
+    DotKernel           dot;
+};
+
+// REDUCTIONS
+//
+// Every variant keeps four lanes, lane j taking elements 4k + j, then combines
+// them as (l0 + l1) + (l2 + l3) and adds the tail in order. Doubles round the
+// same way whatever the vector width, so sum and dot agree across CPUs.
+// min and max keep the a < b ? a : b choice of minpd and maxpd.
+
+#define REDUCE_LANES 4
+
+static double minimum(double a, double b) {
+    return a < b ? a : b;
+}
+
+static double maximum(double a, double b) {
+    return a > b ? a : b;
+}
+
+static double combineSum(const double* lanes, const double* tail, size_t tailLength) {
+    double total = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for (size_t i = 0; i < tailLength; i++) {
+        total += tail[i];
+    }
+    return total;
+}
+
+static double combineDot(const double* lanes, const double* a, const double* b, size_t tailLength) {
+    double total = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for (size_t i = 0; i < tailLength; i++) {
+        total += a[i] * b[i];
+    }
+    return total;
+}
+
+static double combineExtreme(double (*choose)(double, double), const double* lanes, const double* tail, size_t tailLength) {
+    double result = choose(choose(lanes[0], lanes[1]), choose(lanes[2], lanes[3]));
+    for (size_t i = 0; i < tailLength; i++) {
+        result = choose(result, tail[i]);
+    }
+    return result;
+}
+
+// arrays shorter than the lanes, the caller has checked n > 0
+static double shortExtreme(double (*choose)(double, double), const double* a, size_t n) {
+    double result = a[0];
+    for (size_t i = 1; i < n; i++) {
+        result = choose(result, a[i]);
+    }
+    return result;
+}
+
+// SCALAR
+
+#define SCALAR_KERNELS(name, expression) \
+    static void scalar##name(double* out, const double* a, const double* b, size_t n) { \
+        for (size_t i = 0; i < n; i++) { \
+            double x = a[i]; \
+            double y = b[i]; \
+            out[i] = expression; \
+        } \
+    } \
+    SCALAR_BROADCAST_KERNEL(name, expression)
+
+#define SCALAR_BROADCAST_KERNEL(name, expression) \
+    static void scalarBroadcast##name(double* out, const double* a, double y, size_t n) { \
+        for (size_t i = 0; i < n; i++) { \
+            double x = a[i]; \
+            out[i] = expression; \
+        } \
+    }
+
+SCALAR_KERNELS(Add, x + y)
+SCALAR_KERNELS(Subtract, x - y)
+SCALAR_KERNELS(Multiply, x * y)
+SCALAR_KERNELS(Divide, x / y)
+SCALAR_BROADCAST_KERNEL(ReverseSubtract, y - x)
+SCALAR_BROADCAST_KERNEL(ReverseDivide, y / x)
+SCALAR_KERNELS(Equal, x == y ? 1.0 : 0.0)
+SCALAR_KERNELS(NotEqual, x != y ? 1.0 : 0.0)
+SCALAR_KERNELS(Less, x < y ? 1.0 : 0.0)
+SCALAR_KERNELS(Greater, x > y ? 1.0 : 0.0)
+SCALAR_KERNELS(LesserEqual, x <= y ? 1.0 : 0.0)
+SCALAR_KERNELS(GreaterEqual, x >= y ? 1.0 : 0.0)
+
+static double scalarSum(const double* a, size_t n) {
+    double lanes[REDUCE_LANES] = { 0, 0, 0, 0 };
+    size_t i = 0;
+    for (; i + REDUCE_LANES <= n; i += REDUCE_LANES) {
+        for (size_t j = 0; j < REDUCE_LANES; j++) {
+            lanes[j] += a[i + j];
+        }
+    }
+    return combineSum(lanes, a + i, n - i);
+}
+
+static double scalarDot(const double* a, const double* b, size_t n) {
+    double lanes[REDUCE_LANES] = { 0, 0, 0, 0 };
+    size_t i = 0;
+    for (; i + REDUCE_LANES <= n; i += REDUCE_LANES) {
+        for (size_t j = 0; j < REDUCE_LANES; j++) {
+            lanes[j] += a[i + j] * b[i + j];
+        }
+    }
+    return combineDot(lanes, a + i, b + i, n - i);
+}
+
+#define SCALAR_EXTREME(functionName, choose) \
+    static double functionName(const double* a, size_t n) { \
+        if (n < REDUCE_LANES) return shortExtreme(choose, a, n); \
+        double lanes[REDUCE_LANES] = { a[0], a[1], a[2], a[3] }; \
+        size_t i = REDUCE_LANES; \
+        for (; i + REDUCE_LANES <= n; i += REDUCE_LANES) { \
+            for (size_t j = 0; j < REDUCE_LANES; j++) { \
+                lanes[j] = choose(lanes[j], a[i + j]); \
+            } \
+        } \
+        return combineExtreme(choose, lanes, a + i, n - i); \
+    }
+
+SCALAR_EXTREME(scalarMin, minimum)
+SCALAR_EXTREME(scalarMax, maximum)
+
+#define KERNEL_TABLE(prefix, broadcastPrefix) \
+    { \
+        [BIN_OP_PLUS] = prefix##Add, [BIN_OP_MINUS] = prefix##Subtract, \
+        [BIN_OP_STAR] = prefix##Multiply, [BIN_OP_SLASH] = prefix##Divide, \
+        [BIN_OP_EQUALITY] = prefix##Equal, [BIN_OP_NOT_EQUAL] = prefix##NotEqual, \
+        [BIN_OP_LESS] = prefix##Less, [BIN_OP_GREATER] = prefix##Greater, \
+        [BIN_OP_LESSER_EQUAL] = prefix##LesserEqual, [BIN_OP_GREATER_EQUAL] = prefix##GreaterEqual, \
+    }, \
+    { \
+        [BIN_OP_PLUS] = broadcastPrefix##Add, [BIN_OP_MINUS] = broadcastPrefix##Subtract, \
+        [BIN_OP_STAR] = broadcastPrefix##Multiply, [BIN_OP_SLASH] = broadcastPrefix##Divide, \
+        [BIN_OP_EQUALITY] = broadcastPrefix##Equal, [BIN_OP_NOT_EQUAL] = broadcastPrefix##NotEqual, \
+        [BIN_OP_LESS] = broadcastPrefix##Less, [BIN_OP_GREATER] = broadcastPrefix##Greater, \
+        [BIN_OP_LESSER_EQUAL] = broadcastPrefix##LesserEqual, [BIN_OP_GREATER_EQUAL] = broadcastPrefix##GreaterEqual, \
+        [KERNEL_REVERSE_SUBTRACT] = broadcastPrefix##ReverseSubtract, \
+        [KERNEL_REVERSE_DIVIDE] = broadcastPrefix##ReverseDivide, \
+    }
+
+static const struct NumbersKernels scalarKernels = {
+    "scalar",
+    KERNEL_TABLE(scalar, scalarBroadcast),
+    scalarSum, scalarMin, scalarMax, scalarDot,
+};
+
+#if defined(__x86_64__)
+
+// SSE2, part of every x86-64 CPU. Arrays are aligned, so whole vectors use
+// aligned loads and the tail runs the scalar expression.
+
+#define SSE2_KERNELS(name, vector, expression) \
+    static void sse2##name(double* out, const double* a, const double* b, size_t n) { \
+        size_t i = 0; \
+        for (; i + 2 <= n; i += 2) { \
+            __m128d x = _mm_load_pd(a + i); \
+            __m128d y = _mm_load_pd(b + i); \
+            _mm_store_pd(out + i, vector); \
+        } \
+        for (; i < n; i++) { \
+            double x = a[i]; \
+            double y = b[i]; \
+            out[i] = expression; \
+        } \
+    } \
+    SSE2_BROADCAST_KERNEL(name, vector, expression)
+
+#define SSE2_BROADCAST_KERNEL(name, vector, expression) \
+    static void sse2Broadcast##name(double* out, const double* a, double scalar, size_t n) { \
+        const __m128d broadcast = _mm_set1_pd(scalar); \
+        size_t i = 0; \
+        for (; i + 2 <= n; i += 2) { \
+            __m128d x = _mm_load_pd(a + i); \
+            __m128d y = broadcast; \
+            _mm_store_pd(out + i, vector); \
+        } \
+        for (; i < n; i++) { \
+            double x = a[i]; \
+            double y = scalar; \
+            out[i] = expression; \
+        } \
+    }
+
+// comparisons give all ones or all zeros per lane, masked down to 1.0 or 0.0
+#define SSE2_MASK(comparison) _mm_and_pd(comparison, _mm_set1_pd(1.0))
+
+SSE2_KERNELS(Add, _mm_add_pd(x, y), x + y)
+SSE2_KERNELS(Subtract, _mm_sub_pd(x, y), x - y)
+SSE2_KERNELS(Multiply, _mm_mul_pd(x, y), x * y)
+SSE2_KERNELS(Divide, _mm_div_pd(x, y), x / y)
+SSE2_BROADCAST_KERNEL(ReverseSubtract, _mm_sub_pd(y, x), y - x)
+SSE2_BROADCAST_KERNEL(ReverseDivide, _mm_div_pd(y, x), y / x)
+SSE2_KERNELS(Equal, SSE2_MASK(_mm_cmpeq_pd(x, y)), x == y ? 1.0 : 0.0)
+SSE2_KERNELS(NotEqual, SSE2_MASK(_mm_cmpneq_pd(x, y)), x != y ? 1.0 : 0.0)
+SSE2_KERNELS(Less, SSE2_MASK(_mm_cmplt_pd(x, y)), x < y ? 1.0 : 0.0)
+SSE2_KERNELS(Greater, SSE2_MASK(_mm_cmpgt_pd(x, y)), x > y ? 1.0 : 0.0)
+SSE2_KERNELS(LesserEqual, SSE2_MASK(_mm_cmple_pd(x, y)), x <= y ? 1.0 : 0.0)
+SSE2_KERNELS(GreaterEqual, SSE2_MASK(_mm_cmpge_pd(x, y)), x >= y ? 1.0 : 0.0)
+
+// two registers make the four lanes
+static double sse2Sum(const double* a, size_t n) {
+    __m128d low = _mm_setzero_pd();
+    __m128d high = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + REDUCE_LANES <= n; i += REDUCE_LANES) {
+        low = _mm_add_pd(low, _mm_load_pd(a + i));
+        high = _mm_add_pd(high, _mm_load_pd(a + i + 2));
+    }
+    double lanes[REDUCE_LANES];
+    _mm_storeu_pd(lanes, low);
+    _mm_storeu_pd(lanes + 2, high);
+    return combineSum(lanes, a + i, n - i);
+}
+
+static double sse2Dot(const double* a, const double* b, size_t n) {
+    __m128d low = _mm_setzero_pd();
+    __m128d high = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + REDUCE_LANES <= n; i += REDUCE_LANES) {
+        low = _mm_add_pd(low, _mm_mul_pd(_mm_load_pd(a + i), _mm_load_pd(b + i)));
+        high = _mm_add_pd(high, _mm_mul_pd(_mm_load_pd(a + i + 2), _mm_load_pd(b + i + 2)));
+    }
+    double lanes[REDUCE_LANES];
+    _mm_storeu_pd(lanes, low);
+    _mm_storeu_pd(lanes + 2, high);
+    return combineDot(lanes, a + i, b + i, n - i);
+}
+
+#define SSE2_EXTREME(functionName, instruction, choose) \
+    static double functionName(const double* a, size_t n) { \
+        if (n < REDUCE_LANES) return shortExtreme(choose, a, n); \
+        __m128d low = _mm_load_pd(a); \
+        __m128d high = _mm_load_pd(a + 2); \
+        size_t i = REDUCE_LANES; \
+        for (; i + REDUCE_LANES <= n; i += REDUCE_LANES) { \
+            low = instruction(low, _mm_load_pd(a + i)); \
+            high = instruction(high, _mm_load_pd(a + i + 2)); \
+        } \
+        double lanes[REDUCE_LANES]; \
+        _mm_storeu_pd(lanes, low); \
+        _mm_storeu_pd(lanes + 2, high); \
+        return combineExtreme(choose, lanes, a + i, n - i); \
+    }
+
+SSE2_EXTREME(sse2Min, _mm_min_pd, minimum)
+SSE2_EXTREME(sse2Max, _mm_max_pd, maximum)
+
+static const struct NumbersKernels sse2Kernels = {
+    "sse2",
+    KERNEL_TABLE(sse2, sse2Broadcast),
+    sse2Sum, sse2Min, sse2Max, sse2Dot,
+};
+
+// AVX2, only called once the CPU is known to support it
+
+#define AVX2 __attribute__((target("avx2")))
+
+#define AVX2_KERNELS(name, vector, expression) \
+    AVX2 static void avx2##name(double* out, const double* a, const double* b, size_t n) { \
+        size_t i = 0; \
+        for (; i + 4 <= n; i += 4) { \
+            __m256d x = _mm256_load_pd(a + i); \
+            __m256d y = _mm256_load_pd(b + i); \
+            _mm256_store_pd(out + i, vector); \
+        } \
+        for (; i < n; i++) { \
+            double x = a[i]; \
+            double y = b[i]; \
+            out[i] = expression; \
+        } \
+    } \
+    AVX2_BROADCAST_KERNEL(name, vector, expression)
+
+#define AVX2_BROADCAST_KERNEL(name, vector, expression) \
+    AVX2 static void avx2Broadcast##name(double* out, const double* a, double scalar, size_t n) { \
+        const __m256d broadcast = _mm256_set1_pd(scalar); \
+        size_t i = 0; \
+        for (; i + 4 <= n; i += 4) { \
+            __m256d x = _mm256_load_pd(a + i); \
+            __m256d y = broadcast; \
+            _mm256_store_pd(out + i, vector); \
+        } \
+        for (; i < n; i++) { \
+            double x = a[i]; \
+            double y = scalar; \
+            out[i] = expression; \
+        } \
+    }
+
+// ordered predicates except !=, which is true for NaN like the C operator
+#define AVX2_MASK(predicate) _mm256_and_pd(_mm256_cmp_pd(x, y, predicate), _mm256_set1_pd(1.0))
+
+AVX2_KERNELS(Add, _mm256_add_pd(x, y), x + y)
+AVX2_KERNELS(Subtract, _mm256_sub_pd(x, y), x - y)
+AVX2_KERNELS(Multiply, _mm256_mul_pd(x, y), x * y)
+AVX2_KERNELS(Divide, _mm256_div_pd(x, y), x / y)
+AVX2_BROADCAST_KERNEL(ReverseSubtract, _mm256_sub_pd(y, x), y - x)
+AVX2_BROADCAST_KERNEL(ReverseDivide, _mm256_div_pd(y, x), y / x)
+AVX2_KERNELS(Equal, AVX2_MASK(_CMP_EQ_OQ), x == y ? 1.0 : 0.0)
+AVX2_KERNELS(NotEqual, AVX2_MASK(_CMP_NEQ_UQ), x != y ? 1.0 : 0.0)
+AVX2_KERNELS(Less, AVX2_MASK(_CMP_LT_OQ), x < y ? 1.0 : 0.0)
+AVX2_KERNELS(Greater, AVX2_MASK(_CMP_GT_OQ), x > y ? 1.0 : 0.0)
+AVX2_KERNELS(LesserEqual, AVX2_MASK(_CMP_LE_OQ), x <= y ? 1.0 : 0.0)
+AVX2_KERNELS(GreaterEqual, AVX2_MASK(_CMP_GE_OQ), x >= y ? 1.0 : 0.0)
+
+// separate multiply and add, a fused one would round differently from the others
+AVX2 static double avx2Sum(const double* a, size_t n) {
+    __m256d total = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + REDUCE_LANES <= n; i += REDUCE_LANES) {
+        total = _mm256_add_pd(total, _mm256_load_pd(a + i));
+    }
+    double lanes[REDUCE_LANES];
+    _mm256_storeu_pd(lanes, total);
+    return combineSum(lanes, a + i, n - i);
+}
+
+AVX2 static double avx2Dot(const double* a, const double* b, size_t n) {
+    __m256d total = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + REDUCE_LANES <= n; i += REDUCE_LANES) {
+        total = _mm256_add_pd(total, _mm256_mul_pd(_mm256_load_pd(a + i), _mm256_load_pd(b + i)));
+    }
+    double lanes[REDUCE_LANES];
+    _mm256_storeu_pd(lanes, total);
+    return combineDot(lanes, a + i, b + i, n - i);
+}
+
+#define AVX2_EXTREME(functionName, instruction, choose) \
+    AVX2 static double functionName(const double* a, size_t n) { \
+        if (n < REDUCE_LANES) return shortExtreme(choose, a, n); \
+        __m256d result = _mm256_load_pd(a); \
+        size_t i = REDUCE_LANES; \
+        for (; i + REDUCE_LANES <= n; i += REDUCE_LANES) { \
+            result = instruction(result, _mm256_load_pd(a + i)); \
+        } \
+        double lanes[REDUCE_LANES]; \
+        _mm256_storeu_pd(lanes, result); \
+        return combineExtreme(choose, lanes, a + i, n - i); \
+    }
+
+AVX2_EXTREME(avx2Min, _mm256_min_pd, minimum)
+AVX2_EXTREME(avx2Max, _mm256_max_pd, maximum)
+
+static const struct NumbersKernels avx2Kernels = {
+    "avx2",
+    KERNEL_TABLE(avx2, avx2Broadcast),
+    avx2Sum, avx2Min, avx2Max, avx2Dot,
+};
+
+#endif
+
+// DISPATCH
+
+static const struct NumbersKernels* kernels = &scalarKernels;
+static pthread_once_t kernelsSelected = PTHREAD_ONCE_INIT;
+
+static void selectKernels(void) {
+    const char* forced = getenv("INTERP_KERNELS");
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    bool hasAvx2 = __builtin_cpu_supports("avx2");
+    if (forced && strcmp(forced, "scalar") == 0) {
+        kernels = &scalarKernels;
+    } else if (forced && strcmp(forced, "sse2") == 0) {
+        kernels = &sse2Kernels;
+    } else {
+        kernels = hasAvx2 ? &avx2Kernels : &sse2Kernels;
+    }
+#else
+    (void) forced;
+    kernels = &scalarKernels;
+#endif
+}
+
+static const struct NumbersKernels* getKernels(void) {
+    pthread_once(&kernelsSelected, selectKernels);
+    return kernels;
+}
+
+const char* numbersKernelName(void) {
+    return getKernels()->name;
+}
+
+// ARRAYS
+
+struct NumberArray* createNumberArray(size_t length) {
+    if (length > NUMBERS_MAX_LENGTH) {
+        raiseError("Numbers array of %zu elements is too large.\n", length);
+    }
+    struct NumberArray* array = allocMemory(sizeof(struct NumberArray));
+    // a whole number of alignments, and something for empty arrays
+    size_t bytes = (length * sizeof(double) + NUMBERS_ALIGNMENT - 1) / NUMBERS_ALIGNMENT * NUMBERS_ALIGNMENT;
+    double* data = allocAligned(NUMBERS_ALIGNMENT, bytes ? bytes : NUMBERS_ALIGNMENT);
+    if (!array || !data) {
+        freeMemory(array);
+        freeAligned(data);
+        raiseError("Error allocating while creating numbers.\n");
+    }
+    atomic_init(&array->refcount, 0);
+    array->length = length;
+    array->data = data;
+    return array;
+}
+
+void freeNumberArray(struct NumberArray* array) {
+    freeAligned(array->data);
+    freeMemory(array);
+}
+
+struct Value createNumbersValue(struct NumberArray* array) {
+    struct Value val;
+    val.type = VALUE_NUMBERS;
+    val.originNode = NULL;
+    val.data.numbers = array;
+    return val;
+}
+
+void storeNumbersElement(const struct ASTNode* node, struct NumberArray* array, size_t i, struct Value element) {
+    if (element.type != VALUE_NUMBER) {
+        freeNumberArray(array);
+        raiseError("Elements of numbers must be number values, line %zu\n", node->line);
+    }
+    array->data[i] = element.data.number;
+}
+
+// RANGE AND REDUCTIONS, see builtins.c
+
+struct Value buildRange(const struct ASTNode* node, double start, double end, double step) {
+    if (step == 0) {
+        raiseError("Step of range cannot be zero, line %zu\n", node->line);
+    }
+
+    // end is left out, like a loop counting up to it
+    double steps = (end - start) / step;
+    if (!(steps > 0)) steps = 0;
+    if (steps > (double) NUMBERS_MAX_LENGTH) {
+        raiseError("Range from %g to %g is too large, line %zu\n", start, end, node->line);
+    }
+    size_t length = (size_t) steps;
+    if ((double) length < steps) length++;
+    struct NumberArray* array = createNumberArray(length);
+    for (size_t i = 0; i < length; i++) {
+        array->data[i] = start + (double) i * step;
+    }
+    return createNumbersValue(array);
+}
+
+double sumNumbers(const struct NumberArray* array) {
+    return getKernels()->sum(array->data, array->length);
+}
+
+double minNumbers(const struct NumberArray* array) {
+    return getKernels()->min(array->data, array->length);
+}
+
+double maxNumbers(const struct NumberArray* array) {
+    return getKernels()->max(array->data, array->length);
+}
+
+double dotNumbers(const struct NumberArray* left, const struct NumberArray* right) {
+    return getKernels()->dot(left->data, right->data, left->length);
+}
+
+struct Value indexNumbers(const struct ASTNode* node, struct Value array, struct Value index) {
+    if (array.type != VALUE_NUMBERS) {
+        raiseError("Only numbers and maps can be indexed, line %zu\n", node->line);
+    }
+    if (index.type != VALUE_NUMBER) {
+        discardTemporary(array);
+        raiseError("Index must be a number value, line %zu\n", node->line);
+    }
+    double position = index.data.number;
+    size_t length = array.data.numbers->length;
+    if (!(position >= 0) || position >= (double) length) {
+        discardTemporary(array);
+        raiseError("Index %g is out of range for numbers of length %zu, line %zu\n", position, length, node->line);
+    }
+    if (position != (double) (size_t) position) {
+        discardTemporary(array);
+        raiseError("Index %g is not a whole number, line %zu\n", position, node->line);
+    }
+    double element = array.data.numbers->data[(size_t) position];
+    discardTemporary(array);
+    return createNumberValue(element);
+}
+
+// OPERATORS
+
+static bool containsZero(const struct NumberArray* array) {
+    for (size_t i = 0; i < array->length; i++) {
+        if (array->data[i] == 0) return true;
+    }
+    return false;
+}
+
+// the operator seen from the other side, for number op array
+static size_t reversedOperation(enum BinaryOperatorTypes op) {
+    switch (op) {
+        case BIN_OP_MINUS:          return KERNEL_REVERSE_SUBTRACT;
+        case BIN_OP_SLASH:          return KERNEL_REVERSE_DIVIDE;
+        case BIN_OP_LESS:           return BIN_OP_GREATER;
+        case BIN_OP_GREATER:        return BIN_OP_LESS;
+        case BIN_OP_LESSER_EQUAL:   return BIN_OP_GREATER_EQUAL;
+        case BIN_OP_GREATER_EQUAL:  return BIN_OP_LESSER_EQUAL;
+        default:                    return op;
+    }
+}
+
+static bool isTemporary(struct Value val) {
+    return val.type == VALUE_NUMBERS && atomic_load(&val.data.numbers->refcount) == 0;
+}
+
+struct Value applyNumbersOperator(const struct ASTNode* node, struct Value left, struct Value right) {
+    const struct NumbersKernels* k = getKernels();
+    enum BinaryOperatorTypes op = node->data.binary.operationChar;
+    struct NumberArray* array = left.type == VALUE_NUMBERS ? left.data.numbers : right.data.numbers;
+
+    bool divideByZero;
+    if (left.type == VALUE_NUMBERS && right.type == VALUE_NUMBERS) {
+        if (left.data.numbers->length != right.data.numbers->length) {
+            size_t leftLength = left.data.numbers->length;
+            size_t rightLength = right.data.numbers->length;
+            discardTemporary(left);
+            discardTemporary(right);
+            raiseError("Numbers of different lengths (%zu and %zu), line %zu column %zu\n",
+                leftLength, rightLength, node->line, node->column);
+        }
+        divideByZero = op == BIN_OP_SLASH && containsZero(right.data.numbers);
+    } else if (right.type == VALUE_NUMBER) {
+        divideByZero = op == BIN_OP_SLASH && right.data.number == 0;
+    } else {
+        divideByZero = op == BIN_OP_SLASH && containsZero(right.data.numbers);
+    }
+    if (divideByZero) {
+        discardTemporary(left);
+        discardTemporary(right);
+        raiseError("Cannot divide by zero. line %zu column %zu\n", node->line, node->column);
+    }
+
+    // a temporary operand is overwritten in place instead of building another array
+    struct NumberArray* result;
+    if (isTemporary(left)) {
+        result = left.data.numbers;
+    } else if (isTemporary(right)) {
+        result = right.data.numbers;
+    } else {
+        result = createNumberArray(array->length);
+    }
+
+    if (left.type == VALUE_NUMBERS && right.type == VALUE_NUMBERS) {
+        k->elementwise[op](result->data, left.data.numbers->data, right.data.numbers->data, array->length);
+    } else if (right.type == VALUE_NUMBER) {
+        k->broadcast[op](result->data, array->data, right.data.number, array->length);
+    } else {
+        k->broadcast[reversedOperation(op)](result->data, array->data, left.data.number, array->length);
+    }
+
+    if (right.type == VALUE_NUMBERS && right.data.numbers != result) {
+        discardTemporary(right);
+    }
+    return createNumbersValue(result);
+}
+
+void writeNumbers(const struct NumberArray* array) {
+    writeOutput("[", 1);
+    for (size_t i = 0; i < array->length; i++) {
+        char buffer[NUMBER_TEXT_SIZE + 2] = ", ";
+        size_t length = formatNumber(array->data[i], buffer + 2) + 2;
+        writeOutput(i == 0 ? buffer + 2 : buffer, i == 0 ? length - 2 : length);
+    }
+    writeOutput("]", 1);
+}
@@ -0,0 +1,943 @@
+#include "../include/optimiser.h"
+#include "../include/allocator.h"
+#include "../include/modules.h"
+#include "../include/evaluator.h"
+#include "../include/builtins.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define NONE ((size_t) -1)
+#define VERSION_BUCKET_COUNT 257
+#define VALUE_BUCKET_COUNT 1024
+
+// SSA FORM
+//
+// Control flow in this language is structured, so the IR keeps it that way:
+// regions mirror if blocks, loop bodies and fn bodies, and phi versions are
+// created where a region is entered (loops) or left (loops and ifs) for every
+// name it writes. A value defined in a region is available in that region and
+// every region nested in it, which is what dominance means here.
+
+enum IROpcode {
+    IR_CONSTANT,
+    IR_LOAD,
+    IR_BINARY,
+    IR_OPAQUE,      // logical operators, spawn, await, builtins and array literals, never shared or moved
+};
+
+enum IRType {
+    IR_TYPE_UNKNOWN,
+    IR_TYPE_NUMBER,
+    IR_TYPE_BOOL,
+    IR_TYPE_TEXT,
+    IR_TYPE_NUMBERS,
+};
+
+struct IRRegion {
+    size_t              parent;         // NONE for the root of a scope
+    bool                isLoop;
+    struct ASTNodeList* enclosingList;  // list holding the loop statement, hoisted code goes before it
+    struct ASTNode*     statement;
+};
+
+struct IRVersion {
+    const char*     name;
+    enum IRType     type;
+    bool            defined;    // the variable certainly exists while this version is current
+    size_t          region;     // where the version is created
+    size_t          copyOf;     // load value this version was assigned from, NONE otherwise
+};
+
+struct IRValue {
+    enum IROpcode               opcode;
+    enum BinaryOperatorTypes    op;
+    size_t                      operands[2];
+    size_t                      version;        // IR_LOAD
+    double                      number;         // IR_CONSTANT of type number
+    enum IRType                 type;
+    size_t                      region;
+    size_t                      replacement;    // canonical value, set by copy propagation and CSE
+    size_t                      hoistTo;        // loop region chosen by LICM, NONE otherwise
+};
+
+// one expression in the AST and the value it computes
+struct IROccurrence {
+    struct ASTNode**    slot;
+    size_t              value;
+    size_t              region;
+    size_t              parent;         // enclosing occurrence in the same expression tree
+    bool                statement;      // a statement on its own, replacing it could make it print
+    size_t              copySource;     // load value of another variable holding the same version
+    const char*         copySourceName;
+    bool                dead;           // inside an expression that gets replaced
+};
+
+struct VersionBinding {
+    const char*             name;
+    size_t                  version;
+    struct VersionBinding*  next;
+};
+
+struct VersionMap {
+    struct VersionBinding* bucket[VERSION_BUCKET_COUNT];
+};
+
+struct SSAProgram {
+    struct IRRegion*        regions;
+    size_t                  regionCount;
+    struct IRVersion*       versions;
+    size_t                  versionCount;
+    struct IRValue*         values;
+    size_t                  valueCount;
+    struct IROccurrence*    occurrences;
+    size_t                  occurrenceCount;
+
+    struct VersionMap*      currentVersions;   // of the scope being built
+    size_t                  nextTemporary;
+};
+
+#define GROW(array, count) \
+    array = resizeMemory(array, sizeof(*(array)) * ((count) + 1))
+
+static unsigned long hashText(const char* text) {
+    unsigned long h = 5381;
+    while (*text) {
+        h = ((h << 5) + h) + (unsigned char)*text;
+        text++;
+    }
+    return h;
+}
+
+static double elapsedMilliseconds(const struct timespec* start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1000.0 + (end.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+static bool isBinaryNode(enum ASTNodeType type) {
+    switch (type) {
+        case NODE_BINARY_OPERATION:
+        CASE_NUMBER_BINARY_NODES:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static enum IRType typeOfDataType(enum TokenType dataType) {
+    switch (dataType) {
+        case NUMBER_TYPE:   return IR_TYPE_NUMBER;
+        case TEXT_TYPE:     return IR_TYPE_TEXT;
+        case BOOLEAN_TYPE:  return IR_TYPE_BOOL;
+        case NUMBERS_TYPE:  return IR_TYPE_NUMBERS;
+        default:            return IR_TYPE_UNKNOWN;
+    }
+}
+
+static enum IRType typeOfStaticType(enum StaticType type) {
+    switch (type) {
+        case STATIC_NUMBER:     return IR_TYPE_NUMBER;
+        case STATIC_TEXT:       return IR_TYPE_TEXT;
+        case STATIC_BOOL:       return IR_TYPE_BOOL;
+        case STATIC_NUMBERS:    return IR_TYPE_NUMBERS;
+        default:                return IR_TYPE_UNKNOWN;
+    }
+}
+
+// VERSIONS
+
+static struct VersionBinding* findBinding(struct VersionMap* map, const char* name) {
+    unsigned long h = hashText(name) % VERSION_BUCKET_COUNT;
+    for (struct VersionBinding* binding = map->bucket[h]; binding; binding = binding->next) {
+        if (strcmp(binding->name, name) == 0) return binding;
+    }
+    return NULL;
+}
+
+static void freeVersionMap(struct VersionMap* map) {
+    for (size_t i = 0; i < VERSION_BUCKET_COUNT; i++) {
+        struct VersionBinding* binding = map->bucket[i];
+        while (binding) {
+            struct VersionBinding* next = binding->next;
+            freeMemory(binding);
+            binding = next;
+        }
+    }
+}
+
+static size_t newVersion(struct SSAProgram* ssa, const char* name, enum IRType type, bool defined, size_t region, size_t copyOf) {
+    GROW(ssa->versions, ssa->versionCount);
+    struct IRVersion* version = &ssa->versions[ssa->versionCount];
+    version->name = name;
+    version->type = type;
+    version->defined = defined;
+    version->region = region;
+    version->copyOf = copyOf;
+
+    struct VersionBinding* binding = findBinding(ssa->currentVersions, name);
+    if (!binding) {
+        unsigned long h = hashText(name) % VERSION_BUCKET_COUNT;
+        binding = allocMemory(sizeof(struct VersionBinding));
+        binding->name = name;
+        binding->next = ssa->currentVersions->bucket[h];
+        ssa->currentVersions->bucket[h] = binding;
+    }
+    binding->version = ssa->versionCount;
+    return ssa->versionCount++;
+}
+
+// current version of a name, a name never written in this scope gets an undefined version
+static size_t currentVersion(struct SSAProgram* ssa, const char* name, size_t rootRegion) {
+    struct VersionBinding* binding = findBinding(ssa->currentVersions, name);
+    if (binding) return binding->version;
+    return newVersion(ssa, name, IR_TYPE_UNKNOWN, false, rootRegion, NONE);
+}
+
+// names a block writes, not counting nested fn bodies which get their own environment
+static void collectWrittenNames(const struct ASTNodeList* list, const char*** names, size_t* count) {
+    for (size_t i = 0; i < list->count; i++) {
+        const struct ASTNode* n = list->nodes[i];
+        switch (n->nodeType) {
+            case NODE_VARIABLE_DECLARATION:
+                GROW(*names, *count);
+                (*names)[(*count)++] = n->data.varDeclaration.name;
+                break;
+            case NODE_VARIABLE_ASSIGN:
+                GROW(*names, *count);
+                (*names)[(*count)++] = n->data.varAssignment.name;
+                break;
+            case NODE_FUNCTION_DECLARATION:
+                GROW(*names, *count);
+                (*names)[(*count)++] = n->data.funcDeclaration.name;
+                break;
+            case NODE_IF_STATEMENT:
+                collectWrittenNames(n->data.ifStatement.conditionTrueBlock, names, count);
+                break;
+            case NODE_LOOP_STATEMENT:
+                collectWrittenNames(n->data.loopStatement.loopCodeBlock, names, count);
+                break;
+            case NODE_PARALLEL_LOOP:
+                // the body runs in chunk environments, only reductions come back out
+                for (size_t j = 0; j < n->data.parallelLoop.reductionCount; j++) {
+                    GROW(*names, *count);
+                    (*names)[(*count)++] = n->data.parallelLoop.reductions[j].name;
+                }
+                break;
+            case NODE_INLINED_BLOCK:
+                for (size_t j = 0; j < n->data.inlinedBlock.localCount; j++) {
+                    GROW(*names, *count);
+                    (*names)[(*count)++] = n->data.inlinedBlock.locals[j];
+                }
+                collectWrittenNames(n->data.inlinedBlock.codeBlock, names, count);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// BUILDING
+
+struct ScopeBuilder {
+    struct SSAProgram*  ssa;
+    size_t              root;
+};
+
+static size_t newRegion(struct SSAProgram* ssa, size_t parent, bool isLoop, struct ASTNodeList* list, struct ASTNode* statement) {
+    GROW(ssa->regions, ssa->regionCount);
+    struct IRRegion* region = &ssa->regions[ssa->regionCount];
+    region->parent = parent;
+    region->isLoop = isLoop;
+    region->enclosingList = list;
+    region->statement = statement;
+    return ssa->regionCount++;
+}
+
+static size_t newValue(struct SSAProgram* ssa, enum IROpcode opcode, enum IRType type, size_t region) {
+    GROW(ssa->values, ssa->valueCount);
+    struct IRValue* value = &ssa->values[ssa->valueCount];
+    memset(value, 0, sizeof(struct IRValue));
+    value->opcode = opcode;
+    value->type = type;
+    value->region = region;
+    value->operands[0] = NONE;
+    value->operands[1] = NONE;
+    value->version = NONE;
+    value->replacement = ssa->valueCount;
+    value->hoistTo = NONE;
+    return ssa->valueCount++;
+}
+
+static size_t newOccurrence(struct SSAProgram* ssa, struct ASTNode** slot, size_t region, size_t parent, bool statement) {
+    GROW(ssa->occurrences, ssa->occurrenceCount);
+    struct IROccurrence* occurrence = &ssa->occurrences[ssa->occurrenceCount];
+    occurrence->slot = slot;
+    occurrence->value = NONE;
+    occurrence->region = region;
+    occurrence->parent = parent;
+    occurrence->statement = statement;
+    occurrence->copySource = NONE;
+    occurrence->copySourceName = NULL;
+    occurrence->dead = false;
+    return ssa->occurrenceCount++;
+}
+
+static size_t buildExpression(struct ScopeBuilder* builder, struct ASTNode** slot, size_t region, size_t parent, bool statement) {
+    struct SSAProgram* ssa = builder->ssa;
+    struct ASTNode* node = *slot;
+
+    switch (node->nodeType) {
+        case NODE_NUMBER_LITERAL:
+            {
+                size_t value = newValue(ssa, IR_CONSTANT, IR_TYPE_NUMBER, builder->root);
+                ssa->values[value].number = node->data.numberValue;
+                return value;
+            }
+        case NODE_BOOL_LITERAL:
+            {
+                size_t value = newValue(ssa, IR_CONSTANT, IR_TYPE_BOOL, builder->root);
+                ssa->values[value].number = node->data.boolValue;
+                return value;
+            }
+        case NODE_TEXT_LITERAL:
+            return newValue(ssa, IR_CONSTANT, IR_TYPE_TEXT, builder->root);
+        case NODE_VARIABLE_REFERENCE:
+        case NODE_CACHED_VARIABLE_REFERENCE:
+            {
+                size_t occurrence = newOccurrence(ssa, slot, region, parent, statement);
+                size_t version = currentVersion(ssa, node->data.textValue, builder->root);
+                size_t value = newValue(ssa, IR_LOAD, ssa->versions[version].type, region);
+                ssa->values[value].version = version;
+                ssa->occurrences[occurrence].value = value;
+
+                // reading a plain copy whose source still holds the copied version
+                size_t copyOf = ssa->versions[version].copyOf;
+                if (copyOf != NONE) {
+                    const struct IRValue* source = &ssa->values[ssa->values[copyOf].replacement];
+                    const char* sourceName = ssa->versions[source->version].name;
+                    struct VersionBinding* binding = findBinding(ssa->currentVersions, sourceName);
+                    if (binding && binding->version == source->version) {
+                        ssa->occurrences[occurrence].copySource = ssa->values[copyOf].replacement;
+                        ssa->occurrences[occurrence].copySourceName = sourceName;
+                    }
+                }
+                return value;
+            }
+        case NODE_BINARY_OPERATION:
+        CASE_NUMBER_BINARY_NODES:
+            {
+                size_t occurrence = newOccurrence(ssa, slot, region, parent, statement);
+                size_t left = buildExpression(builder, &node->data.binary.leftSide, region, occurrence, false);
+                size_t right = buildExpression(builder, &node->data.binary.rightSide, region, occurrence, false);
+                enum BinaryOperatorTypes op = node->data.binary.operationChar;
+
+                // evaluation only continues past an operator when it produced its result type,
+                // a numbers operand makes every operator element-wise
+                enum IRType leftType = ssa->values[left].type;
+                enum IRType rightType = ssa->values[right].type;
+                enum IRType type = isComparisonOperator(op) ? IR_TYPE_BOOL : IR_TYPE_NUMBER;
+                if (leftType == IR_TYPE_NUMBERS || rightType == IR_TYPE_NUMBERS) {
+                    type = IR_TYPE_NUMBERS;
+                } else if (leftType == IR_TYPE_UNKNOWN || rightType == IR_TYPE_UNKNOWN) {
+                    type = IR_TYPE_UNKNOWN;
+                }
+                size_t value = newValue(ssa, IR_BINARY, type, region);
+                ssa->values[value].op = op;
+                ssa->values[value].operands[0] = left;
+                ssa->values[value].operands[1] = right;
+                ssa->occurrences[occurrence].value = value;
+                return value;
+            }
+        case NODE_LOGICAL_AND:
+        case NODE_LOGICAL_OR:
+            {
+                // the right side may not run, values computed there are not available afterwards
+                buildExpression(builder, &node->data.binary.leftSide, region, parent, false);
+                size_t conditional = newRegion(ssa, region, false, NULL, NULL);
+                buildExpression(builder, &node->data.binary.rightSide, conditional, parent, false);
+                return newValue(ssa, IR_OPAQUE, IR_TYPE_BOOL, region);
+            }
+        case NODE_LOGICAL_NOT:
+            buildExpression(builder, &node->data.unary.operand, region, parent, false);
+            return newValue(ssa, IR_OPAQUE, IR_TYPE_BOOL, region);
+        case NODE_SPAWN:
+            // the task gets copies of the arguments, this environment is not written
+            for (size_t i = 0; i < node->data.funcCall.argumentCount; i++) {
+                buildExpression(builder, &node->data.funcCall.arguments[i], region, NONE, false);
+            }
+            return newValue(ssa, IR_OPAQUE, IR_TYPE_UNKNOWN, region);
+        case NODE_AWAIT:
+            buildExpression(builder, &node->data.unary.operand, region, parent, false);
+            return newValue(ssa, IR_OPAQUE, IR_TYPE_UNKNOWN, region);
+        case NODE_NUMBERS:
+            for (size_t i = 0; i < node->data.numbers.elementCount; i++) {
+                buildExpression(builder, &node->data.numbers.elements[i], region, parent, false);
+            }
+            return newValue(ssa, IR_OPAQUE, IR_TYPE_NUMBERS, region);
+        case NODE_BUILTIN_CALL:
+            for (size_t i = 0; i < node->data.builtinCall.argumentCount; i++) {
+                buildExpression(builder, &node->data.builtinCall.arguments[i], region, parent, false);
+            }
+            return newValue(ssa, IR_OPAQUE, typeOfStaticType(node->data.builtinCall.builtin->result), region);
+        case NODE_INDEX:
+            {
+                // a map's elements can be of any type
+                size_t container = buildExpression(builder, &node->data.binary.leftSide, region, parent, false);
+                buildExpression(builder, &node->data.binary.rightSide, region, parent, false);
+                bool numbers = container != NONE && ssa->values[container].type == IR_TYPE_NUMBERS;
+                return newValue(ssa, IR_OPAQUE, numbers ? IR_TYPE_NUMBER : IR_TYPE_UNKNOWN, region);
+            }
+        case NODE_MAP:
+            for (size_t i = 0; i < node->data.map.entryCount; i++) {
+                buildExpression(builder, &node->data.map.keys[i], region, parent, false);
+                buildExpression(builder, &node->data.map.values[i], region, parent, false);
+            }
+            return newValue(ssa, IR_OPAQUE, IR_TYPE_UNKNOWN, region);
+        default:
+            return NONE;
+    }
+}
+
+static void buildList(struct ScopeBuilder* builder, struct ASTNodeList* list, size_t region);
+
+// the fns an import binds, their bodies belong to the module and are left alone
+static void bindImportedNames(struct SSAProgram* ssa, const struct ASTNodeList* module, size_t region) {
+    for (size_t i = 0; i < module->count; i++) {
+        const struct ASTNode* n = module->nodes[i];
+        if (n->nodeType == NODE_FUNCTION_DECLARATION) {
+            newVersion(ssa, n->data.funcDeclaration.name, IR_TYPE_UNKNOWN, false, region, NONE);
+        } else {
+            bindImportedNames(ssa, &n->data.import.module->program, region);
+        }
+    }
+}
+
+static void buildScope(struct SSAProgram* ssa, struct ASTNodeList* list, const struct Parameter* parameters, size_t parameterCount) {
+    struct VersionMap* enclosing = ssa->currentVersions;
+    struct VersionMap scopeVersions;
+    memset(&scopeVersions, 0, sizeof(scopeVersions));
+    ssa->currentVersions = &scopeVersions;
+
+    struct ScopeBuilder builder;
+    builder.ssa = ssa;
+    builder.root = newRegion(ssa, NONE, false, NULL, NULL);
+
+    for (size_t i = 0; i < parameterCount; i++) {
+        newVersion(ssa, parameters[i].name, typeOfDataType(parameters[i].dataType), true, builder.root, NONE);
+    }
+    buildList(&builder, list, builder.root);
+
+    freeVersionMap(&scopeVersions);
+    ssa->currentVersions = enclosing;
+}
+
+// a written name gets a phi version, it may or may not hold what it held before
+static size_t mergeVersion(struct SSAProgram* ssa, const char* name, size_t before, size_t region) {
+    const struct IRVersion* previous = &ssa->versions[before];
+    enum IRType type = previous->type;
+    struct VersionBinding* binding = findBinding(ssa->currentVersions, name);
+    if (binding && ssa->versions[binding->version].type != type) {
+        type = previous->defined ? IR_TYPE_UNKNOWN : ssa->versions[binding->version].type;
+    }
+    return newVersion(ssa, name, type, previous->defined, region, NONE);
+}
+
+static void buildList(struct ScopeBuilder* builder, struct ASTNodeList* list, size_t region) {
+    struct SSAProgram* ssa = builder->ssa;
+
+    for (size_t i = 0; i < list->count; i++) {
+        struct ASTNode* n = list->nodes[i];
+        switch (n->nodeType) {
+            case NODE_VARIABLE_DECLARATION:
+                {
+                    size_t value = buildExpression(builder, &n->data.varDeclaration.node, region, NONE, false);
+                    bool copy = value != NONE && ssa->values[value].opcode == IR_LOAD;
+                    newVersion(ssa, n->data.varDeclaration.name, typeOfDataType(n->data.varDeclaration.dataType),
+                        true, region, copy ? value : NONE);
+                    break;
+                }
+            case NODE_VARIABLE_ASSIGN:
+                {
+                    size_t value = buildExpression(builder, &n->data.varAssignment.node, region, NONE, false);
+                    size_t before = currentVersion(ssa, n->data.varAssignment.name, builder->root);
+                    enum IRType type = ssa->versions[before].type;
+                    if (type == IR_TYPE_UNKNOWN && value != NONE) type = ssa->values[value].type;
+                    bool copy = value != NONE && ssa->values[value].opcode == IR_LOAD;
+                    newVersion(ssa, n->data.varAssignment.name, type, true, region, copy ? value : NONE);
+                    break;
+                }
+            case NODE_FUNCTION_DECLARATION:
+                newVersion(ssa, n->data.funcDeclaration.name, IR_TYPE_UNKNOWN, false, region, NONE);
+                buildScope(ssa, n->data.funcDeclaration.codeBlock, n->data.funcDeclaration.parameters,
+                    n->data.funcDeclaration.parameterCount);
+                break;
+            case NODE_IMPORT:
+                bindImportedNames(ssa, &n->data.import.module->program, region);
+                break;
+            case NODE_FUNCTION_CALL:
+            case NODE_CACHED_FUNCTION_CALL:
+                // the callee runs in its own environment and cannot write this one
+                for (size_t j = 0; j < n->data.funcCall.argumentCount; j++) {
+                    buildExpression(builder, &n->data.funcCall.arguments[j], region, NONE, false);
+                }
+                break;
+            case NODE_IF_STATEMENT:
+            case NODE_LOOP_STATEMENT:
+                {
+                    bool isLoop = n->nodeType == NODE_LOOP_STATEMENT;
+                    struct ASTNode** header = isLoop ? &n->data.loopStatement.loopCount : &n->data.ifStatement.condition;
+                    struct ASTNodeList* block = isLoop ? n->data.loopStatement.loopCodeBlock : n->data.ifStatement.conditionTrueBlock;
+                    buildExpression(builder, header, region, NONE, false);
+
+                    const char** written = NULL;
+                    size_t writtenCount = 0;
+                    collectWrittenNames(block, &written, &writtenCount);
+                    size_t* before = allocMemory(sizeof(size_t) * (writtenCount ? writtenCount : 1));
+                    for (size_t j = 0; j < writtenCount; j++) {
+                        before[j] = currentVersion(ssa, written[j], builder->root);
+                    }
+
+                    size_t child = newRegion(ssa, region, isLoop, list, n);
+                    if (isLoop) {
+                        // loop header phis, later iterations see what earlier ones wrote
+                        for (size_t j = 0; j < writtenCount; j++) {
+                            mergeVersion(ssa, written[j], before[j], child);
+                        }
+                    }
+                    buildList(builder, block, child);
+                    for (size_t j = 0; j < writtenCount; j++) {
+                        mergeVersion(ssa, written[j], before[j], region);
+                    }
+
+                    freeMemory(before);
+                    freeMemory(written);
+                    break;
+                }
+            case NODE_PARALLEL_LOOP:
+                // the body is left alone, temporaries would not reach the chunk environments
+                buildExpression(builder, &n->data.parallelLoop.loopCount, region, NONE, false);
+                for (size_t j = 0; j < n->data.parallelLoop.reductionCount; j++) {
+                    newVersion(ssa, n->data.parallelLoop.reductions[j].name, IR_TYPE_NUMBER, true, region, NONE);
+                }
+                break;
+            case NODE_INLINED_BLOCK:
+                {
+                    // always runs to the end, so it is part of the enclosing region
+                    struct ASTInlinedBlock* block = &n->data.inlinedBlock;
+                    size_t* arguments = allocMemory(sizeof(size_t) * (block->argumentCount ? block->argumentCount : 1));
+                    for (size_t j = 0; j < block->argumentCount; j++) {
+                        arguments[j] = buildExpression(builder, &block->arguments[j], region, NONE, false);
+                    }
+                    for (size_t j = 0; j < block->argumentCount; j++) {
+                        bool copy = arguments[j] != NONE && ssa->values[arguments[j]].opcode == IR_LOAD;
+                        newVersion(ssa, block->parameters[j].name, typeOfDataType(block->parameters[j].dataType),
+                            true, region, copy ? arguments[j] : NONE);
+                    }
+                    freeMemory(arguments);
+
+                    buildList(builder, block->codeBlock, region);
+                    for (size_t j = 0; j < block->localCount; j++) {
+                        newVersion(ssa, block->locals[j], IR_TYPE_UNKNOWN, false, region, NONE);
+                    }
+                    break;
+                }
+            case NODE_INDEX_ASSIGN:
+                // changes the map in place, the variable keeps its version
+                buildExpression(builder, &n->data.indexAssignment.key, region, NONE, false);
+                buildExpression(builder, &n->data.indexAssignment.value, region, NONE, false);
+                break;
+            case NODE_TEMPORARY_SET:
+                break;
+            default:
+                if (isBinaryNode(n->nodeType) || n->nodeType == NODE_VARIABLE_REFERENCE ||
+                        n->nodeType == NODE_CACHED_VARIABLE_REFERENCE || n->nodeType == NODE_SPAWN ||
+                        n->nodeType == NODE_AWAIT || n->nodeType == NODE_BUILTIN_CALL) {
+                    buildExpression(builder, &list->nodes[i], region, NONE, true);
+                }
+                break;
+        }
+    }
+}
+
+// ANALYSIS HELPERS
+
+static size_t canonical(const struct SSAProgram* ssa, size_t value) {
+    while (ssa->values[value].replacement != value) {
+        value = ssa->values[value].replacement;
+    }
+    return value;
+}
+
+static bool isRegionInside(const struct SSAProgram* ssa, size_t region, size_t ancestor) {
+    while (region != NONE) {
+        if (region == ancestor) return true;
+        region = ssa->regions[region].parent;
+    }
+    return false;
+}
+
+// deepest region whose definitions the value needs, it can be computed anywhere inside it
+static size_t availableRegion(const struct SSAProgram* ssa, size_t value) {
+    const struct IRValue* v = &ssa->values[canonical(ssa, value)];
+    switch (v->opcode) {
+        case IR_CONSTANT:
+            return v->region;
+        case IR_LOAD:
+            return ssa->versions[v->version].region;
+        case IR_OPAQUE:
+            return v->region;
+        case IR_BINARY:
+            {
+                size_t left = availableRegion(ssa, v->operands[0]);
+                size_t right = availableRegion(ssa, v->operands[1]);
+                return isRegionInside(ssa, left, right) ? left : right;
+            }
+    }
+    return NONE;
+}
+
+// true when computing the value can never stop the program
+static bool cannotFail(const struct SSAProgram* ssa, size_t value) {
+    const struct IRValue* v = &ssa->values[canonical(ssa, value)];
+    switch (v->opcode) {
+        case IR_CONSTANT:
+            return true;
+        case IR_LOAD:
+            return ssa->versions[v->version].defined;
+        case IR_OPAQUE:
+            return false;
+        case IR_BINARY:
+            {
+                const struct IRValue* left = &ssa->values[canonical(ssa, v->operands[0])];
+                const struct IRValue* right = &ssa->values[canonical(ssa, v->operands[1])];
+                if (left->type != IR_TYPE_NUMBER || right->type != IR_TYPE_NUMBER) return false;
+                if (!cannotFail(ssa, v->operands[0]) || !cannotFail(ssa, v->operands[1])) return false;
+                if (v->op == BIN_OP_SLASH) {
+                    return right->opcode == IR_CONSTANT && right->number != 0;
+                }
+                return true;
+            }
+    }
+    return false;
+}
+
+// PASSES
+
+static size_t runCopyPropagation(struct SSAProgram* ssa) {
+    size_t changes = 0;
+    for (size_t i = 0; i < ssa->occurrenceCount; i++) {
+        struct IROccurrence* occurrence = &ssa->occurrences[i];
+        if (occurrence->copySource == NONE || occurrence->statement) continue;
+        ssa->values[occurrence->value].replacement = occurrence->copySource;
+        changes++;
+    }
+    return changes;
+}
+
+struct ValueKey {
+    size_t              value;
+    struct ValueKey*    next;
+};
+
+static bool sameComputation(const struct SSAProgram* ssa, const struct IRValue* a, const struct IRValue* b) {
+    if (a->opcode != b->opcode) return false;
+    if (a->opcode == IR_LOAD) return a->version == b->version;
+    if (a->opcode == IR_CONSTANT) return a->type == b->type && a->number == b->number;
+    return a->op == b->op &&
+        canonical(ssa, a->operands[0]) == canonical(ssa, b->operands[0]) &&
+        canonical(ssa, a->operands[1]) == canonical(ssa, b->operands[1]);
+}
+
+static size_t runCSE(struct SSAProgram* ssa) {
+    size_t changes = 0;
+    struct ValueKey** table = allocZeroed(VALUE_BUCKET_COUNT, sizeof(struct ValueKey*));
+
+    // values are created in evaluation order, so every earlier match in an enclosing region has already run
+    for (size_t i = 0; i < ssa->valueCount; i++) {
+        struct IRValue* value = &ssa->values[i];
+        if (value->replacement != i || value->type == IR_TYPE_TEXT || value->opcode == IR_OPAQUE) continue;
+
+        unsigned long h;
+        if (value->opcode == IR_CONSTANT) {
+            unsigned long long bits;
+            memcpy(&bits, &value->number, sizeof(bits));
+            h = (unsigned long) (bits ^ (bits >> 32)) * 31 + value->type;
+        } else if (value->opcode == IR_LOAD) {
+            h = value->version * 31 + 7;
+        } else {
+            h = ((canonical(ssa, value->operands[0]) * 31 + canonical(ssa, value->operands[1])) * 31) + value->op;
+        }
+        h %= VALUE_BUCKET_COUNT;
+
+        size_t match = NONE;
+        for (struct ValueKey* key = table[h]; key; key = key->next) {
+            const struct IRValue* candidate = &ssa->values[key->value];
+            if (sameComputation(ssa, candidate, value) && isRegionInside(ssa, value->region, candidate->region)) {
+                match = key->value;
+                break;
+            }
+        }
+
+        if (match != NONE) {
+            value->replacement = match;
+            if (value->opcode == IR_BINARY) changes++;
+            continue;
+        }
+        struct ValueKey* key = allocMemory(sizeof(struct ValueKey));
+        key->value = i;
+        key->next = table[h];
+        table[h] = key;
+    }
+
+    for (size_t i = 0; i < VALUE_BUCKET_COUNT; i++) {
+        struct ValueKey* key = table[i];
+        while (key) {
+            struct ValueKey* next = key->next;
+            freeMemory(key);
+            key = next;
+        }
+    }
+    freeMemory(table);
+    return changes;
+}
+
+static size_t runLICM(struct SSAProgram* ssa) {
+    size_t changes = 0;
+    for (size_t i = 0; i < ssa->valueCount; i++) {
+        struct IRValue* value = &ssa->values[i];
+        if (value->opcode != IR_BINARY || value->replacement != i) continue;
+        if (!cannotFail(ssa, i)) continue;
+
+        // outermost enclosing loop the value does not depend on
+        size_t available = availableRegion(ssa, i);
+        size_t target = NONE;
+        for (size_t region = value->region; region != NONE; region = ssa->regions[region].parent) {
+            if (region == available || isRegionInside(ssa, available, region)) break;
+            if (ssa->regions[region].isLoop) target = region;
+        }
+        if (target != NONE) {
+            value->hoistTo = target;
+            changes++;
+        }
+    }
+    return changes;
+}
+
+// LOWERING BACK TO THE AST
+
+struct Materialised {
+    char*           name;       // temporary holding the value, NULL when it is recomputed
+    size_t          first;      // first live occurrence
+    size_t          uses;       // live occurrences outside statement position
+    struct ASTNode* hoisted;    // computation to insert before the loop
+};
+
+static bool hasDeadAncestor(const struct SSAProgram* ssa, const bool* replaced, size_t occurrence) {
+    for (size_t parent = ssa->occurrences[occurrence].parent; parent != NONE; parent = ssa->occurrences[parent].parent) {
+        if (replaced[parent]) return true;
+    }
+    return false;
+}
+
+static char* temporaryName(struct SSAProgram* ssa) {
+    // '$' never comes out of the tokeniser, so temporaries cannot clash with program names
+    char* name = allocMemory(32);
+    snprintf(name, 32, "$t%zu", ssa->nextTemporary++);
+    return name;
+}
+
+static struct ASTNode* createTemporaryNode(enum ASTNodeType type, const char* name, struct ASTNode* value, const struct ASTNode* position) {
+    struct ASTNode* node = allocZeroed(1, sizeof(struct ASTNode));
+    node->nodeType = type;
+    node->line = position->line;
+    node->column = position->column;
+    if (type == NODE_TEMPORARY_SET) {
+        node->data.varAssignment.name = copyText(name);
+        node->data.varAssignment.node = value;
+        node->data.varAssignment.typeChecked = true;
+    } else {
+        node->data.textValue = copyText(name);
+    }
+    return node;
+}
+
+static void insertBefore(struct ASTNodeList* list, const struct ASTNode* statement, struct ASTNode* node) {
+    size_t index = 0;
+    while (index < list->count && list->nodes[index] != statement) index++;
+    appendAST(list, node);
+    memmove(&list->nodes[index + 1], &list->nodes[index], sizeof(struct ASTNode*) * (list->count - 1 - index));
+    list->nodes[index] = node;
+}
+
+static size_t lowerToAST(struct SSAProgram* ssa) {
+    size_t changes = 0;
+    struct Materialised* materialised = allocZeroed(ssa->valueCount ? ssa->valueCount : 1, sizeof(struct Materialised));
+    bool* replaced = allocZeroed(ssa->occurrenceCount ? ssa->occurrenceCount : 1, sizeof(bool));
+
+    // decide which occurrences turn into temporaries, replacing an expression also
+    // removes the occurrences inside it, so repeat until the decision is stable
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 0; i < ssa->valueCount; i++) {
+            materialised[i].first = NONE;
+            materialised[i].uses = 0;
+        }
+        for (size_t i = 0; i < ssa->occurrenceCount; i++) {
+            struct IROccurrence* occurrence = &ssa->occurrences[i];
+            occurrence->dead = hasDeadAncestor(ssa, replaced, i);
+            if (occurrence->dead) continue;
+            size_t value = canonical(ssa, occurrence->value);
+            if (ssa->values[value].opcode != IR_BINARY) continue;
+            if (materialised[value].first == NONE) materialised[value].first = i;
+            if (!occurrence->statement) materialised[value].uses++;
+        }
+
+        for (size_t i = 0; i < ssa->occurrenceCount; i++) {
+            const struct IROccurrence* occurrence = &ssa->occurrences[i];
+            bool replace = false;
+            if (!occurrence->dead && !occurrence->statement) {
+                size_t value = canonical(ssa, occurrence->value);
+                const struct IRValue* v = &ssa->values[value];
+                if (v->opcode == IR_BINARY) {
+                    size_t first = materialised[value].first;
+                    bool hoisted = v->hoistTo != NONE && isRegionInside(ssa, ssa->occurrences[first].region, v->hoistTo);
+                    if (hoisted) {
+                        replace = isRegionInside(ssa, occurrence->region, v->hoistTo);
+                    } else {
+                        replace = first != i && materialised[value].uses >= 2;
+                    }
+                }
+            }
+            if (replace != replaced[i]) {
+                replaced[i] = replace;
+                changed = true;
+            }
+        }
+    }
+
+    // renamed in every occurrence, hoisted copies below must not read a copy declared inside the loop
+    for (size_t i = 0; i < ssa->occurrenceCount; i++) {
+        const struct IROccurrence* occurrence = &ssa->occurrences[i];
+        struct ASTNode* node = *occurrence->slot;
+        if (occurrence->copySourceName && !occurrence->statement &&
+                (node->nodeType == NODE_VARIABLE_REFERENCE || node->nodeType == NODE_CACHED_VARIABLE_REFERENCE)) {
+            freeMemory(node->data.textValue);
+            node->data.textValue = copyText(occurrence->copySourceName);
+            // now reads another variable, whose source name it does not know
+            freeMemory(node->sourceName);
+            node->sourceName = NULL;
+            changes++;
+        }
+    }
+
+    // hoisted values are computed before their loop from a copy of the untouched expression
+    for (size_t i = 0; i < ssa->occurrenceCount; i++) {
+        const struct IROccurrence* occurrence = &ssa->occurrences[i];
+        if (!replaced[i]) continue;
+        size_t value = canonical(ssa, occurrence->value);
+        const struct IRValue* v = &ssa->values[value];
+        if (materialised[value].name || v->hoistTo == NONE ||
+                !isRegionInside(ssa, ssa->occurrences[materialised[value].first].region, v->hoistTo)) {
+            continue;
+        }
+
+        const struct ASTNode* loop = ssa->regions[v->hoistTo].statement;
+        materialised[value].name = temporaryName(ssa);
+        struct ASTNode* computation = cloneNode(*occurrence->slot);
+        materialised[value].hoisted = createTemporaryNode(NODE_TEMPORARY_SET, materialised[value].name, computation, loop);
+        changes++;
+    }
+
+    // occurrences are in evaluation order, the first one of a shared value stores it
+    for (size_t i = 0; i < ssa->occurrenceCount; i++) {
+        struct IROccurrence* occurrence = &ssa->occurrences[i];
+        if (occurrence->dead) continue;
+        size_t value = canonical(ssa, occurrence->value);
+        struct ASTNode* node = *occurrence->slot;
+
+        if (replaced[i]) {
+            if (!materialised[value].name) {
+                // CSE, the first occurrence was passed without being given a name
+                continue;
+            }
+            *occurrence->slot = createTemporaryNode(NODE_VARIABLE_REFERENCE, materialised[value].name, NULL, node);
+            destroyNode(node);
+            changes++;
+            continue;
+        }
+
+        if (ssa->values[value].opcode == IR_BINARY && materialised[value].first == i && materialised[value].uses >= 2 &&
+                !materialised[value].name) {
+            materialised[value].name = temporaryName(ssa);
+            *occurrence->slot = createTemporaryNode(NODE_TEMPORARY_SET, materialised[value].name, node, node);
+            changes++;
+        }
+    }
+
+    // inserted last, growing a block moves the statement slots occurrences point into
+    for (size_t i = 0; i < ssa->valueCount; i++) {
+        if (materialised[i].hoisted) {
+            const struct IRRegion* loop = &ssa->regions[ssa->values[i].hoistTo];
+            insertBefore(loop->enclosingList, loop->statement, materialised[i].hoisted);
+        }
+        freeMemory(materialised[i].name);
+    }
+    freeMemory(materialised);
+    freeMemory(replaced);
+    return changes;
+}
+
+void optimiseProgram(struct ASTNodeList* program, struct OptimiserStats* stats) {
+    memset(stats, 0, sizeof(struct OptimiserStats));
+
+    struct SSAProgram ssa;
+    memset(&ssa, 0, sizeof(ssa));
+    ssa.nextTemporary = 1;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    buildScope(&ssa, program, NULL, 0);
+    stats->milliseconds[PASS_BUILD_SSA] = elapsedMilliseconds(&start);
+    stats->changes[PASS_BUILD_SSA] = ssa.valueCount;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    stats->changes[PASS_COPY_PROPAGATION] = runCopyPropagation(&ssa);
+    stats->milliseconds[PASS_COPY_PROPAGATION] = elapsedMilliseconds(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    stats->changes[PASS_CSE] = runCSE(&ssa);
+    stats->milliseconds[PASS_CSE] = elapsedMilliseconds(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    stats->changes[PASS_LICM] = runLICM(&ssa);
+    stats->milliseconds[PASS_LICM] = elapsedMilliseconds(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    stats->changes[PASS_LOWER_AST] = lowerToAST(&ssa);
+    stats->milliseconds[PASS_LOWER_AST] = elapsedMilliseconds(&start);
+
+    stats->values = ssa.valueCount;
+    stats->versions = ssa.versionCount;
+    stats->regions = ssa.regionCount;
+
+    freeMemory(ssa.regions);
+    freeMemory(ssa.versions);
+    freeMemory(ssa.values);
+    freeMemory(ssa.occurrences);
+}
+
+void printOptimiserStats(const struct OptimiserStats* stats) {
+    static const char* passNames[OPTIMISER_PASS_COUNT] = {
+        "build-ssa", "copy-propagation", "cse", "licm", "lower-ast"
+    };
+    static const char* changeNames[OPTIMISER_PASS_COUNT] = {
+        "values", "forwarded reads", "shared expressions", "hoisted expressions", "rewritten nodes"
+    };
+
+    fprintf(stderr, "optimiser: %zu values, %zu versions, %zu regions\n", stats->values, stats->versions, stats->regions);
+    for (int i = 0; i < OPTIMISER_PASS_COUNT; i++) {
+        fprintf(stderr, "optimiser: %-17s %8.3f ms  %zu %s\n", passNames[i], stats->milliseconds[i], stats->changes[i], changeNames[i]);
+    }
+}
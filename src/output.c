@@ -0,0 +1,116 @@
+#include "../include/output.h"
+#include "../include/map.h"
+#include "../include/numbers.h"
+#include "../include/runtime.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static enum OutputFormat outputFormat = OUTPUT_TEXT;
+
+void setOutputFormat(enum OutputFormat format) {
+    outputFormat = format;
+}
+
+enum OutputFormat getOutputFormat(void) {
+    return outputFormat;
+}
+
+size_t formatNumber(double value, char* text) {
+    if (outputFormat == OUTPUT_EXACT) return formatShortest(value, text);
+    return formatGeneral(value, text);
+}
+
+// BUFFER
+//
+// Only the thread running the command line's program writes here, tasks and
+// parallel loops print through their own sinks.
+
+static char outputBuffer[OUTPUT_BUFFER_SIZE];
+static size_t outputUsed = 0;
+static int outputFd = -1;
+static bool flushLines = false;
+
+// gives up on the rest when fd fails, as stdio did
+static void writeAll(const char* text, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(outputFd, text, length);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        text += written;
+        length -= (size_t) written;
+    }
+}
+
+bool useBufferedOutput(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || (flags & O_ACCMODE) == O_RDONLY) return false;
+    flushOutput();
+    if (outputFd < 0) atexit(flushOutput);
+    outputFd = fd;
+    flushLines = isatty(fd);
+    return true;
+}
+
+bool bufferOutput(const char* text, size_t length) {
+    if (outputFd < 0) return false;
+    if (length > OUTPUT_BUFFER_SIZE - outputUsed) {
+        flushOutput();
+        // no point copying what fills the buffer on its own
+        if (length >= OUTPUT_BUFFER_SIZE) {
+            writeAll(text, length);
+            return true;
+        }
+    }
+    memcpy(outputBuffer + outputUsed, text, length);
+    outputUsed += length;
+    if (flushLines && memchr(text, '\n', length)) flushOutput();
+    return true;
+}
+
+void flushOutput(void) {
+    if (outputUsed == 0) return;
+    writeAll(outputBuffer, outputUsed);
+    outputUsed = 0;
+}
+
+// BINARY RECORDS
+
+static void writeRecordHeader(char tag, uint64_t size) {
+    char header[1 + sizeof(uint64_t)];
+    header[0] = tag;
+    memcpy(header + 1, &size, sizeof(size));
+    writeOutput(header, sizeof(header));
+}
+
+void writeBinaryValue(struct Value val) {
+    if (val.type == VALUE_NUMBER) {
+        char record[1 + sizeof(double)];
+        record[0] = 'n';
+        memcpy(record + 1, &val.data.number, sizeof(double));
+        writeOutput(record, sizeof(record));
+    } else if (val.type == VALUE_BOOL) {
+        char record[2] = { 'b', val.data.boolVal ? 1 : 0 };
+        writeOutput(record, sizeof(record));
+    } else if (val.type == VALUE_TEXT) {
+        size_t length = strlen(val.data.text);
+        writeRecordHeader('t', length);
+        writeOutput(val.data.text, length);
+    } else if (val.type == VALUE_NUMBERS) {
+        const struct NumberArray* array = val.data.numbers;
+        writeRecordHeader('a', array->length);
+        writeOutput((const char*) array->data, array->length * sizeof(double));
+    } else if (val.type == VALUE_MAP) {
+        const struct Map* map = val.data.map;
+        writeRecordHeader('m', map->count);
+        for (size_t i = 0; i < map->count; i++) {
+            writeBinaryValue(map->entries[i].key);
+            writeBinaryValue(map->entries[i].value);
+        }
+    }
+}
@@ -0,0 +1,357 @@
+#include "../include/parallelLoop.h"
+#include "../include/allocator.h"
+#include "../include/runtime.h"
+#include "../include/builtins.h"
+#include "../include/threadPool.h"
+#include <stdio.h>
+#include <string.h>
+
+// RESOLVING
+
+struct NameList {
+    char**  names;
+    size_t  count;
+};
+
+struct Resolver {
+    const struct ASTParallelLoop*   loop;
+    struct NameList                 locals;
+    struct NameList                 shared;
+};
+
+static bool containsName(const struct NameList* list, const char* name) {
+    for (size_t i = 0; i < list->count; i++) {
+        if (strcmp(list->names[i], name) == 0) return true;
+    }
+    return false;
+}
+
+static void addName(struct NameList* list, const char* name) {
+    if (containsName(list, name)) return;
+    list->names = resizeMemory(list->names, sizeof(char*) * (list->count + 1));
+    list->names[list->count++] = copyText(name);
+}
+
+static const struct Reduction* findReduction(const struct ASTParallelLoop* loop, const char* name) {
+    for (size_t i = 0; i < loop->reductionCount; i++) {
+        if (strcmp(loop->reductions[i].name, name) == 0) return &loop->reductions[i];
+    }
+    return NULL;
+}
+
+static bool isIndex(const struct ASTParallelLoop* loop, const char* name) {
+    return loop->indexName && strcmp(loop->indexName, name) == 0;
+}
+
+static const char* reductionSymbol(const struct Reduction* reduction) {
+    return reduction->op == BIN_OP_PLUS ? "+" : "*";
+}
+
+static void collectLocals(struct Resolver* resolver, const struct ASTNodeList* list) {
+    for (size_t i = 0; i < list->count; i++) {
+        const struct ASTNode* n = list->nodes[i];
+        switch (n->nodeType) {
+            case NODE_VARIABLE_DECLARATION:
+                {
+                    const char* name = n->data.varDeclaration.name;
+                    if (findReduction(resolver->loop, name) || isIndex(resolver->loop, name)) {
+                        raiseError("Parallel loop cannot declare '%s', it is already its index or a reduction, line %zu\n", name, n->line);
+                    }
+                    addName(&resolver->locals, name);
+                    break;
+                }
+            case NODE_IF_STATEMENT:
+                collectLocals(resolver, n->data.ifStatement.conditionTrueBlock);
+                break;
+            case NODE_LOOP_STATEMENT:
+                collectLocals(resolver, n->data.loopStatement.loopCodeBlock);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+static void resolveExpression(struct Resolver* resolver, const struct ASTNode* n) {
+    switch (n->nodeType) {
+        case NODE_VARIABLE_REFERENCE:
+            {
+                const char* name = n->data.textValue;
+                const struct Reduction* reduction = findReduction(resolver->loop, name);
+                if (reduction) {
+                    raiseError("Reduction variable '%s' can only be updated as %s = %s %s value, line %zu\n",
+                        name, name, name, reductionSymbol(reduction), n->line);
+                }
+                if (!isIndex(resolver->loop, name) && !containsName(&resolver->locals, name)) {
+                    addName(&resolver->shared, name);
+                }
+                break;
+            }
+        case NODE_BINARY_OPERATION:
+        case NODE_INDEX:
+        case NODE_LOGICAL_AND:
+        case NODE_LOGICAL_OR:
+        CASE_NUMBER_BINARY_NODES:
+            resolveExpression(resolver, n->data.binary.leftSide);
+            resolveExpression(resolver, n->data.binary.rightSide);
+            break;
+        case NODE_NUMBERS:
+            for (size_t i = 0; i < n->data.numbers.elementCount; i++) {
+                resolveExpression(resolver, n->data.numbers.elements[i]);
+            }
+            break;
+        case NODE_MAP:
+            for (size_t i = 0; i < n->data.map.entryCount; i++) {
+                resolveExpression(resolver, n->data.map.keys[i]);
+                resolveExpression(resolver, n->data.map.values[i]);
+            }
+            break;
+        case NODE_BUILTIN_CALL:
+            if (!n->data.builtinCall.builtin->pure) {
+                raiseError("Parallel loop cannot call %s, its iterations run in no particular order, line %zu\n",
+                    n->data.builtinCall.builtin->name, n->line);
+            }
+            for (size_t i = 0; i < n->data.builtinCall.argumentCount; i++) {
+                resolveExpression(resolver, n->data.builtinCall.arguments[i]);
+            }
+            break;
+        case NODE_LOGICAL_NOT:
+            resolveExpression(resolver, n->data.unary.operand);
+            break;
+        case NODE_SPAWN:
+            raiseError("Parallel loop cannot spawn tasks, line %zu\n", n->line);
+        case NODE_AWAIT:
+            raiseError("Parallel loop cannot await tasks, line %zu\n", n->line);
+        default:
+            break;
+    }
+}
+
+static bool isReference(const struct ASTNode* n, const char* name) {
+    return n->nodeType == NODE_VARIABLE_REFERENCE && strcmp(n->data.textValue, name) == 0;
+}
+
+// reductions are only ever updated as name = name op value, or name = value op name
+static void resolveReductionUpdate(struct Resolver* resolver, const struct ASTNode* n, const struct Reduction* reduction) {
+    const struct ASTNode* value = n->data.varAssignment.node;
+    if (value->nodeType == NODE_BINARY_OPERATION && value->data.binary.operationChar == reduction->op) {
+        if (isReference(value->data.binary.leftSide, reduction->name)) {
+            resolveExpression(resolver, value->data.binary.rightSide);
+            return;
+        }
+        if (isReference(value->data.binary.rightSide, reduction->name)) {
+            resolveExpression(resolver, value->data.binary.leftSide);
+            return;
+        }
+    }
+    raiseError("Reduction variable '%s' can only be updated as %s = %s %s value, line %zu\n",
+        reduction->name, reduction->name, reduction->name, reductionSymbol(reduction), n->line);
+}
+
+static void resolveList(struct Resolver* resolver, const struct ASTNodeList* list) {
+    for (size_t i = 0; i < list->count; i++) {
+        const struct ASTNode* n = list->nodes[i];
+        switch (n->nodeType) {
+            case NODE_VARIABLE_DECLARATION:
+                resolveExpression(resolver, n->data.varDeclaration.node);
+                break;
+            case NODE_VARIABLE_ASSIGN:
+                {
+                    const char* name = n->data.varAssignment.name;
+                    const struct Reduction* reduction = findReduction(resolver->loop, name);
+                    if (reduction) {
+                        resolveReductionUpdate(resolver, n, reduction);
+                    } else if (isIndex(resolver->loop, name)) {
+                        raiseError("Parallel loop index '%s' cannot be assigned, line %zu\n", name, n->line);
+                    } else if (!containsName(&resolver->locals, name)) {
+                        raiseError("Parallel loop cannot assign '%s', it is shared by every iteration. "
+                            "Declare it inside the loop or as a reduction, line %zu\n", name, n->line);
+                    } else {
+                        resolveExpression(resolver, n->data.varAssignment.node);
+                    }
+                    break;
+                }
+            case NODE_INDEX_ASSIGN:
+                // even a local may hold a map the other iterations share
+                raiseError("Parallel loop cannot change map '%s', its iterations run in no particular order, line %zu\n",
+                    n->data.indexAssignment.name, n->line);
+            case NODE_VARIABLE_REFERENCE:
+                raiseError("Parallel loop cannot print '%s', its iterations run in no particular order, line %zu\n",
+                    n->data.textValue, n->line);
+            case NODE_FUNCTION_DECLARATION:
+                raiseError("Parallel loop cannot declare functions, line %zu\n", n->line);
+            case NODE_FUNCTION_CALL:
+                raiseError("Parallel loop cannot call functions, line %zu\n", n->line);
+            case NODE_PARALLEL_LOOP:
+                raiseError("Parallel loops cannot be nested, line %zu\n", n->line);
+            case NODE_IF_STATEMENT:
+                resolveExpression(resolver, n->data.ifStatement.condition);
+                resolveList(resolver, n->data.ifStatement.conditionTrueBlock);
+                break;
+            case NODE_LOOP_STATEMENT:
+                resolveExpression(resolver, n->data.loopStatement.loopCount);
+                resolveList(resolver, n->data.loopStatement.loopCodeBlock);
+                break;
+            default:
+                resolveExpression(resolver, n);
+                break;
+        }
+    }
+}
+
+void resolveParallelLoop(struct ASTNode* node) {
+    struct ASTParallelLoop* loop = &node->data.parallelLoop;
+    for (size_t i = 0; i < loop->reductionCount; i++) {
+        const char* name = loop->reductions[i].name;
+        if (isIndex(loop, name) || findReduction(loop, name) != &loop->reductions[i]) {
+            raiseError("'%s' is used more than once in the index and reductions of a parallel loop, line %zu\n", name, node->line);
+        }
+    }
+
+    struct Resolver resolver;
+    resolver.loop = loop;
+    resolver.locals.names = NULL;
+    resolver.locals.count = 0;
+    resolver.shared.names = NULL;
+    resolver.shared.count = 0;
+
+    collectLocals(&resolver, loop->loopCodeBlock);
+    resolveList(&resolver, loop->loopCodeBlock);
+
+    loop->locals = resolver.locals.names;
+    loop->localCount = resolver.locals.count;
+    loop->sharedNames = resolver.shared.names;
+    loop->sharedCount = resolver.shared.count;
+}
+
+// RUNNING
+
+struct ParallelChunk {
+    const struct ASTNode*   node;
+    struct Environment*     outer;      // only read while chunks run
+    const void*             body;
+    ParallelBodyFunction    runBody;
+    size_t                  first;
+    size_t                  last;
+    double*                 partials;   // one per reduction
+    char*                   error;      // message of the error that stopped the chunk
+    struct Interpreter*     interpreter;
+};
+
+static void runChunk(void* argument) {
+    struct ParallelChunk* chunk = argument;
+    const struct ASTParallelLoop* loop = &chunk->node->data.parallelLoop;
+    // what the chunk allocates counts against the memory limit of the loop's instance
+    struct Interpreter* previousInterpreter = enterInterpreter(chunk->interpreter);
+
+    // errors are raised again by the thread that runs the loop
+    struct Environment env = { 0 };
+    struct ErrorHandler handler;
+    if (setjmp(handler.jump) == 0) {
+        pushErrorHandler(&handler);
+        createEnvironment(&env);
+        for (size_t i = 0; i < loop->sharedCount; i++) {
+            // names that do not exist are left out, reading them reports the usual error
+            struct Value* val = getValue(chunk->outer, loop->sharedNames[i]);
+            if (!val) continue;
+            struct Value copy = *val;
+            if (copy.type == VALUE_TEXT) {
+                copy.data.text = copyText(copy.data.text);
+            }
+            setValue(&env, loop->sharedNames[i], copy);
+        }
+        for (size_t i = 0; i < loop->reductionCount; i++) {
+            setValue(&env, loop->reductions[i].name, createNumberValue(loop->reductions[i].op == BIN_OP_PLUS ? 0 : 1));
+        }
+
+        for (size_t iteration = chunk->first; iteration < chunk->last; iteration++) {
+            if (loop->indexName) {
+                setValue(&env, loop->indexName, createNumberValue((double) iteration));
+            }
+            chunk->runBody(chunk->body, &env);
+            for (size_t i = 0; i < loop->localCount; i++) {
+                removeValue(&env, loop->locals[i]);
+            }
+        }
+        popErrorHandler(&handler);
+
+        for (size_t i = 0; i < loop->reductionCount; i++) {
+            chunk->partials[i] = getValue(&env, loop->reductions[i].name)->data.number;
+        }
+    } else {
+        // from malloc, the error may be the memory limit of the loop's instance
+        chunk->error = strdup(handler.message);
+    }
+    freeEnvironment(&env);
+    enterInterpreter(previousInterpreter);
+}
+
+void runParallelLoop(const struct ASTNode* node, struct Value loopCount, const void* body,
+        ParallelBodyFunction runBody, struct Environment* env) {
+    const struct ASTParallelLoop* loop = &node->data.parallelLoop;
+
+    // same checks as NODE_LOOP_STATEMENT
+    if (loopCount.type != VALUE_NUMBER) {
+        raiseError("Loop count must be a number value, line %zu\n", node->line);
+    }
+    if (loopCount.data.number < 0.0) {
+        raiseError("Negative loop count is not possible, line %zu\n", node->line);
+    }
+    for (size_t i = 0; i < loop->reductionCount; i++) {
+        struct Value* val = getValue(env, loop->reductions[i].name);
+        if (!val || val->type != VALUE_NUMBER) {
+            raiseError("Reduction variable '%s' must be an existing number variable, line %zu\n", loop->reductions[i].name, node->line);
+        }
+    }
+
+    size_t count = (size_t) loopCount.data.number;
+    if (count == 0) return;
+
+    size_t chunkCount = count < PARALLEL_MAX_CHUNKS ? count : PARALLEL_MAX_CHUNKS;
+    size_t chunkSize = count / chunkCount;
+    size_t remainder = count % chunkCount;
+    struct ParallelChunk* chunks = allocMemory(sizeof(struct ParallelChunk) * chunkCount);
+    double* partials = allocMemory(sizeof(double) * chunkCount * (loop->reductionCount ? loop->reductionCount : 1));
+
+    struct TaskGroup group;
+    initTaskGroup(&group);
+    size_t first = 0;
+    for (size_t c = 0; c < chunkCount; c++) {
+        chunks[c].node = node;
+        chunks[c].outer = env;
+        chunks[c].body = body;
+        chunks[c].runBody = runBody;
+        chunks[c].first = first;
+        chunks[c].last = first + chunkSize + (c < remainder ? 1 : 0);
+        chunks[c].partials = &partials[c * loop->reductionCount];
+        chunks[c].error = NULL;
+        chunks[c].interpreter = currentInterpreter();
+        first = chunks[c].last;
+        submitTask(&group, runChunk, &chunks[c]);
+    }
+    waitTaskGroup(&group);
+
+    // the error of the first chunk that failed, so it does not depend on timing
+    for (size_t c = 0; c < chunkCount; c++) {
+        if (!chunks[c].error) continue;
+        char message[ERROR_MESSAGE_SIZE];
+        snprintf(message, sizeof(message), "%s", chunks[c].error);
+        for (size_t other = c; other < chunkCount; other++) {
+            free(chunks[other].error);
+        }
+        freeMemory(partials);
+        freeMemory(chunks);
+        raiseError("%s", message);
+    }
+
+    for (size_t i = 0; i < loop->reductionCount; i++) {
+        const struct Reduction* reduction = &loop->reductions[i];
+        double value = getValue(env, reduction->name)->data.number;
+        for (size_t c = 0; c < chunkCount; c++) {
+            value = reduction->op == BIN_OP_PLUS ? value + chunks[c].partials[i] : value * chunks[c].partials[i];
+        }
+        setValue(env, reduction->name, createNumberValue(value));
+    }
+    freeMemory(partials);
+    freeMemory(chunks);
+}
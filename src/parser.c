@@ -1,10 +1,16 @@
 #include "../include/parser.h"
+#include "../include/allocator.h"
+#include "../include/runtime.h"
+#include "../include/parallelLoop.h"
+#include "../include/builtins.h"
+#include "../include/modules.h"
+#include "../include/stats.h"
 #include <stdio.h>
 #include <stdbool.h>
 #include <string.h>
 
 struct ASTNode* createBinaryNode(enum BinaryOperatorTypes op, struct ASTNode* left, struct ASTNode* right, size_t line, size_t column) {
-    struct ASTNode* n = malloc(sizeof(struct ASTNode));
+    struct ASTNode* n = allocZeroed(1, sizeof(struct ASTNode));
     n->nodeType = NODE_BINARY_OPERATION;
     n->line = line;
     n->column = column;
@@ -15,11 +21,132 @@ struct ASTNode* createBinaryNode(enum BinaryOperatorTypes op, struct ASTNode* le
     return n;
 }
 
+// expressions separated by commas up to the closing token, which is skipped
+static struct ASTNode** parseArguments(struct TokenList* tokens, size_t* index, enum TokenType closing, size_t* count) {
+    struct ASTNode** arguments = NULL;
+    *count = 0;
+    while (tokens->data[*index].tokenType != closing) {
+        struct ASTNode* arg = parseTopLevel(tokens, index);
+
+        arguments = resizeMemory(arguments, sizeof(struct ASTNode*) * (*count + 1));
+        arguments[*count] = arg;
+        (*count)++;
+
+        if (tokens->data[*index].tokenType == COMMA) {
+            (*index)++;
+        } else if (tokens->data[*index].tokenType != closing) {
+            raiseError("Expected ',' between values, line %zu\n", tokens->data[*index].line);
+        }
+    }
+    (*index)++;
+    return arguments;
+}
+
+// [a, b, c]
+static struct ASTNode* parseNumbers(struct TokenList* tokens, size_t* index) {
+    struct Token token = tokens->data[*index];
+    (*index)++;
+
+    size_t count;
+    struct ASTNode** elements = parseArguments(tokens, index, RIGHT_SQUARE, &count);
+
+    struct ASTNode* node = allocZeroed(1, sizeof(struct ASTNode));
+    node->line = token.line;
+    node->column = token.column;
+    node->nodeType = NODE_NUMBERS;
+    node->data.numbers.elements = elements;
+    node->data.numbers.elementCount = count;
+    return node;
+}
+
+// {key: value, ...}, {} is the empty map
+static struct ASTNode* parseMap(struct TokenList* tokens, size_t* index) {
+    struct Token token = tokens->data[*index];
+    (*index)++;
+
+    struct ASTNode** keys = NULL;
+    struct ASTNode** values = NULL;
+    size_t count = 0;
+    while (tokens->data[*index].tokenType != RIGHT_CURLY) {
+        struct ASTNode* key = parseTopLevel(tokens, index);
+        if (tokens->data[*index].tokenType != COLON) {
+            raiseError("Expected ':' between a map key and its value, line %zu\n", tokens->data[*index].line);
+        }
+        (*index)++;
+        struct ASTNode* value = parseTopLevel(tokens, index);
+
+        keys = resizeMemory(keys, sizeof(struct ASTNode*) * (count + 1));
+        values = resizeMemory(values, sizeof(struct ASTNode*) * (count + 1));
+        keys[count] = key;
+        values[count] = value;
+        count++;
+
+        if (tokens->data[*index].tokenType == COMMA) {
+            (*index)++;
+        } else if (tokens->data[*index].tokenType != RIGHT_CURLY) {
+            raiseError("Expected ',' between map entries, line %zu\n", tokens->data[*index].line);
+        }
+    }
+    (*index)++;
+
+    struct ASTNode* node = allocZeroed(1, sizeof(struct ASTNode));
+    node->line = token.line;
+    node->column = token.column;
+    node->nodeType = NODE_MAP;
+    node->data.map.keys = keys;
+    node->data.map.values = values;
+    node->data.map.entryCount = count;
+    return node;
+}
+
+// NAME(arguments) where NAME is a builtin, bound to it here
+static struct ASTNode* parseBuiltinCall(struct TokenList* tokens, size_t* index, const struct Builtin* builtin) {
+    struct Token token = tokens->data[*index];
+    // skip the name and its '('
+    (*index) += 2;
+
+    size_t count;
+    struct ASTNode** arguments = parseArguments(tokens, index, RIGHT_PAREN, &count);
+
+    struct ASTNode* node = allocZeroed(1, sizeof(struct ASTNode));
+    node->line = token.line;
+    node->column = token.column;
+    node->nodeType = NODE_BUILTIN_CALL;
+    node->data.builtinCall.builtin = builtin;
+    node->data.builtinCall.arguments = arguments;
+    node->data.builtinCall.argumentCount = count;
+
+    if (count < builtin->requiredCount || count > builtin->parameterCount) {
+        destroyNode(node);
+        raiseError("Wrong number of arguments to %s, line %zu\n", builtin->name, token.line);
+    }
+    return node;
+}
+
+static const struct Builtin* findCalledBuiltin(struct TokenList* tokens, size_t index) {
+    const struct Token* token = &tokens->data[index];
+    if (token->tokenType != IDENTIFIER || tokens->data[index + 1].tokenType != LEFT_PAREN) return NULL;
+    return findBuiltin(token->lexeme, token->length);
+}
+
 struct ASTNode* parsePrimary(struct TokenList* tokens, size_t* index) {
     struct Token* token = &tokens->data[*index];
 
+    if (token->tokenType == LEFT_SQUARE) {
+        return parseNumbers(tokens, index);
+    }
+
+    if (token->tokenType == LEFT_CURLY) {
+        return parseMap(tokens, index);
+    }
+
+    const struct Builtin* builtin = findCalledBuiltin(tokens, *index);
+    if (builtin) {
+        return parseBuiltinCall(tokens, index, builtin);
+    }
+
     if (token->tokenType == NUMBER) {
-        struct ASTNode* node = malloc(sizeof(struct ASTNode));
+        struct ASTNode* node = allocZeroed(1, sizeof(struct ASTNode));
         node->line = token->line;
         node->column = token->column;
         node->nodeType = NODE_NUMBER_LITERAL;
@@ -30,29 +157,29 @@ struct ASTNode* parsePrimary(struct TokenList* tokens, size_t* index) {
     }
 
     if (token->tokenType == IDENTIFIER) {
-        struct ASTNode* node = malloc(sizeof(struct ASTNode));
+        struct ASTNode* node = allocZeroed(1, sizeof(struct ASTNode));
         node->line = token->line;
         node->column = token->column;
         node->nodeType = NODE_VARIABLE_REFERENCE;
-        node->data.textValue = strndup(token->lexeme, token->length);
+        node->data.textValue = copyTextN(token->lexeme, token->length);
         
         (*index)++;
         return node;
     }
 
     if (token->tokenType == TEXT) {
-        struct ASTNode* node = malloc(sizeof(struct ASTNode));
+        struct ASTNode* node = allocZeroed(1, sizeof(struct ASTNode));
         node->line = token->line;
         node->column = token->column;
         node->nodeType = NODE_TEXT_LITERAL;
-        node->data.textValue = strndup(token->lexeme, token->length);
+        node->data.textValue = copyTextN(token->lexeme, token->length);
 
         (*index)++;
         return node;
     }
 
     if (token->tokenType == FALSE || token->tokenType == TRUE) {
-        struct ASTNode* node = malloc(sizeof(struct ASTNode));
+        struct ASTNode* node = allocZeroed(1, sizeof(struct ASTNode));
         node->line = token->line;
         node->column = token->column;
         node->nodeType = NODE_BOOL_LITERAL;
@@ -62,29 +189,116 @@ struct ASTNode* parsePrimary(struct TokenList* tokens, size_t* index) {
         return node;
     }
 
-    // CANNOT PARSE PRIMARY
-    // LOG ERROR
-    printf("error parsing primary");
-    return NULL;
+    raiseError("Expected a value, line %zu\n", token->line);
+}
+
+// NAME(arguments), shared by calls and spawn, the caller handles what follows
+static struct ASTNode* parseCall(struct TokenList* tokens, size_t* index, enum ASTNodeType nodeType) {
+    struct Token token = tokens->data[*index];
+    (*index)++;
+
+    char* funcName = copyTextN(token.lexeme, token.length);
+
+    // ( paren
+    (*index)++;
+
+    size_t argumentCounter = 0;
+    struct ASTNode** arguments = NULL;
+    while (tokens->data[*index].tokenType != RIGHT_PAREN) {
+        struct ASTNode* arg = parseTopLevel(tokens, index);
+
+        arguments = resizeMemory(arguments, sizeof(struct ASTNode*) * (argumentCounter + 1));
+        arguments[argumentCounter] = arg;
+        argumentCounter++;
+
+        if (tokens->data[*index].tokenType == COMMA) {
+            (*index)++;
+        }
+    }
+    (*index)++;
+
+    struct ASTNode* node = allocZeroed(1, sizeof(struct ASTNode));
+    node->line = token.line;
+    node->column = token.column;
+    node->nodeType = nodeType;
+    node->data.funcCall.argumentCount = argumentCounter;
+    node->data.funcCall.arguments = arguments;
+    node->data.funcCall.name = funcName;
+    node->data.funcCall.typeChecked = false;
+
+    return node;
 }
 
 struct ASTNode* parseFactor(struct TokenList* tokens, size_t* index) {
     struct Token token = tokens->data[*index];
 
+    // spawn NAME(arguments)
+    if (token.tokenType == SPAWN_DECLARATION) {
+        (*index)++;
+        if (tokens->data[*index].tokenType != IDENTIFIER || tokens->data[*index + 1].tokenType != LEFT_PAREN) {
+            raiseError("Expected a function call after 'spawn', line %zu\n", token.line);
+        }
+        if (findCalledBuiltin(tokens, *index)) {
+            raiseError("Builtins cannot be spawned, line %zu\n", token.line);
+        }
+        return parseCall(tokens, index, NODE_SPAWN);
+    }
+
+    // await factor
+    if (token.tokenType == AWAIT_DECLARATION) {
+        (*index)++;
+        struct ASTNode* node = allocZeroed(1, sizeof(struct ASTNode));
+        node->line = token.line;
+        node->column = token.column;
+        node->nodeType = NODE_AWAIT;
+        node->data.unary.operand = parseFactor(tokens, index);
+        return node;
+    }
+
+    // !factor
+    if (token.tokenType == NOT_OPERATOR) {
+        (*index)++;
+        struct ASTNode* node = allocZeroed(1, sizeof(struct ASTNode));
+        node->line = token.line;
+        node->column = token.column;
+        node->nodeType = NODE_LOGICAL_NOT;
+        node->data.unary.operand = parseFactor(tokens, index);
+        return node;
+    }
+
     // if has parens, parse entire; else its a literal or identifier.
+    struct ASTNode* node;
     if (token.tokenType == LEFT_PAREN) {
         (*index)++;
-        struct ASTNode* subExpr = parseTopLevel(tokens,index);
+        node = parseTopLevel(tokens,index);
         if (tokens->data[*index].tokenType != RIGHT_PAREN) {
             // ERROR;
-            printf("Expected ')'\n");
-            exit(1);
+            raiseError("Expected ')'\n");
         }
         (*index)++;
-        return subExpr;
+    } else {
+        node = parsePrimary(tokens, index);
     }
 
-    return parsePrimary(tokens, index);
+    // value[index]
+    while (tokens->data[*index].tokenType == LEFT_SQUARE) {
+        struct Token bracket = tokens->data[*index];
+        (*index)++;
+        struct ASTNode* element = parseTopLevel(tokens, index);
+        if (tokens->data[*index].tokenType != RIGHT_SQUARE) {
+            raiseError("Expected ']', line %zu\n", bracket.line);
+        }
+        (*index)++;
+
+        struct ASTNode* indexNode = allocZeroed(1, sizeof(struct ASTNode));
+        indexNode->line = bracket.line;
+        indexNode->column = bracket.column;
+        indexNode->nodeType = NODE_INDEX;
+        indexNode->data.binary.leftSide = node;
+        indexNode->data.binary.rightSide = element;
+        node = indexNode;
+    }
+    return node;
 }
 
 struct ASTNode* parseTerm(struct TokenList* tokens, size_t* index) {
@@ -102,8 +316,7 @@ struct ASTNode* parseTerm(struct TokenList* tokens, size_t* index) {
                     op = BIN_OP_SLASH;
                     break;
                 default:
-                    printf("Could not identify binary operator. Line %zu\n", token.line);
-                    exit(1);
+                    raiseError("Could not identify binary operator. Line %zu\n", token.line);
                     
             }
             (*index)++; 
@@ -134,8 +347,7 @@ struct ASTNode* parseExpression(struct TokenList* tokens, size_t* index) {
                     op = BIN_OP_MINUS;
                     break;
                 default:
-                    printf("Could not identify binary operator. Line %zu\n", token.line);
-                    exit(1);
+                    raiseError("Could not identify binary operator. Line %zu\n", token.line);
 
             }
             (*index)++;
@@ -155,36 +367,34 @@ struct ASTNode* parseDeclaration(struct TokenList* tokens, size_t* index) {
     (*index)++;
     struct Token token = tokens->data[*index];
     if (token.tokenType != IDENTIFIER) {
-        // ERROR;
-        exit(1);
+        raiseError("Expected variable name after its type, line %zu\n", token.line);
     }
 
     // get var name
-    char* name = strndup(token.lexeme, token.length);
+    char* name = copyTextN(token.lexeme, token.length);
     (*index)++;
 
     // get =
     if (tokens->data[*index].tokenType != EQUAL) {
-        // ERROR;
-        exit(1);
+        raiseError("Expected '=' after variable name, line %zu\n", token.line);
     }
     (*index)++;
     
     struct ASTNode* init = parseTopLevel(tokens, index);
 
     if (tokens->data[*index].tokenType != SEMICOLON) {
-        printf("Expected ';'. Line %zu\n", token.line);
-        exit(1);
+        raiseError("Expected ';'. Line %zu\n", token.line);
     }
     (*index)++;
 
-    struct ASTNode* node = malloc(sizeof(struct ASTNode));
+    struct ASTNode* node = allocZeroed(1, sizeof(struct ASTNode));
     node->line = token.line;
     node->column = token.column;
     node->nodeType = NODE_VARIABLE_DECLARATION;
     node->data.varDeclaration.name = name;
     node->data.varDeclaration.dataType = dataType;
     node->data.varDeclaration.node = init;
+    node->data.varDeclaration.typeChecked = false;
     return node;
 }
 
@@ -199,31 +409,30 @@ struct ASTNode* parseAssignment(struct TokenList* tokens, size_t* index) {
     // solution puts the datatype check in evaluator.
     
     // get var name
-    char* name = strndup(token.lexeme, token.length);
+    char* name = copyTextN(token.lexeme, token.length);
     (*index)++;
     
     // get = 
     if (tokens->data[*index].tokenType != EQUAL) {
-        printf("Expected '=', in assignment.\n");
-        exit(1);
+        raiseError("Expected '=', in assignment.\n");
     }
     (*index)++;
 
     struct ASTNode* assignValue = parseTopLevel(tokens, index);
 
     if (tokens->data[*index].tokenType != SEMICOLON) {
-        printf("Expected ';'\n");
-        exit(1);
+        raiseError("Expected ';'\n");
     }
     (*index)++;
 
 
-    struct ASTNode* node = malloc(sizeof(struct ASTNode));
+    struct ASTNode* node = allocZeroed(1, sizeof(struct ASTNode));
     node->line = token.line;
     node->column = token.column;
     node->nodeType = NODE_VARIABLE_ASSIGN;
     node->data.varAssignment.name = name;
     node->data.varAssignment.node = assignValue;
+    node->data.varAssignment.typeChecked = false;
     
     return node;
 }
@@ -231,20 +440,18 @@ struct ASTNode* parseAssignment(struct TokenList* tokens, size_t* index) {
 struct ASTNodeList* parseCodeBlock(struct TokenList* tokens, size_t* index) {
     // check for '{'
     if (tokens->data[*index].tokenType != LEFT_CURLY) {
-        printf("Expected '{' at line %zu, column %zu\n", tokens->data[*index].line, 
+        raiseError("Expected '{' at line %zu, column %zu\n", tokens->data[*index].line, 
             tokens->data[*index].column);
-        exit(1);
     }
     (*index)++;
 
-    struct ASTNodeList* ast = malloc(sizeof(struct ASTNodeList));
+    struct ASTNodeList* ast = allocMemory(sizeof(struct ASTNodeList));
     initAST(ast);
 
     while (tokens->data[*index].tokenType != RIGHT_CURLY)
     {
         if (tokens->data[*index].tokenType == END_OF_FILE) {
-            printf("Expected '}' to close code block, reached end of file instead.\n");
-            exit(1);
+            raiseError("Expected '}' to close code block, reached end of file instead.\n");
         }
         struct ASTNode* statement = parseStatement(tokens, index);
         appendAST(ast, statement);
@@ -258,8 +465,12 @@ struct ASTNode* parseFunctionDeclaration(struct TokenList* tokens, size_t* index
     (*index)++; // skip "fn" keyword
     struct Token token = tokens->data[*index];
 
+    if (findBuiltin(token.lexeme, token.length)) {
+        raiseError("Cannot declare function %.*s, it is a builtin, line %zu\n", (int) token.length, token.lexeme, token.line);
+    }
+
     // get function name
-    char* name = strndup(token.lexeme, token.length);
+    char* name = copyTextN(token.lexeme, token.length);
     (*index)++;
 
     // handle params
@@ -270,22 +481,23 @@ struct ASTNode* parseFunctionDeclaration(struct TokenList* tokens, size_t* index
         enum TokenType dataType = tokens->data[*index].tokenType;
         if (dataType != NUMBER_TYPE &&
                 dataType != TEXT_TYPE &&
-                dataType != BOOLEAN_TYPE) {
-            printf("Declaring function parameters must be in the form of datatype variable_name, line %zu\n", token.line);
-            exit(1);
+                dataType != BOOLEAN_TYPE &&
+                dataType != TASK_TYPE &&
+                dataType != NUMBERS_TYPE &&
+                dataType != MAP_TYPE) {
+            raiseError("Declaring function parameters must be in the form of datatype variable_name, line %zu\n", token.line);
         }
         (*index)++;
         struct Token parameterToken = tokens->data[*index];
         if (parameterToken.tokenType != IDENTIFIER) {
-            printf("Expected parameter name on line %zu\n", token.line);
-            exit(1);
+            raiseError("Expected parameter name on line %zu\n", token.line);
         } 
 
         struct Parameter param;
         param.dataType = dataType;
-        param.name = strndup(parameterToken.lexeme, parameterToken.length);
+        param.name = copyTextN(parameterToken.lexeme, parameterToken.length);
 
-        params = realloc(params, sizeof(struct Parameter) * (parameterCounter+1));
+        params = resizeMemory(params, sizeof(struct Parameter) * (parameterCounter+1));
         params[parameterCounter] = param;
         parameterCounter++;
 
@@ -299,7 +511,7 @@ struct ASTNode* parseFunctionDeclaration(struct TokenList* tokens, size_t* index
     // get code block
     struct ASTNodeList* codeBlock = parseCodeBlock(tokens, index);
 
-    struct ASTNode* node = malloc(sizeof(struct ASTNode));
+    struct ASTNode* node = allocZeroed(1, sizeof(struct ASTNode));
     node->line = token.line;
     node->column = token.column;
     node->nodeType = NODE_FUNCTION_DECLARATION;
@@ -312,57 +524,61 @@ struct ASTNode* parseFunctionDeclaration(struct TokenList* tokens, size_t* index
 }
 
 struct ASTNode* parseFunctionCall(struct TokenList* tokens, size_t* index) {
-    struct Token token = tokens->data[*index];
-    (*index)++;
-
-    char* funcName = strndup(token.lexeme, token.length);
+    struct ASTNode* node = parseCall(tokens, index, NODE_FUNCTION_CALL);
 
-    // ( paren
+    // semi colon
+    if (tokens->data[*index].tokenType != SEMICOLON) {
+        raiseError("Expected ';' at line %zu, column %zu.\n", 
+            tokens->data[*index].line, tokens->data[*index].column);
+    }
     (*index)++;
+    return node;
+}
 
-    size_t argumentCounter = 0;
-    struct ASTNode** arguments = NULL;
-    while (tokens->data[*index].tokenType != RIGHT_PAREN) {
-        struct ASTNode* arg = parseTopLevel(tokens, index);
+static struct ASTNode* createLogicalNode(enum ASTNodeType type, struct ASTNode* left, struct ASTNode* right, size_t line, size_t column) {
+    struct ASTNode* n = createBinaryNode(BIN_OP_EQUALITY, left, right, line, column);
+    n->nodeType = type;
+    return n;
+}
 
-        arguments = realloc(arguments, sizeof(struct ASTNode*) * (argumentCounter + 1));
-        arguments[argumentCounter] = arg;
-        argumentCounter++;
+// LEFT || RIGHT
+struct ASTNode* parseLogicalOr(struct TokenList* tokens, size_t* index) {
+    struct ASTNode* left = parseLogicalAnd(tokens, index);
 
-        if (tokens->data[*index].tokenType == COMMA) {
-            (*index)++;
-        }
+    while (tokens->data[*index].tokenType == OR_OPERATOR) {
+        struct Token token = tokens->data[*index];
+        (*index)++;
+        struct ASTNode* right = parseLogicalAnd(tokens, index);
+        left = createLogicalNode(NODE_LOGICAL_OR, left, right, token.line, token.column);
     }
-    (*index)++;
 
-    // semi colon
-    if (tokens->data[*index].tokenType != SEMICOLON) {
-        printf("Expected ';' at line %zu, column %zu.\n", 
-            tokens->data[*index].line, tokens->data[*index].column);
-        exit(1);
-    }
-    (*index)++;
+    return left;
+}
 
-    struct ASTNode* node = malloc(sizeof(struct ASTNode));
-    node->line = token.line;
-    node->column = token.column;
-    node->nodeType = NODE_FUNCTION_CALL;
-    node->data.funcCall.argumentCount = argumentCounter;
-    node->data.funcCall.arguments = arguments;
-    node->data.funcCall.name = funcName;
+// LEFT && RIGHT
+struct ASTNode* parseLogicalAnd(struct TokenList* tokens, size_t* index) {
+    struct ASTNode* left = parseEquality(tokens, index);
 
-    return node;
+    while (tokens->data[*index].tokenType == AND_OPERATOR) {
+        struct Token token = tokens->data[*index];
+        (*index)++;
+        struct ASTNode* right = parseEquality(tokens, index);
+        left = createLogicalNode(NODE_LOGICAL_AND, left, right, token.line, token.column);
+    }
+
+    return left;
 }
 
-// LEFT == RIGHT
+// LEFT == RIGHT, LEFT != RIGHT
 struct ASTNode* parseEquality(struct TokenList* tokens, size_t* index) {
     struct ASTNode* left = parseComparsion(tokens, index);
 
-    while (tokens->data[*index].tokenType == EQUALITY_OPERATOR) {
+    while (tokens->data[*index].tokenType == EQUALITY_OPERATOR || tokens->data[*index].tokenType == NOT_EQUAL) {
         struct Token token = tokens->data[*index];
+        enum BinaryOperatorTypes op = token.tokenType == NOT_EQUAL ? BIN_OP_NOT_EQUAL : BIN_OP_EQUALITY;
         (*index)++;
         struct ASTNode* right = parseComparsion(tokens, index);
-        left = createBinaryNode(BIN_OP_EQUALITY, left, right, token.line, token.column);
+        left = createBinaryNode(op, left, right, token.line, token.column);
     }
 
     return left;
@@ -412,8 +628,7 @@ struct ASTNode* parseIfStatement(struct TokenList* tokens, size_t* index) {
 
     // check for left paren;
     if (tokens->data[*index].tokenType != LEFT_PAREN) {
-        printf("Expected '(' to create if statement on line %zu\n", token.line);
-        exit(1);
+        raiseError("Expected '(' to create if statement on line %zu\n", token.line);
     }
     (*index)++;
     
@@ -422,15 +637,14 @@ struct ASTNode* parseIfStatement(struct TokenList* tokens, size_t* index) {
     
     // check for right paren
     if (tokens->data[*index].tokenType != RIGHT_PAREN) {
-        printf("Expected ')' to end if statement condition on line %zu\n", token.line);
-        exit(1);
+        raiseError("Expected ')' to end if statement condition on line %zu\n", token.line);
     }
     (*index)++;
 
     // get code block
     struct ASTNodeList* codeBlock = parseCodeBlock(tokens, index);
 
-    struct ASTNode* node = malloc(sizeof(struct ASTNode));
+    struct ASTNode* node = allocZeroed(1, sizeof(struct ASTNode));
     node->line = token.line;
     node->column = token.column;
     node->nodeType = NODE_IF_STATEMENT;
@@ -450,7 +664,7 @@ struct ASTNode* parseLoopStatement(struct TokenList* tokens, size_t* index) {
     // get code block
     struct ASTNodeList* codeBlock = parseCodeBlock(tokens, index);
 
-    struct ASTNode* node = malloc(sizeof(struct ASTNode));
+    struct ASTNode* node = allocZeroed(1, sizeof(struct ASTNode));
     node->line = token.line;
     node->column = token.column;
     node->nodeType = NODE_LOOP_STATEMENT;
@@ -460,22 +674,134 @@ struct ASTNode* parseLoopStatement(struct TokenList* tokens, size_t* index) {
     return node;
 }
 
+static bool isContextualKeyword(const struct Token* token, const char* keyword) {
+    return token->tokenType == IDENTIFIER && token->length == strlen(keyword) &&
+        strncmp(token->lexeme, keyword, token->length) == 0;
+}
+
+// parallel loop COUNT [as INDEX] [reduce(+: NAME, *: NAME)] { ... }
+struct ASTNode* parseParallelLoop(struct TokenList* tokens, size_t* index) {
+    struct Token token = tokens->data[*index];
+    (*index)++;
+
+    if (tokens->data[*index].tokenType != LOOP_DECLARATION) {
+        raiseError("Expected 'loop' after 'parallel' on line %zu\n", token.line);
+    }
+    (*index)++;
+
+    // get loop count
+    struct ASTNode* loopCount = parseTopLevel(tokens, index);
+
+    // 'as' and 'reduce' are only keywords here, they stay usable as names elsewhere
+    char* indexName = NULL;
+    if (isContextualKeyword(&tokens->data[*index], "as")) {
+        (*index)++;
+        struct Token nameToken = tokens->data[*index];
+        if (nameToken.tokenType != IDENTIFIER) {
+            raiseError("Expected index name after 'as' on line %zu\n", token.line);
+        }
+        indexName = copyTextN(nameToken.lexeme, nameToken.length);
+        (*index)++;
+    }
+
+    struct Reduction* reductions = NULL;
+    size_t reductionCount = 0;
+    if (isContextualKeyword(&tokens->data[*index], "reduce")) {
+        (*index)++;
+        if (tokens->data[*index].tokenType != LEFT_PAREN) {
+            raiseError("Expected '(' after 'reduce' on line %zu\n", token.line);
+        }
+        (*index)++;
+
+        while (tokens->data[*index].tokenType != RIGHT_PAREN) {
+            enum TokenType opType = tokens->data[*index].tokenType;
+            if ((opType != PLUS && opType != STAR) || tokens->data[*index + 1].tokenType != COLON ||
+                    tokens->data[*index + 2].tokenType != IDENTIFIER) {
+                raiseError("Reductions must be in the form '+: name' or '*: name', line %zu\n", token.line);
+            }
+            struct Token nameToken = tokens->data[*index + 2];
+            *index += 3;
+
+            reductions = resizeMemory(reductions, sizeof(struct Reduction) * (reductionCount + 1));
+            reductions[reductionCount].op = opType == PLUS ? BIN_OP_PLUS : BIN_OP_STAR;
+            reductions[reductionCount].name = copyTextN(nameToken.lexeme, nameToken.length);
+            reductionCount++;
+
+            if (tokens->data[*index].tokenType == COMMA) {
+                (*index)++;
+            }
+        }
+        (*index)++;
+    }
+
+    // get code block
+    struct ASTNodeList* codeBlock = parseCodeBlock(tokens, index);
+
+    struct ASTNode* node = allocZeroed(1, sizeof(struct ASTNode));
+    node->line = token.line;
+    node->column = token.column;
+    node->nodeType = NODE_PARALLEL_LOOP;
+    node->data.parallelLoop.loopCount = loopCount;
+    node->data.parallelLoop.loopCodeBlock = codeBlock;
+    node->data.parallelLoop.indexName = indexName;
+    node->data.parallelLoop.reductions = reductions;
+    node->data.parallelLoop.reductionCount = reductionCount;
+
+    resolveParallelLoop(node);
+    return node;
+}
+
+// NAME[key] = value; where target is the already parsed NAME[key]
+static struct ASTNode* parseIndexAssignment(struct TokenList* tokens, size_t* index, struct ASTNode* target) {
+    struct Token token = tokens->data[*index];
+    if (target->nodeType != NODE_INDEX || target->data.binary.leftSide->nodeType != NODE_VARIABLE_REFERENCE) {
+        destroyNode(target);
+        raiseError("Only variables and map elements can be assigned to, line %zu\n", token.line);
+    }
+    (*index)++;
+
+    struct ASTNode* value = parseTopLevel(tokens, index);
+    if (tokens->data[*index].tokenType != SEMICOLON) {
+        destroyNode(target);
+        destroyNode(value);
+        raiseError("Expected ';'. Line %zu\n", token.line);
+    }
+    (*index)++;
+
+    // the target's variable name and key move into the assignment
+    struct ASTNode* variable = target->data.binary.leftSide;
+    struct ASTNode* node = allocZeroed(1, sizeof(struct ASTNode));
+    node->line = target->line;
+    node->column = target->column;
+    node->nodeType = NODE_INDEX_ASSIGN;
+    node->data.indexAssignment.name = variable->data.textValue;
+    node->data.indexAssignment.key = target->data.binary.rightSide;
+    node->data.indexAssignment.value = value;
+    freeMemory(variable);
+    freeMemory(target);
+    return node;
+}
+
 // recursive descent top level call
 struct ASTNode* parseTopLevel(struct TokenList* tokens, size_t* index) {
-    return parseEquality(tokens, index);
+    return parseLogicalOr(tokens, index);
 }
 
 struct ASTNode* parseStatement(struct TokenList* tokens, size_t* index) {
     enum TokenType tokenType = tokens->data[*index].tokenType;
 
+    if (tokenType == IMPORT_DECLARATION) {
+        raiseError("Imports must be at the top level of a file, line %zu\n", tokens->data[*index].line);
+    }
+
     // FUNCTION DECLARATION
     if (tokenType == FUNCTION_DECLARATION) {
         return parseFunctionDeclaration(tokens, index);
     }
 
-    // FUNCTION CALL
+    // FUNCTION CALL, builtins are called as expressions
     if (tokenType == IDENTIFIER && 
-            tokens->data[*index + 1].tokenType == LEFT_PAREN) {
+            tokens->data[*index + 1].tokenType == LEFT_PAREN && !findCalledBuiltin(tokens, *index)) {
         return parseFunctionCall(tokens, index);
     }
 
@@ -489,8 +815,14 @@ struct ASTNode* parseStatement(struct TokenList* tokens, size_t* index) {
         return parseLoopStatement(tokens, index);
     }
 
+    // PARALLEL LOOP
+    if (tokenType == PARALLEL_DECLARATION) {
+        return parseParallelLoop(tokens, index);
+    }
+
     // DECLARATION
-    if (tokenType == TEXT_TYPE || tokenType == NUMBER_TYPE || tokenType == BOOLEAN_TYPE) {
+    if (tokenType == TEXT_TYPE || tokenType == NUMBER_TYPE || tokenType == BOOLEAN_TYPE || tokenType == TASK_TYPE ||
+            tokenType == NUMBERS_TYPE || tokenType == MAP_TYPE) {
         return parseDeclaration(tokens, index);
     }
 
@@ -499,27 +831,89 @@ struct ASTNode* parseStatement(struct TokenList* tokens, size_t* index) {
         return parseAssignment(tokens, index);
     }
 
-    // EXPRESSION
+    // EXPRESSION, or NAME[key] = value;
     struct ASTNode* expression = parseTopLevel(tokens, index);
+    if (tokens->data[*index].tokenType == EQUAL) {
+        return parseIndexAssignment(tokens, index, expression);
+    }
     if (tokens->data[*index].tokenType != SEMICOLON) {
-        printf("Expectedb ';'. Line %zu\n", tokens->data[*index].line);
-        exit(1);
+        raiseError("Expectedb ';'. Line %zu\n", tokens->data[*index].line);
     }
     (*index)++;
     return expression;
 }
 
-struct ASTNodeList parseProgram(const char* sourceCode) {
-    struct TokenList tokens = tokenise(sourceCode);
+// import "path";
+static struct ASTNode* parseImport(struct TokenList* tokens, size_t* index) {
+    struct Token keyword = tokens->data[*index];
+    (*index)++;
+
+    struct Token file = tokens->data[*index];
+    if (file.tokenType != TEXT) {
+        raiseError("Expected a file name in quotes after 'import', line %zu\n", keyword.line);
+    }
+    (*index)++;
+    if (tokens->data[*index].tokenType != SEMICOLON) {
+        raiseError("Expected ';' after import, line %zu\n", keyword.line);
+    }
+    (*index)++;
+
+    struct ASTNode* node = allocZeroed(1, sizeof(struct ASTNode));
+    node->nodeType = NODE_IMPORT;
+    node->line = keyword.line;
+    node->column = keyword.column;
+    // the lexeme keeps its quotes
+    node->data.import.path = copyTextN(file.lexeme + 1, file.length - 2);
+    return node;
+}
+
+// frees the tokens, imports are only allowed at the top level
+static struct ASTNodeList parseTokens(struct TokenList* tokens) {
     struct ASTNodeList ast;
     initAST(&ast);
 
+    // embedders keep running after a syntax error, so free what was parsed
+    struct ErrorHandler handler;
+    if (setjmp(handler.jump) != 0) {
+        destroyAST(&ast);
+        destroyTokenList(tokens);
+        raiseError("%s", handler.message);
+    }
+    pushErrorHandler(&handler);
     size_t i = 0;
-    while (tokens.data[i].tokenType != END_OF_FILE) {
-        struct ASTNode* statement = parseStatement(&tokens, &i);
+    while (tokens->data[i].tokenType != END_OF_FILE) {
+        struct ASTNode* statement = tokens->data[i].tokenType == IMPORT_DECLARATION ?
+            parseImport(tokens, &i) : parseStatement(tokens, &i);
         appendAST(&ast, statement);
     }
+    popErrorHandler(&handler);
 
-    destroyTokenList(&tokens);
+    destroyTokenList(tokens);
+    return ast;
+}
+
+struct ASTNodeList parseSource(const char* sourceCode) {
+    struct TokenList tokens = tokenise(sourceCode);
+    return parseTokens(&tokens);
+}
+
+struct ASTNodeList parseProgram(const char* sourceCode, const char* path) {
+    beginPhase(STATS_TOKENISE);
+    struct TokenList tokens = tokenise(sourceCode);
+    endPhase(STATS_TOKENISE);
+    countTokens(tokens.count);
+
+    beginPhase(STATS_PARSE);
+    struct ASTNodeList ast = parseTokens(&tokens);
+
+    struct ErrorHandler handler;
+    if (setjmp(handler.jump) != 0) {
+        destroyAST(&ast);
+        raiseError("%s", handler.message);
+    }
+    pushErrorHandler(&handler);
+    loadImports(&ast, path);
+    popErrorHandler(&handler);
+    endPhase(STATS_PARSE);
     return ast;
 }
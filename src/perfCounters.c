@@ -0,0 +1,100 @@
+#include "../include/perfCounters.h"
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+const char* const perfCounterNames[PERF_COUNTER_COUNT] = {
+    [PERF_CYCLES] = "cycles",
+    [PERF_INSTRUCTIONS] = "instructions",
+    [PERF_L1_MISSES] = "l1Misses",
+    [PERF_LLC_MISSES] = "llcMisses",
+    [PERF_BRANCH_MISSES] = "branchMisses",
+};
+
+static int counterFds[PERF_COUNTER_COUNT] = { -1, -1, -1, -1, -1 };
+
+#define CACHE_READ_MISSES(cache) \
+    ((cache) | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} counterEvents[PERF_COUNTER_COUNT] = {
+    [PERF_CYCLES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    [PERF_INSTRUCTIONS] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    [PERF_L1_MISSES] = { PERF_TYPE_HW_CACHE, CACHE_READ_MISSES(PERF_COUNT_HW_CACHE_L1D) },
+    [PERF_LLC_MISSES] = { PERF_TYPE_HW_CACHE, CACHE_READ_MISSES(PERF_COUNT_HW_CACHE_LL) },
+    [PERF_BRANCH_MISSES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+};
+
+static int openCounter(enum PerfCounter counter) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = counterEvents[counter].type;
+    attr.config = counterEvents[counter].config;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // glibc has no wrapper, this thread on any CPU
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+static void explainFailure(int error, char* reason, size_t reasonSize) {
+    if (error == EACCES || error == EPERM) {
+        int paranoid = -1;
+        FILE* file = fopen("/proc/sys/kernel/perf_event_paranoid", "r");
+        if (file) {
+            if (fscanf(file, "%d", &paranoid) != 1) paranoid = -1;
+            fclose(file);
+        }
+        snprintf(reason, reasonSize, "perf_event_open: %s (kernel.perf_event_paranoid is %d)",
+            strerror(error), paranoid);
+    } else if (error == ENOENT || error == EOPNOTSUPP || error == ENODEV) {
+        snprintf(reason, reasonSize, "perf_event_open: no hardware counters here (%s)", strerror(error));
+    } else {
+        snprintf(reason, reasonSize, "perf_event_open: %s", strerror(error));
+    }
+}
+
+bool openPerfCounters(char* reason, size_t reasonSize) {
+    int firstError = 0;
+    bool any = false;
+    for (size_t i = 0; i < PERF_COUNTER_COUNT; i++) {
+        counterFds[i] = openCounter((enum PerfCounter) i);
+        if (counterFds[i] >= 0) {
+            any = true;
+        } else if (!firstError) {
+            firstError = errno;
+        }
+    }
+    if (!any) explainFailure(firstError, reason, reasonSize);
+    return any;
+}
+
+bool perfCounterOpen(enum PerfCounter counter) {
+    return counterFds[counter] >= 0;
+}
+
+void readPerfCounters(uint64_t values[PERF_COUNTER_COUNT]) {
+    for (size_t i = 0; i < PERF_COUNTER_COUNT; i++) {
+        // the count, then the time it was enabled and the time it was running
+        uint64_t reading[3];
+        values[i] = 0;
+        if (counterFds[i] < 0 || read(counterFds[i], reading, sizeof(reading)) != (ssize_t) sizeof(reading)) continue;
+        values[i] = reading[0];
+        if (reading[2] > 0 && reading[2] < reading[1]) {
+            values[i] = (uint64_t) ((double) reading[0] * (double) reading[1] / (double) reading[2]);
+        }
+    }
+}
+
+void closePerfCounters(void) {
+    for (size_t i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if (counterFds[i] >= 0) close(counterFds[i]);
+        counterFds[i] = -1;
+    }
+}
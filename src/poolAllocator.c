@@ -0,0 +1,162 @@
+#include "../include/allocator.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SLAB_SIZE       (64 * 1024)
+#define CLASS_WIDTH     16
+#define CLASS_COUNT     (POOL_LARGEST_BLOCK / CLASS_WIDTH)
+// blocks past the largest class, from malloc
+#define LARGE_BLOCK     UINT64_MAX
+
+// in front of every block
+struct PoolBlock {
+    uint64_t    sizeClass;      // LARGE_BLOCK for malloc's
+    uint64_t    size;           // asked for, of malloc's
+};
+
+_Static_assert(sizeof(struct PoolBlock) == 16, "blocks must stay aligned like malloc's");
+
+struct FreeBlock {
+    struct FreeBlock* next;
+};
+
+// slabs are chained through their first 16 bytes
+struct Slab {
+    struct Slab*    next;
+    uint64_t        unused;
+};
+
+struct PoolAllocator {
+    struct Allocator    base;
+    uint64_t            generation;
+    pthread_mutex_t     lock;
+    struct Slab*        slabs;
+};
+
+// A thread's free lists and what is left of the slab it cuts each class from,
+// for the pool whose generation it holds. A thread moving to another pool
+// drops them, the blocks stay in their slabs until that pool is destroyed.
+struct ThreadCache {
+    uint64_t            generation;
+    struct FreeBlock*   free[CLASS_COUNT];
+    char*               next[CLASS_COUNT];
+    char*               end[CLASS_COUNT];
+};
+
+static _Thread_local struct ThreadCache cache;
+static atomic_uint_fast64_t generations = 1;
+
+static size_t classBytes(size_t sizeClass) {
+    return sizeof(struct PoolBlock) + (sizeClass + 1) * CLASS_WIDTH;
+}
+
+static struct ThreadCache* cacheFor(const struct PoolAllocator* pool) {
+    if (cache.generation != pool->generation) {
+        memset(&cache, 0, sizeof(cache));
+        cache.generation = pool->generation;
+    }
+    return &cache;
+}
+
+static struct PoolBlock* cutBlock(struct PoolAllocator* pool, struct ThreadCache* threadCache, size_t sizeClass) {
+    size_t bytes = classBytes(sizeClass);
+    if (!threadCache->next[sizeClass] || threadCache->next[sizeClass] + bytes > threadCache->end[sizeClass]) {
+        struct Slab* slab = malloc(SLAB_SIZE);
+        if (!slab) return NULL;
+        pthread_mutex_lock(&pool->lock);
+        slab->next = pool->slabs;
+        pool->slabs = slab;
+        pthread_mutex_unlock(&pool->lock);
+        threadCache->next[sizeClass] = (char*) (slab + 1);
+        threadCache->end[sizeClass] = (char*) slab + SLAB_SIZE;
+    }
+    struct PoolBlock* block = (struct PoolBlock*) threadCache->next[sizeClass];
+    threadCache->next[sizeClass] += bytes;
+    return block;
+}
+
+static void* poolAllocate(struct Allocator* self, size_t size, const char* site) {
+    (void) site;
+    struct PoolAllocator* pool = (struct PoolAllocator*) self;
+    struct PoolBlock* block;
+    if (size > POOL_LARGEST_BLOCK) {
+        if (size > SIZE_MAX - sizeof(struct PoolBlock)) return NULL;
+        block = malloc(sizeof(struct PoolBlock) + size);
+        if (!block) return NULL;
+        *block = (struct PoolBlock) { LARGE_BLOCK, size };
+        return block + 1;
+    }
+    size_t sizeClass = (size - 1) / CLASS_WIDTH;
+    struct ThreadCache* threadCache = cacheFor(pool);
+    struct FreeBlock* reused = threadCache->free[sizeClass];
+    if (reused) {
+        threadCache->free[sizeClass] = reused->next;
+        return reused;
+    }
+    block = cutBlock(pool, threadCache, sizeClass);
+    if (!block) return NULL;
+    *block = (struct PoolBlock) { sizeClass, size };
+    return block + 1;
+}
+
+static void poolRelease(struct Allocator* self, void* memory, const char* site) {
+    (void) site;
+    struct PoolAllocator* pool = (struct PoolAllocator*) self;
+    struct PoolBlock* block = (struct PoolBlock*) memory - 1;
+    if (block->sizeClass == LARGE_BLOCK) {
+        free(block);
+        return;
+    }
+    struct ThreadCache* threadCache = cacheFor(pool);
+    struct FreeBlock* freed = memory;
+    freed->next = threadCache->free[block->sizeClass];
+    threadCache->free[block->sizeClass] = freed;
+}
+
+static void* poolResize(struct Allocator* self, void* memory, size_t size, const char* site) {
+    struct PoolBlock* block = (struct PoolBlock*) memory - 1;
+    size_t capacity = block->sizeClass == LARGE_BLOCK ? block->size : (block->sizeClass + 1) * CLASS_WIDTH;
+    if (block->sizeClass != LARGE_BLOCK && size <= capacity) return memory;
+    if (block->sizeClass == LARGE_BLOCK && size > POOL_LARGEST_BLOCK) {
+        if (size > SIZE_MAX - sizeof(struct PoolBlock)) return NULL;
+        struct PoolBlock* resized = realloc(block, sizeof(struct PoolBlock) + size);
+        if (!resized) return NULL;
+        resized->size = size;
+        return resized + 1;
+    }
+    void* moved = poolAllocate(self, size, site);
+    if (!moved) return NULL;
+    memcpy(moved, memory, size < capacity ? size : capacity);
+    poolRelease(self, memory, site);
+    return moved;
+}
+
+static size_t poolMeasure(struct Allocator* self, void* memory) {
+    (void) self;
+    const struct PoolBlock* block = (const struct PoolBlock*) memory - 1;
+    return block->sizeClass == LARGE_BLOCK ? block->size : (block->sizeClass + 1) * CLASS_WIDTH;
+}
+
+struct Allocator* createPoolAllocator(void) {
+    struct PoolAllocator* pool = calloc(1, sizeof(struct PoolAllocator));
+    if (!pool) return NULL;
+    pool->base = (struct Allocator) { "pool", poolAllocate, poolResize, poolRelease, poolMeasure };
+    pool->generation = atomic_fetch_add(&generations, 1);
+    pthread_mutex_init(&pool->lock, NULL);
+    return &pool->base;
+}
+
+void destroyPoolAllocator(struct Allocator* self) {
+    struct PoolAllocator* pool = (struct PoolAllocator*) self;
+    struct Slab* slab = pool->slabs;
+    while (slab) {
+        struct Slab* next = slab->next;
+        free(slab);
+        slab = next;
+    }
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
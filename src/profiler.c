@@ -0,0 +1,268 @@
+#include "../include/profiler.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+bool profilerRunning = false;
+_Thread_local struct ProfileStack profileStack;
+
+// distinct stacks kept and the frames they hold between them, samples of
+// stacks past either are dropped
+#define PROFILE_TABLE_SIZE  4096
+#define PROFILE_MAX_STACKS  (PROFILE_TABLE_SIZE / 4 * 3)
+#define PROFILE_FRAME_POOL  (PROFILE_TABLE_SIZE * 16)
+#define PROFILE_REPORT_ROWS 15
+
+struct SampledStack {
+    uint64_t    hash;
+    uint32_t    firstFrame;     // in framePool
+    uint32_t    depth;          // 0 while the slot is free
+    uint64_t    samples;
+};
+
+static struct SampledStack* sampledStacks = NULL;
+static struct ProfileFrame* framePool = NULL;
+static size_t stackCount = 0;
+static size_t framesUsed = 0;
+static uint64_t samplesTaken = 0;
+static atomic_uint_fast64_t samplesDropped;
+// held by the thread taking a sample, timer signals can reach two threads at once
+static atomic_flag sampling = ATOMIC_FLAG_INIT;
+static const char* foldedOutput = NULL;
+
+// SAMPLING
+
+static uint64_t hashFrames(const struct ProfileFrame* frames, size_t count) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < count; i++) {
+        h = (h ^ (uint64_t) (uintptr_t) frames[i].name) * 0x100000001b3ULL;
+        h = (h ^ ((uint64_t) frames[i].line << 32 | frames[i].column)) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static bool sameFrames(const struct ProfileFrame* a, const struct ProfileFrame* b, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (a[i].name != b[i].name || a[i].line != b[i].line || a[i].column != b[i].column) return false;
+    }
+    return true;
+}
+
+static bool recordStack(const struct ProfileFrame* frames, size_t count) {
+    uint64_t hash = hashFrames(frames, count);
+    for (size_t probe = 0; probe < PROFILE_TABLE_SIZE; probe++) {
+        struct SampledStack* stack = &sampledStacks[(hash + probe) & (PROFILE_TABLE_SIZE - 1)];
+        if (stack->depth == 0) {
+            if (stackCount == PROFILE_MAX_STACKS || framesUsed + count > PROFILE_FRAME_POOL) return false;
+            memcpy(framePool + framesUsed, frames, count * sizeof(*frames));
+            *stack = (struct SampledStack) { hash, (uint32_t) framesUsed, (uint32_t) count, 1 };
+            framesUsed += count;
+            stackCount++;
+            return true;
+        }
+        if (stack->hash == hash && stack->depth == count && sameFrames(framePool + stack->firstFrame, frames, count)) {
+            stack->samples++;
+            return true;
+        }
+    }
+    return false;
+}
+
+// SIGPROF handler, runs on whichever thread used the CPU time
+static void takeSample(int signal) {
+    (void) signal;
+    if (atomic_flag_test_and_set_explicit(&sampling, memory_order_acquire)) {
+        atomic_fetch_add(&samplesDropped, 1);
+        return;
+    }
+    size_t count = profileStack.depth + 1;
+    if (count > PROFILE_MAX_DEPTH) count = PROFILE_MAX_DEPTH;
+    struct ProfileFrame frames[PROFILE_MAX_DEPTH];
+    memcpy(frames, profileStack.frames, count * sizeof(*frames));
+    // a pool thread's first frame keeps the line of the last parallel loop
+    // chunk it ran, which means nothing under a task
+    if (count > 1 && !frames[0].name) {
+        frames[0].line = 0;
+        frames[0].column = 0;
+    }
+    if (recordStack(frames, count)) {
+        samplesTaken++;
+    } else {
+        atomic_fetch_add(&samplesDropped, 1);
+    }
+    atomic_flag_clear_explicit(&sampling, memory_order_release);
+}
+
+bool startProfiler(const char* foldedPath) {
+    sampledStacks = calloc(PROFILE_TABLE_SIZE, sizeof(*sampledStacks));
+    framePool = malloc(PROFILE_FRAME_POOL * sizeof(*framePool));
+    if (!sampledStacks || !framePool) {
+        free(sampledStacks);
+        free(framePool);
+        sampledStacks = NULL;
+        errno = ENOMEM;
+        return false;
+    }
+    foldedOutput = foldedPath;
+    profileStack.frames[0] = (struct ProfileFrame) { "main", 0, 0 };
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = takeSample;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, NULL) != 0) return false;
+
+    profilerRunning = true;
+    struct itimerval timer = { { 0, PROFILE_INTERVAL_US }, { 0, PROFILE_INTERVAL_US } };
+    if (setitimer(ITIMER_PROF, &timer, NULL) != 0) {
+        profilerRunning = false;
+        return false;
+    }
+    // a program ending in an error exits without returning to main
+    atexit(finishProfiler);
+    return true;
+}
+
+// REPORT
+
+struct ProfileRow {
+    const char* name;
+    uint32_t    line;
+    uint32_t    column;
+    uint64_t    self;
+    uint64_t    total;
+};
+
+struct ProfileRows {
+    struct ProfileRow*  rows;
+    size_t              count;
+    size_t              capacity;
+};
+
+static const char* frameName(const struct ProfileFrame* frame) {
+    // tasks and parallel loop chunks start on pool threads
+    return frame->name ? frame->name : "worker";
+}
+
+static struct ProfileRow* findRow(struct ProfileRows* rows, const char* name, uint32_t line, uint32_t column) {
+    for (size_t i = 0; i < rows->count; i++) {
+        struct ProfileRow* row = &rows->rows[i];
+        if (row->name == name && row->line == line && row->column == column) return row;
+    }
+    if (rows->count == rows->capacity) {
+        size_t capacity = rows->capacity ? rows->capacity * 2 : 64;
+        struct ProfileRow* grown = realloc(rows->rows, capacity * sizeof(*grown));
+        if (!grown) return NULL;
+        rows->rows = grown;
+        rows->capacity = capacity;
+    }
+    struct ProfileRow* row = &rows->rows[rows->count++];
+    *row = (struct ProfileRow) { name, line, column, 0, 0 };
+    return row;
+}
+
+static int compareSelf(const void* a, const void* b) {
+    const struct ProfileRow* left = a;
+    const struct ProfileRow* right = b;
+    if (left->self != right->self) return left->self < right->self ? 1 : -1;
+    return left->total < right->total ? 1 : left->total > right->total ? -1 : 0;
+}
+
+static double percent(uint64_t samples) {
+    return 100.0 * (double) samples / (double) samplesTaken;
+}
+
+static void printReport(void) {
+    fprintf(stderr, "Profile: %llu samples, one per %d us of CPU time, %llu dropped, stacks in %s\n",
+        (unsigned long long) samplesTaken, PROFILE_INTERVAL_US,
+        (unsigned long long) atomic_load(&samplesDropped), foldedOutput);
+    if (samplesTaken == 0) return;
+
+    struct ProfileRows lines = { 0 };
+    struct ProfileRows functions = { 0 };
+    for (size_t i = 0; i < PROFILE_TABLE_SIZE; i++) {
+        const struct SampledStack* stack = &sampledStacks[i];
+        if (stack->depth == 0) continue;
+        const struct ProfileFrame* frames = framePool + stack->firstFrame;
+        const struct ProfileFrame* leaf = &frames[stack->depth - 1];
+
+        struct ProfileRow* row = findRow(&lines, frameName(leaf), leaf->line, leaf->column);
+        if (row) row->self += stack->samples;
+        row = findRow(&functions, frameName(leaf), 0, 0);
+        if (row) row->self += stack->samples;
+        // a recursive fn counts once per sample
+        for (size_t f = 0; f < stack->depth; f++) {
+            bool seen = false;
+            for (size_t g = 0; g < f && !seen; g++) {
+                seen = frames[g].name == frames[f].name;
+            }
+            row = seen ? NULL : findRow(&functions, frameName(&frames[f]), 0, 0);
+            if (row) row->total += stack->samples;
+        }
+    }
+
+    qsort(lines.rows, lines.count, sizeof(*lines.rows), compareSelf);
+    fprintf(stderr, "\n  samples       %%  line:column  function\n");
+    for (size_t i = 0; i < lines.count && i < PROFILE_REPORT_ROWS; i++) {
+        const struct ProfileRow* row = &lines.rows[i];
+        char position[32];
+        snprintf(position, sizeof(position), "%u:%u", row->line, row->column);
+        fprintf(stderr, "%9llu  %5.1f%%  %-11s  %s\n", (unsigned long long) row->self, percent(row->self),
+            row->line ? position : "-", row->name);
+    }
+
+    qsort(functions.rows, functions.count, sizeof(*functions.rows), compareSelf);
+    fprintf(stderr, "\n     self       %%     total       %%  function\n");
+    for (size_t i = 0; i < functions.count && i < PROFILE_REPORT_ROWS; i++) {
+        const struct ProfileRow* row = &functions.rows[i];
+        fprintf(stderr, "%9llu  %5.1f%%  %8llu  %5.1f%%  %s\n", (unsigned long long) row->self, percent(row->self),
+            (unsigned long long) row->total, percent(row->total), row->name);
+    }
+    free(lines.rows);
+    free(functions.rows);
+}
+
+static void writeFoldedStacks(void) {
+    FILE* file = fopen(foldedOutput, "w");
+    if (!file) {
+        fprintf(stderr, "Cannot write %s: %s\n", foldedOutput, strerror(errno));
+        return;
+    }
+    for (size_t i = 0; i < PROFILE_TABLE_SIZE; i++) {
+        const struct SampledStack* stack = &sampledStacks[i];
+        if (stack->depth == 0) continue;
+        const struct ProfileFrame* frames = framePool + stack->firstFrame;
+        for (size_t f = 0; f < stack->depth; f++) {
+            if (f > 0) fputc(';', file);
+            fputs(frameName(&frames[f]), file);
+            if (frames[f].line) fprintf(file, ":%u", frames[f].line);
+        }
+        fprintf(file, " %llu\n", (unsigned long long) stack->samples);
+    }
+    if (fclose(file) != 0) {
+        fprintf(stderr, "Cannot write %s: %s\n", foldedOutput, strerror(errno));
+    }
+}
+
+void finishProfiler(void) {
+    if (!profilerRunning) return;
+    struct itimerval stopped;
+    memset(&stopped, 0, sizeof(stopped));
+    setitimer(ITIMER_PROF, &stopped, NULL);
+    signal(SIGPROF, SIG_IGN);
+    // waits out a sample another thread is still taking
+    while (atomic_flag_test_and_set_explicit(&sampling, memory_order_acquire)) {
+    }
+    profilerRunning = false;
+
+    printReport();
+    writeFoldedStacks();
+    free(sampledStacks);
+    free(framePool);
+    sampledStacks = NULL;
+    framePool = NULL;
+}
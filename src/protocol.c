@@ -0,0 +1,73 @@
+#include "../include/protocol.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static bool sendAll(int socket, const void* data, size_t length) {
+    const char* bytes = data;
+    while (length > 0) {
+        // MSG_NOSIGNAL, a client going away is not worth a SIGPIPE
+        ssize_t written = send(socket, bytes, length, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        bytes += written;
+        length -= (size_t) written;
+    }
+    return true;
+}
+
+static bool receiveAll(int socket, void* data, size_t length) {
+    char* bytes = data;
+    while (length > 0) {
+        ssize_t got = read(socket, bytes, length);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        bytes += got;
+        length -= (size_t) got;
+    }
+    return true;
+}
+
+bool sendFrame(int socket, enum FrameType type, const void* data, size_t length) {
+    if (length > FRAME_MAX_LENGTH) return false;
+    struct FrameHeader header = { (uint32_t) type, (uint32_t) length };
+    return sendAll(socket, &header, sizeof(header)) && sendAll(socket, data, length);
+}
+
+bool receiveFrame(int socket, struct FrameHeader* header, char** payload) {
+    *payload = NULL;
+    if (!receiveAll(socket, header, sizeof(*header)) || header->length > FRAME_MAX_LENGTH) {
+        return false;
+    }
+    char* data = malloc(header->length + 1);
+    if (!data) return false;
+    if (!receiveAll(socket, data, header->length)) {
+        free(data);
+        return false;
+    }
+    data[header->length] = '\0';
+    *payload = data;
+    return true;
+}
+
+int connectSocket(const char* path) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr*) &address, sizeof(address)) != 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
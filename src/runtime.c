@@ -0,0 +1,158 @@
+#include "../include/runtime.h"
+#include "../include/allocator.h"
+#include "../include/output.h"
+#include "../include/profiler.h"
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// used by the command line and anything running outside interpRun
+static struct Interpreter defaultInterpreter = {
+    .tasks = { .lock = PTHREAD_MUTEX_INITIALIZER },
+};
+
+static _Thread_local struct Interpreter* interpreterOnThread = NULL;
+static _Thread_local const struct OutputSink* sinkOnThread = NULL;
+static _Thread_local struct ErrorHandler* handlerOnThread = NULL;
+static _Thread_local struct CallScope* scopeOnThread = NULL;
+
+struct Interpreter* currentInterpreter(void) {
+    return interpreterOnThread ? interpreterOnThread : &defaultInterpreter;
+}
+
+struct Interpreter* enterInterpreter(struct Interpreter* interpreter) {
+    struct Interpreter* previous = interpreterOnThread;
+    interpreterOnThread = interpreter;
+    setThreadAllocator(interpreter ? interpreter->allocator : NULL);
+    return previous;
+}
+
+// a run waiting on a task can pick up another run on the same thread, so spare
+// instances sit on a free list rather than in a thread-local
+static pthread_mutex_t spareLock = PTHREAD_MUTEX_INITIALIZER;
+static struct Interpreter** spareInterpreters = NULL;
+static size_t spareCount = 0;
+static size_t spareCapacity = 0;
+
+struct Interpreter* takeSpareInterpreter(size_t memoryLimit) {
+    pthread_mutex_lock(&spareLock);
+    struct Interpreter* interpreter = spareCount > 0 ? spareInterpreters[--spareCount] : NULL;
+    pthread_mutex_unlock(&spareLock);
+
+    if (!interpreter) {
+        interpreter = allocZeroed(1, sizeof(struct Interpreter));
+        if (!interpreter) {
+            raiseError("Error calloc while creating interpreter.\n");
+        }
+        createEnvironment(&interpreter->globals);
+        initTaskRegistry(&interpreter->tasks);
+    }
+    if ((memoryLimit || interpreter->allocator) && !limitInterpreterMemory(interpreter, memoryLimit)) {
+        raiseError("Error calloc while limiting memory.\n");
+    }
+    return interpreter;
+}
+
+void returnSpareInterpreter(struct Interpreter* interpreter) {
+    clearEnvironment(&interpreter->globals);
+    pthread_mutex_lock(&spareLock);
+    if (spareCount == spareCapacity) {
+        spareCapacity = spareCapacity ? spareCapacity * 2 : 8;
+        spareInterpreters = resizeMemory(spareInterpreters, sizeof(struct Interpreter*) * spareCapacity);
+    }
+    spareInterpreters[spareCount++] = interpreter;
+    pthread_mutex_unlock(&spareLock);
+}
+
+void destroySpareInterpreters(void) {
+    for (size_t i = 0; i < spareCount; i++) {
+        freeEnvironment(&spareInterpreters[i]->globals);
+        destroyTaskRegistry(&spareInterpreters[i]->tasks);
+        if (spareInterpreters[i]->allocator) destroyLimitingAllocator(spareInterpreters[i]->allocator);
+        freeMemory(spareInterpreters[i]);
+    }
+    freeMemory(spareInterpreters);
+    spareInterpreters = NULL;
+    spareCount = spareCapacity = 0;
+}
+
+bool limitInterpreterMemory(struct Interpreter* interpreter, size_t limit) {
+    if (interpreter->allocator) {
+        resetLimitingAllocator(interpreter->allocator, limit);
+        return true;
+    }
+    interpreter->allocator = createLimitingAllocator(limit);
+    return interpreter->allocator != NULL;
+}
+
+const struct OutputSink* setOutputSink(const struct OutputSink* sink) {
+    const struct OutputSink* previous = sinkOnThread;
+    sinkOnThread = sink;
+    return previous;
+}
+
+void writeOutput(const char* text, size_t length) {
+    const struct OutputSink* sink = sinkOnThread;
+    if (sink && sink->write) {
+        sink->write(sink->data, text, length);
+    } else if (!bufferOutput(text, length)) {
+        fwrite(text, 1, length, stdout);
+    }
+}
+
+void printOutput(const char* format, ...) {
+    char buffer[ERROR_MESSAGE_SIZE];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length < 0) return;
+    if ((size_t) length >= sizeof(buffer)) length = sizeof(buffer) - 1;
+    writeOutput(buffer, (size_t) length);
+}
+
+void enterCallScope(struct CallScope* scope) {
+    scope->caller = scopeOnThread;
+    scopeOnThread = scope;
+}
+
+void leaveCallScope(struct CallScope* scope) {
+    scopeOnThread = scope->caller;
+}
+
+void pushErrorHandler(struct ErrorHandler* handler) {
+    handler->previous = handlerOnThread;
+    handler->profileDepth = profileStack.depth;
+    handler->scope = scopeOnThread;
+    handlerOnThread = handler;
+}
+
+void popErrorHandler(struct ErrorHandler* handler) {
+    handlerOnThread = handler->previous;
+}
+
+void raiseError(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    struct ErrorHandler* handler = handlerOnThread;
+    if (!handler) {
+        // same output as before there were handlers, in order with printed values
+        flushOutput();
+        vprintf(format, args);
+        va_end(args);
+        exit(1);
+    }
+    vsnprintf(handler->message, sizeof(handler->message), format, args);
+    va_end(args);
+    handlerOnThread = handler->previous;
+    // the calls unwound never leave their frames or free their scopes
+    profileStack.depth = handler->profileDepth;
+    while (scopeOnThread != handler->scope) {
+        struct CallScope* scope = scopeOnThread;
+        scopeOnThread = scope->caller;
+        freeEnvironment(&scope->env);
+    }
+    longjmp(handler->jump, 1);
+}
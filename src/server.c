@@ -0,0 +1,259 @@
+#include "../include/server.h"
+#include "../include/parser.h"
+#include "../include/protocol.h"
+#include "../include/runtime.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define SERVER_CACHE_BUCKETS 256
+// least recently used programs beyond this are dropped
+#define SERVER_CACHE_LIMIT 512
+
+// a prepared program, shared by every request with the same source and path
+struct CachedProgram {
+    uint64_t                hash;
+    char*                   source;
+    size_t                  length;
+    char*                   path;       // its imports are resolved from, NULL for sent source
+    struct ASTNodeList      program;
+    size_t                  users;      // requests running it
+    uint64_t                lastUsed;
+    bool                    evicted;    // freed by its last user
+    struct CachedProgram*   next;
+};
+
+struct ProgramCache {
+    pthread_mutex_t         lock;
+    struct CachedProgram*   buckets[SERVER_CACHE_BUCKETS];
+    size_t                  count;
+    uint64_t                clock;
+};
+
+static struct ProgramCache programCache = { .lock = PTHREAD_MUTEX_INITIALIZER };
+static const struct RunOptions* serverOptions;
+
+// FNV-1a
+static uint64_t hashSource(const char* source, size_t length) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char) source[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static void freeCachedProgram(struct CachedProgram* cached) {
+    destroyAST(&cached->program);
+    free(cached->source);
+    free(cached->path);
+    free(cached);
+}
+
+static bool samePath(const char* a, const char* b) {
+    return a == b || (a && b && strcmp(a, b) == 0);
+}
+
+// called with the lock held
+static struct CachedProgram* findCachedProgram(uint64_t hash, const char* source, size_t length, const char* path) {
+    for (struct CachedProgram* c = programCache.buckets[hash % SERVER_CACHE_BUCKETS]; c; c = c->next) {
+        if (c->hash == hash && c->length == length && memcmp(c->source, source, length) == 0 && samePath(c->path, path)) {
+            c->users++;
+            c->lastUsed = programCache.clock++;
+            return c;
+        }
+    }
+    return NULL;
+}
+
+// called with the lock held, programs still running are freed by their last user
+static void evictLeastRecentlyUsed(void) {
+    struct CachedProgram** oldest = NULL;
+    for (size_t b = 0; b < SERVER_CACHE_BUCKETS; b++) {
+        for (struct CachedProgram** link = &programCache.buckets[b]; *link; link = &(*link)->next) {
+            if (!oldest || (*link)->lastUsed < (*oldest)->lastUsed) oldest = link;
+        }
+    }
+    struct CachedProgram* victim = *oldest;
+    *oldest = victim->next;
+    programCache.count--;
+    if (victim->users == 0) {
+        freeCachedProgram(victim);
+    } else {
+        victim->evicted = true;
+    }
+}
+
+// parses and prepares the source on a miss, NULL when the type checker rejects
+// it (the errors are already printed), syntax errors are raised
+static struct CachedProgram* acquireProgram(const char* source, size_t length, const char* path) {
+    uint64_t hash = hashSource(source, length);
+    pthread_mutex_lock(&programCache.lock);
+    struct CachedProgram* cached = findCachedProgram(hash, source, length, path);
+    pthread_mutex_unlock(&programCache.lock);
+    if (cached) return cached;
+
+    // outside the lock, a slow parse does not hold up other requests
+    struct ASTNodeList program = parseProgram(source, path);
+    if (!prepareProgram(&program, serverOptions)) {
+        destroyAST(&program);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&programCache.lock);
+    // another request may have parsed the same source meanwhile
+    cached = findCachedProgram(hash, source, length, path);
+    bool inserted = false;
+    if (!cached) {
+        cached = calloc(1, sizeof(struct CachedProgram));
+        char* copy = malloc(length + 1);
+        char* pathCopy = path ? strdup(path) : NULL;
+        if (!cached || !copy || (path && !pathCopy)) {
+            pthread_mutex_unlock(&programCache.lock);
+            raiseError("Error malloc while caching program.\n");
+        }
+        memcpy(copy, source, length + 1);
+        cached->hash = hash;
+        cached->source = copy;
+        cached->length = length;
+        cached->path = pathCopy;
+        cached->program = program;
+        cached->users = 1;
+        cached->lastUsed = programCache.clock++;
+        size_t bucket = hash % SERVER_CACHE_BUCKETS;
+        cached->next = programCache.buckets[bucket];
+        programCache.buckets[bucket] = cached;
+        if (++programCache.count > SERVER_CACHE_LIMIT) evictLeastRecentlyUsed();
+        inserted = true;
+    }
+    pthread_mutex_unlock(&programCache.lock);
+    if (!inserted) destroyAST(&program);
+    return cached;
+}
+
+static void releaseProgram(struct CachedProgram* cached) {
+    pthread_mutex_lock(&programCache.lock);
+    bool unused = --cached->users == 0 && cached->evicted;
+    pthread_mutex_unlock(&programCache.lock);
+    if (unused) freeCachedProgram(cached);
+}
+
+static void writeResponseOutput(void* data, const char* text, size_t length) {
+    fwrite(text, 1, length, data);
+}
+
+// runs one request, its output is written to output, returns the exit status
+static int serveRequest(const struct FrameHeader* request, const char* payload, FILE* output) {
+    struct Interpreter* interp = takeSpareInterpreter(serverOptions->memoryLimit);
+    struct Interpreter* previousInterpreter = enterInterpreter(interp);
+    struct OutputSink sink = { writeResponseOutput, output };
+    const struct OutputSink* previousSink = setOutputSink(&sink);
+
+    volatile int status = EXIT_FAILURE;
+    char* source = request->type == FRAME_PATH ? readSourceFile(payload) : (char*) payload;
+    if (!source) {
+        printOutput("Cannot read %s: %s\n", payload, strerror(errno));
+    } else {
+        struct CachedProgram* volatile cached = NULL;
+        struct ErrorHandler handler;
+        if (setjmp(handler.jump) == 0) {
+            pushErrorHandler(&handler);
+            cached = acquireProgram(source, strlen(source), request->type == FRAME_PATH ? payload : NULL);
+            if (cached) {
+                executeProgram(&cached->program, serverOptions, &interp->globals);
+                status = EXIT_SUCCESS;
+            }
+            popErrorHandler(&handler);
+        } else {
+            discardRemainingTasks();
+            printOutput("%s", handler.message);
+        }
+        if (cached) releaseProgram(cached);
+        if (source != payload) free(source);
+    }
+
+    setOutputSink(previousSink);
+    enterInterpreter(previousInterpreter);
+    returnSpareInterpreter(interp);
+    return status;
+}
+
+static void* serveConnection(void* argument) {
+    int fd = (int) (intptr_t) argument;
+    struct FrameHeader request;
+    char* payload;
+    while (receiveFrame(fd, &request, &payload)) {
+        if (request.type != FRAME_PATH && request.type != FRAME_SOURCE) {
+            free(payload);
+            break;
+        }
+        char* outputText = NULL;
+        size_t outputSize = 0;
+        FILE* output = open_memstream(&outputText, &outputSize);
+        if (!output) {
+            free(payload);
+            break;
+        }
+        int32_t status = serveRequest(&request, payload, output);
+        fclose(output);
+        free(payload);
+
+        bool sent = sendFrame(fd, FRAME_OUTPUT, outputText, outputSize) &&
+            sendFrame(fd, FRAME_EXIT, &status, sizeof(status));
+        free(outputText);
+        if (!sent) break;
+    }
+    close(fd);
+    return NULL;
+}
+
+int runServer(const char* socketPath, const struct RunOptions* options) {
+    serverOptions = options;
+
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "serve: socket path too long: %s\n", socketPath);
+        return EXIT_FAILURE;
+    }
+    strcpy(address.sun_path, socketPath);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        perror("serve: socket");
+        return EXIT_FAILURE;
+    }
+    // a socket file left by a server that was killed
+    unlink(socketPath);
+    if (bind(listener, (struct sockaddr*) &address, sizeof(address)) != 0 || listen(listener, 64) != 0) {
+        fprintf(stderr, "serve: cannot listen on %s: %s\n", socketPath, strerror(errno));
+        close(listener);
+        return EXIT_FAILURE;
+    }
+    fprintf(stderr, "serve: listening on %s\n", socketPath);
+
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+    while (true) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            perror("serve: accept");
+            break;
+        }
+        pthread_t thread;
+        if (pthread_create(&thread, &attributes, serveConnection, (void*) (intptr_t) fd) != 0) {
+            close(fd);
+        }
+    }
+    pthread_attr_destroy(&attributes);
+    close(listener);
+    unlink(socketPath);
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,756 @@
+#include "../include/snapshot.h"
+#include "../include/allocator.h"
+#include "../include/builtins.h"
+#include "../include/map.h"
+#include "../include/modules.h"
+#include "../include/numbers.h"
+#include "../include/output.h"
+#include "../include/runtime.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SNAPSHOT_MAGIC "SNAPSHOT"
+#define SNAPSHOT_NONE SIZE_MAX
+
+// images are only read by the build that wrote them, the layout of nodes
+// and values is not kept stable between builds
+static const char snapshotBuild[] = __DATE__ " " __TIME__;
+
+struct SnapshotDependency {
+    char*       path;           // a module, resolved
+    uint64_t    hash;
+    uint64_t    length;
+};
+
+struct SnapshotGlobal {
+    char*           name;
+    struct Value    value;      // anything but a fn or a task
+};
+
+// a pointer to a builtin, found again by name in every run
+struct SnapshotBuiltin {
+    uint64_t    slot;           // offset of the pointer
+    uint64_t    name;           // offset of the name
+};
+
+// at the start of the image, the pointers in it are moved like the others
+struct SnapshotHeader {
+    char                        magic[8];
+    char                        build[32];
+    uint64_t                    size;
+    uint64_t                    checksum;       // of everything after it, as written
+    uint64_t                    base;           // the address the pointers are for
+    struct SnapshotKey          key;
+    struct SnapshotDependency*  dependencies;
+    size_t                      dependencyCount;
+    struct SnapshotGlobal*      globals;
+    size_t                      globalCount;
+    struct ASTNodeList*         program;
+    char*                       output;
+    size_t                      outputLength;
+    // offsets rather than pointers, they are needed to move the others
+    uint64_t                    relocations;    // uint64_t offsets of every pointer
+    size_t                      relocationCount;
+    uint64_t                    builtins;
+    size_t                      builtinCount;
+};
+
+struct Snapshot {
+    char*       image;
+    size_t      size;
+};
+
+static uint64_t hashBytes(const char* bytes, size_t length) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char) bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// a word at a time, reading the whole image has to stay cheap next to running it
+static uint64_t checksumImage(const char* image, size_t size) {
+    size_t at = offsetof(struct SnapshotHeader, checksum) + sizeof(uint64_t);
+    uint64_t sum = 14695981039346656037ull;
+    for (; at + sizeof(uint64_t) <= size; at += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, image + at, sizeof(word));
+        sum = (sum ^ word) * 1099511628211ull;
+        sum ^= sum >> 29;
+    }
+    for (; at < size; at++) sum = (sum ^ (unsigned char) image[at]) * 1099511628211ull;
+    return sum;
+}
+
+void makeSnapshotKey(struct SnapshotKey* key, const char* source, const char* path, const struct RunOptions* options) {
+    // zeroed whole, keys are compared byte for byte
+    memset(key, 0, sizeof(struct SnapshotKey));
+    key->sourceLength = strlen(source);
+    key->sourceHash = hashBytes(source, key->sourceLength);
+    key->passes = (uint64_t) options->typeCheck | (uint64_t) options->inlineEnabled << 1 |
+        (uint64_t) options->deadCode << 2 | (uint64_t) options->optimiser << 3;
+    key->inlineBudget = options->inlineEnabled ? options->inlineOptions.budget : 0;
+    key->outputFormat = (uint64_t) getOutputFormat();
+    if (!realpath(path, key->path)) key->path[0] = '\0';
+}
+
+// WRITING
+
+struct ImageWriter {
+    char*                   data;
+    size_t                  size;
+    size_t                  capacity;
+    uint64_t*               relocations;
+    size_t                  relocationCount;
+    size_t                  relocationCapacity;
+    struct SnapshotBuiltin* builtins;
+    size_t                  builtinCount;
+    size_t                  builtinCapacity;
+};
+
+// zeroed space for size bytes, its offset
+static size_t reserve(struct ImageWriter* writer, size_t size, size_t alignment) {
+    size_t at = (writer->size + alignment - 1) & ~(alignment - 1);
+    if (at + size > writer->capacity) {
+        size_t capacity = writer->capacity ? writer->capacity : 64 * 1024;
+        while (capacity < at + size) capacity *= 2;
+        char* data = realloc(writer->data, capacity);
+        if (!data) raiseError("Error realloc while writing a snapshot.\n");
+        memset(data + writer->capacity, 0, capacity - writer->capacity);
+        writer->data = data;
+        writer->capacity = capacity;
+    }
+    writer->size = at + size;
+    return at;
+}
+
+static void* growImageTable(void* table, size_t* capacity, size_t count, size_t size) {
+    if (count < *capacity) return table;
+    *capacity = *capacity ? *capacity * 2 : 256;
+    table = realloc(table, *capacity * size);
+    if (!table) raiseError("Error realloc while writing a snapshot.\n");
+    return table;
+}
+
+// the pointer at offset slot points at the block at target, or is NULL
+static void storePointer(struct ImageWriter* writer, size_t slot, size_t target) {
+    uint64_t address = 0;
+    if (target != SNAPSHOT_NONE) {
+        address = SNAPSHOT_BASE + target;
+        writer->relocations = growImageTable(writer->relocations, &writer->relocationCapacity, writer->relocationCount,
+            sizeof(uint64_t));
+        writer->relocations[writer->relocationCount++] = slot;
+    }
+    memcpy(writer->data + slot, &address, sizeof(address));
+}
+
+static void storeBuiltin(struct ImageWriter* writer, size_t slot, size_t name) {
+    writer->builtins = growImageTable(writer->builtins, &writer->builtinCapacity, writer->builtinCount,
+        sizeof(struct SnapshotBuiltin));
+    writer->builtins[writer->builtinCount++] = (struct SnapshotBuiltin) { slot, name };
+    memset(writer->data + slot, 0, sizeof(void*));
+}
+
+static size_t writeBytes(struct ImageWriter* writer, const void* bytes, size_t length, size_t alignment) {
+    size_t at = reserve(writer, length, alignment);
+    if (length > 0) memcpy(writer->data + at, bytes, length);
+    return at;
+}
+
+static size_t writeText(struct ImageWriter* writer, const char* text) {
+    if (!text) return SNAPSHOT_NONE;
+    return writeBytes(writer, text, strlen(text) + 1, 1);
+}
+
+static size_t writeNode(struct ImageWriter* writer, const struct ASTNode* n);
+
+static size_t writeNodes(struct ImageWriter* writer, struct ASTNode* const* nodes, size_t count) {
+    if (count == 0) return SNAPSHOT_NONE;
+    size_t at = reserve(writer, sizeof(struct ASTNode*) * count, sizeof(void*));
+    for (size_t i = 0; i < count; i++) {
+        storePointer(writer, at + sizeof(struct ASTNode*) * i, writeNode(writer, nodes[i]));
+    }
+    return at;
+}
+
+static size_t writeList(struct ImageWriter* writer, const struct ASTNodeList* list) {
+    if (!list) return SNAPSHOT_NONE;
+    struct ASTNodeList copy = { NULL, list->count, list->count };
+    size_t at = writeBytes(writer, &copy, sizeof(copy), sizeof(void*));
+    storePointer(writer, at + offsetof(struct ASTNodeList, nodes), writeNodes(writer, list->nodes, list->count));
+    return at;
+}
+
+static size_t writeNames(struct ImageWriter* writer, char* const* names, size_t count) {
+    if (count == 0) return SNAPSHOT_NONE;
+    size_t at = reserve(writer, sizeof(char*) * count, sizeof(void*));
+    for (size_t i = 0; i < count; i++) {
+        storePointer(writer, at + sizeof(char*) * i, writeText(writer, names[i]));
+    }
+    return at;
+}
+
+static size_t writeParameters(struct ImageWriter* writer, const struct Parameter* parameters, size_t count) {
+    if (count == 0) return SNAPSHOT_NONE;
+    size_t at = writeBytes(writer, parameters, sizeof(struct Parameter) * count, sizeof(void*));
+    for (size_t i = 0; i < count; i++) {
+        storePointer(writer, at + sizeof(struct Parameter) * i + offsetof(struct Parameter, name),
+            writeText(writer, parameters[i].name));
+    }
+    return at;
+}
+
+static size_t writeReductions(struct ImageWriter* writer, const struct Reduction* reductions, size_t count) {
+    if (count == 0) return SNAPSHOT_NONE;
+    size_t at = writeBytes(writer, reductions, sizeof(struct Reduction) * count, sizeof(void*));
+    for (size_t i = 0; i < count; i++) {
+        storePointer(writer, at + sizeof(struct Reduction) * i + offsetof(struct Reduction, name),
+            writeText(writer, reductions[i].name));
+    }
+    return at;
+}
+
+// offset of a field of the node at `at`
+#define NODE_FIELD(at, field) ((at) + offsetof(struct ASTNode, data.field))
+
+// every pointer the node holds is stored again, a copied one would point into this process
+static size_t writeNode(struct ImageWriter* writer, const struct ASTNode* n) {
+    if (!n) return SNAPSHOT_NONE;
+    struct ASTNode copy = *n;
+    memset(&copy.feedback, 0, sizeof(copy.feedback));
+    size_t at = writeBytes(writer, &copy, sizeof(copy), sizeof(void*));
+    storePointer(writer, at + offsetof(struct ASTNode, sourceName), writeText(writer, n->sourceName));
+
+    switch (n->nodeType) {
+        case NODE_NUMBER_LITERAL:
+        case NODE_BOOL_LITERAL:
+            break;
+
+        case NODE_TEXT_LITERAL:
+        case NODE_VARIABLE_REFERENCE:
+        case NODE_CACHED_VARIABLE_REFERENCE:
+            storePointer(writer, NODE_FIELD(at, textValue), writeText(writer, n->data.textValue));
+            break;
+
+        case NODE_BINARY_OPERATION:
+        case NODE_INDEX:
+        case NODE_LOGICAL_AND:
+        case NODE_LOGICAL_OR:
+        CASE_NUMBER_BINARY_NODES:
+            storePointer(writer, NODE_FIELD(at, binary.leftSide), writeNode(writer, n->data.binary.leftSide));
+            storePointer(writer, NODE_FIELD(at, binary.rightSide), writeNode(writer, n->data.binary.rightSide));
+            break;
+
+        case NODE_LOGICAL_NOT:
+        case NODE_AWAIT:
+            storePointer(writer, NODE_FIELD(at, unary.operand), writeNode(writer, n->data.unary.operand));
+            break;
+
+        case NODE_VARIABLE_DECLARATION:
+            storePointer(writer, NODE_FIELD(at, varDeclaration.name), writeText(writer, n->data.varDeclaration.name));
+            storePointer(writer, NODE_FIELD(at, varDeclaration.node), writeNode(writer, n->data.varDeclaration.node));
+            break;
+
+        case NODE_VARIABLE_ASSIGN:
+        case NODE_TEMPORARY_SET:
+            storePointer(writer, NODE_FIELD(at, varAssignment.name), writeText(writer, n->data.varAssignment.name));
+            storePointer(writer, NODE_FIELD(at, varAssignment.node), writeNode(writer, n->data.varAssignment.node));
+            break;
+
+        case NODE_FUNCTION_DECLARATION:
+            {
+                const struct ASTFunctionDeclaration* decl = &n->data.funcDeclaration;
+                storePointer(writer, NODE_FIELD(at, funcDeclaration.name), writeText(writer, decl->name));
+                storePointer(writer, NODE_FIELD(at, funcDeclaration.parameters),
+                    writeParameters(writer, decl->parameters, decl->parameterCount));
+                storePointer(writer, NODE_FIELD(at, funcDeclaration.codeBlock), writeList(writer, decl->codeBlock));
+                break;
+            }
+
+        case NODE_FUNCTION_CALL:
+        case NODE_CACHED_FUNCTION_CALL:
+        case NODE_SPAWN:
+            storePointer(writer, NODE_FIELD(at, funcCall.name), writeText(writer, n->data.funcCall.name));
+            storePointer(writer, NODE_FIELD(at, funcCall.arguments),
+                writeNodes(writer, n->data.funcCall.arguments, n->data.funcCall.argumentCount));
+            break;
+
+        case NODE_BUILTIN_CALL:
+            storeBuiltin(writer, NODE_FIELD(at, builtinCall.builtin), writeText(writer, n->data.builtinCall.builtin->name));
+            storePointer(writer, NODE_FIELD(at, builtinCall.arguments),
+                writeNodes(writer, n->data.builtinCall.arguments, n->data.builtinCall.argumentCount));
+            break;
+
+        case NODE_NUMBERS:
+            storePointer(writer, NODE_FIELD(at, numbers.elements),
+                writeNodes(writer, n->data.numbers.elements, n->data.numbers.elementCount));
+            break;
+
+        case NODE_MAP:
+            storePointer(writer, NODE_FIELD(at, map.keys), writeNodes(writer, n->data.map.keys, n->data.map.entryCount));
+            storePointer(writer, NODE_FIELD(at, map.values), writeNodes(writer, n->data.map.values, n->data.map.entryCount));
+            break;
+
+        case NODE_INDEX_ASSIGN:
+            storePointer(writer, NODE_FIELD(at, indexAssignment.name), writeText(writer, n->data.indexAssignment.name));
+            storePointer(writer, NODE_FIELD(at, indexAssignment.key), writeNode(writer, n->data.indexAssignment.key));
+            storePointer(writer, NODE_FIELD(at, indexAssignment.value), writeNode(writer, n->data.indexAssignment.value));
+            break;
+
+        case NODE_IMPORT:
+            // binds a module of this process, imports are only run before the point
+            raiseError("An import cannot be saved in a snapshot, line %zu\n", n->line);
+
+        case NODE_IF_STATEMENT:
+            storePointer(writer, NODE_FIELD(at, ifStatement.condition), writeNode(writer, n->data.ifStatement.condition));
+            storePointer(writer, NODE_FIELD(at, ifStatement.conditionTrueBlock),
+                writeList(writer, n->data.ifStatement.conditionTrueBlock));
+            break;
+
+        case NODE_LOOP_STATEMENT:
+            storePointer(writer, NODE_FIELD(at, loopStatement.loopCount), writeNode(writer, n->data.loopStatement.loopCount));
+            storePointer(writer, NODE_FIELD(at, loopStatement.loopCodeBlock),
+                writeList(writer, n->data.loopStatement.loopCodeBlock));
+            break;
+
+        case NODE_PARALLEL_LOOP:
+            {
+                const struct ASTParallelLoop* loop = &n->data.parallelLoop;
+                storePointer(writer, NODE_FIELD(at, parallelLoop.loopCount), writeNode(writer, loop->loopCount));
+                storePointer(writer, NODE_FIELD(at, parallelLoop.loopCodeBlock), writeList(writer, loop->loopCodeBlock));
+                storePointer(writer, NODE_FIELD(at, parallelLoop.indexName), writeText(writer, loop->indexName));
+                storePointer(writer, NODE_FIELD(at, parallelLoop.reductions),
+                    writeReductions(writer, loop->reductions, loop->reductionCount));
+                storePointer(writer, NODE_FIELD(at, parallelLoop.sharedNames),
+                    writeNames(writer, loop->sharedNames, loop->sharedCount));
+                storePointer(writer, NODE_FIELD(at, parallelLoop.locals), writeNames(writer, loop->locals, loop->localCount));
+                break;
+            }
+
+        case NODE_INLINED_BLOCK:
+            {
+                const struct ASTInlinedBlock* block = &n->data.inlinedBlock;
+                storePointer(writer, NODE_FIELD(at, inlinedBlock.functionName), writeText(writer, block->functionName));
+                storePointer(writer, NODE_FIELD(at, inlinedBlock.parameters),
+                    writeParameters(writer, block->parameters, block->argumentCount));
+                storePointer(writer, NODE_FIELD(at, inlinedBlock.arguments),
+                    writeNodes(writer, block->arguments, block->argumentCount));
+                storePointer(writer, NODE_FIELD(at, inlinedBlock.codeBlock), writeList(writer, block->codeBlock));
+                storePointer(writer, NODE_FIELD(at, inlinedBlock.locals), writeNames(writer, block->locals, block->localCount));
+                break;
+            }
+    }
+    return at;
+}
+
+static void writeValueAt(struct ImageWriter* writer, size_t at, struct Value val);
+
+static size_t writeImageNumbers(struct ImageWriter* writer, const struct NumberArray* array) {
+    // zeroed, the count is set again when the array is copied out
+    size_t at = reserve(writer, sizeof(struct NumberArray), sizeof(void*));
+    memcpy(writer->data + at + offsetof(struct NumberArray, length), &array->length, sizeof(array->length));
+    storePointer(writer, at + offsetof(struct NumberArray, data),
+        writeBytes(writer, array->data, sizeof(double) * array->length, sizeof(double)));
+    return at;
+}
+
+// only the count and the entries, the map is built again from them
+static size_t writeImageMap(struct ImageWriter* writer, const struct Map* map) {
+    size_t at = reserve(writer, sizeof(struct Map), sizeof(void*));
+    memcpy(writer->data + at + offsetof(struct Map, count), &map->count, sizeof(map->count));
+    if (map->count == 0) return at;
+    size_t entries = reserve(writer, sizeof(struct MapEntry) * map->count, sizeof(void*));
+    for (size_t i = 0; i < map->count; i++) {
+        size_t entry = entries + sizeof(struct MapEntry) * i;
+        writeValueAt(writer, entry + offsetof(struct MapEntry, key), map->entries[i].key);
+        writeValueAt(writer, entry + offsetof(struct MapEntry, value), map->entries[i].value);
+    }
+    storePointer(writer, at + offsetof(struct Map, entries), entries);
+    return at;
+}
+
+static void writeValueAt(struct ImageWriter* writer, size_t at, struct Value val) {
+    val.originNode = NULL;
+    memcpy(writer->data + at, &val, sizeof(val));
+    size_t data = at + offsetof(struct Value, data);
+    if (val.type == VALUE_TEXT) {
+        storePointer(writer, data, writeText(writer, val.data.text));
+    } else if (val.type == VALUE_NUMBERS) {
+        storePointer(writer, data, writeImageNumbers(writer, val.data.numbers));
+    } else if (val.type == VALUE_MAP) {
+        storePointer(writer, data, writeImageMap(writer, val.data.map));
+    }
+}
+
+// the declarations of fn globals go to program, the other globals are written
+static size_t writeGlobals(struct ImageWriter* writer, const struct Environment* env, struct ASTNodeList* program,
+    size_t* count) {
+    *count = 0;
+    for (size_t i = 0; i < env->bucket_count; i++) {
+        for (const struct Entry* entry = env->bucket[i]; entry; entry = entry->next) {
+            if (entry->value.type != VALUE_FUNCTION) (*count)++;
+        }
+    }
+    size_t globals = reserve(writer, sizeof(struct SnapshotGlobal) * *count, sizeof(void*));
+    size_t written = 0;
+    for (size_t i = 0; i < env->bucket_count; i++) {
+        for (const struct Entry* entry = env->bucket[i]; entry; entry = entry->next) {
+            const struct ASTNode* origin = entry->value.originNode;
+            if (entry->value.type == VALUE_TASK) {
+                raiseError("%s holds a task\n", entry->key);
+            } else if (entry->value.type == VALUE_FUNCTION) {
+                // bound again by running the declaration
+                if (!origin || origin->nodeType != NODE_FUNCTION_DECLARATION ||
+                        strcmp(origin->data.funcDeclaration.name, entry->key) != 0) {
+                    raiseError("%s holds a fn declared under another name\n", entry->key);
+                }
+                appendAST(program, (struct ASTNode*) origin);
+                continue;
+            }
+            size_t global = globals + sizeof(struct SnapshotGlobal) * written++;
+            storePointer(writer, global + offsetof(struct SnapshotGlobal, name), writeText(writer, entry->key));
+            writeValueAt(writer, global + offsetof(struct SnapshotGlobal, value), entry->value);
+        }
+    }
+    return globals;
+}
+
+static size_t writeDependencies(struct ImageWriter* writer, size_t* count) {
+    *count = 0;
+    for (const struct Module* module = loadedModules(); module; module = module->next) (*count)++;
+    size_t dependencies = reserve(writer, sizeof(struct SnapshotDependency) * *count, sizeof(void*));
+    size_t at = dependencies;
+    for (const struct Module* module = loadedModules(); module; module = module->next) {
+        char* source = readSourceFile(module->path);
+        if (!source) raiseError("Cannot read %s: %s\n", module->path, strerror(errno));
+        uint64_t length = strlen(source);
+        uint64_t hash = hashBytes(source, length);
+        free(source);
+        memcpy(writer->data + at + offsetof(struct SnapshotDependency, hash), &hash, sizeof(hash));
+        memcpy(writer->data + at + offsetof(struct SnapshotDependency, length), &length, sizeof(length));
+        storePointer(writer, at + offsetof(struct SnapshotDependency, path), writeText(writer, module->path));
+        at += sizeof(struct SnapshotDependency);
+    }
+    return dependencies;
+}
+
+static void freeWriter(struct ImageWriter* writer) {
+    free(writer->data);
+    free(writer->relocations);
+    free(writer->builtins);
+}
+
+// the image of the globals in env, with program left to run after them
+static void writeImage(struct ImageWriter* writer, const struct SnapshotKey* key, const struct Environment* env,
+    const struct ASTNodeList* rest, struct ASTNodeList* program, const char* output, size_t outputLength) {
+    size_t header = reserve(writer, sizeof(struct SnapshotHeader), sizeof(void*));
+    struct SnapshotHeader fields = { .key = *key, .base = SNAPSHOT_BASE };
+    memcpy(fields.magic, SNAPSHOT_MAGIC, sizeof(fields.magic));
+    snprintf(fields.build, sizeof(fields.build), "%s", snapshotBuild);
+
+    size_t globals = writeGlobals(writer, env, program, &fields.globalCount);
+    for (size_t i = 0; i < rest->count; i++) appendAST(program, rest->nodes[i]);
+    size_t dependencies = writeDependencies(writer, &fields.dependencyCount);
+    size_t list = writeList(writer, program);
+    size_t text = writeBytes(writer, output, outputLength, 1);
+    fields.outputLength = outputLength;
+    memcpy(writer->data + header, &fields, sizeof(fields));
+    storePointer(writer, header + offsetof(struct SnapshotHeader, globals), globals);
+    storePointer(writer, header + offsetof(struct SnapshotHeader, dependencies), dependencies);
+    storePointer(writer, header + offsetof(struct SnapshotHeader, program), list);
+    storePointer(writer, header + offsetof(struct SnapshotHeader, output), text);
+
+    // last, nothing is stored after them
+    uint64_t builtins = writeBytes(writer, writer->builtins, sizeof(struct SnapshotBuiltin) * writer->builtinCount,
+        sizeof(uint64_t));
+    uint64_t relocations = writeBytes(writer, writer->relocations, sizeof(uint64_t) * writer->relocationCount,
+        sizeof(uint64_t));
+    uint64_t size = writer->size;
+    memcpy(writer->data + header + offsetof(struct SnapshotHeader, builtins), &builtins, sizeof(builtins));
+    memcpy(writer->data + header + offsetof(struct SnapshotHeader, builtinCount), &writer->builtinCount, sizeof(size_t));
+    memcpy(writer->data + header + offsetof(struct SnapshotHeader, relocations), &relocations, sizeof(relocations));
+    memcpy(writer->data + header + offsetof(struct SnapshotHeader, relocationCount), &writer->relocationCount,
+        sizeof(size_t));
+    memcpy(writer->data + header + offsetof(struct SnapshotHeader, size), &size, sizeof(size));
+    uint64_t checksum = checksumImage(writer->data, writer->size);
+    memcpy(writer->data + header + offsetof(struct SnapshotHeader, checksum), &checksum, sizeof(checksum));
+}
+
+// through a file of its own renamed over file, so a reader never sees half an image
+static void saveImage(const struct ImageWriter* writer, const char* file) {
+    char temporary[PATH_MAX];
+    snprintf(temporary, sizeof(temporary), "%s.%d", file, (int) getpid());
+    FILE* out = fopen(temporary, "wb");
+    if (!out) raiseError("Cannot write %s: %s\n", temporary, strerror(errno));
+    bool written = fwrite(writer->data, 1, writer->size, out) == writer->size;
+    int error = errno;
+    if (fclose(out) != 0 && written) {
+        written = false;
+        error = errno;
+    }
+    if (written && rename(temporary, file) != 0) {
+        written = false;
+        error = errno;
+    }
+    if (!written) {
+        unlink(temporary);
+        raiseError("Cannot write %s: %s\n", file, strerror(error));
+    }
+}
+
+// RUNNING UP TO THE SNAPSHOT POINT
+
+// what the run up to the point printed, passed on to where it would have gone
+struct Capture {
+    struct OutputSink           sink;
+    const struct OutputSink*    next;
+    char*                       text;
+    size_t                      length;
+    size_t                      capacity;
+    bool                        failed;     // out of memory, no image is written
+};
+
+static void captureOutput(void* data, const char* text, size_t length) {
+    struct Capture* capture = data;
+    if (!capture->failed && capture->length + length > capture->capacity) {
+        size_t capacity = capture->capacity ? capture->capacity : 4096;
+        while (capacity < capture->length + length) capacity *= 2;
+        char* grown = realloc(capture->text, capacity);
+        if (grown) {
+            capture->text = grown;
+            capture->capacity = capacity;
+        } else {
+            capture->failed = true;
+        }
+    }
+    if (!capture->failed) {
+        memcpy(capture->text + capture->length, text, length);
+        capture->length += length;
+    }
+    const struct OutputSink* own = setOutputSink(capture->next);
+    writeOutput(text, length);
+    setOutputSink(own);
+}
+
+static bool isDeclaration(const struct ASTNode* n) {
+    return n->nodeType == NODE_VARIABLE_DECLARATION || n->nodeType == NODE_FUNCTION_DECLARATION ||
+        n->nodeType == NODE_IMPORT;
+}
+
+// just after the first top-level snapshot() call, or else after the leading declarations
+static size_t snapshotPoint(const struct ASTNodeList* program) {
+    for (size_t i = 0; i < program->count; i++) {
+        const struct ASTNode* n = program->nodes[i];
+        if (n->nodeType == NODE_BUILTIN_CALL && strcmp(n->data.builtinCall.builtin->name, "snapshot") == 0) {
+            return i + 1;
+        }
+    }
+    size_t point = 0;
+    while (point < program->count && isDeclaration(program->nodes[point])) point++;
+    return point;
+}
+
+// the declarations of the fns among the globals
+static void appendFunctions(const struct Environment* env, struct ASTNodeList* program) {
+    for (size_t i = 0; i < env->bucket_count; i++) {
+        for (const struct Entry* entry = env->bucket[i]; entry; entry = entry->next) {
+            const struct ASTNode* origin = entry->value.originNode;
+            if (entry->value.type == VALUE_FUNCTION && origin && origin->nodeType == NODE_FUNCTION_DECLARATION) {
+                appendAST(program, (struct ASTNode*) origin);
+            }
+        }
+    }
+}
+
+// checked before anything runs, a program that cannot be saved runs as without --snapshot
+static bool canSnapshot(const struct ASTNodeList* program, size_t point) {
+    for (size_t i = 0; i < program->count; i++) {
+        const struct ASTNode* n = program->nodes[i];
+        if (i < point && n->nodeType == NODE_VARIABLE_DECLARATION && n->data.varDeclaration.dataType == TASK_TYPE) {
+            fprintf(stderr, "Snapshot not written: %s holds a task\n", n->data.varDeclaration.name);
+            return false;
+        }
+        if (i >= point && n->nodeType == NODE_IMPORT) {
+            fprintf(stderr, "Snapshot not written: the import on line %zu comes after the snapshot point\n", n->line);
+            return false;
+        }
+    }
+    return true;
+}
+
+void executeAndSnapshot(const struct ASTNodeList* program, const struct RunOptions* options, struct Environment* env,
+    const char* file, const struct SnapshotKey* key) {
+    size_t point = snapshotPoint(program);
+    if (!canSnapshot(program, point)) {
+        executeProgram(program, options, env);
+        return;
+    }
+    struct ASTNodeList before = { program->nodes, point, point };
+    struct ASTNodeList rest = { program->nodes + point, program->count - point, program->count - point };
+
+    struct Capture capture = { .sink = { captureOutput, &capture } };
+    capture.next = setOutputSink(&capture.sink);
+    executeProgram(&before, options, env);
+    setOutputSink(capture.next);
+
+    // the declarations are run again, also when no image is written, so both runs bind the fns the same way
+    struct ASTNodeList after;
+    initAST(&after);
+    struct ImageWriter writer = { 0 };
+    struct ErrorHandler handler;
+    if (setjmp(handler.jump) == 0) {
+        pushErrorHandler(&handler);
+        if (capture.failed) raiseError("Error realloc while keeping the output for a snapshot.\n");
+        writeImage(&writer, key, env, &rest, &after, capture.text, capture.length);
+        saveImage(&writer, file);
+        popErrorHandler(&handler);
+    } else {
+        fprintf(stderr, "Snapshot not written: %s", handler.message);
+        after.count = 0;
+        appendFunctions(env, &after);
+        for (size_t i = 0; i < rest.count; i++) appendAST(&after, rest.nodes[i]);
+    }
+    freeWriter(&writer);
+    free(capture.text);
+
+    executeProgram(&after, options, env);
+    freeMemory(after.nodes);
+}
+
+// READING
+
+static char* mapImage(int fd, size_t size) {
+    void* image = MAP_FAILED;
+#ifdef MAP_FIXED_NOREPLACE
+    image = mmap((void*) SNAPSHOT_BASE, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED_NOREPLACE, fd, 0);
+#endif
+    // taken, or a kernel that takes the address as a hint gave another
+    if (image == MAP_FAILED) image = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    return image == MAP_FAILED ? NULL : image;
+}
+
+static bool fitsImage(uint64_t at, size_t count, size_t size, size_t imageSize) {
+    return at <= imageSize && count <= (imageSize - at) / size;
+}
+
+// Checks the header and makes the pointers good for where the image is mapped.
+// Only offsets are checked one by one, the pointers are trusted once the
+// checksum shows the image is as it was written.
+static bool loadImage(char* image, size_t size, const struct SnapshotKey* key) {
+    struct SnapshotHeader* header = (struct SnapshotHeader*) image;
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 ||
+            strncmp(header->build, snapshotBuild, sizeof(header->build)) != 0 || header->size != size ||
+            memcmp(&header->key, key, sizeof(struct SnapshotKey)) != 0 ||
+            !fitsImage(header->relocations, header->relocationCount, sizeof(uint64_t), size) ||
+            !fitsImage(header->builtins, header->builtinCount, sizeof(struct SnapshotBuiltin), size) ||
+            header->checksum != checksumImage(image, size)) {
+        return false;
+    }
+
+    // at the address it was written for only the builtins are stored
+    uintptr_t delta = (uintptr_t) image - header->base;
+    if (delta != 0) {
+        const uint64_t* relocations = (const uint64_t*) (image + header->relocations);
+        for (size_t i = 0; i < header->relocationCount; i++) {
+            if (relocations[i] > size - sizeof(uintptr_t)) return false;
+            uintptr_t pointer;
+            memcpy(&pointer, image + relocations[i], sizeof(pointer));
+            pointer += delta;
+            memcpy(image + relocations[i], &pointer, sizeof(pointer));
+        }
+    }
+    const struct SnapshotBuiltin* builtins = (const struct SnapshotBuiltin*) (image + header->builtins);
+    for (size_t i = 0; i < header->builtinCount; i++) {
+        uint64_t slot = builtins[i].slot;
+        uint64_t name = builtins[i].name;
+        if (slot > size - sizeof(void*) || name >= size || !memchr(image + name, '\0', size - name)) return false;
+        const struct Builtin* builtin = findBuiltin(image + name, strlen(image + name));
+        if (!builtin) return false;
+        memcpy(image + slot, &builtin, sizeof(builtin));
+    }
+    return true;
+}
+
+static bool dependenciesUnchanged(const struct SnapshotHeader* header) {
+    for (size_t i = 0; i < header->dependencyCount; i++) {
+        const struct SnapshotDependency* dependency = &header->dependencies[i];
+        char* source = readSourceFile(dependency->path);
+        if (!source) return false;
+        size_t length = strlen(source);
+        bool unchanged = length == dependency->length && hashBytes(source, length) == dependency->hash;
+        free(source);
+        if (!unchanged) return false;
+    }
+    return true;
+}
+
+struct Snapshot* openSnapshot(const char* file, const struct SnapshotKey* key) {
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    struct stat info;
+    char* image = NULL;
+    size_t size = 0;
+    if (fstat(fd, &info) == 0 && (size_t) info.st_size >= sizeof(struct SnapshotHeader)) {
+        size = (size_t) info.st_size;
+        image = mapImage(fd, size);
+    }
+    close(fd);
+    if (!image) return NULL;
+
+    struct Snapshot* snapshot = malloc(sizeof(struct Snapshot));
+    if (!snapshot || !loadImage(image, size, key) || !dependenciesUnchanged((const struct SnapshotHeader*) image)) {
+        free(snapshot);
+        munmap(image, size);
+        return NULL;
+    }
+    *snapshot = (struct Snapshot) { image, size };
+    return snapshot;
+}
+
+const struct ASTNodeList* snapshotProgram(const struct Snapshot* snapshot) {
+    return ((const struct SnapshotHeader*) snapshot->image)->program;
+}
+
+// a copy the environment can own of a value in the image
+static struct Value restoreValue(struct Value val) {
+    if (val.type == VALUE_TEXT) {
+        val.data.text = copyText(val.data.text);
+    } else if (val.type == VALUE_NUMBERS) {
+        const struct NumberArray* saved = val.data.numbers;
+        struct NumberArray* array = createNumberArray(saved->length);
+        if (saved->length > 0) memcpy(array->data, saved->data, sizeof(double) * saved->length);
+        val = createNumbersValue(array);
+    } else if (val.type == VALUE_MAP) {
+        const struct Map* saved = val.data.map;
+        struct Map* map = createMap();
+        for (size_t i = 0; i < saved->count; i++) {
+            // the map copies keys and texts itself
+            struct Value value = saved->entries[i].value;
+            if (value.type == VALUE_NUMBERS) value = restoreValue(value);
+            setMapEntry(map, saved->entries[i].key, value);
+        }
+        val = createMapValue(map);
+    }
+    return val;
+}
+
+void restoreSnapshot(const struct Snapshot* snapshot, struct Environment* env) {
+    const struct SnapshotHeader* header = (const struct SnapshotHeader*) snapshot->image;
+    if (header->outputLength > 0) writeOutput(header->output, header->outputLength);
+    for (size_t i = 0; i < header->globalCount; i++) {
+        setValue(env, header->globals[i].name, restoreValue(header->globals[i].value));
+    }
+}
+
+void closeSnapshot(struct Snapshot* snapshot) {
+    munmap(snapshot->image, snapshot->size);
+    free(snapshot);
+}
@@ -0,0 +1,191 @@
+#include "../include/stats.h"
+#include "../include/perfCounters.h"
+#include "../include/trace.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+bool statsEnabled = false;
+_Thread_local struct StatsCounters statsCounters;
+
+static pthread_mutex_t countersLock = PTHREAD_MUTEX_INITIALIZER;
+static struct StatsCounters* registeredCounters = NULL;
+static struct StatsCounters totals;
+static bool countersCollected = false;
+static bool statsWritten = false;
+static const char* statsPath = NULL;
+
+struct PhaseTime {
+    double      wallStart;
+    double      cpuStart;
+    double      wall;
+    double      cpu;
+    uint64_t    traceStart;
+    uint64_t    countersStart[PERF_COUNTER_COUNT];
+    uint64_t    counters[PERF_COUNTER_COUNT];
+};
+
+static struct PhaseTime phases[STATS_PHASE_COUNT];
+static const char* const phaseNames[STATS_PHASE_COUNT] = {
+    [STATS_READ] = "read",
+    [STATS_TOKENISE] = "tokenise",
+    [STATS_PARSE] = "parse",
+    [STATS_PASSES] = "passes",
+    [STATS_EVALUATE] = "evaluate",
+    [STATS_TEARDOWN] = "teardown",
+};
+
+static bool perfCountersRequested = false;
+static bool perfCountersOpen = false;
+static char perfCountersMissing[160];
+
+static size_t tokenCount = 0;
+static size_t nodeCount = 0;
+static size_t nodesByType[NODE_TYPE_COUNT];
+
+void registerStatsCounters(void) {
+    pthread_mutex_lock(&countersLock);
+    statsCounters.registered = true;
+    statsCounters.next = registeredCounters;
+    registeredCounters = &statsCounters;
+    pthread_mutex_unlock(&countersLock);
+}
+
+static void exitStats(void) {
+    writeStats();
+}
+
+void enableStats(const char* path) {
+    statsEnabled = true;
+    statsPath = path;
+    // a program ending in an error exits without returning to main
+    atexit(exitStats);
+}
+
+void enablePerfCounters(void) {
+    perfCountersRequested = true;
+    perfCountersOpen = openPerfCounters(perfCountersMissing, sizeof(perfCountersMissing));
+}
+
+static double clockSeconds(clockid_t clock) {
+    struct timespec t;
+    clock_gettime(clock, &t);
+    return (double) t.tv_sec + (double) t.tv_nsec / 1e9;
+}
+
+// phases are spans of --trace as well
+void beginPhase(enum StatsPhase phase) {
+    // scripts of --batch parse on pool threads, which never trace
+    if (traceEnabled) phases[phase].traceStart = traceClock();
+    if (!statsEnabled) return;
+    phases[phase].wallStart = clockSeconds(CLOCK_MONOTONIC);
+    phases[phase].cpuStart = clockSeconds(CLOCK_PROCESS_CPUTIME_ID);
+    if (perfCountersOpen) readPerfCounters(phases[phase].countersStart);
+}
+
+void endPhase(enum StatsPhase phase) {
+    traceSpan(TRACE_PHASE, phaseNames[phase], 0, 0, phases[phase].traceStart);
+    if (!statsEnabled) return;
+    if (perfCountersOpen) {
+        uint64_t now[PERF_COUNTER_COUNT];
+        readPerfCounters(now);
+        for (size_t i = 0; i < PERF_COUNTER_COUNT; i++) {
+            phases[phase].counters[i] += now[i] - phases[phase].countersStart[i];
+        }
+    }
+    phases[phase].wall += clockSeconds(CLOCK_MONOTONIC) - phases[phase].wallStart;
+    phases[phase].cpu += clockSeconds(CLOCK_PROCESS_CPUTIME_ID) - phases[phase].cpuStart;
+}
+
+void countTokens(size_t count) {
+    if (statsEnabled) tokenCount += count;
+}
+
+void countProgramNodes(const struct ASTNodeList* program) {
+    if (statsEnabled) nodeCount += countNodeTypes(program, nodesByType);
+}
+
+void collectStatsCounters(void) {
+    if (countersCollected) return;
+    countersCollected = true;
+    pthread_mutex_lock(&countersLock);
+    for (const struct StatsCounters* counters = registeredCounters; counters; counters = counters->next) {
+        totals.dispatches += counters->dispatches;
+        totals.environments += counters->environments;
+        totals.lookups += counters->lookups;
+        totals.lookupProbes += counters->lookupProbes;
+        totals.stores += counters->stores;
+        totals.storeProbes += counters->storeProbes;
+    }
+    // the pool's threads and their counters are about to go
+    registeredCounters = NULL;
+    pthread_mutex_unlock(&countersLock);
+}
+
+static double average(uint64_t total, uint64_t count) {
+    return count ? (double) total / (double) count : 0.0;
+}
+
+void writeStats(void) {
+    if (!statsEnabled || statsWritten) return;
+    statsWritten = true;
+    collectStatsCounters();
+
+    FILE* out = stderr;
+    if (statsPath) {
+        out = fopen(statsPath, "w");
+        if (!out) {
+            fprintf(stderr, "Cannot write %s: %s\n", statsPath, strerror(errno));
+            return;
+        }
+    }
+    struct rusage usage;
+    long peakKilobytes = getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+
+    fprintf(out, "{\n  \"phases\": {\n");
+    for (size_t i = 0; i < STATS_PHASE_COUNT; i++) {
+        fprintf(out, "    \"%s\": { \"wallSeconds\": %.9f, \"cpuSeconds\": %.9f", phaseNames[i],
+            phases[i].wall, phases[i].cpu);
+        for (size_t c = 0; c < PERF_COUNTER_COUNT && perfCountersOpen; c++) {
+            if (perfCounterOpen((enum PerfCounter) c)) {
+                fprintf(out, ", \"%s\": %llu", perfCounterNames[c], (unsigned long long) phases[i].counters[c]);
+            } else {
+                fprintf(out, ", \"%s\": null", perfCounterNames[c]);
+            }
+        }
+        fprintf(out, " }%s\n", i + 1 < STATS_PHASE_COUNT ? "," : "");
+    }
+    fprintf(out, "  },\n");
+    if (perfCountersRequested) {
+        if (perfCountersOpen) {
+            fprintf(out, "  \"perfCounters\": { \"available\": true },\n");
+        } else {
+            fprintf(out, "  \"perfCounters\": { \"available\": false, \"reason\": \"%s\" },\n", perfCountersMissing);
+        }
+    }
+    fprintf(out, "  \"tokens\": %zu,\n", tokenCount);
+    fprintf(out, "  \"nodes\": {\n    \"total\": %zu,\n    \"byType\": {", nodeCount);
+    bool first = true;
+    for (size_t i = 0; i < NODE_TYPE_COUNT; i++) {
+        if (nodesByType[i] == 0) continue;
+        fprintf(out, "%s\n      \"%s\": %zu", first ? "" : ",", nodeTypeName((enum ASTNodeType) i), nodesByType[i]);
+        first = false;
+    }
+    fprintf(out, "%s}\n  },\n", first ? "" : "\n    ");
+    fprintf(out, "  \"dispatches\": %llu,\n", (unsigned long long) totals.dispatches);
+    fprintf(out, "  \"environments\": %llu,\n", (unsigned long long) totals.environments);
+    fprintf(out, "  \"lookups\": { \"count\": %llu, \"averageProbes\": %.3f },\n",
+        (unsigned long long) totals.lookups, average(totals.lookupProbes, totals.lookups));
+    fprintf(out, "  \"stores\": { \"count\": %llu, \"averageProbes\": %.3f },\n",
+        (unsigned long long) totals.stores, average(totals.storeProbes, totals.stores));
+    fprintf(out, "  \"peakRssBytes\": %lld\n}\n", (long long) peakKilobytes * 1024);
+
+    closePerfCounters();
+    if (out != stderr && fclose(out) != 0) {
+        fprintf(stderr, "Cannot write %s: %s\n", statsPath, strerror(errno));
+    }
+}
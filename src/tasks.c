@@ -0,0 +1,235 @@
+#include "../include/tasks.h"
+#include "../include/allocator.h"
+#include "../include/runtime.h"
+#include "../include/threadPool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct SpawnedTask {
+    const void*             body;
+    TaskBodyFunction        runBody;
+    struct Environment      env;
+    struct Interpreter*     interpreter;
+    struct TaskGroup        group;      // the single pool task running the body
+    size_t                  sequence;   // spawn order
+
+    // what the body printed, opened on its first print
+    FILE*                   output;
+    char*                   outputText;
+    size_t                  outputSize;
+    char*                   error;      // message of the error that stopped it
+};
+
+struct TaskSlot {
+    struct SpawnedTask* task;       // NULL once awaited
+    uint32_t            generation;
+};
+
+// spawned and not finished yet, in every instance
+static atomic_size_t runningTasks = 0;
+
+bool tasksInFlight(void) {
+    return atomic_load(&runningTasks) > 0;
+}
+
+void initTaskRegistry(struct TaskRegistry* registry) {
+    memset(registry, 0, sizeof(struct TaskRegistry));
+    pthread_mutex_init(&registry->lock, NULL);
+}
+
+void destroyTaskRegistry(struct TaskRegistry* registry) {
+    freeMemory(registry->slots);
+    freeMemory(registry->freeSlots);
+    pthread_mutex_destroy(&registry->lock);
+}
+
+static void writeTaskOutput(void* data, const char* text, size_t length) {
+    struct SpawnedTask* task = data;
+    if (!task->output) {
+        task->output = open_memstream(&task->outputText, &task->outputSize);
+        if (!task->output) {
+            raiseError("Error open_memstream while keeping task output.\n");
+        }
+    }
+    fwrite(text, 1, length, task->output);
+}
+
+static void runSpawnedTask(void* argument) {
+    struct SpawnedTask* task = argument;
+
+    // await may run a task inside another one, even of another instance
+    struct Interpreter* previousInterpreter = enterInterpreter(task->interpreter);
+    struct OutputSink sink = { writeTaskOutput, task };
+    const struct OutputSink* previousSink = setOutputSink(&sink);
+
+    struct ErrorHandler handler;
+    if (setjmp(handler.jump) == 0) {
+        pushErrorHandler(&handler);
+        task->runBody(task->body, &task->env);
+        popErrorHandler(&handler);
+    } else {
+        // from malloc, the error may be the memory limit of the task's instance
+        task->error = strdup(handler.message);
+    }
+
+    setOutputSink(previousSink);
+    enterInterpreter(previousInterpreter);
+
+    if (task->output) {
+        fclose(task->output);
+    }
+    freeEnvironment(&task->env);
+    atomic_fetch_sub(&runningTasks, 1);
+}
+
+struct Value spawnTask(const void* body, TaskBodyFunction runBody, struct Environment* env) {
+    struct SpawnedTask* task = allocZeroed(1, sizeof(struct SpawnedTask));
+    if (!task) {
+        raiseError("Error calloc while spawning task.\n");
+    }
+    task->body = body;
+    task->runBody = runBody;
+    task->env = *env;
+    task->interpreter = currentInterpreter();
+
+    struct TaskRegistry* registry = &task->interpreter->tasks;
+    // the slots last as long as the instance, so they come from the process's
+    // allocator, whose limit cannot raise while the lock is held
+    struct Allocator* runAllocator = setThreadAllocator(NULL);
+    pthread_mutex_lock(&registry->lock);
+    size_t slot;
+    if (registry->freeSlotCount > 0) {
+        slot = registry->freeSlots[--registry->freeSlotCount];
+    } else {
+        registry->slots = resizeMemory(registry->slots, sizeof(struct TaskSlot) * (registry->slotCount + 1));
+        registry->freeSlots = resizeMemory(registry->freeSlots, sizeof(size_t) * (registry->slotCount + 1));
+        slot = registry->slotCount++;
+        registry->slots[slot].generation = 0;
+    }
+    registry->slots[slot].task = task;
+    task->sequence = registry->nextSequence++;
+    uint32_t generation = registry->slots[slot].generation;
+    pthread_mutex_unlock(&registry->lock);
+    setThreadAllocator(runAllocator);
+
+    // counted before it can start, so no node rewrites itself while it runs
+    atomic_fetch_add(&runningTasks, 1);
+    initTaskGroup(&task->group);
+    submitTask(&task->group, runSpawnedTask, task);
+
+    struct Value val;
+    val.type = VALUE_TASK;
+    val.originNode = NULL;
+    val.data.task.slot = (uint32_t) slot;
+    val.data.task.generation = generation;
+    return val;
+}
+
+// takes the task out of its slot, NULL when it was already awaited
+static struct SpawnedTask* claimTask(struct TaskRegistry* registry, struct TaskHandle handle) {
+    struct SpawnedTask* task = NULL;
+    pthread_mutex_lock(&registry->lock);
+    if (handle.slot < registry->slotCount && registry->slots[handle.slot].generation == handle.generation) {
+        task = registry->slots[handle.slot].task;
+        registry->slots[handle.slot].task = NULL;
+        registry->slots[handle.slot].generation++;
+        registry->freeSlots[registry->freeSlotCount++] = handle.slot;
+    }
+    pthread_mutex_unlock(&registry->lock);
+    return task;
+}
+
+// waits for the task and frees it, keeping its output and error when asked to
+static void joinTask(struct SpawnedTask* task, bool keepResult) {
+    waitTaskGroup(&task->group);
+    if (task->outputText) {
+        if (keepResult) writeOutput(task->outputText, task->outputSize);
+        free(task->outputText);
+    }
+    char* error = task->error;
+    freeMemory(task);
+
+    if (error) {
+        if (keepResult) {
+            char message[ERROR_MESSAGE_SIZE];
+            snprintf(message, sizeof(message), "%s", error);
+            free(error);
+            raiseError("%s", message);
+        }
+        free(error);
+    }
+}
+
+struct Value awaitTask(const struct ASTNode* node, struct Value handle) {
+    if (handle.type != VALUE_TASK) {
+        raiseError("Only tasks can be awaited, line %zu\n", node->line);
+    }
+    struct SpawnedTask* task = claimTask(&currentInterpreter()->tasks, handle.data.task);
+    if (!task) {
+        raiseError("Task was already awaited, line %zu\n", node->line);
+    }
+    joinTask(task, true);
+    return createNumberValue(0);
+}
+
+static int compareSequence(const void* a, const void* b) {
+    const struct SpawnedTask* left = *(struct SpawnedTask* const*) a;
+    const struct SpawnedTask* right = *(struct SpawnedTask* const*) b;
+    return left->sequence < right->sequence ? -1 : left->sequence > right->sequence;
+}
+
+static void joinRemainingTasks(bool keepResult) {
+    struct TaskRegistry* registry = &currentInterpreter()->tasks;
+    while (true) {
+        // tasks still running may spawn more, so collect until none are left
+        pthread_mutex_lock(&registry->lock);
+        // from malloc, discarding the tasks of a run stopped by its memory limit
+        // must not reach the limit again
+        struct SpawnedTask** remaining = malloc(sizeof(struct SpawnedTask*) * (registry->slotCount ? registry->slotCount : 1));
+        if (!remaining) {
+            pthread_mutex_unlock(&registry->lock);
+            raiseError("Error malloc while awaiting tasks.\n");
+        }
+        size_t remainingCount = 0;
+        for (size_t i = 0; i < registry->slotCount; i++) {
+            if (!registry->slots[i].task) continue;
+            remaining[remainingCount++] = registry->slots[i].task;
+            registry->slots[i].task = NULL;
+            registry->slots[i].generation++;
+            registry->freeSlots[registry->freeSlotCount++] = i;
+        }
+        pthread_mutex_unlock(&registry->lock);
+
+        if (remainingCount == 0) {
+            free(remaining);
+            break;
+        }
+        qsort(remaining, remainingCount, sizeof(struct SpawnedTask*), compareSequence);
+
+        // an error stops the program, the tasks after it are still waited for
+        struct ErrorHandler handler;
+        volatile size_t i = 0;
+        if (setjmp(handler.jump) != 0) {
+            for (i++; i < remainingCount; i++) {
+                joinTask(remaining[i], false);
+            }
+            free(remaining);
+            raiseError("%s", handler.message);
+        }
+        pushErrorHandler(&handler);
+        for (; i < remainingCount; i++) {
+            joinTask(remaining[i], keepResult);
+        }
+        popErrorHandler(&handler);
+        free(remaining);
+    }
+}
+
+void awaitRemainingTasks(void) {
+    joinRemainingTasks(true);
+}
+
+void discardRemainingTasks(void) {
+    joinRemainingTasks(false);
+}
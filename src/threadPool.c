@@ -0,0 +1,231 @@
+#include "../include/threadPool.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define INITIAL_QUEUE_CAPACITY 64
+
+struct Task {
+    TaskFunction        run;
+    void*               argument;
+    struct TaskGroup*   group;
+};
+
+// ring buffer, the owner works at the back and thieves take from the front
+struct TaskQueue {
+    pthread_mutex_t lock;
+    struct Task*    tasks;
+    size_t          front;
+    size_t          count;
+    size_t          capacity;
+};
+
+struct ThreadPool {
+    size_t              workerCount;
+    pthread_t*          workers;
+    struct TaskQueue*   queues;     // workerCount + 1, the last one for threads outside the pool
+
+    atomic_size_t       queued;     // tasks waiting in any queue
+    atomic_size_t       sleeping;   // workers waiting for tasks
+    pthread_mutex_t     sleepLock;
+    pthread_cond_t      wake;
+    bool                stopping;
+};
+
+// started by the first submit, which may come from several threads outside the pool
+static struct ThreadPool* _Atomic pool = NULL;
+static size_t threadCount = 0;
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+
+// queue of the current thread, workers set it when they start
+static _Thread_local size_t ownQueue = (size_t) -1;
+
+void setThreadCount(size_t threads) {
+    threadCount = threads;
+}
+
+size_t getThreadCount(void) {
+    if (threadCount == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threadCount = online > 0 ? (size_t) online : 1;
+    }
+    return threadCount;
+}
+
+static void pushBack(struct TaskQueue* queue, struct Task task) {
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count == queue->capacity) {
+        size_t capacity = queue->capacity * 2;
+        struct Task* tasks = malloc(sizeof(struct Task) * capacity);
+        if (!tasks) {
+            printf("Error malloc while queueing task.\n");
+            exit(1);
+        }
+        for (size_t i = 0; i < queue->count; i++) {
+            tasks[i] = queue->tasks[(queue->front + i) % queue->capacity];
+        }
+        free(queue->tasks);
+        queue->tasks = tasks;
+        queue->front = 0;
+        queue->capacity = capacity;
+    }
+    queue->tasks[(queue->front + queue->count) % queue->capacity] = task;
+    queue->count++;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static bool popBack(struct TaskQueue* queue, struct Task* task) {
+    pthread_mutex_lock(&queue->lock);
+    bool found = queue->count > 0;
+    if (found) {
+        queue->count--;
+        *task = queue->tasks[(queue->front + queue->count) % queue->capacity];
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+static bool stealFront(struct TaskQueue* queue, struct Task* task) {
+    pthread_mutex_lock(&queue->lock);
+    bool found = queue->count > 0;
+    if (found) {
+        *task = queue->tasks[queue->front];
+        queue->front = (queue->front + 1) % queue->capacity;
+        queue->count--;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+static size_t currentQueue(const struct ThreadPool* threadPool) {
+    return ownQueue == (size_t) -1 ? threadPool->workerCount : ownQueue;
+}
+
+// runs one task from the own queue or stolen from another, false when every queue is empty
+static bool runQueuedTask(struct ThreadPool* threadPool) {
+    size_t queueCount = threadPool->workerCount + 1;
+    size_t own = currentQueue(threadPool);
+    struct Task task;
+
+    bool found = popBack(&threadPool->queues[own], &task);
+    for (size_t i = 1; !found && i < queueCount; i++) {
+        found = stealFront(&threadPool->queues[(own + i) % queueCount], &task);
+    }
+    if (!found) return false;
+
+    atomic_fetch_sub(&threadPool->queued, 1);
+    task.run(task.argument);
+    atomic_fetch_sub(&task.group->pending, 1);
+    return true;
+}
+
+static void* workerMain(void* argument) {
+    ownQueue = (size_t) (uintptr_t) argument;
+    struct ThreadPool* threadPool = pool;
+
+    while (true) {
+        if (runQueuedTask(threadPool)) continue;
+
+        // counted before checking queued, so submitTask either sees a sleeper or this sees its task
+        pthread_mutex_lock(&threadPool->sleepLock);
+        atomic_fetch_add(&threadPool->sleeping, 1);
+        while (!threadPool->stopping && atomic_load(&threadPool->queued) == 0) {
+            pthread_cond_wait(&threadPool->wake, &threadPool->sleepLock);
+        }
+        atomic_fetch_sub(&threadPool->sleeping, 1);
+        bool stopping = threadPool->stopping && atomic_load(&threadPool->queued) == 0;
+        pthread_mutex_unlock(&threadPool->sleepLock);
+        if (stopping) break;
+    }
+    return NULL;
+}
+
+static struct ThreadPool* startThreadPool(void) {
+    pthread_mutex_lock(&poolLock);
+    if (!pool) {
+        struct ThreadPool* threadPool = calloc(1, sizeof(struct ThreadPool));
+        threadPool->workerCount = getThreadCount() - 1;
+        threadPool->queues = calloc(threadPool->workerCount + 1, sizeof(struct TaskQueue));
+        threadPool->workers = calloc(threadPool->workerCount ? threadPool->workerCount : 1, sizeof(pthread_t));
+        if (!threadPool->queues || !threadPool->workers) {
+            printf("Error calloc while starting thread pool.\n");
+            exit(1);
+        }
+        for (size_t i = 0; i <= threadPool->workerCount; i++) {
+            pthread_mutex_init(&threadPool->queues[i].lock, NULL);
+            threadPool->queues[i].capacity = INITIAL_QUEUE_CAPACITY;
+            threadPool->queues[i].tasks = malloc(sizeof(struct Task) * INITIAL_QUEUE_CAPACITY);
+        }
+        atomic_init(&threadPool->queued, 0);
+        atomic_init(&threadPool->sleeping, 0);
+        pthread_mutex_init(&threadPool->sleepLock, NULL);
+        pthread_cond_init(&threadPool->wake, NULL);
+
+        // workers read the pool as soon as they start
+        pool = threadPool;
+        for (size_t i = 0; i < threadPool->workerCount; i++) {
+            if (pthread_create(&threadPool->workers[i], NULL, workerMain, (void*) (uintptr_t) i) != 0) {
+                printf("Error creating worker thread.\n");
+                exit(1);
+            }
+        }
+    }
+    pthread_mutex_unlock(&poolLock);
+    return pool;
+}
+
+void initTaskGroup(struct TaskGroup* group) {
+    atomic_init(&group->pending, 0);
+}
+
+void submitTask(struct TaskGroup* group, TaskFunction run, void* argument) {
+    struct ThreadPool* threadPool = pool ? pool : startThreadPool();
+    struct Task task = { run, argument, group };
+
+    atomic_fetch_add(&group->pending, 1);
+    pushBack(&threadPool->queues[currentQueue(threadPool)], task);
+    atomic_fetch_add(&threadPool->queued, 1);
+
+    // busy workers find the task on their own
+    if (atomic_load(&threadPool->sleeping) > 0) {
+        pthread_mutex_lock(&threadPool->sleepLock);
+        pthread_cond_signal(&threadPool->wake);
+        pthread_mutex_unlock(&threadPool->sleepLock);
+    }
+}
+
+void waitTaskGroup(struct TaskGroup* group) {
+    while (atomic_load(&group->pending) > 0) {
+        // help instead of blocking, the group's own tasks are usually still queued
+        if (!pool || !runQueuedTask(pool)) {
+            sched_yield();
+        }
+    }
+}
+
+void shutdownThreadPool(void) {
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->sleepLock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->sleepLock);
+
+    for (size_t i = 0; i < pool->workerCount; i++) {
+        pthread_join(pool->workers[i], NULL);
+    }
+    for (size_t i = 0; i <= pool->workerCount; i++) {
+        pthread_mutex_destroy(&pool->queues[i].lock);
+        free(pool->queues[i].tasks);
+    }
+    pthread_mutex_destroy(&pool->sleepLock);
+    pthread_cond_destroy(&pool->wake);
+    free(pool->queues);
+    free(pool->workers);
+    free(pool);
+    pool = NULL;
+}
@@ -3,9 +3,11 @@
 #include <string.h>
 #include <stdbool.h>
 #include "../include/tokeniser.h"
+#include "../include/allocator.h"
+#include "../include/runtime.h"
 
 void initTokenList(struct TokenList *tokenList) {
-    tokenList->data = malloc(sizeof(struct Token) * 10);
+    tokenList->data = allocMemory(sizeof(struct Token) * 10);
     
     if (!tokenList->data) {
         printf("Error malloc in init of token list.\n");
@@ -19,7 +21,7 @@ void initTokenList(struct TokenList *tokenList) {
 void appendTokenList(struct TokenList *tokenList, struct Token token) {
     if (tokenList->count >= tokenList->capacity) {
         size_t newCapacity = tokenList->capacity * 2;
-        struct Token *newData = realloc(tokenList->data, sizeof(struct Token) * newCapacity);
+        struct Token *newData = resizeMemory(tokenList->data, sizeof(struct Token) * newCapacity);
         
         // if realloc fails
         if (!newData) {
@@ -41,11 +43,11 @@ void destroyTokenList(struct TokenList *tokenList) {
     //  struct Token * currToken = &tokenList->data[i];
 
     //  if (currToken->literal.text_value) {
-    //      free(currToken->literal.text_value);
+    //      freeMemory(currToken->literal.text_value);
     //  }
     //}
 
-    free(tokenList->data);
+    freeMemory(tokenList->data);
 
     tokenList->data = NULL;
     tokenList->count = 0;
@@ -165,10 +167,16 @@ struct TokenList tokenise(const char* sourceCode) {
             enum TokenType tokenType = IDENTIFIER;
             if (textSize == 6 && strncmp(&sourceCode[startIndex], "number", 6) == 0)    // number type keyword
                 tokenType = NUMBER_TYPE;
+            else if (textSize == 7 && strncmp(&sourceCode[startIndex], "numbers", 7) == 0)
+                tokenType = NUMBERS_TYPE;
             else if (textSize == 4 && strncmp(&sourceCode[startIndex], "text", 4) == 0) // text type keyword
                 tokenType = TEXT_TYPE;
             else if (textSize == 7 && strncmp(&sourceCode[startIndex], "boolean", 7) == 0)
                 tokenType = BOOLEAN_TYPE;
+            else if (textSize == 4 && strncmp(&sourceCode[startIndex], "task", 4) == 0)
+                tokenType = TASK_TYPE;
+            else if (textSize == 3 && strncmp(&sourceCode[startIndex], "map", 3) == 0)
+                tokenType = MAP_TYPE;
             else if (textSize == 4 && strncmp(&sourceCode[startIndex], "true", 4) == 0)
                 tokenType = TRUE;
             else if (textSize == 5 && strncmp(&sourceCode[startIndex], "false", 5) == 0)
@@ -179,6 +187,14 @@ struct TokenList tokenise(const char* sourceCode) {
                 tokenType = IF_DECLARATION;
             else if (textSize == 4 && strncmp(&sourceCode[startIndex], "loop", 4) == 0)
                 tokenType = LOOP_DECLARATION;
+            else if (textSize == 8 && strncmp(&sourceCode[startIndex], "parallel", 8) == 0)
+                tokenType = PARALLEL_DECLARATION;
+            else if (textSize == 5 && strncmp(&sourceCode[startIndex], "spawn", 5) == 0)
+                tokenType = SPAWN_DECLARATION;
+            else if (textSize == 5 && strncmp(&sourceCode[startIndex], "await", 5) == 0)
+                tokenType = AWAIT_DECLARATION;
+            else if (textSize == 6 && strncmp(&sourceCode[startIndex], "import", 6) == 0)
+                tokenType = IMPORT_DECLARATION;
 
             union uLiteral literal;
             literal.text_value = 0;
@@ -197,7 +213,7 @@ struct TokenList tokenise(const char* sourceCode) {
             }
             
             size_t stringLength = i - startIndex;
-            //char *stringValue = malloc(stringLength + 1);
+            //char *stringValue = allocMemory(stringLength + 1);
             //memcpy(stringValue, &sourceCode[startIndex], stringLength);
             //stringValue[stringLength] = '\0';
 
@@ -236,6 +252,14 @@ struct TokenList tokenise(const char* sourceCode) {
                 nextCharacter(sourceCode, &i, &line, &column);
                 continue;
             }
+            case ':': {
+                union uLiteral literal;
+                literal.number_value = 0;
+                struct Token colonToken = createToken(COLON, &sourceCode[i], 1, startLine, startColumn, literal);
+                appendTokenList(&tokens, colonToken);
+                nextCharacter(sourceCode, &i, &line, &column);
+                continue;
+            }
             case '*': {
                 union uLiteral literal;
                 literal.number_value = 0;
@@ -308,6 +332,22 @@ struct TokenList tokenise(const char* sourceCode) {
                 nextCharacter(sourceCode, &i, &line, &column);
                 continue;
             }
+            case '[': {
+                union uLiteral literal;
+                literal.number_value = 0;
+                struct Token lSquareToken = createToken(LEFT_SQUARE, &sourceCode[i], 1, startLine, startColumn, literal);
+                appendTokenList(&tokens, lSquareToken);
+                nextCharacter(sourceCode, &i, &line, &column);
+                continue;
+            }
+            case ']': {
+                union uLiteral literal;
+                literal.number_value = 0;
+                struct Token rSquareToken = createToken(RIGHT_SQUARE, &sourceCode[i], 1, startLine, startColumn, literal);
+                appendTokenList(&tokens, rSquareToken);
+                nextCharacter(sourceCode, &i, &line, &column);
+                continue;
+            }
             case '>': {
                 union uLiteral literal;
                 literal.number_value = 0;
@@ -338,12 +378,45 @@ struct TokenList tokenise(const char* sourceCode) {
                 }
                 continue;
             }
+            case '!': {
+                union uLiteral literal;
+                literal.number_value = 0;
+                // != operator
+                if (sourceCode[i+1] == '=') {
+                    struct Token notEqualToken = createToken(NOT_EQUAL, &sourceCode[i], 2, startLine, startColumn, literal);
+                    appendTokenList(&tokens, notEqualToken);
+                    nextCharacter(sourceCode, &i, &line, &column);
+                    nextCharacter(sourceCode, &i, &line, &column);
+                } else {
+                    struct Token notToken = createToken(NOT_OPERATOR, &sourceCode[i], 1, startLine, startColumn, literal);
+                    appendTokenList(&tokens, notToken);
+                    nextCharacter(sourceCode, &i, &line, &column);
+                }
+                continue;
+            }
+            case '&':
+            case '|': {
+                // only the doubled forms exist, a single one falls through to the error below
+                if (sourceCode[i+1] != c) {
+                    nextCharacter(sourceCode, &i, &line, &column);
+                    break;
+                }
+                union uLiteral literal;
+                literal.number_value = 0;
+                enum TokenType type = c == '&' ? AND_OPERATOR : OR_OPERATOR;
+                struct Token logicalToken = createToken(type, &sourceCode[i], 2, startLine, startColumn, literal);
+                appendTokenList(&tokens, logicalToken);
+                nextCharacter(sourceCode, &i, &line, &column);
+                nextCharacter(sourceCode, &i, &line, &column);
+                continue;
+            }
             default:
                 nextCharacter(sourceCode, &i, &line, &column);
                 break;
         }
         
-        printf("cannot tokenise?"); 
+        destroyTokenList(&tokens);
+        raiseError("Unexpected character '%c', line %zu\n", c, startLine);
 
     }
     return tokens;
@@ -0,0 +1,135 @@
+#include "../include/trace.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+struct TraceEvent {
+    uint64_t        start;      // clock ticks
+    uint64_t        end;
+    const char*     name;
+    uint64_t        count;
+    uint32_t        line;
+    uint32_t        kind;
+};
+
+struct TraceRing {
+    atomic_uint_fast64_t    written;    // events ever ended, the ring holds the latest
+    int                     thread;     // the kernel's id
+    struct TraceRing*       next;       // of the thread that traced before this one
+    struct TraceEvent       events[TRACE_RING_EVENTS];
+};
+
+bool traceEnabled = false;
+static _Thread_local struct TraceRing* traceRing = NULL;
+
+static _Atomic(struct TraceRing*) registeredRings = NULL;
+static const char* traceOutput = NULL;
+// both clocks when tracing started, ticks are converted to time between them
+static uint64_t startTicks;
+static uint64_t startNanoseconds;
+
+static uint64_t monotonicNanoseconds(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000u + (uint64_t) t.tv_nsec;
+}
+
+static struct TraceRing* registerTraceRing(void) {
+    // from malloc, the pages of the ring are only touched as spans fill them
+    struct TraceRing* ring = malloc(sizeof(struct TraceRing));
+    if (!ring) return NULL;
+    atomic_init(&ring->written, 0);
+    ring->thread = (int) syscall(SYS_gettid);
+    ring->next = atomic_load(&registeredRings);
+    while (!atomic_compare_exchange_weak(&registeredRings, &ring->next, ring)) {
+    }
+    traceRing = ring;
+    return ring;
+}
+
+// only the thread owning the ring writes it, the release lets the writer of
+// the trace read the event once it sees the count
+void recordTraceSpan(enum TraceKind kind, const char* name, uint64_t count, size_t line, uint64_t start) {
+    struct TraceRing* ring = traceRing ? traceRing : registerTraceRing();
+    if (!ring) return;
+    uint_fast64_t written = atomic_load_explicit(&ring->written, memory_order_relaxed);
+    ring->events[written & (TRACE_RING_EVENTS - 1)] =
+        (struct TraceEvent) { start, traceClock(), name, count, (uint32_t) line, kind };
+    atomic_store_explicit(&ring->written, written + 1, memory_order_release);
+}
+
+void enableTrace(const char* path) {
+    traceOutput = path;
+    startNanoseconds = monotonicNanoseconds();
+    startTicks = traceClock();
+    traceEnabled = true;
+    // a program ending in an error exits without returning to main
+    atexit(finishTrace);
+}
+
+// WRITING
+
+static void writeEvent(FILE* file, const struct TraceEvent* event, int thread, double microsecondsPerTick) {
+    static const char* const categories[] = {
+        [TRACE_PHASE] = "phase",
+        [TRACE_CALL] = "call",
+        [TRACE_LOOP] = "loop",
+    };
+    // a span cut short by an error may end before a later start was taken
+    uint64_t start = event->start > startTicks ? event->start - startTicks : 0;
+    uint64_t duration = event->end > event->start ? event->end - event->start : 0;
+    fprintf(file, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": %d",
+        event->name, categories[event->kind], (double) start * microsecondsPerTick,
+        (double) duration * microsecondsPerTick, (int) getpid(), thread);
+    if (event->kind == TRACE_CALL) {
+        fprintf(file, ", \"args\": {\"arguments\": %llu, \"line\": %u}}", (unsigned long long) event->count, event->line);
+    } else if (event->kind == TRACE_LOOP) {
+        fprintf(file, ", \"args\": {\"iterations\": %llu, \"line\": %u}}", (unsigned long long) event->count, event->line);
+    } else {
+        fputc('}', file);
+    }
+}
+
+static void writeRing(FILE* file, const struct TraceRing* ring, double microsecondsPerTick, uint64_t* dropped) {
+    uint64_t written = atomic_load_explicit(&ring->written, memory_order_acquire);
+    uint64_t first = written > TRACE_RING_EVENTS ? written - TRACE_RING_EVENTS : 0;
+    *dropped += first;
+    fprintf(file, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+        (int) getpid(), ring->thread, ring->thread == (int) getpid() ? "main" : "worker");
+    for (uint64_t i = first; i < written; i++) {
+        writeEvent(file, &ring->events[i & (TRACE_RING_EVENTS - 1)], ring->thread, microsecondsPerTick);
+    }
+}
+
+void finishTrace(void) {
+    if (!traceEnabled) return;
+    traceEnabled = false;
+    uint64_t elapsedTicks = traceClock() - startTicks;
+    uint64_t elapsedNanoseconds = monotonicNanoseconds() - startNanoseconds;
+    double microsecondsPerTick = elapsedTicks ? (double) elapsedNanoseconds / 1000.0 / (double) elapsedTicks : 0.0;
+
+    FILE* file = fopen(traceOutput, "w");
+    if (!file) {
+        fprintf(stderr, "Cannot write %s: %s\n", traceOutput, strerror(errno));
+        return;
+    }
+    uint64_t dropped = 0;
+    fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    fprintf(file, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"name\": \"interpreter\"}}",
+        (int) getpid());
+    for (const struct TraceRing* ring = atomic_load(&registeredRings); ring; ring = ring->next) {
+        writeRing(file, ring, microsecondsPerTick, &dropped);
+    }
+    fprintf(file, "\n], \"otherData\": {\"droppedEvents\": %llu}}\n", (unsigned long long) dropped);
+    if (fclose(file) != 0) {
+        fprintf(stderr, "Cannot write %s: %s\n", traceOutput, strerror(errno));
+    }
+    if (dropped) {
+        fprintf(stderr, "Trace: the oldest %llu spans were overwritten, each thread keeps the latest %d\n",
+            (unsigned long long) dropped, TRACE_RING_EVENTS);
+    }
+}
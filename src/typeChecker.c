@@ -0,0 +1,511 @@
+#include "../include/typeChecker.h"
+#include "../include/allocator.h"
+#include "../include/modules.h"
+#include "../include/evaluator.h"
+#include "../include/runtime.h"
+#include "../include/builtins.h"
+#include <stdio.h>
+#include <string.h>
+#define SCOPE_BUCKET_COUNT 257
+
+// Every environment the evaluator creates (the program's and one per function call)
+// gets a scope here. A name keeps one type for the whole scope: the evaluator rejects
+// redeclarations and assignments of another type, so unless the scope declares the
+// same name with different types the declared type is what every read sees.
+
+struct Symbol {
+    const char*                             name;
+    enum StaticType                         type;
+    const struct ASTFunctionDeclaration*    function;
+    struct Symbol*                          next;
+};
+
+struct Scope {
+    struct Symbol*  bucket[SCOPE_BUCKET_COUNT];
+};
+
+struct TypeChecker {
+    size_t errorCount;
+};
+
+static unsigned long hashSymbol(const char* name) {
+    unsigned long h = 5381;
+    while (*name) {
+        h = ((h << 5) + h) + (unsigned char)*name;
+        name++;
+    }
+    return h;
+}
+
+static struct Symbol* findSymbol(struct Scope* scope, const char* name) {
+    unsigned long h = hashSymbol(name) % SCOPE_BUCKET_COUNT;
+    for (struct Symbol* symbol = scope->bucket[h]; symbol; symbol = symbol->next) {
+        if (strcmp(symbol->name, name) == 0) return symbol;
+    }
+    return NULL;
+}
+
+static void declareSymbol(struct Scope* scope, const char* name, enum StaticType type, const struct ASTFunctionDeclaration* function) {
+    struct Symbol* symbol = findSymbol(scope, name);
+    if (symbol) {
+        // bound twice in one scope, only keep what both bindings agree on
+        if (symbol->type != type || type == STATIC_FUNCTION) {
+            symbol->type = STATIC_UNKNOWN;
+            symbol->function = NULL;
+        }
+        return;
+    }
+
+    unsigned long h = hashSymbol(name) % SCOPE_BUCKET_COUNT;
+    symbol = allocMemory(sizeof(struct Symbol));
+    symbol->name = name;
+    symbol->type = type;
+    symbol->function = function;
+    symbol->next = scope->bucket[h];
+    scope->bucket[h] = symbol;
+}
+
+static void freeScope(struct Scope* scope) {
+    for (size_t i = 0; i < SCOPE_BUCKET_COUNT; i++) {
+        struct Symbol* symbol = scope->bucket[i];
+        while (symbol) {
+            struct Symbol* next = symbol->next;
+            freeMemory(symbol);
+            symbol = next;
+        }
+    }
+}
+
+static enum StaticType staticTypeOf(enum TokenType dataType) {
+    switch (dataType) {
+        case NUMBER_TYPE:   return STATIC_NUMBER;
+        case TEXT_TYPE:     return STATIC_TEXT;
+        case BOOLEAN_TYPE:  return STATIC_BOOL;
+        case TASK_TYPE:     return STATIC_TASK;
+        case NUMBERS_TYPE:  return STATIC_NUMBERS;
+        case MAP_TYPE:      return STATIC_MAP;
+        default:            return STATIC_UNKNOWN;
+    }
+}
+
+const char* staticTypeName(enum StaticType type) {
+    switch (type) {
+        case STATIC_NUMBER:     return "number";
+        case STATIC_TEXT:       return "text";
+        case STATIC_BOOL:       return "boolean";
+        case STATIC_FUNCTION:   return "function";
+        case STATIC_TASK:       return "task";
+        case STATIC_NUMBERS:    return "numbers";
+        case STATIC_MAP:        return "map";
+        default:                return "unknown";
+    }
+}
+
+static const char* operatorName(enum BinaryOperatorTypes op) {
+    switch (op) {
+        case BIN_OP_PLUS:           return "+";
+        case BIN_OP_MINUS:          return "-";
+        case BIN_OP_STAR:           return "*";
+        case BIN_OP_SLASH:          return "/";
+        case BIN_OP_EQUALITY:       return "==";
+        case BIN_OP_NOT_EQUAL:      return "!=";
+        case BIN_OP_LESS:           return "<";
+        case BIN_OP_GREATER:        return ">";
+        case BIN_OP_LESSER_EQUAL:   return "<=";
+        case BIN_OP_GREATER_EQUAL:  return ">=";
+        default:                    return "?";
+    }
+}
+
+static enum ASTNodeType specialisedNumberNode(enum BinaryOperatorTypes op) {
+    switch (op) {
+        case BIN_OP_PLUS:           return NODE_NUMBER_ADD;
+        case BIN_OP_MINUS:          return NODE_NUMBER_SUBTRACT;
+        case BIN_OP_STAR:           return NODE_NUMBER_MULTIPLY;
+        case BIN_OP_SLASH:          return NODE_NUMBER_DIVIDE;
+        case BIN_OP_EQUALITY:       return NODE_NUMBER_EQUAL;
+        case BIN_OP_NOT_EQUAL:      return NODE_NUMBER_NOT_EQUAL;
+        case BIN_OP_LESS:           return NODE_NUMBER_LESS;
+        case BIN_OP_GREATER:        return NODE_NUMBER_GREATER;
+        case BIN_OP_LESSER_EQUAL:   return NODE_NUMBER_LESSER_EQUAL;
+        case BIN_OP_GREATER_EQUAL:  return NODE_NUMBER_GREATER_EQUAL;
+        default:                    return NODE_BINARY_OPERATION;
+    }
+}
+
+// operands the arithmetic and comparison operators may take
+static bool isNumeric(enum StaticType type) {
+    return type == STATIC_UNKNOWN || type == STATIC_NUMBER || type == STATIC_NUMBERS;
+}
+
+static void reportError(struct TypeChecker* checker, const struct ASTNode* node, const char* message, const char* detail) {
+    printOutput("Type error: %s%s, line %zu column %zu\n", message, detail ? detail : "", node->line, node->column);
+    checker->errorCount++;
+}
+
+static void checkMapKey(struct TypeChecker* checker, const struct ASTNode* node, enum StaticType key) {
+    if (key != STATIC_UNKNOWN && key != STATIC_NUMBER && key != STATIC_TEXT) {
+        reportError(checker, node, "map key should be text or number, got ", staticTypeName(key));
+    }
+}
+
+static void checkMapValue(struct TypeChecker* checker, const struct ASTNode* node, enum StaticType value) {
+    if (value == STATIC_MAP || value == STATIC_TASK || value == STATIC_FUNCTION) {
+        reportError(checker, node, "map values cannot be maps, tasks or functions, got ", staticTypeName(value));
+    }
+}
+
+// first pass over a scope, bindings in if and loop blocks share the enclosing environment
+static void declareScope(struct Scope* scope, const struct ASTNodeList* list) {
+    for (size_t i = 0; i < list->count; i++) {
+        const struct ASTNode* n = list->nodes[i];
+        switch (n->nodeType) {
+            case NODE_VARIABLE_DECLARATION:
+                declareSymbol(scope, n->data.varDeclaration.name, staticTypeOf(n->data.varDeclaration.dataType), NULL);
+                break;
+            case NODE_FUNCTION_DECLARATION:
+                declareSymbol(scope, n->data.funcDeclaration.name, STATIC_FUNCTION, &n->data.funcDeclaration);
+                break;
+            case NODE_IMPORT:
+                // calls are checked against the module's fns, their bodies are the module's
+                declareScope(scope, &n->data.import.module->program);
+                break;
+            case NODE_IF_STATEMENT:
+                declareScope(scope, n->data.ifStatement.conditionTrueBlock);
+                break;
+            case NODE_LOOP_STATEMENT:
+                declareScope(scope, n->data.loopStatement.loopCodeBlock);
+                break;
+            case NODE_PARALLEL_LOOP:
+                if (n->data.parallelLoop.indexName) {
+                    declareSymbol(scope, n->data.parallelLoop.indexName, STATIC_NUMBER, NULL);
+                }
+                declareScope(scope, n->data.parallelLoop.loopCodeBlock);
+                break;
+            case NODE_INLINED_BLOCK:
+                for (size_t j = 0; j < n->data.inlinedBlock.argumentCount; j++) {
+                    const struct Parameter* param = &n->data.inlinedBlock.parameters[j];
+                    declareSymbol(scope, param->name, staticTypeOf(param->dataType), NULL);
+                }
+                declareScope(scope, n->data.inlinedBlock.codeBlock);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+static void checkList(struct TypeChecker* checker, struct Scope* scope, struct ASTNodeList* list);
+
+static enum StaticType checkNode(struct TypeChecker* checker, struct Scope* scope, struct ASTNode* node);
+
+static void checkCall(struct TypeChecker* checker, struct Scope* scope, struct ASTNode* node);
+
+// not inlined, its scope would make the frame of checkNode, which recurses once
+// per level of nesting, 2 KB bigger and overflow the stack on deep expressions
+__attribute__((noinline))
+static void checkFunctionBody(struct TypeChecker* checker, struct ASTFunctionDeclaration* decl) {
+    struct Scope bodyScope;
+    memset(&bodyScope, 0, sizeof(bodyScope));
+
+    for (size_t i = 0; i < decl->parameterCount; i++) {
+        declareSymbol(&bodyScope, decl->parameters[i].name, staticTypeOf(decl->parameters[i].dataType), NULL);
+    }
+    declareScope(&bodyScope, decl->codeBlock);
+    checkList(checker, &bodyScope, decl->codeBlock);
+    freeScope(&bodyScope);
+}
+
+// checks arguments against the parameters of callee, true when every argument is proven to match
+static bool checkArguments(struct TypeChecker* checker, struct Scope* scope, const struct ASTNode* node,
+        const char* callee, struct ASTNode** arguments, size_t argumentCount, const struct Parameter* parameters) {
+    bool proven = true;
+    for (size_t i = 0; i < argumentCount; i++) {
+        enum StaticType argType = checkNode(checker, scope, arguments[i]);
+        enum StaticType paramType = staticTypeOf(parameters[i].dataType);
+        if (argType == STATIC_UNKNOWN) {
+            proven = false;
+        } else if (argType != paramType) {
+            char detail[160];
+            snprintf(detail, sizeof(detail), " %zu ('%s') of '%s', expected %s but got %s",
+                i + 1, parameters[i].name, callee, staticTypeName(paramType), staticTypeName(argType));
+            reportError(checker, node, "argument", detail);
+            proven = false;
+        }
+    }
+    return proven;
+}
+
+static enum StaticType checkNode(struct TypeChecker* checker, struct Scope* scope, struct ASTNode* node) {
+    switch (node->nodeType) {
+        case NODE_NUMBER_LITERAL:
+            return STATIC_NUMBER;
+        case NODE_TEXT_LITERAL:
+            return STATIC_TEXT;
+        case NODE_BOOL_LITERAL:
+            return STATIC_BOOL;
+        case NODE_VARIABLE_REFERENCE:
+            {
+                struct Symbol* symbol = findSymbol(scope, node->data.textValue);
+                if (!symbol) {
+                    reportError(checker, node, "variable is never declared in this scope: ", node->data.textValue);
+                    return STATIC_UNKNOWN;
+                }
+                return symbol->type;
+            }
+        case NODE_BINARY_OPERATION:
+        CASE_NUMBER_BINARY_NODES:
+            {
+                enum BinaryOperatorTypes op = node->data.binary.operationChar;
+                enum StaticType left = checkNode(checker, scope, node->data.binary.leftSide);
+                enum StaticType right = checkNode(checker, scope, node->data.binary.rightSide);
+
+                if (!isNumeric(left) || !isNumeric(right)) {
+                    char detail[96];
+                    snprintf(detail, sizeof(detail), "'%s' on %s and %s", operatorName(op), staticTypeName(left), staticTypeName(right));
+                    reportError(checker, node, "cannot apply ", detail);
+                } else if (left == STATIC_NUMBER && right == STATIC_NUMBER) {
+                    node->nodeType = specialisedNumberNode(op);
+                    return isComparisonOperator(op) ? STATIC_BOOL : STATIC_NUMBER;
+                }
+
+                // numbers on either side apply element-wise, comparisons included
+                if (left == STATIC_NUMBERS || right == STATIC_NUMBERS) return STATIC_NUMBERS;
+                if (left == STATIC_UNKNOWN || right == STATIC_UNKNOWN) return STATIC_UNKNOWN;
+                // anything else stops the program
+                return isComparisonOperator(op) ? STATIC_BOOL : STATIC_NUMBER;
+            }
+        case NODE_NUMBERS:
+            {
+                const struct ASTNumbers* numbers = &node->data.numbers;
+                for (size_t i = 0; i < numbers->elementCount; i++) {
+                    enum StaticType element = checkNode(checker, scope, numbers->elements[i]);
+                    if (element != STATIC_UNKNOWN && element != STATIC_NUMBER) {
+                        reportError(checker, numbers->elements[i], "element should be number but got ", staticTypeName(element));
+                    }
+                }
+                return STATIC_NUMBERS;
+            }
+        case NODE_BUILTIN_CALL:
+            {
+                struct ASTBuiltinCall* call = &node->data.builtinCall;
+                bool proven = true;
+                for (size_t i = 0; i < call->argumentCount; i++) {
+                    enum StaticType argument = checkNode(checker, scope, call->arguments[i]);
+                    enum StaticType parameter = call->builtin->parameters[i];
+                    if (parameter == STATIC_UNKNOWN) continue;
+                    if (argument == STATIC_UNKNOWN) {
+                        proven = false;
+                    } else if (argument != parameter) {
+                        char detail[128];
+                        snprintf(detail, sizeof(detail), " %zu of %s, expected %s but got %s",
+                            i + 1, call->builtin->name, staticTypeName(parameter), staticTypeName(argument));
+                        reportError(checker, node, "argument", detail);
+                        proven = false;
+                    }
+                }
+                call->typeChecked = proven;
+                return call->builtin->result;
+            }
+        case NODE_INDEX:
+            {
+                enum StaticType container = checkNode(checker, scope, node->data.binary.leftSide);
+                enum StaticType index = checkNode(checker, scope, node->data.binary.rightSide);
+                if (container == STATIC_MAP) {
+                    checkMapKey(checker, node, index);
+                    return STATIC_UNKNOWN;
+                }
+                if (container != STATIC_UNKNOWN && container != STATIC_NUMBERS) {
+                    reportError(checker, node, "only numbers and maps can be indexed, got ", staticTypeName(container));
+                }
+                if (index != STATIC_UNKNOWN && index != STATIC_NUMBER) {
+                    reportError(checker, node, "index should be a number, got ", staticTypeName(index));
+                }
+                // a map's element could be anything
+                return container == STATIC_UNKNOWN ? STATIC_UNKNOWN : STATIC_NUMBER;
+            }
+        case NODE_MAP:
+            {
+                const struct ASTMap* literal = &node->data.map;
+                for (size_t i = 0; i < literal->entryCount; i++) {
+                    checkMapKey(checker, literal->keys[i], checkNode(checker, scope, literal->keys[i]));
+                    checkMapValue(checker, literal->values[i], checkNode(checker, scope, literal->values[i]));
+                }
+                return STATIC_MAP;
+            }
+        case NODE_INDEX_ASSIGN:
+            {
+                struct ASTIndexAssignment* assignment = &node->data.indexAssignment;
+                struct Symbol* symbol = findSymbol(scope, assignment->name);
+                if (!symbol) {
+                    reportError(checker, node, "cannot assign variable that is never declared in this scope: ", assignment->name);
+                } else if (symbol->type != STATIC_UNKNOWN && symbol->type != STATIC_MAP) {
+                    char detail[160];
+                    snprintf(detail, sizeof(detail), "'%s' is %s", assignment->name, staticTypeName(symbol->type));
+                    reportError(checker, node, "only map elements can be assigned to, ", detail);
+                }
+                checkMapKey(checker, node, checkNode(checker, scope, assignment->key));
+                checkMapValue(checker, node, checkNode(checker, scope, assignment->value));
+                return STATIC_NUMBER;
+            }
+        case NODE_LOGICAL_AND:
+        case NODE_LOGICAL_OR:
+            {
+                enum StaticType left = checkNode(checker, scope, node->data.binary.leftSide);
+                enum StaticType right = checkNode(checker, scope, node->data.binary.rightSide);
+                if ((left != STATIC_UNKNOWN && left != STATIC_BOOL) || (right != STATIC_UNKNOWN && right != STATIC_BOOL)) {
+                    char detail[96];
+                    snprintf(detail, sizeof(detail), "'%s' on %s and %s", node->nodeType == NODE_LOGICAL_AND ? "&&" : "||",
+                        staticTypeName(left), staticTypeName(right));
+                    reportError(checker, node, "cannot apply ", detail);
+                }
+                return STATIC_BOOL;
+            }
+        case NODE_LOGICAL_NOT:
+            {
+                enum StaticType operand = checkNode(checker, scope, node->data.unary.operand);
+                if (operand != STATIC_UNKNOWN && operand != STATIC_BOOL) {
+                    reportError(checker, node, "cannot apply '!' to ", staticTypeName(operand));
+                }
+                return STATIC_BOOL;
+            }
+        case NODE_VARIABLE_DECLARATION:
+            {
+                struct ASTVariableDeclaration* decl = &node->data.varDeclaration;
+                enum StaticType declared = staticTypeOf(decl->dataType);
+                enum StaticType value = checkNode(checker, scope, decl->node);
+                if (value != STATIC_UNKNOWN && value != declared) {
+                    char detail[160];
+                    snprintf(detail, sizeof(detail), "'%s' is declared %s but given %s", decl->name, staticTypeName(declared), staticTypeName(value));
+                    reportError(checker, node, "", detail);
+                }
+                decl->typeChecked = value == declared;
+                return declared;
+            }
+        case NODE_VARIABLE_ASSIGN:
+            {
+                struct ASTVariableAssignment* assign = &node->data.varAssignment;
+                enum StaticType value = checkNode(checker, scope, assign->node);
+                struct Symbol* symbol = findSymbol(scope, assign->name);
+                if (!symbol) {
+                    reportError(checker, node, "cannot assign variable that is never declared in this scope: ", assign->name);
+                    return value;
+                }
+                if (symbol->type != STATIC_UNKNOWN && value != STATIC_UNKNOWN && symbol->type != value) {
+                    char detail[160];
+                    snprintf(detail, sizeof(detail), "'%s' is %s but assigned %s", assign->name, staticTypeName(symbol->type), staticTypeName(value));
+                    reportError(checker, node, "", detail);
+                }
+                assign->typeChecked = symbol->type != STATIC_UNKNOWN && symbol->type == value;
+                return value;
+            }
+        case NODE_FUNCTION_DECLARATION:
+            checkFunctionBody(checker, &node->data.funcDeclaration);
+            return STATIC_FUNCTION;
+        case NODE_IMPORT:
+            return STATIC_UNKNOWN;
+        case NODE_FUNCTION_CALL:
+            checkCall(checker, scope, node);
+            // calls have no return value yet, the evaluator hands back 0
+            return STATIC_NUMBER;
+        case NODE_SPAWN:
+            checkCall(checker, scope, node);
+            return STATIC_TASK;
+        case NODE_AWAIT:
+            {
+                enum StaticType operand = checkNode(checker, scope, node->data.unary.operand);
+                if (operand != STATIC_UNKNOWN && operand != STATIC_TASK) {
+                    reportError(checker, node, "await needs a task, got ", staticTypeName(operand));
+                }
+                // the value of the call, 0 like every call
+                return STATIC_NUMBER;
+            }
+        case NODE_IF_STATEMENT:
+            {
+                enum StaticType condition = checkNode(checker, scope, node->data.ifStatement.condition);
+                if (condition != STATIC_UNKNOWN && condition != STATIC_BOOL) {
+                    reportError(checker, node, "if condition should be boolean, got ", staticTypeName(condition));
+                }
+                checkList(checker, scope, node->data.ifStatement.conditionTrueBlock);
+                return STATIC_NUMBER;
+            }
+        case NODE_LOOP_STATEMENT:
+            {
+                enum StaticType count = checkNode(checker, scope, node->data.loopStatement.loopCount);
+                if (count != STATIC_UNKNOWN && count != STATIC_NUMBER) {
+                    reportError(checker, node, "loop count should be a number, got ", staticTypeName(count));
+                }
+                checkList(checker, scope, node->data.loopStatement.loopCodeBlock);
+                return STATIC_NUMBER;
+            }
+        case NODE_PARALLEL_LOOP:
+            {
+                struct ASTParallelLoop* loop = &node->data.parallelLoop;
+                enum StaticType count = checkNode(checker, scope, loop->loopCount);
+                if (count != STATIC_UNKNOWN && count != STATIC_NUMBER) {
+                    reportError(checker, node, "loop count should be a number, got ", staticTypeName(count));
+                }
+                for (size_t i = 0; i < loop->reductionCount; i++) {
+                    struct Symbol* symbol = findSymbol(scope, loop->reductions[i].name);
+                    if (!symbol) {
+                        reportError(checker, node, "reduction variable is never declared in this scope: ", loop->reductions[i].name);
+                    } else if (symbol->type != STATIC_UNKNOWN && symbol->type != STATIC_NUMBER) {
+                        reportError(checker, node, "reduction variable should be a number: ", loop->reductions[i].name);
+                    }
+                }
+                checkList(checker, scope, loop->loopCodeBlock);
+                return STATIC_NUMBER;
+            }
+        case NODE_INLINED_BLOCK:
+            {
+                struct ASTInlinedBlock* block = &node->data.inlinedBlock;
+                block->typeChecked = checkArguments(checker, scope, node, block->functionName, block->arguments, block->argumentCount, block->parameters);
+                checkList(checker, scope, block->codeBlock);
+                return STATIC_NUMBER;
+            }
+        default:
+            return STATIC_UNKNOWN;
+    }
+}
+
+static void checkCall(struct TypeChecker* checker, struct Scope* scope, struct ASTNode* node) {
+    struct ASTFunctionCall* call = &node->data.funcCall;
+    struct Symbol* symbol = findSymbol(scope, call->name);
+    if (!symbol) {
+        reportError(checker, node, "function is never declared in this scope: ", call->name);
+    } else if (symbol->type != STATIC_UNKNOWN && symbol->type != STATIC_FUNCTION) {
+        reportError(checker, node, "cannot call a variable that is not a function: ", call->name);
+    } else if (symbol->function) {
+        const struct ASTFunctionDeclaration* decl = symbol->function;
+        if (decl->parameterCount != call->argumentCount) {
+            char detail[128];
+            snprintf(detail, sizeof(detail), "'%s' expects %zu argument(s), got %zu", call->name, decl->parameterCount, call->argumentCount);
+            reportError(checker, node, "", detail);
+        } else {
+            call->typeChecked = checkArguments(checker, scope, node, call->name, call->arguments, call->argumentCount, decl->parameters);
+            return;
+        }
+    }
+    for (size_t i = 0; i < call->argumentCount; i++) {
+        checkNode(checker, scope, call->arguments[i]);
+    }
+}
+
+static void checkList(struct TypeChecker* checker, struct Scope* scope, struct ASTNodeList* list) {
+    for (size_t i = 0; i < list->count; i++) {
+        checkNode(checker, scope, list->nodes[i]);
+    }
+}
+
+size_t typeCheckProgram(struct ASTNodeList* program) {
+    struct TypeChecker checker;
+    checker.errorCount = 0;
+
+    struct Scope globalScope;
+    memset(&globalScope, 0, sizeof(globalScope));
+    declareScope(&globalScope, program);
+    checkList(&checker, &globalScope, program);
+    freeScope(&globalScope);
+
+    return checker.errorCount;
+}
@@ -0,0 +1,38 @@
+#!/bin/sh
+# runs every tests/*.txt through bin/main once without options and once with
+# each option set below, and compares what it prints, stderr included, and its
+# exit code with the test's .expected file, as the options must not change them
+cd "$(dirname "$0")/.." || exit 1
+
+OPTION_SETS="--dce
+--inline
+--inline --dce
+--engine=closure
+--engine=closure --dce
+--engine=closure --inline"
+
+newline='
+'
+count=0
+failed=0
+for program in tests/*.txt; do
+    expected=$(cat "${program%.txt}.expected")
+    passed=true
+    IFS=$newline
+    for options in "" $OPTION_SETS; do
+        IFS=' '
+        # shellcheck disable=SC2086
+        actual=$(bin/main $options "$program" 2>&1; echo "exit $?")
+        if [ "$actual" != "$expected" ]; then
+            echo "FAIL $program ${options:-(no options)}"
+            printf '%s\n' "$actual" | diff "${program%.txt}.expected" - | sed 's/^/    /'
+            passed=false
+        fi
+    done
+    IFS=' '
+    count=$((count + 1))
+    $passed || failed=$((failed + 1))
+done
+
+echo "$((count - failed)) of $count tests passed"
+[ "$failed" -eq 0 ]